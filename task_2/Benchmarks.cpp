@@ -0,0 +1,845 @@
+#include "task_1/Benchmarks.h"
+#include "task_1/BuddyAllocator.h"
+#include "task_1/ThreadPool.h"
+#include "task_1/Vertex.h"
+#include "task_1/VertexDeduplication.h"
+#include "task_1/Culling.h"
+#include "task_1/Scene.h"
+#include "task_1/Lights.h"
+#include "task_1/MipChain.h"
+#include "task_1/TextureCompression.h"
+#include "task_1/TextureCache.h"
+#include "task_1/MeshOptimizer.h"
+#include "task_1/VertexLayout.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iterator>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace {
+    // time a callable in milliseconds
+    template<typename F>
+    double timeMs(F&& function)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        function();
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    // serial unordered_map dedup against the chunked parallel one on a synthetic
+    // height field with grid_size x grid_size quads (two triangles each). returns false if the
+    // two disagree
+    bool benchmarkVertexDeduplication(size_t grid_size, ThreadPool& pool)
+    {
+        auto fetch = [grid_size](size_t corner) {
+            static const int quad_corners[2][3] = { { 0, 1, 2 }, { 0, 2, 3 } };
+            static const int corner_x[4] = { 0, 1, 1, 0 };
+            static const int corner_y[4] = { 0, 0, 1, 1 };
+
+            size_t triangle = corner / 3;
+            size_t quad = triangle / 2;
+            int quad_corner = quad_corners[triangle % 2][corner % 3];
+
+            float x = static_cast<float>(quad % grid_size + corner_x[quad_corner]);
+            float y = static_cast<float>(quad / grid_size + corner_y[quad_corner]);
+
+            Vertex vertex{};
+            vertex.pos = { x, 0.25f * std::sin(x * 0.1f) * std::cos(y * 0.1f), y };
+            vertex.color = { 1.0f, 1.0f, 1.0f };
+            vertex.texCoord = { x / grid_size, y / grid_size };
+            vertex.norm = { 0.0f, 1.0f, 0.0f };
+            return vertex;
+        };
+
+        size_t corner_count = grid_size * grid_size * 6;
+
+        std::vector<Vertex> serial_vertices, parallel_vertices;
+        std::vector<uint32_t> serial_indices, parallel_indices;
+
+        double serial_ms = timeMs([&]() { deduplicateVerticesSerial(corner_count, fetch, serial_vertices, serial_indices); });
+        double parallel_ms = timeMs([&]() { deduplicateVerticesParallel(corner_count, fetch, pool, parallel_vertices, parallel_indices); });
+
+        bool identical = serial_vertices.size() == parallel_vertices.size() &&
+            serial_indices == parallel_indices &&
+            std::memcmp(serial_vertices.data(), parallel_vertices.data(), sizeof(Vertex) * serial_vertices.size()) == 0;
+
+        std::cout << corner_count / 3 << " triangles, " << serial_vertices.size() << " unique vertices" << std::endl;
+        std::cout << "    serial   " << serial_ms << " ms" << std::endl;
+        std::cout << "    parallel " << parallel_ms << " ms (" << pool.size() << " threads, "
+            << serial_ms / parallel_ms << "x)" << std::endl;
+        std::cout << "    output " << (identical ? "identical" : "DIFFERS") << std::endl;
+        return identical;
+    }
+
+    // random allocate/free churn on a 64MB buddy range with resource-like sizes.
+    // checks that live ranges never overlap, respect alignment, and that freeing
+    // everything coalesces back into a single block
+    int benchmarkAllocator()
+    {
+        const uint64_t range_size = 64ull * 1024 * 1024;
+        const size_t operations = 1000000;
+
+        BuddyAllocator allocator(range_size);
+        std::mt19937_64 random(1234);
+
+        struct Live {
+            uint64_t offset, size;
+        };
+        std::vector<Live> live;
+        std::map<uint64_t, uint64_t> ranges;
+        size_t failed = 0;
+        float worst_fragmentation = 0.0f;
+
+        bool valid = true;
+
+        double ms = timeMs([&]() {
+            for (size_t i = 0; i < operations && valid; i++) {
+                if (live.empty() || random() % 100 < 55) {
+                    // mostly small UBO/staging sized requests with the odd large one
+                    uint64_t size = random() % 100 < 95 ? 64 + random() % (64 * 1024) : 1024 * 1024 + random() % (8 * 1024 * 1024);
+                    uint64_t alignment = uint64_t(1) << (random() % 17);
+
+                    uint64_t offset = allocator.allocate(size, alignment);
+                    if (offset == BuddyAllocator::NO_SPACE) {
+                        failed++;
+                        continue;
+                    }
+
+                    auto next = ranges.lower_bound(offset);
+                    bool overlaps = (next != ranges.end() && next->first < offset + size) ||
+                        (next != ranges.begin() && std::prev(next)->first + std::prev(next)->second > offset);
+                    if (overlaps || offset % alignment != 0 || offset + size > range_size) {
+                        std::cerr << "allocator returned a bad range at operation " << i << std::endl;
+                        valid = false;
+                    }
+
+                    ranges[offset] = size;
+                    live.push_back({ offset, size });
+                }
+                else {
+                    size_t victim = random() % live.size();
+                    allocator.free(live[victim].offset);
+                    ranges.erase(live[victim].offset);
+                    live[victim] = live.back();
+                    live.pop_back();
+                }
+
+                worst_fragmentation = std::max(worst_fragmentation, allocator.fragmentation());
+            }
+        });
+
+        for (const auto& allocation : live) {
+            allocator.free(allocation.offset);
+        }
+
+        bool coalesced = allocator.empty() && allocator.largestFreeBlock() == range_size;
+
+        std::cout << operations << " buddy operations in " << ms << " ms, " << failed << " out of space" << std::endl;
+        std::cout << "    worst fragmentation " << worst_fragmentation << std::endl;
+        std::cout << "    fully coalesced after freeing " << (coalesced ? "yes" : "NO") << std::endl;
+
+        return valid && coalesced ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // scalar AoS sphere tests against the SoA SIMD kernel. spheres are scattered through a
+    // 200 unit cube around a camera looking down -z, so roughly a tenth of them survive
+    bool benchmarkSphereCulling(size_t count)
+    {
+        std::mt19937 random(static_cast<uint32_t>(count));
+        std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+        std::uniform_real_distribution<float> radius(0.1f, 2.0f);
+
+        std::vector<glm::vec4> spheres(count);
+        for (glm::vec4& sphere : spheres) {
+            sphere = glm::vec4(position(random), position(random), position(random), radius(random));
+        }
+
+        SphereSoA soa;
+        soa.assign(spheres.data(), spheres.size());
+
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 150.0f);
+        proj[1][1] *= -1;
+        Frustum frustum = extractFrustum(proj * view);
+
+        std::vector<uint32_t> scalar_visible(count);
+        std::vector<uint32_t> simd_visible(soa.paddedSize());
+        size_t scalar_count = 0;
+        size_t simd_count = 0;
+
+        // average over enough passes that the 10k case is measurable
+        const int passes = static_cast<int>(std::max<size_t>(10, 10000000 / count));
+        double scalar_ms = timeMs([&]() {
+            for (int pass = 0; pass < passes; pass++) {
+                scalar_count = cullSpheresScalar(spheres.data(), spheres.size(), frustum, scalar_visible.data());
+            }
+        }) / passes;
+        double simd_ms = timeMs([&]() {
+            for (int pass = 0; pass < passes; pass++) {
+                simd_count = cullSpheres(soa, frustum, simd_visible.data());
+            }
+        }) / passes;
+
+        bool identical = scalar_count == simd_count &&
+            std::equal(scalar_visible.begin(), scalar_visible.begin() + scalar_count, simd_visible.begin());
+
+        std::cout << count << " spheres, " << scalar_count << " visible" << std::endl;
+        std::cout << "    scalar AoS " << scalar_ms << " ms (" << scalar_ms * 1e6 / count << " ns/sphere)" << std::endl;
+        std::cout << "    " << cullSpheresKernel() << " SoA " << simd_ms << " ms (" << simd_ms * 1e6 / count << " ns/sphere, "
+            << scalar_ms / simd_ms << "x)" << std::endl;
+        std::cout << "    visible list " << (identical ? "identical" : "DIFFERS") << std::endl;
+
+        return identical;
+    }
+
+    // cullReference on a hand placed scene against the visible sets worked out by hand, for the
+    // camera and a cascade, with and without compaction. instances carry their id as the material
+    bool checkCullReference()
+    {
+        struct Placed {
+            uint32_t mesh;
+            glm::vec3 position;
+            bool dynamic;
+            // expected in the camera, static cascade and dynamic cascade views
+            bool visible[CULL_VIEW_COUNT];
+        };
+        // camera at the origin looking down -z, 90 degrees, near 1 and far 100. the cascade is
+        // a 20 x 20 x 60 box around the origin. meshes are unit cubes, spheres of radius sqrt(3)
+        static const Placed placed[] = {
+            { 0, { 0.0f, 0.0f, -5.0f }, false, { true, true, false } },
+            { 0, { 0.0f, 0.0f, 5.0f }, false, { false, true, false } },      // behind the camera
+            { 0, { 50.0f, 0.0f, -5.0f }, false, { false, false, false } },   // right of both
+            { 1, { 0.0f, 0.0f, -50.0f }, false, { true, false, false } },    // past the cascade
+            { 1, { 0.0f, 0.0f, -200.0f }, false, { false, false, false } },  // past the far plane
+            { 0, { 0.0f, 0.0f, -20.0f }, true, { true, false, true } },
+            { 1, { 0.0f, 30.0f, -40.0f }, true, { true, false, false } },
+        };
+
+        Model cube;
+        cube.boundsMin = glm::vec3(-1.0f);
+        cube.boundsMax = glm::vec3(1.0f);
+
+        Scene scene;
+        scene.addMesh(cube);
+        scene.addMesh(cube);
+        for (uint32_t id = 0; id < std::size(placed); id++) {
+            scene.addInstance(placed[id].mesh, glm::translate(glm::mat4(1.0f), placed[id].position), id,
+                placed[id].dynamic ? INSTANCE_DYNAMIC : 0u);
+        }
+        scene.build();
+        std::vector<CullBatch> batches = buildCullBatches(scene);
+
+        glm::mat4 camera = glm::perspective(glm::radians(90.0f), 1.0f, 1.0f, 100.0f) *
+            glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 cascade = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, -30.0f, 30.0f);
+
+        bool passed = true;
+        for (CullView view : { CULL_VIEW_CAMERA, CULL_VIEW_LIGHT, CULL_VIEW_LIGHT_DYNAMIC }) {
+            Frustum frustum = extractFrustum(view == CULL_VIEW_CAMERA ? camera : cascade);
+
+            for (uint32_t flags : { CULL_FLAG_ENABLED, CULL_FLAG_ENABLED | CULL_FLAG_COMPACT }) {
+                CullResult result = cullReference(scene, batches, glm::mat4(1.0f), frustum, flags, view);
+                bool compact = (flags & CULL_FLAG_COMPACT) != 0;
+
+                bool matches = true;
+                uint32_t slot = 0;
+                for (uint32_t b = 0; b < batches.size(); b++) {
+                    Scene::DrawBatch const& batch = scene.batches()[b];
+                    std::vector<uint32_t> expected;
+                    for (uint32_t i = batch.firstInstance; i < batch.firstInstance + batch.instanceCount; i++) {
+                        uint32_t id = scene.instances()[i].materialId;
+                        if (placed[id].visible[view]) {
+                            expected.push_back(id);
+                        }
+                    }
+
+                    if (compact && expected.empty()) {
+                        continue;
+                    }
+
+                    VkDrawIndexedIndirectCommand const& command = result.draws[compact ? slot++ : b];
+                    std::vector<uint32_t> found;
+                    for (uint32_t i = 0; i < command.instanceCount && command.firstInstance + i < result.visible.size(); i++) {
+                        found.push_back(scene.instances()[result.visible[command.firstInstance + i]].materialId);
+                    }
+                    std::sort(found.begin(), found.end());
+
+                    matches = matches && command.firstInstance == batch.firstInstance && command.instanceCount == expected.size() &&
+                        found == expected;
+                }
+                matches = matches && result.drawCount == (compact ? slot : static_cast<uint32_t>(batches.size()));
+
+                std::cout << "reference cull, view " << view << (compact ? ", compacted" : "") << ": "
+                    << result.drawCount << " draws, " << (matches ? "expected" : "UNEXPECTED") << " visible lists" << std::endl;
+                passed = passed && matches;
+            }
+        }
+
+        return passed;
+    }
+
+    int benchmarkCulling()
+    {
+        bool identical = checkCullReference();
+        for (size_t count : { 10000, 100000, 1000000 }) {
+            identical = benchmarkSphereCulling(count) && identical;
+        }
+        return identical ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // buildClusters against lights placed so their clusters can be worked out by hand. the camera
+    // sits at the origin looking down -z with a 120 degree fov, so the tiles are wide enough for
+    // the lights on the axis to stay in the middle column and row. slices run from 1 to 4, each
+    // 4^(1/24) deeper than the last
+    bool checkClusters()
+    {
+        struct Placed {
+            GpuLight light;
+            uint32_t xMin, xMax, yMin, yMax, zMin, zMax;
+            bool lit;
+        };
+
+        float aspect = 16.0f / 9.0f;
+        float tan_half = std::tan(glm::radians(60.0f));
+        // view space point at a depth along the ray through ndc_x, ndc_y
+        auto onScreen = [&](float ndc_x, float ndc_y, float depth) {
+            return glm::vec3(ndc_x * tan_half * aspect * depth, ndc_y * tan_half * depth, -depth);
+        };
+        auto point = [](glm::vec3 const& position, float radius) {
+            return GpuLight{ glm::vec4(position, radius), glm::vec4(1.0f, 1.0f, 1.0f, -1.0f), glm::vec4(0.0f, -1.0f, 0.0f, -2.0f) };
+        };
+        auto spot = [](glm::vec3 const& position, float radius) {
+            return GpuLight{ glm::vec4(position, radius), glm::vec4(1.0f, 1.0f, 1.0f, 0.9f), glm::vec4(0.0f, 0.0f, -1.0f, 0.8f) };
+        };
+
+        // on the axis, columns 7 and 8 meet and row 4 is the middle one. a spot light is
+        // clustered by its sphere, the cone is left to the lighting pass
+        const Placed placed[] = {
+            // depths 1.01 to 1.03, inside slice 0 [1, 1.059]
+            { point(onScreen(0.0f, 0.0f, 1.02f), 0.01f), 7, 8, 4, 4, 0, 0, true },
+            // depths 1.75 to 2.25, slice 9 [1.682, 1.782] to slice 14 [2.245, 2.378]
+            { spot(onScreen(0.0f, 0.0f, 2.0f), 0.25f), 7, 8, 4, 4, 9, 14, true },
+            // behind the camera
+            { point(glm::vec3(0.0f, 0.0f, 2.0f), 0.5f), 0, 0, 0, 0, 0, 0, false },
+            // centre of tile 12, 6 and inside slice 19 [2.996, 3.174]
+            { point(onScreen(12.5f / 16.0f * 2.0f - 1.0f, 6.5f / 9.0f * 2.0f - 1.0f, 3.08f), 0.01f), 12, 12, 6, 6, 19, 19, true },
+        };
+
+        std::vector<GpuLight> lights;
+        ClusterLists expected;
+        expected.counts.assign(CLUSTER_COUNT, 0);
+        expected.indices.assign(static_cast<size_t>(CLUSTER_COUNT) * MAX_LIGHTS_PER_CLUSTER, 0);
+        for (uint32_t i = 0; i < std::size(placed); i++) {
+            Placed const& light = placed[i];
+            lights.push_back(light.light);
+            if (!light.lit) {
+                continue;
+            }
+
+            for (uint32_t z = light.zMin; z <= light.zMax; z++) {
+                for (uint32_t y = light.yMin; y <= light.yMax; y++) {
+                    for (uint32_t x = light.xMin; x <= light.xMax; x++) {
+                        uint32_t cluster = (z * CLUSTER_Y + y) * CLUSTER_X + x;
+                        expected.indices[static_cast<size_t>(cluster) * MAX_LIGHTS_PER_CLUSTER + expected.counts[cluster]++] = i;
+                    }
+                }
+            }
+        }
+
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 proj = glm::perspective(glm::radians(120.0f), aspect, 0.5f, 10.0f);
+        ClusterLists clusters = buildClusters(lights.data(), static_cast<uint32_t>(lights.size()), view, proj, 1.0f, 4.0f);
+
+        bool matches = clusters.counts == expected.counts && clusters.indices == expected.indices;
+        size_t lit = static_cast<size_t>(std::count_if(clusters.counts.begin(), clusters.counts.end(), [](uint32_t count) { return count > 0; }));
+        std::cout << "reference clusters, " << lights.size() << " placed lights: " << lit << " clusters lit, "
+            << (matches ? "expected" : "UNEXPECTED") << " light lists" << std::endl;
+        return matches;
+    }
+
+    // CPU cluster builder with the renderer's camera over the unit cube the single model fills
+    int benchmarkLights()
+    {
+        bool passed = checkClusters();
+
+        glm::mat4 view = glm::lookAt(glm::vec3(-2.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 proj = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.001f, 4.0f);
+        proj[1][1] *= -1;
+
+        for (uint32_t count : { 1u, 64u, 256u, 1024u }) {
+            LightSet lights;
+            lights.generate(count, glm::vec3(-1.0f), glm::vec3(1.0f));
+
+            ClusterLists clusters;
+            const int passes = 10;
+            double ms = timeMs([&]() {
+                for (int pass = 0; pass < passes; pass++) {
+                    clusters = buildClusters(lights.lights().data(), count, view, proj, 0.1f, 4.0f);
+                }
+            }) / passes;
+
+            size_t occupied = 0, total = 0, full = 0;
+            uint32_t most = 0;
+            for (uint32_t cluster_count : clusters.counts) {
+                occupied += cluster_count > 0 ? 1 : 0;
+                total += cluster_count;
+                full += cluster_count == MAX_LIGHTS_PER_CLUSTER ? 1 : 0;
+                most = std::max(most, cluster_count);
+            }
+
+            std::cout << count << " lights, " << ms << " ms per build (" << CLUSTER_COUNT << " clusters)" << std::endl;
+            std::cout << "    " << occupied << " clusters lit, " << (occupied > 0 ? static_cast<double>(total) / occupied : 0.0)
+                << " lights per lit cluster, at most " << most << ", " << full << " full" << std::endl;
+        }
+
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // scalar against SIMD mip chain over a noisy gradient, timed for the larger sizes.
+    // the odd size exercises the clamped edges and the scalar tails
+    bool benchmarkMipChain(uint32_t width, uint32_t height, bool timed)
+    {
+        std::vector<MipLevel> levels;
+        size_t size = mipChainLayout(width, height, levels);
+
+        std::mt19937 random(width * 31 + height);
+        std::uniform_int_distribution<int> noise(-24, 24);
+        std::vector<uint8_t> scalar_chain(size);
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                uint8_t* texel = scalar_chain.data() + (static_cast<size_t>(y) * width + x) * 4;
+                texel[0] = static_cast<uint8_t>(std::clamp(static_cast<int>(x * 255 / width) + noise(random), 0, 255));
+                texel[1] = static_cast<uint8_t>(std::clamp(static_cast<int>(y * 255 / height) + noise(random), 0, 255));
+                texel[2] = static_cast<uint8_t>(std::clamp(128 + noise(random) * 4, 0, 255));
+                texel[3] = static_cast<uint8_t>(std::clamp(255 - noise(random) * 8, 0, 255));
+            }
+        }
+        std::vector<uint8_t> simd_chain = scalar_chain;
+
+        const int passes = timed ? 5 : 1;
+        double scalar_ms = timeMs([&]() {
+            for (int pass = 0; pass < passes; pass++) {
+                generateMipChainScalar(scalar_chain.data(), levels);
+            }
+        }) / passes;
+        double simd_ms = timeMs([&]() {
+            for (int pass = 0; pass < passes; pass++) {
+                generateMipChain(simd_chain.data(), levels);
+            }
+        }) / passes;
+
+        bool identical = scalar_chain == simd_chain;
+
+        std::cout << width << "x" << height << ", " << levels.size() << " levels, " << size / (1024.0 * 1024.0) << " MB" << std::endl;
+        if (timed) {
+            double megapixels = static_cast<double>(width) * height / 1e6;
+            std::cout << "    scalar " << scalar_ms << " ms (" << megapixels / scalar_ms * 1000.0 << " MP/s)" << std::endl;
+            std::cout << "    " << mipChainKernel() << "   " << simd_ms << " ms (" << megapixels / simd_ms * 1000.0 << " MP/s, "
+                << scalar_ms / simd_ms << "x)" << std::endl;
+        }
+        std::cout << "    chain " << (identical ? "identical" : "DIFFERS") << std::endl;
+
+        return identical;
+    }
+
+    int benchmarkMips()
+    {
+        // black and white average to half the light, sRGB 188, not to the 128 a gamma space filter gives
+        std::vector<MipLevel> levels;
+        std::vector<uint8_t> checker(mipChainLayout(2, 2, levels), 0);
+        for (size_t texel : { 0, 3 }) {
+            std::fill_n(checker.begin() + texel * 4, 4, uint8_t(255));
+        }
+        checker[1 * 4 + 3] = checker[2 * 4 + 3] = 255;
+        generateMipChain(checker.data(), levels);
+        bool linear = checker[levels[1].offset] == 188 && checker[levels[1].offset + 3] == 255;
+        std::cout << "2x2 black and white checker averages to " << int(checker[levels[1].offset]) << (linear ? "" : ", expected 188") << std::endl;
+
+        bool identical = benchmarkMipChain(1023, 517, false);
+        identical = benchmarkMipChain(3840, 2160, true) && identical;
+        identical = benchmarkMipChain(7680, 4320, true) && identical;
+
+        return identical && linear ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // PSNR of the top level of a compressed chain against the source, over the first channels
+    double compressedPsnr(BlockFormat format, uint8_t const* source, uint8_t const* blocks, uint32_t width, uint32_t height, int channels)
+    {
+        double error = 0.0;
+        uint8_t texels[64];
+        uint32_t blocks_x = (width + 3) / 4;
+        for (uint32_t by = 0; by < (height + 3) / 4; by++) {
+            for (uint32_t bx = 0; bx < blocks_x; bx++) {
+                uint8_t const* block = blocks + (static_cast<size_t>(by) * blocks_x + bx) * blockBytes(format);
+                if (format == BlockFormat::BC1) {
+                    decodeBC1Block(block, texels);
+                }
+                else {
+                    decodeBC7Block(block, texels);
+                }
+
+                for (uint32_t y = 0; y < 4 && by * 4 + y < height; y++) {
+                    for (uint32_t x = 0; x < 4 && bx * 4 + x < width; x++) {
+                        uint8_t const* texel = source + ((static_cast<size_t>(by) * 4 + y) * width + bx * 4 + x) * 4;
+                        for (int c = 0; c < channels; c++) {
+                            double d = static_cast<double>(texel[c]) - texels[(y * 4 + x) * 4 + c];
+                            error += d * d;
+                        }
+                    }
+                }
+            }
+        }
+
+        double mean = error / (static_cast<double>(width) * height * channels);
+        return mean == 0.0 ? 99.0 : 10.0 * std::log10(255.0 * 255.0 / mean);
+    }
+
+    // BC1 and BC7 over the mip chain of a synthetic 1024x1024 image of gradients, a disc and
+    // mild noise, on one thread and on the pool. then a round trip through the KTX2 cache
+    int benchmarkTextures()
+    {
+        const uint32_t size = 1024;
+        std::vector<MipLevel> levels;
+        std::vector<uint8_t> chain(mipChainLayout(size, size, levels));
+
+        std::mt19937 random(7);
+        std::uniform_int_distribution<int> noise(-6, 6);
+        for (uint32_t y = 0; y < size; y++) {
+            for (uint32_t x = 0; x < size; x++) {
+                float dx = x - size * 0.5f;
+                float dy = y - size * 0.5f;
+                bool disc = dx * dx + dy * dy < size * size * 0.09f;
+                uint8_t* texel = chain.data() + (static_cast<size_t>(y) * size + x) * 4;
+                texel[0] = static_cast<uint8_t>(std::clamp(static_cast<int>(x * 255 / size) + noise(random), 0, 255));
+                texel[1] = static_cast<uint8_t>(std::clamp((disc ? 200 : static_cast<int>(y * 255 / size)) + noise(random), 0, 255));
+                texel[2] = static_cast<uint8_t>(128 + 100 * std::sin(x * 0.02f));
+                texel[3] = static_cast<uint8_t>(y * 255 / size);
+            }
+        }
+        generateMipChain(chain.data(), levels);
+
+        ThreadPool pool;
+        double megapixels = static_cast<double>(chain.size() / 4) / 1e6;
+        bool passed = true;
+
+        struct Case {
+            BlockFormat format;
+            char const* name;
+            int channels;
+            // comfortably below what the encoders reach on this image
+            double minimumPsnr;
+        };
+        for (Case const& test : { Case{ BlockFormat::BC1, "BC1", 3, 35.0 }, Case{ BlockFormat::BC7, "BC7", 4, 40.0 } }) {
+            std::vector<MipLevel> compressed_levels;
+            std::vector<uint8_t> serial, parallel;
+            double serial_ms = timeMs([&]() { serial = compressMipChain(test.format, chain.data(), levels, compressed_levels); });
+            double parallel_ms = timeMs([&]() { parallel = compressMipChain(test.format, chain.data(), levels, compressed_levels, &pool); });
+
+            double psnr = compressedPsnr(test.format, chain.data(), serial.data(), size, size, test.channels);
+            bool good = psnr >= test.minimumPsnr;
+            bool identical = serial == parallel;
+            passed = passed && good && identical;
+
+            std::cout << test.name << ", " << levels.size() << " levels, " << serial.size() / 1024 << " KB (RGBA8 "
+                << chain.size() / 1024 << " KB, " << static_cast<double>(chain.size()) / serial.size() << "x)" << std::endl;
+            std::cout << "    1 thread   " << serial_ms << " ms (" << megapixels / serial_ms * 1000.0 << " MP/s)" << std::endl;
+            std::cout << "    " << pool.size() << " threads  " << parallel_ms << " ms (" << megapixels / parallel_ms * 1000.0 << " MP/s)" << std::endl;
+            std::cout << "    top level PSNR " << psnr << " dB" << (good ? "" : ", too low") << ", threaded blocks "
+                << (identical ? "identical" : "DIFFER") << std::endl;
+        }
+
+        // write BC7 through the cache and map it back
+        std::vector<MipLevel> compressed_levels;
+        std::vector<uint8_t> compressed = compressMipChain(BlockFormat::BC7, chain.data(), levels, compressed_levels, &pool);
+        std::filesystem::path cache_path = std::filesystem::temp_directory_path() / "task_2_benchmark.ktx2";
+
+        bool round_trip = TextureCache::write(cache_path, 1234, 5678, VK_FORMAT_BC7_SRGB_BLOCK, compressed_levels, compressed.data());
+        bool rejected = false;
+        // unmapped again before the file is removed
+        {
+            TextureCache cache;
+            round_trip = round_trip && cache.open(cache_path, 1234, 5678) && cache.format() == VK_FORMAT_BC7_SRGB_BLOCK;
+            if (round_trip) {
+                std::vector<MipLevel> cached_levels = cache.levels();
+                round_trip = cached_levels.size() == compressed_levels.size();
+                for (size_t i = 0; i < cached_levels.size() && round_trip; i++) {
+                    round_trip = cached_levels[i].width == compressed_levels[i].width &&
+                        cached_levels[i].height == compressed_levels[i].height &&
+                        cached_levels[i].size == compressed_levels[i].size &&
+                        std::memcmp(cache.data() + cached_levels[i].offset, compressed.data() + compressed_levels[i].offset, cached_levels[i].size) == 0;
+                }
+            }
+
+            TextureCache stale;
+            rejected = !stale.open(cache_path, 4321, 5678);
+        }
+
+        std::error_code error;
+        std::filesystem::remove(cache_path, error);
+
+        std::cout << "KTX2 cache round trip " << (round_trip ? "identical" : "DIFFERS") << ", stale hash "
+            << (rejected ? "rejected" : "ACCEPTED") << std::endl;
+
+        return passed && round_trip && rejected ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // height field of grid_size x grid_size quads with its triangles in the given order. vertex
+    // x, z are the grid coordinates, so a vertex can be told apart by its position alone
+    void heightFieldMesh(size_t grid_size, std::vector<uint32_t> const& order, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+    {
+        size_t row = grid_size + 1;
+        vertices.resize(row * row);
+        for (size_t z = 0; z < row; z++) {
+            for (size_t x = 0; x < row; x++) {
+                Vertex& vertex = vertices[z * row + x];
+                vertex.pos = { static_cast<float>(x), 4.0f * std::sin(x * 0.05f) * std::cos(z * 0.05f), static_cast<float>(z) };
+                vertex.color = { 1.0f, 1.0f, 1.0f };
+                vertex.texCoord = { static_cast<float>(x) / grid_size, static_cast<float>(z) / grid_size };
+                vertex.norm = { 0.0f, 1.0f, 0.0f };
+            }
+        }
+
+        indices.clear();
+        indices.reserve(order.size() * 3);
+        for (uint32_t triangle : order) {
+            uint32_t quad = triangle / 2;
+            uint32_t v00 = static_cast<uint32_t>((quad / grid_size) * row + quad % grid_size);
+            uint32_t v01 = v00 + 1;
+            uint32_t v10 = v00 + static_cast<uint32_t>(row);
+            uint32_t v11 = v10 + 1;
+            if (triangle % 2 == 0) {
+                indices.insert(indices.end(), { v00, v10, v01 });
+            }
+            else {
+                indices.insert(indices.end(), { v01, v10, v11 });
+            }
+        }
+    }
+
+    // the triangles as grid vertex ids, each rotated to start at its smallest id so the
+    // winding is kept, then sorted. equal for two index streams drawing the same triangles
+    std::vector<std::array<uint32_t, 3>> canonicalTriangles(size_t grid_size, std::vector<Vertex> const& vertices, std::vector<uint32_t> const& indices)
+    {
+        std::vector<std::array<uint32_t, 3>> triangles(indices.size() / 3);
+        for (size_t t = 0; t < triangles.size(); t++) {
+            std::array<uint32_t, 3>& triangle = triangles[t];
+            for (size_t k = 0; k < 3; k++) {
+                glm::vec3 const& pos = vertices[indices[t * 3 + k]].pos;
+                triangle[k] = static_cast<uint32_t>(pos.z) * static_cast<uint32_t>(grid_size + 1) + static_cast<uint32_t>(pos.x);
+            }
+            std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+        }
+        std::sort(triangles.begin(), triangles.end());
+        return triangles;
+    }
+
+    // the FIFO cache simulator on hand counted streams, then the optimiser on a height field
+    // in scanline and in shuffled order. checks the same triangles come out with their winding,
+    // that vertices are fetched in order and that ACMR drops well below the scanline order's
+    int benchmarkVertexCache()
+    {
+        std::vector<uint32_t> twice = { 0, 1, 2, 0, 1, 2 };
+        std::vector<uint32_t> three = { 0, 1, 2, 3, 4, 5, 0, 1, 2 };
+        VertexCacheStats repeated = analyzeVertexCache(twice.data(), twice.size(), 3);
+        VertexCacheStats evicted = analyzeVertexCache(three.data(), three.size(), 6, 3);
+        VertexCacheStats kept = analyzeVertexCache(three.data(), three.size(), 6);
+        bool simulated = repeated.misses == 3 && repeated.acmr == 1.5f && repeated.atvr == 1.0f &&
+            evicted.misses == 9 && kept.misses == 6 && kept.atvr == 1.0f;
+        std::cout << "cache simulator " << (simulated ? "matches" : "DIFFERS from") << " the hand counted misses" << std::endl;
+
+        bool passed = simulated;
+        const size_t grid_size = 512;
+        std::vector<uint32_t> order(grid_size * grid_size * 2);
+        for (uint32_t t = 0; t < order.size(); t++) {
+            order[t] = t;
+        }
+
+        float scanline_acmr = 0.0f;
+        for (bool shuffled : { false, true }) {
+            if (shuffled) {
+                std::shuffle(order.begin(), order.end(), std::mt19937(7));
+            }
+
+            std::vector<Vertex> vertices;
+            std::vector<uint32_t> indices;
+            heightFieldMesh(grid_size, order, vertices, indices);
+            std::vector<std::array<uint32_t, 3>> triangles = canonicalTriangles(grid_size, vertices, indices);
+            size_t vertex_count = vertices.size();
+
+            VertexCacheStats before = analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+            double cache_ms = timeMs([&]() { optimizeVertexCache(indices.data(), indices.size(), vertices.size()); });
+            VertexCacheStats forsyth = analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+            double overdraw_ms = timeMs([&]() { optimizeOverdraw(indices.data(), indices.size(), vertices.data(), vertices.size()); });
+            double fetch_ms = timeMs([&]() { optimizeVertexFetch(vertices, indices); });
+            VertexCacheStats after = analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+
+            bool same = vertices.size() == vertex_count && canonicalTriangles(grid_size, vertices, indices) == triangles;
+            uint32_t next = 0;
+            for (uint32_t index : indices) {
+                if (index == next) {
+                    next++;
+                }
+                else if (index > next) {
+                    same = false;
+                }
+            }
+            if (!shuffled) {
+                scanline_acmr = before.acmr;
+            }
+            bool improved = after.acmr < 0.8f * scanline_acmr && after.acmr <= forsyth.acmr * 1.05f;
+
+            std::cout << order.size() << " triangles, " << (shuffled ? "shuffled" : "scanline") << " order" << std::endl;
+            std::cout << "    before   ACMR " << before.acmr << ", ATVR " << before.atvr << std::endl;
+            std::cout << "    forsyth  ACMR " << forsyth.acmr << ", ATVR " << forsyth.atvr << " (" << cache_ms << " ms)" << std::endl;
+            std::cout << "    overdraw ACMR " << after.acmr << ", ATVR " << after.atvr << " (" << overdraw_ms << " ms, fetch "
+                << fetch_ms << " ms)" << std::endl;
+            std::cout << "    triangles " << (same ? "kept, vertices fetched in order" : "CHANGED") << ", ACMR "
+                << (improved ? "improved" : "NOT IMPROVED") << std::endl;
+
+            passed = passed && same && improved;
+        }
+
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // packs a height field with random normals and tiled uvs into every vertex layout and reads
+    // it back the way the vertex shaders do. checks the interleaved layout is exact, the quantised
+    // errors stay within half a step of 16 bits and that it fetches at most half the bytes
+    int benchmarkVertexLayouts()
+    {
+        const size_t grid_size = 512;
+        std::vector<uint32_t> order(grid_size * grid_size * 2);
+        for (uint32_t t = 0; t < order.size(); t++) {
+            order[t] = t;
+        }
+
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        heightFieldMesh(grid_size, order, vertices, indices);
+
+        // normals over the whole sphere so every octant folds, uvs repeating past [0, 1]
+        std::mt19937 rng(7);
+        std::normal_distribution<float> gaussian;
+        for (Vertex& vertex : vertices) {
+            vertex.norm = glm::normalize(glm::vec3(gaussian(rng), gaussian(rng), gaussian(rng)));
+            vertex.texCoord = vertex.texCoord * 4.0f - 1.5f;
+        }
+
+        uint32_t interleaved_geometry = 0;
+        uint32_t interleaved_shadow = 0;
+        bool passed = true;
+        for (VertexLayout layout : VERTEX_LAYOUTS) {
+            uint32_t position_stride = vertexStreamStride(layout, VERTEX_STREAM_POSITION);
+            uint32_t attribute_stride = vertexStreamStride(layout, VERTEX_STREAM_ATTRIBUTES);
+            std::vector<uint8_t> positions(position_stride * vertices.size());
+            std::vector<uint8_t> attributes(attribute_stride * vertices.size());
+
+            MeshQuantization quantization{};
+            double pack_ms = timeMs([&]() {
+                quantization = quantizeMesh(layout, vertices.data(), vertices.size());
+                packVertices(layout, quantization, vertices.data(), vertices.size(), positions.data(), attributes.data());
+            });
+
+            // errors relative to the range each component is quantised over
+            glm::vec3 extent = glm::vec3(quantization.positionScale);
+            glm::vec2 tex_coord_range = glm::vec2(quantization.texCoordTransform);
+            if (layout == VertexLayout::Interleaved) {
+                extent = glm::vec3(1.0f);
+                tex_coord_range = glm::vec2(1.0f);
+            }
+
+            float position_error = 0.0f;
+            float tex_coord_error = 0.0f;
+            float normal_degrees = 0.0f;
+            for (size_t i = 0; i < vertices.size(); i++) {
+                Vertex unpacked = unpackVertex(layout, quantization, positions.data(), attributes.data(), i);
+                for (int axis = 0; axis < 3; axis++) {
+                    position_error = std::max(position_error, std::abs(unpacked.pos[axis] - vertices[i].pos[axis]) / extent[axis]);
+                }
+                for (int axis = 0; axis < 2; axis++) {
+                    tex_coord_error = std::max(tex_coord_error, std::abs(unpacked.texCoord[axis] - vertices[i].texCoord[axis]) / tex_coord_range[axis]);
+                }
+                // atan2 rather than acos, which has no precision left this close to 1
+                float sine = glm::length(glm::cross(unpacked.norm, vertices[i].norm));
+                normal_degrees = std::max(normal_degrees, std::atan2(sine, glm::dot(unpacked.norm, vertices[i].norm)) * 57.2957795f);
+            }
+
+            uint32_t geometry_bytes = position_stride + attribute_stride;
+            uint32_t shadow_bytes = position_stride;
+            bool accurate;
+            if (layout == VertexLayout::Interleaved) {
+                interleaved_geometry = geometry_bytes;
+                interleaved_shadow = shadow_bytes;
+                accurate = position_error == 0.0f && tex_coord_error == 0.0f && normal_degrees < 0.01f;
+            }
+            else {
+                // half a 16 bit step, with some slack for the float maths on either side
+                float half_step = 0.5f / 65535.0f * 1.01f;
+                accurate = position_error <= half_step && tex_coord_error <= half_step && normal_degrees < 0.01f;
+            }
+            bool halved = geometry_bytes * 2 <= interleaved_geometry && shadow_bytes * 2 <= interleaved_shadow;
+
+            std::cout << vertexLayoutName(layout) << ", " << vertices.size() << " vertices packed in " << pack_ms << " ms" << std::endl;
+            std::cout << "    " << geometry_bytes << " bytes/vertex geometry pass, " << shadow_bytes << " bytes/vertex shadow pass" << std::endl;
+            std::cout << "    max error position " << position_error * 65535.0f << " steps, uv " << tex_coord_error * 65535.0f
+                << " steps, normal " << normal_degrees << " degrees, " << (accurate ? "within bounds" : "OUT OF BOUNDS") << std::endl;
+
+            passed = passed && accurate && (layout == VertexLayout::Interleaved || halved);
+            if (layout != VertexLayout::Interleaved) {
+                std::cout << "    vertex bandwidth " << (halved ? "halved" : "NOT HALVED") << " in both passes" << std::endl;
+            }
+        }
+
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    int benchmarkMesh()
+    {
+        ThreadPool pool;
+
+        // 1M and 10M triangles
+        bool passed = benchmarkVertexDeduplication(708, pool);
+        passed = benchmarkVertexDeduplication(2237, pool) && passed;
+
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+}
+
+int runBenchmark(std::string const& name)
+{
+    static const std::map<std::string, std::function<int()>> benchmarks = {
+        { "allocator", benchmarkAllocator },
+        { "culling", benchmarkCulling },
+        { "lights", benchmarkLights },
+        { "mesh", benchmarkMesh },
+        { "mips", benchmarkMips },
+        { "textures", benchmarkTextures },
+        { "vcache", benchmarkVertexCache },
+        { "vertices", benchmarkVertexLayouts },
+    };
+
+    auto benchmark = benchmarks.find(name);
+    if (benchmark == benchmarks.end()) {
+        std::cerr << "unknown benchmark " << name << ", available:";
+        for (const auto& entry : benchmarks) {
+            std::cerr << " " << entry.first;
+        }
+        std::cerr << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return benchmark->second();
+}
@@ -0,0 +1,113 @@
+#include "task_1/BuddyAllocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+    bool isPowerOfTwo(uint64_t value)
+    {
+        return value != 0 && (value & (value - 1)) == 0;
+    }
+
+    // smallest order with 2^order >= value
+    uint32_t ceilLog2(uint64_t value)
+    {
+        uint32_t order = 0;
+        while ((uint64_t(1) << order) < value) {
+            order++;
+        }
+        return order;
+    }
+}
+
+BuddyAllocator::BuddyAllocator(uint64_t size, uint64_t min_block_size)
+{
+    if (!isPowerOfTwo(size) || !isPowerOfTwo(min_block_size) || min_block_size > size) {
+        throw std::runtime_error("buddy allocator sizes must be powers of two!");
+    }
+
+    min_order = ceilLog2(min_block_size);
+    max_order = ceilLog2(size);
+
+    free_lists.resize(max_order - min_order + 1);
+    freeList(max_order).insert(0);
+}
+
+uint64_t BuddyAllocator::allocate(uint64_t size, uint64_t alignment)
+{
+    uint32_t order = std::max(min_order, ceilLog2(std::max<uint64_t>(std::max<uint64_t>(size, alignment), 1)));
+    if (order > max_order) {
+        return NO_SPACE;
+    }
+
+    // smallest free block that fits
+    uint32_t found = order;
+    while (found <= max_order && freeList(found).empty()) {
+        found++;
+    }
+    if (found > max_order) {
+        return NO_SPACE;
+    }
+
+    uint64_t offset = *freeList(found).begin();
+    freeList(found).erase(freeList(found).begin());
+
+    // split it down, keeping the low half and freeing the high buddies
+    while (found > order) {
+        found--;
+        freeList(found).insert(offset + (uint64_t(1) << found));
+    }
+
+    allocations[offset] = Allocated{ order, size };
+    used_bytes += uint64_t(1) << order;
+    requested_bytes += size;
+
+    return offset;
+}
+
+void BuddyAllocator::free(uint64_t offset)
+{
+    auto allocation = allocations.find(offset);
+    if (allocation == allocations.end()) {
+        throw std::runtime_error("buddy allocator freed an offset it does not own!");
+    }
+
+    uint32_t order = allocation->second.order;
+    used_bytes -= uint64_t(1) << order;
+    requested_bytes -= allocation->second.requested;
+    allocations.erase(allocation);
+
+    // merge with the buddy for as long as it is free too
+    while (order < max_order) {
+        uint64_t buddy = offset ^ (uint64_t(1) << order);
+        if (freeList(order).erase(buddy) == 0) {
+            break;
+        }
+
+        offset = std::min(offset, buddy);
+        order++;
+    }
+
+    freeList(order).insert(offset);
+}
+
+uint64_t BuddyAllocator::largestFreeBlock() const
+{
+    for (uint32_t order = max_order + 1; order-- > min_order;) {
+        if (!freeList(order).empty()) {
+            return uint64_t(1) << order;
+        }
+    }
+
+    return 0;
+}
+
+float BuddyAllocator::fragmentation() const
+{
+    uint64_t free_bytes = size() - used_bytes;
+    if (free_bytes == 0) {
+        return 0.0f;
+    }
+
+    return 1.0f - static_cast<float>(largestFreeBlock()) / static_cast<float>(free_bytes);
+}
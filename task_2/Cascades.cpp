@@ -0,0 +1,91 @@
+#include "task_1/Cascades.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+void cascadeSplits(uint32_t count, float lambda, float z_near, float z_far, float* splits)
+{
+    for (uint32_t i = 1; i <= count; i++) {
+        float t = static_cast<float>(i) / count;
+        float logarithmic = z_near * std::pow(z_far / z_near, t);
+        float uniform = z_near + (z_far - z_near) * t;
+        splits[i - 1] = lambda * logarithmic + (1.0f - lambda) * uniform;
+    }
+    // no rounding error on the far end, fragments there must still find a cascade
+    splits[count - 1] = z_far;
+}
+
+glm::mat4 fitCascade(glm::mat4 const& view, glm::mat4 const& proj, float slice_near, float slice_far,
+    glm::vec3 const& light_dir, uint32_t resolution, glm::vec3 const& scene_min, glm::vec3 const& scene_max)
+{
+    glm::mat4 inv_proj = glm::inverse(proj);
+    glm::mat4 inv_view = glm::inverse(view);
+
+    // corners of the slice, along the rays through the corners of the screen
+    glm::vec3 corners[8];
+    for (uint32_t corner = 0; corner < 4; corner++) {
+        glm::vec4 on_near = inv_proj * glm::vec4((corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, 0.0f, 1.0f);
+        glm::vec3 ray = glm::vec3(on_near) / on_near.w;
+
+        corners[corner] = glm::vec3(inv_view * glm::vec4(ray * (slice_near / -ray.z), 1.0f));
+        corners[corner + 4] = glm::vec3(inv_view * glm::vec4(ray * (slice_far / -ray.z), 1.0f));
+    }
+
+    glm::vec3 centre(0.0f);
+    for (glm::vec3 const& corner : corners) {
+        centre += corner;
+    }
+    centre /= 8.0f;
+
+    float radius = 0.0f;
+    for (glm::vec3 const& corner : corners) {
+        radius = std::max(radius, glm::length(corner - centre));
+    }
+    // the radius only changes with the projection, round off the float noise so it is exactly stable
+    radius = std::ceil(radius * 1024.0f) / 1024.0f;
+
+    // rotation only, the centre is placed inside the projection so it can be snapped
+    glm::vec3 up = std::abs(light_dir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 light_view = glm::lookAt(glm::vec3(0.0f), light_dir, up);
+
+    glm::vec3 light_centre = glm::vec3(light_view * glm::vec4(centre, 1.0f));
+    float texel = 2.0f * radius / static_cast<float>(resolution);
+    light_centre.x = std::floor(light_centre.x / texel) * texel;
+    light_centre.y = std::floor(light_centre.y / texel) * texel;
+
+    // distances along the light direction, the view looks down -z
+    float depth_near = -light_centre.z - radius;
+    float depth_far = -light_centre.z + radius;
+
+    if (scene_min.x <= scene_max.x) {
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec4 world((corner & 1) ? scene_max.x : scene_min.x, (corner & 2) ? scene_max.y : scene_min.y,
+                (corner & 4) ? scene_max.z : scene_min.z, 1.0f);
+            float depth = -(light_view * world).z;
+            depth_near = std::min(depth_near, depth);
+            depth_far = std::max(depth_far, depth);
+        }
+    }
+
+    glm::mat4 light_proj = glm::ortho(light_centre.x - radius, light_centre.x + radius,
+        light_centre.y - radius, light_centre.y + radius, depth_near, depth_far);
+
+    return light_proj * light_view;
+}
+
+void fitCascades(glm::mat4 const& view, glm::mat4 const& proj, float z_near, float z_far, glm::vec3 const& light_dir,
+    CascadeSettings const& settings, uint32_t resolution, glm::vec3 const& scene_min, glm::vec3 const& scene_max,
+    Cascade* cascades)
+{
+    float splits[MAX_CASCADES];
+    uint32_t count = std::min(std::max(settings.count, 1u), MAX_CASCADES);
+    cascadeSplits(count, settings.lambda, z_near, z_far, splits);
+
+    for (uint32_t i = 0; i < count; i++) {
+        float slice_near = i == 0 ? 0.0f : splits[i - 1];
+        cascades[i].viewProj = fitCascade(view, proj, slice_near, splits[i], light_dir, resolution, scene_min, scene_max);
+        cascades[i].splitFar = splits[i];
+    }
+}
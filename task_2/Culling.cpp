@@ -0,0 +1,312 @@
+#include "task_1/Culling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// the kernel is picked at compile time. MSVC only defines __AVX2__ under /arch:AVX2 and
+// x64 always has SSE2
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CULL_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULL_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define CULL_NEON
+#endif
+
+Frustum extractFrustum(glm::mat4 const& view_proj)
+{
+    // rows of the matrix, glm is column major
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++) {
+        rows[i] = glm::vec4(view_proj[0][i], view_proj[1][i], view_proj[2][i], view_proj[3][i]);
+    }
+
+    Frustum frustum{};
+    frustum.planes[0] = rows[3] + rows[0]; // left
+    frustum.planes[1] = rows[3] - rows[0]; // right
+    frustum.planes[2] = rows[3] + rows[1]; // bottom
+    frustum.planes[3] = rows[3] - rows[1]; // top
+    frustum.planes[4] = rows[2];           // near, z >= 0 with a [0, 1] depth range
+    frustum.planes[5] = rows[3] - rows[2]; // far
+
+    for (glm::vec4& plane : frustum.planes) {
+        float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+        if (length > 0.0f) {
+            plane = plane / length;
+        }
+    }
+
+    return frustum;
+}
+
+glm::vec4 boundingSphere(glm::vec3 const& bounds_min, glm::vec3 const& bounds_max)
+{
+    glm::vec3 centre = (bounds_min + bounds_max) * 0.5f;
+    glm::vec3 half = (bounds_max - bounds_min) * 0.5f;
+    return glm::vec4(centre.x, centre.y, centre.z, std::sqrt(half.x * half.x + half.y * half.y + half.z * half.z));
+}
+
+glm::vec4 transformSphere(glm::mat4 const& transform, glm::vec4 const& sphere)
+{
+    glm::vec4 centre = transform * glm::vec4(sphere.x, sphere.y, sphere.z, 1.0f);
+
+    float scale = 0.0f;
+    for (int column = 0; column < 3; column++) {
+        glm::vec4 axis = transform[column];
+        scale = std::max(scale, std::sqrt(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z));
+    }
+
+    return glm::vec4(centre.x, centre.y, centre.z, sphere.w * scale);
+}
+
+bool sphereInFrustum(Frustum const& frustum, glm::vec4 const& sphere)
+{
+    for (glm::vec4 const& plane : frustum.planes) {
+        if (plane.x * sphere.x + plane.y * sphere.y + plane.z * sphere.z + plane.w < -sphere.w) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<CullBatch> buildCullBatches(Scene const& scene)
+{
+    std::vector<CullBatch> batches;
+    batches.reserve(scene.batches().size());
+
+    for (Scene::DrawBatch const& batch : scene.batches()) {
+        Scene::Mesh const& mesh = scene.meshes()[batch.mesh];
+
+        CullBatch cull_batch{};
+        cull_batch.sphere = boundingSphere(mesh.boundsMin, mesh.boundsMax);
+        cull_batch.indexCount = mesh.indexCount;
+        cull_batch.firstIndex = mesh.firstIndex;
+        cull_batch.vertexOffset = mesh.vertexOffset;
+        cull_batch.firstInstance = batch.firstInstance;
+        batches.push_back(cull_batch);
+    }
+
+    return batches;
+}
+
+bool instanceInView(InstanceData const& instance, CullView view)
+{
+    if (view == CULL_VIEW_CAMERA) {
+        return true;
+    }
+    return ((instance.flags & INSTANCE_DYNAMIC) != 0) == (view == CULL_VIEW_LIGHT_DYNAMIC);
+}
+
+CullResult cullReference(Scene const& scene, std::vector<CullBatch> const& batches, glm::mat4 const& model,
+    Frustum const& frustum, uint32_t flags, CullView view)
+{
+    std::vector<InstanceData> const& instances = scene.instances();
+
+    CullResult result;
+    result.visible.assign(instances.size(), 0);
+
+    // cull.comp, one invocation per instance
+    std::vector<uint32_t> counts(batches.size(), 0);
+    for (uint32_t index = 0; index < instances.size(); index++) {
+        InstanceData const& instance = instances[index];
+        CullBatch const& batch = batches[instance.batch];
+
+        if (!instanceInView(instance, view)) {
+            continue;
+        }
+
+        glm::vec4 sphere = transformSphere(model * instance.model, batch.sphere);
+        if ((flags & CULL_FLAG_ENABLED) && !sphereInFrustum(frustum, sphere)) {
+            continue;
+        }
+
+        result.visible[batch.firstInstance + counts[instance.batch]++] = index;
+    }
+
+    // cull_compact.comp, one invocation per batch
+    result.draws.assign(batches.size(), VkDrawIndexedIndirectCommand{});
+    for (uint32_t b = 0; b < batches.size(); b++) {
+        uint32_t slot = b;
+        if (flags & CULL_FLAG_COMPACT) {
+            if (counts[b] == 0) {
+                continue;
+            }
+            slot = result.drawCount++;
+        }
+
+        VkDrawIndexedIndirectCommand& command = result.draws[slot];
+        command.indexCount = batches[b].indexCount;
+        command.instanceCount = counts[b];
+        command.firstIndex = batches[b].firstIndex;
+        command.vertexOffset = batches[b].vertexOffset;
+        command.firstInstance = batches[b].firstInstance;
+    }
+
+    if (!(flags & CULL_FLAG_COMPACT)) {
+        result.drawCount = static_cast<uint32_t>(batches.size());
+    }
+
+    return result;
+}
+
+void SphereSoA::assign(glm::vec4 const* spheres, size_t sphere_count)
+{
+    count = sphere_count;
+    size_t padded = (count + CULL_SIMD_WIDTH - 1) / CULL_SIMD_WIDTH * CULL_SIMD_WIDTH;
+
+    // a negative infinite radius fails every plane test
+    xs.assign(padded, 0.0f);
+    ys.assign(padded, 0.0f);
+    zs.assign(padded, 0.0f);
+    radii.assign(padded, -std::numeric_limits<float>::infinity());
+
+    for (size_t i = 0; i < count; i++) {
+        set(i, spheres[i]);
+    }
+}
+
+void SphereSoA::set(size_t index, glm::vec4 const& sphere)
+{
+    xs[index] = sphere.x;
+    ys[index] = sphere.y;
+    zs[index] = sphere.z;
+    radii[index] = sphere.w;
+}
+
+size_t cullSpheresScalar(glm::vec4 const* spheres, size_t count, Frustum const& frustum, uint32_t* visible)
+{
+    size_t visible_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (sphereInFrustum(frustum, spheres[i])) {
+            visible[visible_count++] = static_cast<uint32_t>(i);
+        }
+    }
+    return visible_count;
+}
+
+namespace {
+    // append the lanes set in mask without branching. every lane is written, only the
+    // visible ones advance the count, hence the padded visible list
+    size_t appendVisible(uint32_t* visible, size_t visible_count, uint32_t first, int mask, int lanes)
+    {
+        for (int lane = 0; lane < lanes; lane++) {
+            visible[visible_count] = first + lane;
+            visible_count += (mask >> lane) & 1;
+        }
+        return visible_count;
+    }
+}
+
+size_t cullSpheres(SphereSoA const& spheres, Frustum const& frustum, uint32_t* visible)
+{
+    float const* xs = spheres.x();
+    float const* ys = spheres.y();
+    float const* zs = spheres.z();
+    float const* radii = spheres.radius();
+    size_t padded = spheres.paddedSize();
+    size_t visible_count = 0;
+
+#if defined(CULL_AVX2)
+    __m256 planes[6][4];
+    for (int p = 0; p < 6; p++) {
+        for (int c = 0; c < 4; c++) {
+            planes[p][c] = _mm256_set1_ps(frustum.planes[p][c]);
+        }
+    }
+
+    for (size_t i = 0; i < padded; i += 8) {
+        __m256 x = _mm256_loadu_ps(xs + i);
+        __m256 y = _mm256_loadu_ps(ys + i);
+        __m256 z = _mm256_loadu_ps(zs + i);
+        __m256 negative_radius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(radii + i));
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; p++) {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+                _mm256_mul_ps(planes[p][0], x), _mm256_mul_ps(planes[p][1], y)), _mm256_mul_ps(planes[p][2], z)), planes[p][3]);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negative_radius, _CMP_GE_OQ));
+        }
+
+        visible_count = appendVisible(visible, visible_count, static_cast<uint32_t>(i), _mm256_movemask_ps(inside), 8);
+    }
+#elif defined(CULL_SSE2)
+    __m128 planes[6][4];
+    for (int p = 0; p < 6; p++) {
+        for (int c = 0; c < 4; c++) {
+            planes[p][c] = _mm_set1_ps(frustum.planes[p][c]);
+        }
+    }
+
+    for (size_t i = 0; i < padded; i += 4) {
+        __m128 x = _mm_loadu_ps(xs + i);
+        __m128 y = _mm_loadu_ps(ys + i);
+        __m128 z = _mm_loadu_ps(zs + i);
+        __m128 negative_radius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radii + i));
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; p++) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(planes[p][0], x), _mm_mul_ps(planes[p][1], y)), _mm_mul_ps(planes[p][2], z)), planes[p][3]);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negative_radius));
+        }
+
+        visible_count = appendVisible(visible, visible_count, static_cast<uint32_t>(i), _mm_movemask_ps(inside), 4);
+    }
+#elif defined(CULL_NEON)
+    float32x4_t planes[6][4];
+    for (int p = 0; p < 6; p++) {
+        for (int c = 0; c < 4; c++) {
+            planes[p][c] = vdupq_n_f32(frustum.planes[p][c]);
+        }
+    }
+
+    // neon has no movemask, weight each lane's bit and add them up
+    static const uint32_t lane_bits[4] = { 1, 2, 4, 8 };
+    uint32x4_t bits = vld1q_u32(lane_bits);
+
+    for (size_t i = 0; i < padded; i += 4) {
+        float32x4_t x = vld1q_f32(xs + i);
+        float32x4_t y = vld1q_f32(ys + i);
+        float32x4_t z = vld1q_f32(zs + i);
+        float32x4_t negative_radius = vnegq_f32(vld1q_f32(radii + i));
+
+        uint32x4_t inside = vdupq_n_u32(0xffffffffu);
+        for (int p = 0; p < 6; p++) {
+            float32x4_t distance = vaddq_f32(vaddq_f32(vaddq_f32(
+                vmulq_f32(planes[p][0], x), vmulq_f32(planes[p][1], y)), vmulq_f32(planes[p][2], z)), planes[p][3]);
+            inside = vandq_u32(inside, vcgeq_f32(distance, negative_radius));
+        }
+
+        uint32x4_t lanes = vandq_u32(inside, bits);
+        uint32x2_t pairs = vadd_u32(vget_low_u32(lanes), vget_high_u32(lanes));
+        int mask = static_cast<int>(vget_lane_u32(vpadd_u32(pairs, pairs), 0));
+
+        visible_count = appendVisible(visible, visible_count, static_cast<uint32_t>(i), mask, 4);
+    }
+#else
+    for (size_t i = 0; i < padded; i++) {
+        glm::vec4 sphere(xs[i], ys[i], zs[i], radii[i]);
+        visible[visible_count] = static_cast<uint32_t>(i);
+        visible_count += sphereInFrustum(frustum, sphere) ? 1 : 0;
+    }
+#endif
+
+    return visible_count;
+}
+
+char const* cullSpheresKernel()
+{
+#if defined(CULL_AVX2)
+    return "avx2";
+#elif defined(CULL_SSE2)
+    return "sse2";
+#elif defined(CULL_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,278 @@
+#include "task_1/DeviceMemoryAllocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+    // smallest buddy block. covers minUniformBufferOffsetAlignment on all common hardware
+    constexpr VkDeviceSize MIN_SUBALLOCATION = 256;
+
+    VkDeviceSize floorPowerOfTwo(VkDeviceSize value)
+    {
+        VkDeviceSize result = 1;
+        while (result * 2 <= value) {
+            result *= 2;
+        }
+        return result;
+    }
+}
+
+DeviceMemoryAllocator::~DeviceMemoryAllocator()
+{
+    destroy();
+}
+
+void DeviceMemoryAllocator::init(VkPhysicalDevice physical_device, VkDevice logical_device)
+{
+    device = logical_device;
+
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    buffer_image_granularity = properties.limits.bufferImageGranularity;
+    max_device_memory_count = properties.limits.maxMemoryAllocationCount;
+
+    pools.resize(memory_properties.memoryTypeCount * 2);
+    for (uint32_t type = 0; type < memory_properties.memoryTypeCount; type++) {
+        // small heaps (e.g. 256MB host visible device local) get proportionally smaller blocks
+        VkDeviceSize heap_size = memory_properties.memoryHeaps[memory_properties.memoryTypes[type].heapIndex].size;
+        VkDeviceSize block_size = std::max(MIN_SUBALLOCATION, std::min(DEFAULT_BLOCK_SIZE, floorPowerOfTwo(heap_size / 8)));
+
+        for (ResourceKind kind : { ResourceKind::Linear, ResourceKind::Optimal }) {
+            Pool& pool = pools[type * 2 + (kind == ResourceKind::Optimal ? 1 : 0)];
+            pool.memoryType = type;
+            pool.blockSize = block_size;
+        }
+    }
+}
+
+void DeviceMemoryAllocator::destroy()
+{
+    if (device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    for (auto& pool : pools) {
+        for (auto& block : pool.blocks) {
+            if (block) {
+                freeDeviceMemory(block->memory, block->mapped);
+            }
+        }
+    }
+
+    // dedicated allocations are owned by their resources and should have been freed
+    // through free(). anything left at this point was leaked by the caller
+    pools.clear();
+    device = VK_NULL_HANDLE;
+}
+
+uint32_t DeviceMemoryAllocator::findMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties) const
+{
+    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+        if ((type_filter & (1 << i)) && (memory_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("failed to find suitable memory type!");
+}
+
+bool DeviceMemoryAllocator::hasMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties) const
+{
+    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+        if ((type_filter & (1 << i)) && (memory_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+VkMemoryPropertyFlags DeviceMemoryAllocator::propertyFlags(Allocation const& allocation) const
+{
+    return memory_properties.memoryTypes[pools[allocation.pool].memoryType].propertyFlags;
+}
+
+uint32_t DeviceMemoryAllocator::poolIndex(uint32_t memory_type, ResourceKind kind) const
+{
+    // with a granularity of 1 linear and optimal resources can share blocks freely
+    bool separate = kind == ResourceKind::Optimal && buffer_image_granularity > 1;
+    return memory_type * 2 + (separate ? 1 : 0);
+}
+
+Allocation DeviceMemoryAllocator::allocate(VkMemoryRequirements const& requirements, VkMemoryPropertyFlags properties, ResourceKind kind, bool dedicated)
+{
+    uint32_t memory_type = findMemoryType(requirements.memoryTypeBits, properties);
+
+    Allocation allocation{};
+    allocation.pool = poolIndex(memory_type, kind);
+    allocation.size = requirements.size;
+
+    Pool& pool = pools[allocation.pool];
+
+    // offset 0 of its own VkDeviceMemory satisfies any alignment
+    auto allocate_dedicated = [&]() {
+        allocation.memory = allocateDeviceMemory(memory_type, requirements.size, &allocation.mapped);
+        allocation.block = -1;
+
+        pool.dedicatedCount++;
+        pool.dedicatedBytes += requirements.size;
+        return allocation;
+    };
+
+    // big resources would waste most of a block, and attachments are recreated on
+    // resize so they are better off not pinning a block
+    if (dedicated || requirements.size > pool.blockSize / 2) {
+        return allocate_dedicated();
+    }
+
+    // first fit over existing blocks
+    int32_t free_slot = -1;
+    for (size_t i = 0; i < pool.blocks.size(); i++) {
+        if (!pool.blocks[i]) {
+            free_slot = free_slot < 0 ? static_cast<int32_t>(i) : free_slot;
+            continue;
+        }
+
+        uint64_t offset = pool.blocks[i]->range.allocate(requirements.size, requirements.alignment);
+        if (offset != BuddyAllocator::NO_SPACE) {
+            Block& block = *pool.blocks[i];
+            allocation.memory = block.memory;
+            allocation.offset = offset;
+            allocation.mapped = block.mapped ? static_cast<char*>(block.mapped) + offset : nullptr;
+            allocation.block = static_cast<int32_t>(i);
+            return allocation;
+        }
+    }
+
+    // none had room, start a new block
+    void* mapped = nullptr;
+    VkDeviceMemory memory = allocateDeviceMemory(memory_type, pool.blockSize, &mapped);
+    auto block = std::unique_ptr<Block>(new Block{ memory, mapped, BuddyAllocator(pool.blockSize, MIN_SUBALLOCATION) });
+
+    uint64_t offset = block->range.allocate(requirements.size, requirements.alignment);
+
+    // an alignment larger than the block, or a size that rounds up past half of it, does not
+    // fit even an empty block
+    if (offset == BuddyAllocator::NO_SPACE) {
+        freeDeviceMemory(memory, mapped);
+        return allocate_dedicated();
+    }
+
+    if (free_slot < 0) {
+        free_slot = static_cast<int32_t>(pool.blocks.size());
+        pool.blocks.push_back(std::move(block));
+    }
+    else {
+        pool.blocks[free_slot] = std::move(block);
+    }
+
+    allocation.memory = memory;
+    allocation.offset = offset;
+    allocation.mapped = mapped ? static_cast<char*>(mapped) + offset : nullptr;
+    allocation.block = free_slot;
+    return allocation;
+}
+
+void DeviceMemoryAllocator::free(Allocation& allocation)
+{
+    if (allocation.memory == VK_NULL_HANDLE) {
+        return;
+    }
+
+    Pool& pool = pools[allocation.pool];
+
+    if (allocation.block < 0) {
+        freeDeviceMemory(allocation.memory, allocation.mapped);
+        pool.dedicatedCount--;
+        pool.dedicatedBytes -= allocation.size;
+    }
+    else {
+        std::unique_ptr<Block>& block = pool.blocks[allocation.block];
+        block->range.free(allocation.offset);
+
+        // keep one empty block around per pool so alloc/free churn doesn't hit the driver
+        if (block->range.empty()) {
+            bool other_empty = std::any_of(pool.blocks.begin(), pool.blocks.end(), [&](std::unique_ptr<Block> const& other) {
+                return other && other != block && other->range.empty();
+            });
+
+            if (other_empty) {
+                freeDeviceMemory(block->memory, block->mapped);
+                block.reset();
+            }
+        }
+    }
+
+    allocation = Allocation{};
+}
+
+std::vector<DeviceMemoryAllocator::HeapStats> DeviceMemoryAllocator::heapStats() const
+{
+    std::vector<HeapStats> stats(memory_properties.memoryHeapCount);
+    for (uint32_t heap = 0; heap < memory_properties.memoryHeapCount; heap++) {
+        stats[heap] = HeapStats{};
+        stats[heap].heapIndex = heap;
+        stats[heap].heapSize = memory_properties.memoryHeaps[heap].size;
+        stats[heap].deviceLocal = (memory_properties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+    }
+
+    for (auto const& pool : pools) {
+        HeapStats& heap = stats[memory_properties.memoryTypes[pool.memoryType].heapIndex];
+
+        heap.dedicatedCount += pool.dedicatedCount;
+        heap.allocationCount += pool.dedicatedCount;
+        heap.allocatedBytes += pool.dedicatedBytes;
+        heap.usedBytes += pool.dedicatedBytes;
+        heap.requestedBytes += pool.dedicatedBytes;
+
+        for (auto const& block : pool.blocks) {
+            if (!block) {
+                continue;
+            }
+
+            heap.blockCount++;
+            heap.allocationCount += static_cast<uint32_t>(block->range.allocationCount());
+            heap.allocatedBytes += block->range.size();
+            heap.usedBytes += block->range.usedBytes();
+            heap.requestedBytes += block->range.requestedBytes();
+            heap.fragmentation = std::max(heap.fragmentation, block->range.fragmentation());
+        }
+    }
+
+    return stats;
+}
+
+VkDeviceMemory DeviceMemoryAllocator::allocateDeviceMemory(uint32_t memory_type, VkDeviceSize size, void** mapped)
+{
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memory_type;
+
+    VkDeviceMemory memory;
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate device memory!");
+    }
+    device_memory_count++;
+
+    *mapped = nullptr;
+    if (memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS) {
+            throw std::runtime_error("failed to map device memory!");
+        }
+    }
+
+    return memory;
+}
+
+void DeviceMemoryAllocator::freeDeviceMemory(VkDeviceMemory memory, void* mapped)
+{
+    if (mapped) {
+        vkUnmapMemory(device, memory);
+    }
+
+    vkFreeMemory(device, memory, nullptr);
+    device_memory_count--;
+}
@@ -0,0 +1,87 @@
+#include "task_1/GBufferLayout.h"
+
+#include <cstdio>
+
+GBufferFormats gbufferFormats(GBufferLayout layout)
+{
+    switch (layout) {
+    case GBufferLayout::Compact:
+        return { VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_R16G16_SFLOAT };
+    case GBufferLayout::CompactMaterial:
+        return { VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_A2B10G10R10_UNORM_PACK32 };
+    case GBufferLayout::Reference:
+    default:
+        return { VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_A2R10G10B10_UNORM_PACK32 };
+    }
+}
+
+char const* gbufferLayoutName(GBufferLayout layout)
+{
+    switch (layout) {
+    case GBufferLayout::Compact:
+        return "compact";
+    case GBufferLayout::CompactMaterial:
+        return "compact-material";
+    case GBufferLayout::Reference:
+    default:
+        return "reference";
+    }
+}
+
+bool parseGBufferLayout(std::string const& name, GBufferLayout& layout)
+{
+    for (GBufferLayout candidate : GBUFFER_LAYOUTS) {
+        if (name == gbufferLayoutName(candidate)) {
+            layout = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint32_t gbufferFormatSize(VkFormat format)
+{
+    switch (format) {
+    case VK_FORMAT_R32G32B32A32_SFLOAT:
+        return 16;
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+        // most implementations store the stencil in a separate plane
+        return 5;
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_R16G16_SFLOAT:
+    case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+    case VK_FORMAT_A2R10G10B10_UNORM_PACK32:
+    case VK_FORMAT_D32_SFLOAT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+uint32_t gbufferBytesPerPixel(GBufferLayout layout, VkFormat depth_format)
+{
+    GBufferFormats formats = gbufferFormats(layout);
+    return gbufferFormatSize(formats.albedo) + gbufferFormatSize(formats.normal) + gbufferFormatSize(depth_format);
+}
+
+void printGBufferReport(std::ostream& out, uint32_t width, uint32_t height, VkFormat depth_format)
+{
+    double pixels = double(width) * double(height);
+
+    out << "G-buffer layouts at " << width << "x" << height << " (colour + depth attachments)" << std::endl;
+    out << "layout              bytes/px   memory MB   traffic MB/frame   GB/s @ 60 fps" << std::endl;
+
+    for (GBufferLayout layout : GBUFFER_LAYOUTS) {
+        uint32_t bytes = gbufferBytesPerPixel(layout, depth_format);
+        double memory_mb = pixels * bytes / (1024.0 * 1024.0);
+        // written once by the geometry subpass, read once by the lighting subpass
+        double traffic_mb = 2.0 * memory_mb;
+        double traffic_gbs = traffic_mb * 60.0 / 1024.0;
+
+        char line[160];
+        snprintf(line, sizeof(line), "%-18s %9u %11.1f %18.1f %15.2f", gbufferLayoutName(layout), bytes, memory_mb, traffic_mb, traffic_gbs);
+        out << line << std::endl;
+    }
+}
@@ -0,0 +1,222 @@
+#include "task_1/GpuProfiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+void GpuProfiler::init(VkPhysicalDevice physical_device, VkDevice logical_device, uint32_t queue_family, uint32_t frame_count)
+{
+    device = logical_device;
+
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    timestamp_period = properties.limits.timestampPeriod;
+
+    uint32_t family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, nullptr);
+    std::vector<VkQueueFamilyProperties> families(family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, families.data());
+
+    uint32_t valid_bits = families[queue_family].timestampValidBits;
+    if (valid_bits == 0) {
+        std::cerr << "GPU profiler disabled: queue family has no timestamp support" << std::endl;
+        return;
+    }
+    timestamp_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = MAX_SCOPES * 2;
+
+    frames.resize(frame_count);
+    for (auto& queries : frames) {
+        if (vkCreateQueryPool(device, &poolInfo, nullptr, &queries.pool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create timestamp query pool!");
+        }
+    }
+}
+
+void GpuProfiler::destroy()
+{
+    for (auto& queries : frames) {
+        vkDestroyQueryPool(device, queries.pool, nullptr);
+    }
+    frames.clear();
+    timestamp_mask = 0;
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer command_buffer, uint32_t frame)
+{
+    if (!enabled()) {
+        return;
+    }
+
+    current_frame = frame;
+    FrameQueries& queries = frames[frame];
+
+    collect(queries);
+
+    vkCmdResetQueryPool(command_buffer, queries.pool, 0, MAX_SCOPES * 2);
+    queries.writtenScopes = 0;
+    queries.frame = frame_counter++;
+}
+
+void GpuProfiler::flush()
+{
+    if (!enabled()) {
+        return;
+    }
+
+    // oldest first so the log stays in submission order
+    std::vector<FrameQueries*> pending;
+    for (auto& queries : frames) {
+        pending.push_back(&queries);
+    }
+    std::sort(pending.begin(), pending.end(), [](FrameQueries const* a, FrameQueries const* b) { return a->frame < b->frame; });
+
+    for (FrameQueries* queries : pending) {
+        collect(*queries);
+        queries->writtenScopes = 0;
+    }
+}
+
+uint32_t GpuProfiler::beginScope(VkCommandBuffer command_buffer, char const* name)
+{
+    if (!enabled()) {
+        return NO_SCOPE;
+    }
+
+    auto existing = std::find(scope_names.begin(), scope_names.end(), name);
+    uint32_t scope = static_cast<uint32_t>(existing - scope_names.begin());
+    if (existing == scope_names.end()) {
+        if (scope_names.size() == MAX_SCOPES) {
+            return NO_SCOPE;
+        }
+        scope_names.emplace_back(name);
+    }
+
+    FrameQueries& queries = frames[current_frame];
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queries.pool, scope * 2);
+    queries.writtenScopes |= 1u << scope;
+
+    return scope;
+}
+
+void GpuProfiler::endScope(VkCommandBuffer command_buffer, uint32_t scope)
+{
+    if (scope == NO_SCOPE) {
+        return;
+    }
+
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frames[current_frame].pool, scope * 2 + 1);
+}
+
+void GpuProfiler::collect(FrameQueries& queries)
+{
+    if (queries.writtenScopes == 0) {
+        return;
+    }
+
+    // value and availability per query. no WAIT flag, anything not finished is skipped
+    std::array<uint64_t, MAX_SCOPES * 2 * 2> results{};
+    VkResult result = vkGetQueryPoolResults(device, queries.pool, 0, MAX_SCOPES * 2,
+        sizeof(results), results.data(), sizeof(uint64_t) * 2,
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    if (result != VK_SUCCESS && result != VK_NOT_READY) {
+        throw std::runtime_error("failed to read timestamp queries!");
+    }
+
+    FrameSample sample{};
+    sample.frame = queries.frame;
+    sample.ms.fill(std::numeric_limits<float>::quiet_NaN());
+
+    for (uint32_t scope = 0; scope < MAX_SCOPES; scope++) {
+        if (!(queries.writtenScopes & (1u << scope))) {
+            continue;
+        }
+
+        uint64_t begin = results[scope * 4 + 0];
+        bool begin_available = results[scope * 4 + 1] != 0;
+        uint64_t end = results[scope * 4 + 2];
+        bool end_available = results[scope * 4 + 3] != 0;
+
+        if (begin_available && end_available) {
+            uint64_t ticks = (end - begin) & timestamp_mask;
+            sample.ms[scope] = static_cast<float>(ticks * double(timestamp_period) / 1e6);
+        }
+    }
+
+    log.push_back(sample);
+    if (log.size() > LOG_LENGTH) {
+        log.pop_front();
+    }
+}
+
+std::vector<float> GpuProfiler::scopeHistory(size_t scope) const
+{
+    std::vector<float> history;
+    history.reserve(HISTORY_LENGTH);
+
+    for (auto sample = log.rbegin(); sample != log.rend() && history.size() < HISTORY_LENGTH; ++sample) {
+        if (!std::isnan(sample->ms[scope])) {
+            history.push_back(sample->ms[scope]);
+        }
+    }
+
+    std::reverse(history.begin(), history.end());
+    return history;
+}
+
+GpuProfiler::ScopeStats GpuProfiler::scopeStats(size_t scope) const
+{
+    std::vector<float> history = scopeHistory(scope);
+    if (history.empty()) {
+        return ScopeStats{};
+    }
+
+    ScopeStats stats{};
+    stats.lastMs = history.back();
+
+    float total = 0.0f;
+    for (float ms : history) {
+        total += ms;
+    }
+    stats.avgMs = total / history.size();
+
+    std::sort(history.begin(), history.end());
+    stats.minMs = history.front();
+    stats.p99Ms = history[static_cast<size_t>(0.99 * (history.size() - 1))];
+
+    return stats;
+}
+
+bool GpuProfiler::writeCsv(std::filesystem::path const& path) const
+{
+    std::ofstream file(path);
+    if (!file) {
+        return false;
+    }
+
+    file << "frame";
+    for (auto const& name : scope_names) {
+        file << "," << name << "_ms";
+    }
+    file << "\n";
+
+    for (auto const& sample : log) {
+        file << sample.frame;
+        for (size_t scope = 0; scope < scope_names.size(); scope++) {
+            file << ",";
+            if (!std::isnan(sample.ms[scope])) {
+                file << sample.ms[scope];
+            }
+        }
+        file << "\n";
+    }
+
+    return static_cast<bool>(file);
+}
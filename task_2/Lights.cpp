@@ -0,0 +1,138 @@
+#include "task_1/Lights.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+void LightSet::generate(uint32_t count, glm::vec3 const& bounds_min, glm::vec3 const& bounds_max, uint32_t seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    glm::vec3 size = bounds_max - bounds_min;
+    float diagonal = std::sqrt(size.x * size.x + size.y * size.y + size.z * size.z);
+    centre = (bounds_min + bounds_max) * 0.5f;
+
+    base.resize(count);
+    speeds.resize(count);
+
+    for (uint32_t i = 0; i < count; i++) {
+        glm::vec3 position = bounds_min + glm::vec3(unit(random), unit(random), unit(random)) * size;
+        float radius = diagonal * (0.03f + 0.07f * unit(random));
+
+        // saturated colours so overlapping lights stay tellable apart
+        glm::vec3 color(unit(random), unit(random), unit(random));
+        color = color / std::max(color.x, std::max(color.y, std::max(color.z, 1e-3f)));
+
+        GpuLight& light = base[i];
+        light.positionRadius = glm::vec4(position, radius);
+
+        if (i % 4 == 3) {
+            float outer = glm::radians(20.0f + 25.0f * unit(random));
+            light.colorCosInner = glm::vec4(color * 2.0f, std::cos(outer * 0.75f));
+            light.directionCosOuter = glm::vec4(0.0f, -1.0f, 0.0f, std::cos(outer));
+        }
+        else {
+            light.colorCosInner = glm::vec4(color, -1.0f);
+            light.directionCosOuter = glm::vec4(0.0f, -1.0f, 0.0f, -2.0f);
+        }
+
+        speeds[i] = (unit(random) - 0.5f) * 1.5f;
+    }
+
+    current = base;
+}
+
+void LightSet::update(float seconds)
+{
+    for (size_t i = 0; i < base.size(); i++) {
+        float angle = speeds[i] * seconds;
+        float c = std::cos(angle);
+        float s = std::sin(angle);
+
+        glm::vec4 const& from = base[i].positionRadius;
+        float x = from.x - centre.x;
+        float z = from.z - centre.z;
+
+        current[i].positionRadius = glm::vec4(centre.x + c * x + s * z, from.y, centre.z - s * x + c * z, from.w);
+    }
+}
+
+float clusterSliceDepth(uint32_t z, float z_near, float z_far)
+{
+    return z_near * std::pow(z_far / z_near, static_cast<float>(z) / CLUSTER_Z);
+}
+
+void clusterBounds(uint32_t x, uint32_t y, uint32_t z, glm::mat4 const& inv_proj, float z_near, float z_far,
+    glm::vec3& bounds_min, glm::vec3& bounds_max)
+{
+    float depths[2] = { clusterSliceDepth(z, z_near, z_far), clusterSliceDepth(z + 1, z_near, z_far) };
+
+    bounds_min = glm::vec3(std::numeric_limits<float>::max());
+    bounds_max = glm::vec3(-std::numeric_limits<float>::max());
+
+    // walk the rays through the tile's corners out to both ends of the slice
+    for (uint32_t corner = 0; corner < 4; corner++) {
+        float ndc_x = static_cast<float>(x + (corner & 1)) / CLUSTER_X * 2.0f - 1.0f;
+        float ndc_y = static_cast<float>(y + ((corner >> 1) & 1)) / CLUSTER_Y * 2.0f - 1.0f;
+
+        glm::vec4 on_near = inv_proj * glm::vec4(ndc_x, ndc_y, 0.0f, 1.0f);
+        glm::vec3 ray = glm::vec3(on_near) / on_near.w;
+
+        for (float depth : depths) {
+            glm::vec3 point = ray * (depth / -ray.z);
+            bounds_min = glm::min(bounds_min, point);
+            bounds_max = glm::max(bounds_max, point);
+        }
+    }
+}
+
+namespace {
+    bool sphereIntersectsAabb(glm::vec4 const& sphere, glm::vec3 const& bounds_min, glm::vec3 const& bounds_max)
+    {
+        float distance = 0.0f;
+        for (int axis = 0; axis < 3; axis++) {
+            float v = sphere[axis];
+            float nearest = std::min(std::max(v, bounds_min[axis]), bounds_max[axis]);
+            distance += (v - nearest) * (v - nearest);
+        }
+        return distance <= sphere.w * sphere.w;
+    }
+}
+
+ClusterLists buildClusters(GpuLight const* lights, uint32_t light_count, glm::mat4 const& view, glm::mat4 const& proj,
+    float z_near, float z_far)
+{
+    glm::mat4 inv_proj = glm::inverse(proj);
+
+    std::vector<glm::vec4> spheres(light_count);
+    for (uint32_t i = 0; i < light_count; i++) {
+        glm::vec4 const& light = lights[i].positionRadius;
+        glm::vec4 centre = view * glm::vec4(light.x, light.y, light.z, 1.0f);
+        spheres[i] = glm::vec4(centre.x, centre.y, centre.z, light.w);
+    }
+
+    ClusterLists clusters;
+    clusters.counts.assign(CLUSTER_COUNT, 0);
+    clusters.indices.assign(static_cast<size_t>(CLUSTER_COUNT) * MAX_LIGHTS_PER_CLUSTER, 0);
+
+    for (uint32_t cluster = 0; cluster < CLUSTER_COUNT; cluster++) {
+        uint32_t x = cluster % CLUSTER_X;
+        uint32_t y = (cluster / CLUSTER_X) % CLUSTER_Y;
+        uint32_t z = cluster / (CLUSTER_X * CLUSTER_Y);
+
+        glm::vec3 bounds_min, bounds_max;
+        clusterBounds(x, y, z, inv_proj, z_near, z_far, bounds_min, bounds_max);
+
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < light_count && count < MAX_LIGHTS_PER_CLUSTER; i++) {
+            if (sphereIntersectsAabb(spheres[i], bounds_min, bounds_max)) {
+                clusters.indices[static_cast<size_t>(cluster) * MAX_LIGHTS_PER_CLUSTER + count++] = i;
+            }
+        }
+        clusters.counts[cluster] = count;
+    }
+
+    return clusters;
+}
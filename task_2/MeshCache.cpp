@@ -0,0 +1,211 @@
+#include "task_1/MeshCache.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // round an offset up so each blob starts on a 16 byte boundary
+    uint64_t alignOffset(uint64_t offset)
+    {
+        return (offset + 15) & ~uint64_t(15);
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(std::filesystem::path const& path)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        CloseHandle(file);
+        return false;
+    }
+
+    void const* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    file_handle = file;
+    mapping_handle = mapping;
+    mapped_data = view;
+    mapped_size = static_cast<size_t>(file_size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+
+    if (view == MAP_FAILED) {
+        return false;
+    }
+
+    mapped_data = view;
+    mapped_size = static_cast<size_t>(st.st_size);
+#endif
+
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (mapped_data == nullptr) {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(mapped_data);
+    CloseHandle(mapping_handle);
+    CloseHandle(file_handle);
+    mapping_handle = nullptr;
+    file_handle = nullptr;
+#else
+    munmap(const_cast<void*>(mapped_data), mapped_size);
+#endif
+
+    mapped_data = nullptr;
+    mapped_size = 0;
+}
+
+std::filesystem::path MeshCache::pathFor(std::filesystem::path const& source_path)
+{
+    std::filesystem::path cache_path = source_path;
+    cache_path += ".meshcache";
+    return cache_path;
+}
+
+bool MeshCache::write(std::filesystem::path const& cache_path,
+    uint64_t source_hash,
+    uint64_t source_size,
+    Vertex const* vertices, size_t vertex_count,
+    uint32_t const* indices, size_t index_count,
+    Material const* materials, size_t material_count,
+    glm::vec3 const& bounds_min, glm::vec3 const& bounds_max)
+{
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.headerSize = sizeof(Header);
+    header.sourceHash = source_hash;
+    header.sourceSize = source_size;
+    header.vertexStride = sizeof(Vertex);
+    header.materialCount = static_cast<uint32_t>(material_count);
+    header.vertexCount = vertex_count;
+    header.indexCount = index_count;
+    header.materialOffset = alignOffset(sizeof(Header));
+    header.vertexOffset = alignOffset(header.materialOffset + sizeof(Material) * material_count);
+    header.indexOffset = alignOffset(header.vertexOffset + sizeof(Vertex) * vertex_count);
+    for (int i = 0; i < 3; i++) {
+        header.boundsMin[i] = bounds_min[i];
+        header.boundsMax[i] = bounds_max[i];
+    }
+
+    // write to a temporary file first so a crash mid-write never leaves a
+    // truncated cache that happens to carry a valid header
+    std::filesystem::path temp_path = cache_path;
+    temp_path += ".tmp";
+
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        char const padding[16] = {};
+        auto pad_to = [&](uint64_t offset) {
+            uint64_t position = static_cast<uint64_t>(file.tellp());
+            file.write(padding, static_cast<std::streamsize>(offset - position));
+        };
+
+        file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+        pad_to(header.materialOffset);
+        file.write(reinterpret_cast<char const*>(materials), static_cast<std::streamsize>(sizeof(Material) * material_count));
+        pad_to(header.vertexOffset);
+        file.write(reinterpret_cast<char const*>(vertices), static_cast<std::streamsize>(sizeof(Vertex) * vertex_count));
+        pad_to(header.indexOffset);
+        file.write(reinterpret_cast<char const*>(indices), static_cast<std::streamsize>(sizeof(uint32_t) * index_count));
+
+        if (!file.good()) {
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_path, cache_path, error);
+    if (error) {
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+
+    return true;
+}
+
+bool MeshCache::open(std::filesystem::path const& cache_path, uint64_t source_hash, uint64_t source_size)
+{
+    if (!file.open(cache_path)) {
+        return false;
+    }
+
+    bool valid = file.size() >= sizeof(Header);
+
+    if (valid) {
+        Header const& h = header();
+        valid = std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+            h.version == VERSION &&
+            h.headerSize == sizeof(Header) &&
+            h.vertexStride == sizeof(Vertex) &&
+            h.sourceHash == source_hash &&
+            h.sourceSize == source_size &&
+            h.materialCount > 0 &&
+            h.materialOffset + sizeof(Material) * h.materialCount <= file.size() &&
+            h.vertexOffset + sizeof(Vertex) * h.vertexCount <= file.size() &&
+            h.indexOffset + sizeof(uint32_t) * h.indexCount <= file.size();
+    }
+
+    if (!valid) {
+        file.close();
+    }
+
+    return valid;
+}
@@ -0,0 +1,337 @@
+#include "task_1/MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    constexpr uint32_t NO_TRIANGLE = 0xFFFFFFFFu;
+    constexpr uint32_t NO_VERTEX = 0xFFFFFFFFu;
+
+    // the LRU cache Forsyth's scores model, larger than the simulated FIFO so vertices about
+    // to be evicted are still worth something
+    constexpr uint32_t FORSYTH_CACHE_SIZE = 32;
+    constexpr uint32_t FORSYTH_VALENCE_TABLE = 32;
+
+    struct ForsythScores {
+        float cache[FORSYTH_CACHE_SIZE];
+        float valence[FORSYTH_VALENCE_TABLE];
+
+        ForsythScores()
+        {
+            // the three vertices of the last triangle score the same, so the next one is not
+            // biased towards either of its edges
+            for (uint32_t i = 0; i < FORSYTH_CACHE_SIZE; i++) {
+                cache[i] = i < 3 ? 0.75f : std::pow(1.0f - (i - 3) / static_cast<float>(FORSYTH_CACHE_SIZE - 3), 1.5f);
+            }
+            // vertices with few triangles left are boosted so they get finished off
+            valence[0] = 0.0f;
+            for (uint32_t i = 1; i < FORSYTH_VALENCE_TABLE; i++) {
+                valence[i] = 2.0f / std::sqrt(static_cast<float>(i));
+            }
+        }
+    };
+
+    ForsythScores const& forsythScores()
+    {
+        static const ForsythScores scores;
+        return scores;
+    }
+
+    float vertexScore(int32_t cache_position, uint32_t remaining)
+    {
+        if (remaining == 0) {
+            return -1.0f;
+        }
+
+        ForsythScores const& scores = forsythScores();
+        float score = cache_position >= 0 ? scores.cache[cache_position] : 0.0f;
+        return score + (remaining < FORSYTH_VALENCE_TABLE ? scores.valence[remaining] : 2.0f / std::sqrt(static_cast<float>(remaining)));
+    }
+
+    // FIFO cache by insertion stamps. a vertex is cached while fewer than cache_size others
+    // went in after it, so starting the clock cache_size + 1 further on empties the cache
+    struct FifoCache {
+        std::vector<uint32_t> stamps;
+        uint32_t cache_size;
+        uint32_t clock;
+
+        FifoCache(size_t vertex_count, uint32_t size)
+            : stamps(vertex_count, 0), cache_size(size), clock(size + 1)
+        {
+        }
+
+        void reset() { clock += cache_size + 1; }
+
+        uint32_t triangle(uint32_t const* corner)
+        {
+            uint32_t misses = 0;
+            for (uint32_t k = 0; k < 3; k++) {
+                if (clock - stamps[corner[k]] > cache_size) {
+                    stamps[corner[k]] = clock++;
+                    misses++;
+                }
+            }
+            return misses;
+        }
+    };
+
+    struct Cluster {
+        size_t first;
+        size_t end;
+        float key;
+    };
+}
+
+VertexCacheStats analyzeVertexCache(uint32_t const* indices, size_t index_count, size_t vertex_count, uint32_t cache_size)
+{
+    FifoCache cache(vertex_count, cache_size);
+    std::vector<uint8_t> referenced(vertex_count, 0);
+
+    VertexCacheStats stats{};
+    size_t referenced_count = 0;
+    for (size_t i = 0; i + 2 < index_count; i += 3) {
+        stats.misses += cache.triangle(indices + i);
+        for (size_t k = 0; k < 3; k++) {
+            referenced_count += referenced[indices[i + k]] == 0;
+            referenced[indices[i + k]] = 1;
+        }
+    }
+
+    size_t triangle_count = index_count / 3;
+    stats.acmr = triangle_count == 0 ? 0.0f : static_cast<float>(stats.misses) / triangle_count;
+    stats.atvr = referenced_count == 0 ? 0.0f : static_cast<float>(stats.misses) / referenced_count;
+    return stats;
+}
+
+void optimizeVertexCache(uint32_t* indices, size_t index_count, size_t vertex_count)
+{
+    size_t triangle_count = index_count / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+
+    // triangles of each vertex, the first remaining[v] of them not emitted yet
+    std::vector<uint32_t> remaining(vertex_count, 0);
+    for (size_t i = 0; i < triangle_count * 3; i++) {
+        remaining[indices[i]]++;
+    }
+    std::vector<uint32_t> offsets(vertex_count + 1, 0);
+    for (size_t v = 0; v < vertex_count; v++) {
+        offsets[v + 1] = offsets[v] + remaining[v];
+    }
+    std::vector<uint32_t> adjacency(triangle_count * 3);
+    {
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < triangle_count * 3; i++) {
+            adjacency[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    std::vector<int32_t> cache_position(vertex_count, -1);
+    std::vector<float> vertex_scores(vertex_count);
+    for (size_t v = 0; v < vertex_count; v++) {
+        vertex_scores[v] = vertexScore(-1, remaining[v]);
+    }
+
+    std::vector<float> triangle_scores(triangle_count);
+    std::vector<uint8_t> emitted(triangle_count, 0);
+    uint32_t best = 0;
+    for (size_t t = 0; t < triangle_count; t++) {
+        uint32_t const* corner = indices + t * 3;
+        triangle_scores[t] = vertex_scores[corner[0]] + vertex_scores[corner[1]] + vertex_scores[corner[2]];
+        if (triangle_scores[t] > triangle_scores[best]) {
+            best = static_cast<uint32_t>(t);
+        }
+    }
+
+    // the triangle's own vertices go in at the front and push up to three others out the back
+    uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+    uint32_t next_cache[FORSYTH_CACHE_SIZE + 3];
+    size_t cache_count = 0;
+
+    std::vector<uint32_t> result(triangle_count * 3);
+    size_t input_cursor = 0;
+
+    for (size_t output = 0; output < triangle_count; output++) {
+        // nothing in the cache has triangles left, carry on with the next one in input order
+        if (best == NO_TRIANGLE) {
+            while (emitted[input_cursor]) {
+                input_cursor++;
+            }
+            best = static_cast<uint32_t>(input_cursor);
+        }
+
+        uint32_t const* corner = indices + static_cast<size_t>(best) * 3;
+        std::copy(corner, corner + 3, result.begin() + output * 3);
+        emitted[best] = 1;
+
+        size_t next_count = 0;
+        for (uint32_t k = 0; k < 3; k++) {
+            uint32_t v = corner[k];
+            if (std::find(next_cache, next_cache + next_count, v) == next_cache + next_count) {
+                next_cache[next_count++] = v;
+            }
+
+            // one entry goes per corner, so degenerate triangles come out as often as they went in
+            uint32_t* first = adjacency.data() + offsets[v];
+            uint32_t* last = first + remaining[v] - 1;
+            std::iter_swap(std::find(first, last, best), last);
+            remaining[v]--;
+        }
+        for (size_t i = 0; i < cache_count; i++) {
+            uint32_t v = cache[i];
+            if (v != corner[0] && v != corner[1] && v != corner[2]) {
+                next_cache[next_count++] = v;
+            }
+        }
+
+        // rescore everything that moved, including the vertices that just fell out
+        for (size_t i = 0; i < next_count; i++) {
+            uint32_t v = next_cache[i];
+            cache_position[v] = i < FORSYTH_CACHE_SIZE ? static_cast<int32_t>(i) : -1;
+
+            float score = vertexScore(cache_position[v], remaining[v]);
+            float delta = score - vertex_scores[v];
+            vertex_scores[v] = score;
+            for (uint32_t j = offsets[v]; j < offsets[v] + remaining[v]; j++) {
+                triangle_scores[adjacency[j]] += delta;
+            }
+        }
+
+        // only triangles touching the cache changed, so the best one is among them
+        best = NO_TRIANGLE;
+        float best_score = -1.0f;
+        cache_count = std::min<size_t>(next_count, FORSYTH_CACHE_SIZE);
+        for (size_t i = 0; i < cache_count; i++) {
+            uint32_t v = next_cache[i];
+            cache[i] = v;
+            for (uint32_t j = offsets[v]; j < offsets[v] + remaining[v]; j++) {
+                uint32_t t = adjacency[j];
+                if (triangle_scores[t] > best_score) {
+                    best_score = triangle_scores[t];
+                    best = t;
+                }
+            }
+        }
+    }
+
+    std::copy(result.begin(), result.end(), indices);
+}
+
+void optimizeOverdraw(uint32_t* indices, size_t index_count, Vertex const* vertices, size_t vertex_count, float threshold)
+{
+    size_t triangle_count = index_count / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+
+    FifoCache cache(vertex_count, VERTEX_CACHE_SIZE);
+
+    // hard boundaries where the cache order already restarts, a triangle missing all three vertices
+    std::vector<size_t> hard;
+    for (size_t t = 0; t < triangle_count; t++) {
+        if (cache.triangle(indices + t * 3) == 3 || t == 0) {
+            hard.push_back(t);
+        }
+    }
+    hard.push_back(triangle_count);
+
+    // soft boundaries split each hard cluster as soon as the running ACMR from a cold cache
+    // is within threshold of the whole cluster's, so drawing clusters in any order costs at
+    // most threshold times the misses
+    std::vector<Cluster> clusters;
+    for (size_t h = 0; h + 1 < hard.size(); h++) {
+        size_t first = hard[h];
+        size_t end = hard[h + 1];
+
+        cache.reset();
+        uint32_t cluster_misses = 0;
+        for (size_t t = first; t < end; t++) {
+            cluster_misses += cache.triangle(indices + t * 3);
+        }
+        float cluster_threshold = threshold * cluster_misses / static_cast<float>(end - first);
+
+        cache.reset();
+        size_t start = first;
+        uint32_t misses = 0;
+        for (size_t t = first; t < end; t++) {
+            misses += cache.triangle(indices + t * 3);
+            if (misses <= cluster_threshold * (t + 1 - start)) {
+                clusters.push_back({ start, t + 1, 0.0f });
+                start = t + 1;
+                misses = 0;
+                cache.reset();
+            }
+        }
+        if (start < end) {
+            clusters.push_back({ start, end, 0.0f });
+        }
+    }
+
+    // clusters facing away from the mesh centre are more likely to be in front, so they draw first
+    glm::vec3 mesh_centroid(0.0f);
+    float mesh_area = 0.0f;
+    std::vector<glm::vec3> cluster_centroids(clusters.size());
+    std::vector<glm::vec3> cluster_normals(clusters.size());
+    for (size_t c = 0; c < clusters.size(); c++) {
+        glm::vec3 centroid(0.0f);
+        glm::vec3 normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = clusters[c].first; t < clusters[c].end; t++) {
+            glm::vec3 const& a = vertices[indices[t * 3 + 0]].pos;
+            glm::vec3 const& b = vertices[indices[t * 3 + 1]].pos;
+            glm::vec3 const& p = vertices[indices[t * 3 + 2]].pos;
+            glm::vec3 cross = glm::cross(b - a, p - a);
+            float triangle_area = glm::length(cross);
+
+            centroid += (a + b + p) * (triangle_area / 3.0f);
+            normal += cross;
+            area += triangle_area;
+        }
+
+        mesh_centroid += centroid;
+        mesh_area += area;
+        cluster_centroids[c] = area > 0.0f ? centroid / area : centroid;
+        float length = glm::length(normal);
+        cluster_normals[c] = length > 0.0f ? normal / length : normal;
+    }
+    if (mesh_area > 0.0f) {
+        mesh_centroid /= mesh_area;
+    }
+
+    for (size_t c = 0; c < clusters.size(); c++) {
+        clusters[c].key = glm::dot(cluster_centroids[c] - mesh_centroid, cluster_normals[c]);
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), [](Cluster const& a, Cluster const& b) { return a.key > b.key; });
+
+    std::vector<uint32_t> result;
+    result.reserve(triangle_count * 3);
+    for (Cluster const& cluster : clusters) {
+        result.insert(result.end(), indices + cluster.first * 3, indices + cluster.end * 3);
+    }
+    std::copy(result.begin(), result.end(), indices);
+}
+
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+    std::vector<uint32_t> remap(vertices.size(), NO_VERTEX);
+    std::vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+
+    for (uint32_t& index : indices) {
+        if (remap[index] == NO_VERTEX) {
+            remap[index] = static_cast<uint32_t>(reordered.size());
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    vertices.swap(reordered);
+}
+
+void optimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+    optimizeVertexCache(indices.data(), indices.size(), vertices.size());
+    optimizeOverdraw(indices.data(), indices.size(), vertices.data(), vertices.size());
+    optimizeVertexFetch(vertices, indices);
+}
@@ -0,0 +1,230 @@
+#include "task_1/MipChain.h"
+
+#include <algorithm>
+#include <cmath>
+
+// the kernel is picked at compile time like the culling one. MSVC only defines __AVX2__
+// under /arch:AVX2 and x64 always has SSE2
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MIP_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIP_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define MIP_NEON
+#endif
+
+size_t mipChainLayout(uint32_t width, uint32_t height, std::vector<MipLevel>& levels)
+{
+    levels.clear();
+
+    size_t offset = 0;
+    while (true) {
+        MipLevel level{ width, height, offset, static_cast<size_t>(width) * height * 4 };
+        levels.push_back(level);
+        offset += level.size;
+
+        if (width == 1 && height == 1) {
+            break;
+        }
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+    }
+
+    return offset;
+}
+
+namespace {
+    // sRGB bytes to 16 bit linear and back. 16 bits keep every sRGB byte distinct in
+    // linear, so decoding and encoding again gives back the same byte
+    struct SrgbTables {
+        uint16_t decode[256];
+        uint8_t encode[65536];
+
+        SrgbTables()
+        {
+            for (uint32_t i = 0; i < 256; i++) {
+                float srgb = i / 255.0f;
+                float linear = srgb <= 0.04045f ? srgb / 12.92f : std::pow((srgb + 0.055f) / 1.055f, 2.4f);
+                decode[i] = static_cast<uint16_t>(std::lround(linear * 65535.0f));
+            }
+            for (uint32_t i = 0; i < 65536; i++) {
+                float linear = i / 65535.0f;
+                float srgb = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+                encode[i] = static_cast<uint8_t>(std::lround(std::min(std::max(srgb, 0.0f), 1.0f) * 255.0f));
+            }
+        }
+    };
+
+    SrgbTables const& srgbTables()
+    {
+        static const SrgbTables tables;
+        return tables;
+    }
+
+    // alpha is not gamma encoded, it is only widened to the same 16 bit range
+    void decodeRow(uint8_t const* src, uint16_t* dst, uint32_t pixels)
+    {
+        uint16_t const* decode = srgbTables().decode;
+        for (uint32_t i = 0; i < pixels * 4; i += 4) {
+            dst[i + 0] = decode[src[i + 0]];
+            dst[i + 1] = decode[src[i + 1]];
+            dst[i + 2] = decode[src[i + 2]];
+            dst[i + 3] = static_cast<uint16_t>(src[i + 3] * 257);
+        }
+    }
+
+    void encodeRow(uint16_t const* src, uint8_t* dst, size_t pixels)
+    {
+        uint8_t const* encode = srgbTables().encode;
+        for (size_t i = 0; i < pixels * 4; i += 4) {
+            dst[i + 0] = encode[src[i + 0]];
+            dst[i + 1] = encode[src[i + 1]];
+            dst[i + 2] = encode[src[i + 2]];
+            dst[i + 3] = static_cast<uint8_t>((src[i + 3] + 128) / 257);
+        }
+    }
+
+    // texels [first, dst_width) of a row, from rows row0 and row1 of the level above
+    void filterRowScalar(uint16_t const* row0, uint16_t const* row1, uint16_t* dst, uint32_t src_width, uint32_t dst_width, uint32_t first)
+    {
+        for (uint32_t x = first; x < dst_width; x++) {
+            uint32_t x0 = 2 * x * 4;
+            uint32_t x1 = std::min(2 * x + 1, src_width - 1) * 4;
+            for (uint32_t c = 0; c < 4; c++) {
+                uint32_t sum = row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+                dst[x * 4 + c] = static_cast<uint16_t>((sum + 2) >> 2);
+            }
+        }
+    }
+
+    void filterRowSimd(uint16_t const* row0, uint16_t const* row1, uint16_t* dst, uint32_t src_width, uint32_t dst_width)
+    {
+        // texels whose whole 2x2 footprint is inside the row, the clamped ones are left to the scalar tail
+        uint32_t full = std::min(src_width / 2, dst_width);
+        uint32_t x = 0;
+
+#if defined(MIP_AVX2)
+        __m256i two = _mm256_set1_epi32(2);
+        // each 128 bit load is two source texels, widened to 32 bits a channel
+        auto footprint = [&](uint32_t texel) {
+            __m256i top = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const*>(row0 + texel * 8)));
+            __m256i bottom = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const*>(row1 + texel * 8)));
+            return _mm256_add_epi32(top, bottom);
+        };
+        // add the left and right texel of two footprints, giving two averaged texels
+        auto average = [&](__m256i a, __m256i b) {
+            __m256i sum = _mm256_add_epi32(_mm256_permute2x128_si256(a, b, 0x20), _mm256_permute2x128_si256(a, b, 0x31));
+            return _mm256_srli_epi32(_mm256_add_epi32(sum, two), 2);
+        };
+
+        for (; x + 4 <= full; x += 4) {
+            __m256i first = average(footprint(x), footprint(x + 1));
+            __m256i second = average(footprint(x + 2), footprint(x + 3));
+            // packus interleaves the 128 bit lanes, texels come out as x, x + 2, x + 1, x + 3
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(first, second), _MM_SHUFFLE(3, 1, 2, 0));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 4), packed);
+        }
+#elif defined(MIP_SSE2)
+        __m128i zero = _mm_setzero_si128();
+        __m128i two = _mm_set1_epi32(2);
+        // sse2 only packs to signed 16 bits, so pack around the middle of the range
+        __m128i bias32 = _mm_set1_epi32(32768);
+        __m128i bias16 = _mm_set1_epi16(static_cast<short>(0x8000));
+        auto average = [&](uint32_t texel) {
+            __m128i top = _mm_loadu_si128(reinterpret_cast<__m128i const*>(row0 + texel * 8));
+            __m128i bottom = _mm_loadu_si128(reinterpret_cast<__m128i const*>(row1 + texel * 8));
+            __m128i sum = _mm_add_epi32(
+                _mm_add_epi32(_mm_unpacklo_epi16(top, zero), _mm_unpackhi_epi16(top, zero)),
+                _mm_add_epi32(_mm_unpacklo_epi16(bottom, zero), _mm_unpackhi_epi16(bottom, zero)));
+            return _mm_sub_epi32(_mm_srli_epi32(_mm_add_epi32(sum, two), 2), bias32);
+        };
+
+        for (; x + 2 <= full; x += 2) {
+            __m128i packed = _mm_xor_si128(_mm_packs_epi32(average(x), average(x + 1)), bias16);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), packed);
+        }
+#elif defined(MIP_NEON)
+        for (; x < full; x++) {
+            uint16x8_t top = vld1q_u16(row0 + x * 8);
+            uint16x8_t bottom = vld1q_u16(row1 + x * 8);
+            uint32x4_t sum = vaddq_u32(vaddl_u16(vget_low_u16(top), vget_high_u16(top)),
+                vaddl_u16(vget_low_u16(bottom), vget_high_u16(bottom)));
+            // rounding shift, (sum + 2) >> 2
+            vst1_u16(dst + x * 4, vmovn_u32(vrshrq_n_u32(sum, 2)));
+        }
+#endif
+
+        filterRowScalar(row0, row1, dst, src_width, dst_width, x);
+    }
+
+    template<typename Filter>
+    void generate(uint8_t* chain, std::vector<MipLevel> const& levels, Filter filter)
+    {
+        if (levels.size() < 2) {
+            return;
+        }
+
+        // level 0 is decoded two rows at a time, every later level is filtered from the
+        // linear copy of the one above. odd levels live in one buffer, even ones in the other
+        MipLevel const& top = levels[0];
+        std::vector<uint16_t> rows(static_cast<size_t>(top.width) * 4 * 2);
+        std::vector<uint16_t> linear[2];
+        linear[1].resize(levels[1].size);
+        if (levels.size() > 2) {
+            linear[0].resize(levels[2].size);
+        }
+
+        for (size_t i = 1; i < levels.size(); i++) {
+            MipLevel const& above = levels[i - 1];
+            MipLevel const& level = levels[i];
+            uint16_t* dst = linear[i & 1].data();
+            uint16_t const* src = linear[(i - 1) & 1].data();
+
+            for (uint32_t y = 0; y < level.height; y++) {
+                size_t y0 = 2 * static_cast<size_t>(y);
+                size_t y1 = std::min<size_t>(y0 + 1, above.height - 1);
+                uint16_t* row = dst + static_cast<size_t>(y) * level.width * 4;
+
+                if (i == 1) {
+                    uint8_t const* pixels = chain + above.offset;
+                    decodeRow(pixels + y0 * above.width * 4, rows.data(), above.width);
+                    decodeRow(pixels + y1 * above.width * 4, rows.data() + above.width * 4, above.width);
+                    filter(rows.data(), rows.data() + above.width * 4, row, above.width, level.width);
+                }
+                else {
+                    filter(src + y0 * above.width * 4, src + y1 * above.width * 4, row, above.width, level.width);
+                }
+            }
+
+            encodeRow(dst, chain + level.offset, static_cast<size_t>(level.width) * level.height);
+        }
+    }
+}
+
+void generateMipChain(uint8_t* chain, std::vector<MipLevel> const& levels)
+{
+    generate(chain, levels, filterRowSimd);
+}
+
+void generateMipChainScalar(uint8_t* chain, std::vector<MipLevel> const& levels)
+{
+    generate(chain, levels, [](uint16_t const* row0, uint16_t const* row1, uint16_t* dst, uint32_t src_width, uint32_t dst_width) {
+        filterRowScalar(row0, row1, dst, src_width, dst_width, 0);
+    });
+}
+
+char const* mipChainKernel()
+{
+#if defined(MIP_AVX2)
+    return "avx2";
+#elif defined(MIP_SSE2)
+    return "sse2";
+#elif defined(MIP_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
@@ -2,7 +2,6 @@
 
 #include <filesystem>
 #include <iostream>
-#include <unordered_map>
 #include <glm/glm.hpp>
 
 #ifndef TINYOBJLOADER_IMPLEMENTATION
@@ -11,8 +10,56 @@
 #endif
 
 #include "task_1/Vertex.h"
+#include "task_1/HelperFunctions.h"
+#include "task_1/MeshOptimizer.h"
+#include "task_1/VertexDeduplication.h"
+
+void Model::applyMaterial(MeshCache::Material const& material)
+{
+    Ns = material.Ns;
+    Ni = material.Ni;
+    d = material.d;
+    Tr = material.Tr;
+    Tf = glm::vec3(material.Tf[0], material.Tf[1], material.Tf[2]);
+    illum = material.illum;
+    Ka = glm::vec3(material.Ka[0], material.Ka[1], material.Ka[2]);
+    Kd = glm::vec3(material.Kd[0], material.Kd[1], material.Kd[2]);
+    Ks = glm::vec3(material.Ks[0], material.Ks[1], material.Ks[2]);
+    Ke = glm::vec3(material.Ke[0], material.Ke[1], material.Ke[2]);
+}
+
+void Model::loadModel(std::filesystem::path const & model_path, ThreadPool* pool) {	
+    if (!std::filesystem::exists(model_path)) {
+        std::cerr << "Model: could not find " << model_path.generic_string() << std::endl;
+        exit(1);
+    }
+
+    // hash the source so an edited OBJ never loads a stale cache
+    uint64_t source_size = 0;
+    uint64_t source_hash = hashFile(model_path.generic_string(), source_size);
+    std::filesystem::path cache_path = MeshCache::pathFor(model_path);
+
+    // fast path, map the cache and use it in place
+    std::shared_ptr<MeshCache> mesh_cache = std::make_shared<MeshCache>();
+    if (mesh_cache->open(cache_path, source_hash, source_size)) {
+        MeshCache::Header const& header = mesh_cache->header();
+
+        cache = mesh_cache;
+        vertices = std::vector<Vertex>{};
+        indices = std::vector<uint32_t>{};
+
+        boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+        boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+
+        // the last shape's material wins, as it does when parsing
+        applyMaterial(mesh_cache->materials()[header.materialCount - 1]);
+        return;
+    }
+
+    cache.reset();
+    vertices.clear();
+    indices.clear();
 
-void Model::loadModel(std::filesystem::path const & model_path) {	
     tinyobj::ObjReaderConfig reader_config;
     //reader_config.mtl_search_path = "..\\assets"; // Path to material files
 
@@ -33,83 +80,143 @@ void Model::loadModel(std::filesystem::path const & model_path) {
     auto& shapes = reader.GetShapes();
     auto& materials = reader.GetMaterials();
 
-    std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+    // flatten every shape's index stream so vertices are shared across shapes,
+    // exactly as the single map over all shapes used to do
+    std::vector<tinyobj::index_t> corners;
+    {
+        size_t corner_count = 0;
+        for (const auto& shape : shapes) {
+            corner_count += shape.mesh.indices.size();
+        }
 
-    for (const auto& shape : shapes) {
-        for (const auto& index : shape.mesh.indices) {
-            Vertex vertex{};
+        corners.reserve(corner_count);
+        for (const auto& shape : shapes) {
+            corners.insert(corners.end(), shape.mesh.indices.begin(), shape.mesh.indices.end());
+        }
+    }
+
+    auto fetch = [&](size_t corner) {
+        tinyobj::index_t const& index = corners[corner];
+        Vertex vertex{};
 
-            vertex.pos = {
-                attrib.vertices[3 * index.vertex_index + 0] * 1.0,
-                attrib.vertices[3 * index.vertex_index + 1] * 1.0,
-                attrib.vertices[3 * index.vertex_index + 2] * 1.0
+        vertex.pos = {
+            attrib.vertices[3 * index.vertex_index + 0] * 1.0,
+            attrib.vertices[3 * index.vertex_index + 1] * 1.0,
+            attrib.vertices[3 * index.vertex_index + 2] * 1.0
+        };
+
+        if (index.texcoord_index >= 0)
+        {
+            vertex.texCoord = {
+            attrib.texcoords[2 * index.texcoord_index + 0],
+            1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
             };
 
-            if (index.texcoord_index >= 0)
-            {
-                vertex.texCoord = {
-                attrib.texcoords[2 * index.texcoord_index + 0],
-                1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-                };
+        }
+        else
+        {
+            vertex.texCoord = { 0, 0 };
+        }
 
-            }
-            else
-            {
-                vertex.texCoord = { 0, 0 };
-            }
+        vertex.color = { 1.0f, 1.0f, 1.0f };
 
-            vertex.color = { 1.0f, 1.0f, 1.0f };
 
+        vertex.norm = {
+            attrib.normals[3 * index.normal_index + 0],
+            attrib.normals[3 * index.normal_index + 1],
+            attrib.normals[3 * index.normal_index + 2]
+        };
 
-            vertex.norm = {
-                attrib.normals[3 * index.normal_index + 0],
-                attrib.normals[3 * index.normal_index + 1],
-                attrib.normals[3 * index.normal_index + 2]
-            };
+        vertex.norm = glm::normalize(vertex.norm);
 
-            vertex.norm = glm::normalize(vertex.norm);
+        return vertex;
+    };
 
-            if (uniqueVertices.count(vertex) == 0) {
-                uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-                vertices.push_back(vertex);
-            }
+    // fetching and deduplicating vertices dominates load time on large scans, so
+    // spread it over a thread pool. the result matches the serial path byte for byte
+    std::unique_ptr<ThreadPool> local_pool;
+    if (pool == nullptr) {
+        local_pool = std::make_unique<ThreadPool>();
+        pool = local_pool.get();
+    }
 
-            indices.push_back(uniqueVertices[vertex]);
-        }
+    deduplicateVerticesParallel(corners.size(), fetch, *pool, vertices, indices);
+    corners = std::vector<tinyobj::index_t>{};
+
+    // OBJ face order is poor for the post-transform cache. reordered before the cache is
+    // written, so a cache hit gets the optimised order for free
+    optimizeMesh(vertices, indices);
+
+    std::vector<MeshCache::Material> shapeMaterials;
+
+    for (const auto& shape : shapes) {
+        MeshCache::Material material{};
 
         if (!materials.empty())
         {
-            Ns = materials[shape.mesh.material_ids[0]].shininess;
-            Ni = 1.0f;
-            d = materials[shape.mesh.material_ids[0]].dissolve;
-            Tr = 1.0f - d;
-            Tf = glm::vec3(1.0f, 1.0f, 1.0f);
-            illum = materials[shape.mesh.material_ids[0]].illum;
-            Ka = glm::vec3(materials[shape.mesh.material_ids[0]].ambient[0],
-                materials[shape.mesh.material_ids[0]].ambient[1],
-                materials[shape.mesh.material_ids[0]].ambient[2]);
-            Kd = glm::vec3(materials[shape.mesh.material_ids[0]].diffuse[0],
-                materials[shape.mesh.material_ids[0]].diffuse[1],
-                materials[shape.mesh.material_ids[0]].diffuse[2]);
-            Ks = glm::vec3(materials[shape.mesh.material_ids[0]].specular[0],
-                materials[shape.mesh.material_ids[0]].specular[1],
-                materials[shape.mesh.material_ids[0]].specular[2]);
-            Ke = glm::vec3(materials[shape.mesh.material_ids[0]].emission[0],
-                materials[shape.mesh.material_ids[0]].emission[1],
-                materials[shape.mesh.material_ids[0]].emission[2]);
+            tinyobj::material_t const& source = materials[shape.mesh.material_ids[0]];
+
+            material.Ns = source.shininess;
+            material.Ni = 1.0f;
+            material.d = source.dissolve;
+            material.Tr = 1.0f - material.d;
+            material.illum = source.illum;
+            for (int i = 0; i < 3; i++) {
+                material.Tf[i] = 1.0f;
+                material.Ka[i] = source.ambient[i];
+                material.Kd[i] = source.diffuse[i];
+                material.Ks[i] = source.specular[i];
+                material.Ke[i] = source.emission[i];
+            }
         }
         else
         {
-            Ns = 0.0;
-            Ni = 1.0f;
-            d = 0.0;
-            Tr = 1.0f - d;
-            Tf = glm::vec3(1.0f, 1.0f, 1.0f);
-            illum = 0.0;
-            Ka = glm::vec3(0.2, 0.2, 0.2);
-            Kd = glm::vec3(0.7, 0.7, 0.7);
-            Ks = glm::vec3(0.2, 0.2, 0.2);
-            Ke = glm::vec3(0.0, 0.0, 0.0);
+            material.Ns = 0.0;
+            material.Ni = 1.0f;
+            material.d = 0.0;
+            material.Tr = 1.0f - material.d;
+            material.illum = 0.0;
+            for (int i = 0; i < 3; i++) {
+                material.Tf[i] = 1.0f;
+                material.Ka[i] = 0.2f;
+                material.Kd[i] = 0.7f;
+                material.Ks[i] = 0.2f;
+                material.Ke[i] = 0.0f;
+            }
+        }
+
+        shapeMaterials.push_back(material);
+    }
+
+    if (shapeMaterials.empty()) {
+        // keep the defaults for an empty file so the cache always has one entry
+        MeshCache::Material material{};
+        material.Ni = 1.0f;
+        material.Tr = 1.0f;
+        for (int i = 0; i < 3; i++) {
+            material.Tf[i] = 1.0f;
+            material.Ka[i] = 0.2f;
+            material.Kd[i] = 0.7f;
+            material.Ks[i] = 0.2f;
         }
+        shapeMaterials.push_back(material);
+    }
+
+    applyMaterial(shapeMaterials.back());
+
+    boundsMin = vertices.empty() ? glm::vec3(0.0f) : vertices[0].pos;
+    boundsMax = boundsMin;
+    for (const auto& vertex : vertices) {
+        boundsMin = glm::min(boundsMin, vertex.pos);
+        boundsMax = glm::max(boundsMax, vertex.pos);
+    }
+
+    // failing to write the cache only costs us the next startup, so just warn
+    if (!MeshCache::write(cache_path, source_hash, source_size,
+        vertices.data(), vertices.size(),
+        indices.data(), indices.size(),
+        shapeMaterials.data(), shapeMaterials.size(),
+        boundsMin, boundsMax)) {
+        std::cerr << "Model: could not write mesh cache " << cache_path.generic_string() << std::endl;
     }
 }
\ No newline at end of file
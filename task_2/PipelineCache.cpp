@@ -0,0 +1,170 @@
+#include "task_1/PipelineCache.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    // 64 bit FNV-1a, same as hashFile but over memory
+    uint64_t hashBytes(uint8_t const* data, size_t size)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; i++) {
+            hash ^= data[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+}
+
+void PipelineCache::init(VkPhysicalDevice physical_device, VkDevice device, std::filesystem::path const& path)
+{
+    this->device = device;
+    this->path = path;
+
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+    loaded = false;
+    cold_create_ms = std::numeric_limits<float>::quiet_NaN();
+
+    std::vector<uint8_t> data;
+
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (file.is_open()) {
+        size_t file_size = static_cast<size_t>(file.tellg());
+        file.seekg(0);
+
+        Header header{};
+        bool valid = file_size >= sizeof(Header) &&
+            file.read(reinterpret_cast<char*>(&header), sizeof(header)).good();
+
+        valid = valid &&
+            std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+            header.version == VERSION &&
+            header.headerSize == sizeof(Header) &&
+            header.vendorID == properties.vendorID &&
+            header.deviceID == properties.deviceID &&
+            header.driverVersion == properties.driverVersion &&
+            std::memcmp(header.uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0 &&
+            header.dataSize == file_size - sizeof(Header);
+
+        if (valid) {
+            data.resize(static_cast<size_t>(header.dataSize));
+            valid = file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size())).good() &&
+                hashBytes(data.data(), data.size()) == header.dataHash;
+        }
+
+        if (valid) {
+            loaded = true;
+            cold_create_ms = header.coldCreateMs;
+        }
+        else {
+            data.clear();
+            std::cout << "pipeline cache " << path.generic_string() << " is stale, rebuilding" << std::endl;
+        }
+    }
+
+    VkPipelineCacheCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+    if (vkCreatePipelineCache(device, &createInfo, nullptr, &cache) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline cache!");
+    }
+}
+
+void PipelineCache::recordCreateTime(float ms)
+{
+    create_ms = ms;
+
+    // the first cold measurement becomes the baseline stored with the cache
+    if (!loaded && std::isnan(cold_create_ms)) {
+        cold_create_ms = ms;
+    }
+}
+
+std::string PipelineCache::summary() const
+{
+    char line[128];
+    if (!loaded) {
+        snprintf(line, sizeof(line), "pipeline creation %.2f ms (cold)", create_ms);
+    }
+    else if (std::isnan(cold_create_ms)) {
+        snprintf(line, sizeof(line), "pipeline creation %.2f ms (warm)", create_ms);
+    }
+    else {
+        snprintf(line, sizeof(line), "pipeline creation %.2f ms (warm, cold %.2f ms, %.2f ms saved)", create_ms, cold_create_ms, cold_create_ms - create_ms);
+    }
+    return line;
+}
+
+bool PipelineCache::save()
+{
+    if (cache == VK_NULL_HANDLE) {
+        return false;
+    }
+
+    size_t data_size = 0;
+    if (vkGetPipelineCacheData(device, cache, &data_size, nullptr) != VK_SUCCESS) {
+        return false;
+    }
+
+    std::vector<uint8_t> data(data_size);
+    if (vkGetPipelineCacheData(device, cache, &data_size, data.data()) != VK_SUCCESS) {
+        return false;
+    }
+    data.resize(data_size);
+
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.headerSize = sizeof(Header);
+    header.vendorID = properties.vendorID;
+    header.deviceID = properties.deviceID;
+    header.driverVersion = properties.driverVersion;
+    std::memcpy(header.uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+    header.dataSize = data.size();
+    header.dataHash = hashBytes(data.data(), data.size());
+    header.coldCreateMs = cold_create_ms;
+
+    // same temporary file dance as the mesh cache, never leave a half written blob
+    std::filesystem::path temp_path = path;
+    temp_path += ".tmp";
+
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+        file.write(reinterpret_cast<char const*>(data.data()), static_cast<std::streamsize>(data.size()));
+
+        if (!file.good()) {
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_path, path, error);
+    if (error) {
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+
+    return true;
+}
+
+void PipelineCache::destroy()
+{
+    if (cache != VK_NULL_HANDLE) {
+        vkDestroyPipelineCache(device, cache, nullptr);
+        cache = VK_NULL_HANDLE;
+    }
+}
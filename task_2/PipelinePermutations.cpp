@@ -0,0 +1,104 @@
+#include "task_1/PipelinePermutations.h"
+
+#include <chrono>
+#include <vector>
+
+void PipelinePermutations::init(VkDevice device, ThreadPool& pool, Builder builder)
+{
+    this->device = device;
+    this->pool = &pool;
+    this->builder = std::move(builder);
+}
+
+void PipelinePermutations::destroy()
+{
+    std::vector<std::shared_future<void>> running;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto const& entry : pending) {
+            running.push_back(entry.second);
+        }
+    }
+
+    // the builds take the mutex when they finish. a failed one has nothing to destroy
+    for (std::shared_future<void> const& build : running) {
+        build.wait();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto const& entry : ready) {
+        vkDestroyPipeline(device, entry.second, nullptr);
+    }
+    ready.clear();
+    pending.clear();
+    current = VK_NULL_HANDLE;
+}
+
+std::shared_future<void> PipelinePermutations::queue(uint32_t key)
+{
+    std::shared_future<void> build = pool->submit([this, key]() {
+        VkPipeline pipeline = builder(key);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        ready[key] = pipeline;
+    }).share();
+
+    pending[key] = build;
+    return build;
+}
+
+VkPipeline PipelinePermutations::get(uint32_t key)
+{
+    std::shared_future<void> build;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = ready.find(key);
+        if (found != ready.end()) {
+            current = found->second;
+            return current;
+        }
+
+        auto running = pending.find(key);
+        build = running != pending.end() ? running->second : queue(key);
+    }
+
+    // rethrows what the builder threw
+    build.get();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    current = ready.at(key);
+    return current;
+}
+
+VkPipeline PipelinePermutations::select(uint32_t key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = ready.find(key);
+    if (found != ready.end()) {
+        current = found->second;
+        return current;
+    }
+
+    auto running = pending.find(key);
+    if (running == pending.end()) {
+        queue(key);
+    }
+    // done without becoming ready, so the builder threw
+    else if (running->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        running->second.get();
+    }
+
+    return current;
+}
+
+size_t PipelinePermutations::readyCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return ready.size();
+}
+
+size_t PipelinePermutations::pendingCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending.size() - ready.size();
+}
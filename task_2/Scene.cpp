@@ -0,0 +1,182 @@
+#include "task_1/Scene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+uint32_t Scene::addMesh(Model const& model)
+{
+    Mesh mesh{};
+    mesh.model = &model;
+    mesh.firstIndex = static_cast<uint32_t>(index_count);
+    mesh.indexCount = static_cast<uint32_t>(model.getIndexCount());
+    mesh.vertexOffset = static_cast<int32_t>(vertex_count);
+    mesh.vertexCount = static_cast<uint32_t>(model.getVertexCount());
+    mesh.boundsMin = model.boundsMin;
+    mesh.boundsMax = model.boundsMax;
+
+    vertex_count += mesh.vertexCount;
+    index_count += mesh.indexCount;
+
+    mesh_list.push_back(mesh);
+    return static_cast<uint32_t>(mesh_list.size() - 1);
+}
+
+void Scene::addInstance(uint32_t mesh, glm::mat4 const& transform, uint32_t material, uint32_t flags)
+{
+    if (mesh >= mesh_list.size()) {
+        throw std::runtime_error("instance of unknown mesh!");
+    }
+
+    InstanceData instance{};
+    instance.model = transform;
+    instance.materialId = material;
+    instance.flags = flags;
+    instance.mesh = mesh;
+
+    instance_list.push_back(instance);
+    instance_mesh.push_back(mesh);
+}
+
+void Scene::addInstanceGrid(uint32_t mesh, uint32_t count, float extent, uint32_t dynamic_count)
+{
+    if (count == 0) {
+        return;
+    }
+
+    uint32_t side = static_cast<uint32_t>(std::ceil(std::cbrt(static_cast<double>(count))));
+    // cbrt of a perfect cube can come out just above the integer
+    if ((side - 1) * (side - 1) * (side - 1) >= count) {
+        side--;
+    }
+
+    glm::vec3 bounds_min = mesh_list[mesh].boundsMin;
+    glm::vec3 bounds_max = mesh_list[mesh].boundsMax;
+    glm::vec3 bounds_size = bounds_max - bounds_min;
+    glm::vec3 bounds_centre = (bounds_min + bounds_max) * 0.5f;
+
+    float cell = 2.0f * extent / side;
+    float largest = std::max(bounds_size.x, std::max(bounds_size.y, bounds_size.z));
+    // leave a gap between neighbours
+    float scale = largest > 0.0f ? 0.8f * cell / largest : 1.0f;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t x = i % side;
+        uint32_t y = (i / side) % side;
+        uint32_t z = i / (side * side);
+
+        glm::vec3 centre = glm::vec3(-extent) + (glm::vec3(static_cast<float>(x), static_cast<float>(y), static_cast<float>(z)) + 0.5f) * cell;
+
+        glm::mat4 transform = glm::translate(glm::mat4(1.0f), centre);
+        transform = glm::scale(transform, glm::vec3(scale));
+        transform = glm::translate(transform, -bounds_centre);
+
+        // cycle through the 10 bit material ids so the material view shows the instances apart
+        addInstance(mesh, transform, 1 + i % 1023, i + dynamic_count >= count ? INSTANCE_DYNAMIC : 0u);
+    }
+}
+
+void Scene::build(uint32_t max_batch_instances)
+{
+    auto dynamic = [&](uint32_t i) { return (instance_list[i].flags & INSTANCE_DYNAMIC) != 0; };
+
+    // stable so instances of a mesh keep the order they were added in
+    std::vector<uint32_t> order(instance_list.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        if (dynamic(a) != dynamic(b)) {
+            return dynamic(b);
+        }
+        return instance_mesh[a] < instance_mesh[b];
+    });
+
+    std::vector<InstanceData> sorted(instance_list.size());
+    std::vector<uint32_t> sorted_mesh(instance_list.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        sorted[i] = instance_list[order[i]];
+        sorted_mesh[i] = instance_mesh[order[i]];
+    }
+    instance_list.swap(sorted);
+    instance_mesh.swap(sorted_mesh);
+
+    batch_list.clear();
+    dynamic_count = 0;
+    for (uint32_t i = 0; i < instance_mesh.size(); i++) {
+        bool is_dynamic = dynamic(i);
+        if (batch_list.empty() || batch_list.back().mesh != instance_mesh[i] || batch_list.back().dynamic != is_dynamic
+            || batch_list.back().instanceCount >= max_batch_instances) {
+            batch_list.push_back({ instance_mesh[i], i, 0, is_dynamic });
+        }
+        batch_list.back().instanceCount++;
+        instance_list[i].batch = static_cast<uint32_t>(batch_list.size() - 1);
+        dynamic_count += is_dynamic ? 1 : 0;
+    }
+}
+
+void Scene::clear()
+{
+    mesh_list.clear();
+    instance_list.clear();
+    instance_mesh.clear();
+    batch_list.clear();
+    vertex_count = 0;
+    index_count = 0;
+    dynamic_count = 0;
+}
+
+void Scene::bounds(glm::vec3& bounds_min, glm::vec3& bounds_max) const
+{
+    bounds_min = glm::vec3(std::numeric_limits<float>::max());
+    bounds_max = glm::vec3(-std::numeric_limits<float>::max());
+
+    for (InstanceData const& instance : instance_list) {
+        Mesh const& mesh = mesh_list[batch_list[instance.batch].mesh];
+
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec4 local((corner & 1) ? mesh.boundsMax.x : mesh.boundsMin.x,
+                (corner & 2) ? mesh.boundsMax.y : mesh.boundsMin.y,
+                (corner & 4) ? mesh.boundsMax.z : mesh.boundsMin.z, 1.0f);
+            glm::vec3 world = glm::vec3(instance.model * local);
+
+            bounds_min = glm::min(bounds_min, world);
+            bounds_max = glm::max(bounds_max, world);
+        }
+    }
+}
+
+std::vector<MeshQuantization> Scene::quantizeMeshes(VertexLayout layout) const
+{
+    std::vector<MeshQuantization> quantization;
+    quantization.reserve(mesh_list.size());
+    for (Mesh const& mesh : mesh_list) {
+        quantization.push_back(quantizeMesh(layout, mesh.model->getVertexData(), mesh.vertexCount));
+    }
+    return quantization;
+}
+
+void Scene::writeVertices(VertexLayout layout, std::vector<MeshQuantization> const& quantization, void* positions, void* attributes) const
+{
+    size_t position_stride = vertexStreamStride(layout, VERTEX_STREAM_POSITION);
+    size_t attribute_stride = vertexStreamStride(layout, VERTEX_STREAM_ATTRIBUTES);
+
+    for (size_t i = 0; i < mesh_list.size(); i++) {
+        Mesh const& mesh = mesh_list[i];
+        size_t first = static_cast<size_t>(mesh.vertexOffset);
+        packVertices(layout, quantization[i], mesh.model->getVertexData(), mesh.vertexCount,
+            static_cast<uint8_t*>(positions) + first * position_stride,
+            attributes ? static_cast<uint8_t*>(attributes) + first * attribute_stride : nullptr);
+    }
+}
+
+void Scene::writeIndices(uint32_t* destination) const
+{
+    // indices stay mesh relative, vertexOffset of the draw rebases them
+    for (Mesh const& mesh : mesh_list) {
+        std::memcpy(destination + mesh.firstIndex, mesh.model->getIndexData(), sizeof(uint32_t) * mesh.indexCount);
+    }
+}
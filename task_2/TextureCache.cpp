@@ -0,0 +1,179 @@
+#include "task_1/TextureCache.h"
+#include "task_1/TextureCompression.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace {
+    // KTX2 wants level data aligned to the block size, 16 covers BC1, BC7 and RGBA8
+    uint64_t alignOffset(uint64_t offset)
+    {
+        return (offset + 15) & ~uint64_t(15);
+    }
+
+    // a key/value entry is its length, the key with its terminator and the value
+    constexpr uint32_t KEY_VALUE_LENGTH = sizeof(TextureCache::KEY) + sizeof(TextureCache::CacheKey);
+}
+
+std::filesystem::path TextureCache::pathFor(std::filesystem::path const& source_path)
+{
+    std::filesystem::path cache_path = source_path;
+    cache_path += ".ktx2";
+    return cache_path;
+}
+
+size_t TextureCache::levelSize(VkFormat format, uint32_t width, uint32_t height)
+{
+    switch (format) {
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        return compressedLevelSize(BlockFormat::BC1, width, height);
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+        return compressedLevelSize(BlockFormat::BC7, width, height);
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        return static_cast<size_t>(width) * height * 4;
+    default:
+        return 0;
+    }
+}
+
+bool TextureCache::write(std::filesystem::path const& cache_path,
+    uint64_t source_hash,
+    uint64_t source_size,
+    VkFormat format,
+    std::vector<MipLevel> const& levels,
+    uint8_t const* data)
+{
+    Header header{};
+    std::memcpy(header.identifier, IDENTIFIER, sizeof(IDENTIFIER));
+    header.vkFormat = static_cast<uint32_t>(format);
+    header.typeSize = 1;
+    header.pixelWidth = levels[0].width;
+    header.pixelHeight = levels[0].height;
+    header.faceCount = 1;
+    header.levelCount = static_cast<uint32_t>(levels.size());
+    header.kvdByteOffset = static_cast<uint32_t>(sizeof(Header) + sizeof(LevelIndex) * levels.size());
+    header.kvdByteLength = static_cast<uint32_t>(sizeof(uint32_t) + KEY_VALUE_LENGTH);
+
+    CacheKey key{};
+    key.version = VERSION;
+    key.sourceHash = source_hash;
+    key.sourceSize = source_size;
+
+    // KTX2 stores the smallest level first
+    std::vector<LevelIndex> index(levels.size());
+    uint64_t offset = header.kvdByteOffset + header.kvdByteLength;
+    for (size_t i = levels.size(); i-- > 0;) {
+        offset = alignOffset(offset);
+        index[i].byteOffset = offset;
+        index[i].byteLength = levels[i].size;
+        index[i].uncompressedByteLength = levels[i].size;
+        offset += levels[i].size;
+    }
+
+    // write to a temporary file first so a crash mid-write never leaves a
+    // truncated cache that happens to carry a valid header
+    std::filesystem::path temp_path = cache_path;
+    temp_path += ".tmp";
+
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        char const padding[16] = {};
+        auto pad_to = [&](uint64_t offset) {
+            uint64_t position = static_cast<uint64_t>(file.tellp());
+            file.write(padding, static_cast<std::streamsize>(offset - position));
+        };
+
+        file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+        file.write(reinterpret_cast<char const*>(index.data()), static_cast<std::streamsize>(sizeof(LevelIndex) * index.size()));
+        file.write(reinterpret_cast<char const*>(&KEY_VALUE_LENGTH), sizeof(KEY_VALUE_LENGTH));
+        file.write(KEY, sizeof(KEY));
+        file.write(reinterpret_cast<char const*>(&key), sizeof(key));
+        for (size_t i = levels.size(); i-- > 0;) {
+            pad_to(index[i].byteOffset);
+            file.write(reinterpret_cast<char const*>(data + levels[i].offset), static_cast<std::streamsize>(levels[i].size));
+        }
+
+        if (!file.good()) {
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_path, cache_path, error);
+    if (error) {
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+
+    return true;
+}
+
+bool TextureCache::open(std::filesystem::path const& cache_path, uint64_t source_hash, uint64_t source_size)
+{
+    if (!file.open(cache_path)) {
+        return false;
+    }
+
+    bool valid = file.size() >= sizeof(Header);
+
+    if (valid) {
+        Header const& h = header();
+        valid = std::memcmp(h.identifier, IDENTIFIER, sizeof(IDENTIFIER)) == 0 &&
+            h.pixelWidth > 0 && h.pixelHeight > 0 &&
+            h.levelCount > 0 && h.levelCount <= 32 &&
+            h.supercompressionScheme == 0 &&
+            h.kvdByteOffset == sizeof(Header) + sizeof(LevelIndex) * h.levelCount &&
+            h.kvdByteLength >= sizeof(uint32_t) + KEY_VALUE_LENGTH &&
+            uint64_t(h.kvdByteOffset) + h.kvdByteLength <= file.size();
+    }
+
+    if (valid) {
+        // the entry is written first, so it is the only place to look
+        Header const& h = header();
+        uint8_t const* entry = data() + h.kvdByteOffset;
+        uint32_t length;
+        CacheKey key;
+        std::memcpy(&length, entry, sizeof(length));
+        std::memcpy(&key, entry + sizeof(length) + sizeof(KEY), sizeof(key));
+        valid = length == KEY_VALUE_LENGTH &&
+            std::memcmp(entry + sizeof(length), KEY, sizeof(KEY)) == 0 &&
+            key.version == VERSION &&
+            key.sourceHash == source_hash &&
+            key.sourceSize == source_size;
+    }
+
+    if (valid) {
+        Header const& h = header();
+        for (uint32_t i = 0; i < h.levelCount && valid; i++) {
+            LevelIndex const& level = levelIndex()[i];
+            size_t expected = levelSize(format(), std::max(h.pixelWidth >> i, 1u), std::max(h.pixelHeight >> i, 1u));
+            valid = expected != 0 &&
+                level.byteLength == expected &&
+                level.byteOffset + level.byteLength <= file.size();
+        }
+    }
+
+    if (!valid) {
+        file.close();
+    }
+
+    return valid;
+}
+
+std::vector<MipLevel> TextureCache::levels() const
+{
+    Header const& h = header();
+    std::vector<MipLevel> levels(h.levelCount);
+    for (uint32_t i = 0; i < h.levelCount; i++) {
+        levels[i].width = std::max(h.pixelWidth >> i, 1u);
+        levels[i].height = std::max(h.pixelHeight >> i, 1u);
+        levels[i].offset = static_cast<size_t>(levelIndex()[i].byteOffset);
+        levels[i].size = static_cast<size_t>(levelIndex()[i].byteLength);
+    }
+    return levels;
+}
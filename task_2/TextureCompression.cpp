@@ -0,0 +1,498 @@
+#include "task_1/TextureCompression.h"
+#include "task_1/ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+    // BC7 4 bit index weights, out of 64
+    constexpr int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+    // how far each BC1 index lies from colour0 towards colour1
+    constexpr float BC1_WEIGHTS[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+    struct BitWriter {
+        uint8_t* bytes;
+        uint32_t position = 0;
+
+        void write(uint32_t value, uint32_t count)
+        {
+            for (uint32_t i = 0; i < count; i++, position++) {
+                bytes[position >> 3] |= static_cast<uint8_t>(((value >> i) & 1) << (position & 7));
+            }
+        }
+    };
+
+    struct BitReader {
+        uint8_t const* bytes;
+        uint32_t position = 0;
+
+        uint32_t read(uint32_t count)
+        {
+            uint32_t value = 0;
+            for (uint32_t i = 0; i < count; i++, position++) {
+                value |= static_cast<uint32_t>((bytes[position >> 3] >> (position & 7)) & 1) << i;
+            }
+            return value;
+        }
+    };
+
+    // mean and principal axis of the 16 texels, the axis by power iteration on their covariance.
+    // the axis is left at zero for a flat block
+    template<int C>
+    void principalAxis(int const (&texels)[16][C], float (&mean)[C], float (&axis)[C])
+    {
+        for (int c = 0; c < C; c++) {
+            mean[c] = 0.0f;
+            for (int i = 0; i < 16; i++) {
+                mean[c] += static_cast<float>(texels[i][c]);
+            }
+            mean[c] /= 16.0f;
+        }
+
+        float covariance[C][C] = {};
+        for (int i = 0; i < 16; i++) {
+            for (int a = 0; a < C; a++) {
+                float da = texels[i][a] - mean[a];
+                for (int b = 0; b < C; b++) {
+                    covariance[a][b] += da * (texels[i][b] - mean[b]);
+                }
+            }
+        }
+
+        // start from the channel that varies most, the iteration then only has to turn it
+        int widest = 0;
+        for (int c = 1; c < C; c++) {
+            if (covariance[c][c] > covariance[widest][widest]) {
+                widest = c;
+            }
+        }
+        for (int c = 0; c < C; c++) {
+            axis[c] = covariance[widest][c];
+        }
+
+        for (int iteration = 0; iteration < 8; iteration++) {
+            float next[C] = {};
+            float largest = 0.0f;
+            for (int a = 0; a < C; a++) {
+                for (int b = 0; b < C; b++) {
+                    next[a] += covariance[a][b] * axis[b];
+                }
+                largest = std::max(largest, std::abs(next[a]));
+            }
+            if (largest == 0.0f) {
+                std::fill(axis, axis + C, 0.0f);
+                return;
+            }
+            for (int c = 0; c < C; c++) {
+                axis[c] = next[c] / largest;
+            }
+        }
+    }
+
+    // the two ends of the texels' spread along the axis, e0 at the far end
+    template<int C>
+    void axisEndpoints(int const (&texels)[16][C], float const (&mean)[C], float const (&axis)[C], float (&e0)[C], float (&e1)[C])
+    {
+        float length = 0.0f;
+        for (int c = 0; c < C; c++) {
+            length += axis[c] * axis[c];
+        }
+
+        float lo = 0.0f;
+        float hi = 0.0f;
+        if (length > 0.0f) {
+            lo = std::numeric_limits<float>::max();
+            hi = std::numeric_limits<float>::lowest();
+            for (int i = 0; i < 16; i++) {
+                float t = 0.0f;
+                for (int c = 0; c < C; c++) {
+                    t += (texels[i][c] - mean[c]) * axis[c];
+                }
+                lo = std::min(lo, t);
+                hi = std::max(hi, t);
+            }
+            lo /= length;
+            hi /= length;
+        }
+
+        for (int c = 0; c < C; c++) {
+            e0[c] = std::clamp(mean[c] + axis[c] * hi, 0.0f, 255.0f);
+            e1[c] = std::clamp(mean[c] + axis[c] * lo, 0.0f, 255.0f);
+        }
+    }
+
+    // nearest palette entry for every texel. returns the summed squared error
+    template<int C, int N>
+    int chooseIndices(int const (&texels)[16][C], int const (&palette)[N][C], uint8_t (&indices)[16])
+    {
+        int total = 0;
+        for (int i = 0; i < 16; i++) {
+            int best = std::numeric_limits<int>::max();
+            for (int p = 0; p < N; p++) {
+                int error = 0;
+                for (int c = 0; c < C; c++) {
+                    int d = texels[i][c] - palette[p][c];
+                    error += d * d;
+                }
+                if (error < best) {
+                    best = error;
+                    indices[i] = static_cast<uint8_t>(p);
+                }
+            }
+            total += best;
+        }
+        return total;
+    }
+
+    // endpoints that best fit the texels for fixed indices, each index weights[index] of the way
+    // from e0 to e1. returns false when every texel uses the same weight
+    template<int C>
+    bool leastSquares(int const (&texels)[16][C], uint8_t const (&indices)[16], float const* weights, float (&e0)[C], float (&e1)[C])
+    {
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float ax[C] = {}, bx[C] = {};
+        for (int i = 0; i < 16; i++) {
+            float b = weights[indices[i]];
+            float a = 1.0f - b;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for (int c = 0; c < C; c++) {
+                ax[c] += a * texels[i][c];
+                bx[c] += b * texels[i][c];
+            }
+        }
+
+        float determinant = aa * bb - ab * ab;
+        if (std::abs(determinant) < 1e-6f) {
+            return false;
+        }
+
+        for (int c = 0; c < C; c++) {
+            e0[c] = std::clamp((bb * ax[c] - ab * bx[c]) / determinant, 0.0f, 255.0f);
+            e1[c] = std::clamp((aa * bx[c] - ab * ax[c]) / determinant, 0.0f, 255.0f);
+        }
+        return true;
+    }
+
+    uint16_t packRgb565(float const (&color)[3])
+    {
+        uint32_t r = static_cast<uint32_t>(color[0] * 31.0f / 255.0f + 0.5f);
+        uint32_t g = static_cast<uint32_t>(color[1] * 63.0f / 255.0f + 0.5f);
+        uint32_t b = static_cast<uint32_t>(color[2] * 31.0f / 255.0f + 0.5f);
+        return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+    }
+
+    void unpackRgb565(uint16_t packed, int (&color)[3])
+    {
+        int r = (packed >> 11) & 31;
+        int g = (packed >> 5) & 63;
+        int b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    // the palette as the decoder builds it. colour0 > colour1 selects four colours, otherwise
+    // the third is the midpoint and the fourth transparent black
+    void bc1Palette(uint16_t color0, uint16_t color1, int (&palette)[4][4])
+    {
+        int c0[3], c1[3];
+        unpackRgb565(color0, c0);
+        unpackRgb565(color1, c1);
+        bool four = color0 > color1;
+
+        for (int c = 0; c < 3; c++) {
+            palette[0][c] = c0[c];
+            palette[1][c] = c1[c];
+            palette[2][c] = four ? (2 * c0[c] + c1[c]) / 3 : (c0[c] + c1[c]) / 2;
+            palette[3][c] = four ? (c0[c] + 2 * c1[c]) / 3 : 0;
+        }
+        palette[0][3] = palette[1][3] = palette[2][3] = 255;
+        palette[3][3] = four ? 255 : 0;
+    }
+
+    void bc7Palette(int const (&endpoint0)[4], int const (&endpoint1)[4], int (&palette)[16][4])
+    {
+        for (int p = 0; p < 16; p++) {
+            for (int c = 0; c < 4; c++) {
+                palette[p][c] = ((64 - BC7_WEIGHTS[p]) * endpoint0[c] + BC7_WEIGHTS[p] * endpoint1[c] + 32) >> 6;
+            }
+        }
+    }
+
+    // a mode 6 endpoint is 7 bits a channel plus one p bit shared by all four as the lowest bit.
+    // picks the p bit that lands closest. endpoint gets the 8 bit values the decoder sees
+    void quantizeBC7Endpoint(float const (&e)[4], int (&quantized)[4], int& p_bit, int (&endpoint)[4])
+    {
+        float best = std::numeric_limits<float>::max();
+        for (int p = 0; p < 2; p++) {
+            int candidate[4];
+            float error = 0.0f;
+            for (int c = 0; c < 4; c++) {
+                candidate[c] = std::clamp(static_cast<int>(std::floor((e[c] - p) / 2.0f + 0.5f)), 0, 127);
+                float d = static_cast<float>((candidate[c] << 1) | p) - e[c];
+                error += d * d;
+            }
+            if (error < best) {
+                best = error;
+                p_bit = p;
+                std::copy(candidate, candidate + 4, quantized);
+            }
+        }
+        for (int c = 0; c < 4; c++) {
+            endpoint[c] = (quantized[c] << 1) | p_bit;
+        }
+    }
+}
+
+size_t blockBytes(BlockFormat format)
+{
+    return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+size_t compressedLevelSize(BlockFormat format, uint32_t width, uint32_t height)
+{
+    return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+void encodeBC1Block(uint8_t const texels[64], uint8_t block[8])
+{
+    int colors[16][3];
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            colors[i][c] = texels[i * 4 + c];
+        }
+    }
+
+    float mean[3], axis[3], e0[3], e1[3];
+    principalAxis(colors, mean, axis);
+    axisEndpoints(colors, mean, axis, e0, e1);
+
+    uint16_t best0 = 0, best1 = 0;
+    uint8_t best_indices[16] = {};
+    int best_error = std::numeric_limits<int>::max();
+
+    for (int iteration = 0; iteration < 3; iteration++) {
+        uint16_t color0 = packRgb565(e0);
+        uint16_t color1 = packRgb565(e1);
+        // keep to the four colour mode, the order is fixed up below
+        if (color0 < color1) {
+            std::swap(color0, color1);
+            std::swap(e0, e1);
+        }
+
+        int palette[4][4];
+        bc1Palette(color0, color1, palette);
+        int opaque[4][3];
+        for (int p = 0; p < 4; p++) {
+            std::copy(palette[p], palette[p] + 3, opaque[p]);
+        }
+
+        uint8_t indices[16];
+        int error = chooseIndices(colors, opaque, indices);
+        if (error < best_error) {
+            best_error = error;
+            best0 = color0;
+            best1 = color1;
+            std::copy(indices, indices + 16, best_indices);
+        }
+
+        if (error == 0 || !leastSquares(colors, indices, BC1_WEIGHTS, e0, e1)) {
+            break;
+        }
+    }
+
+    uint32_t index_bits = 0;
+    for (int i = 0; i < 16; i++) {
+        index_bits |= static_cast<uint32_t>(best_indices[i]) << (i * 2);
+    }
+
+    block[0] = static_cast<uint8_t>(best0);
+    block[1] = static_cast<uint8_t>(best0 >> 8);
+    block[2] = static_cast<uint8_t>(best1);
+    block[3] = static_cast<uint8_t>(best1 >> 8);
+    for (int i = 0; i < 4; i++) {
+        block[4 + i] = static_cast<uint8_t>(index_bits >> (i * 8));
+    }
+}
+
+void encodeBC7Block(uint8_t const texels[64], uint8_t block[16])
+{
+    int colors[16][4];
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 4; c++) {
+            colors[i][c] = texels[i * 4 + c];
+        }
+    }
+
+    float mean[4], axis[4], e0[4], e1[4];
+    principalAxis(colors, mean, axis);
+    axisEndpoints(colors, mean, axis, e0, e1);
+
+    float weights[16];
+    for (int p = 0; p < 16; p++) {
+        weights[p] = BC7_WEIGHTS[p] / 64.0f;
+    }
+
+    int best_quantized[2][4] = {};
+    int best_p[2] = {};
+    uint8_t best_indices[16] = {};
+    int best_error = std::numeric_limits<int>::max();
+
+    for (int iteration = 0; iteration < 3; iteration++) {
+        int quantized[2][4], p[2], endpoint[2][4];
+        quantizeBC7Endpoint(e0, quantized[0], p[0], endpoint[0]);
+        quantizeBC7Endpoint(e1, quantized[1], p[1], endpoint[1]);
+
+        int palette[16][4];
+        bc7Palette(endpoint[0], endpoint[1], palette);
+
+        uint8_t indices[16];
+        int error = chooseIndices(colors, palette, indices);
+        if (error < best_error) {
+            best_error = error;
+            std::memcpy(best_quantized, quantized, sizeof(quantized));
+            std::copy(p, p + 2, best_p);
+            std::copy(indices, indices + 16, best_indices);
+        }
+
+        if (error == 0 || !leastSquares(colors, indices, weights, e0, e1)) {
+            break;
+        }
+    }
+
+    // the first index is stored without its top bit, so it has to be in the lower half
+    if (best_indices[0] >= 8) {
+        std::swap(best_quantized[0], best_quantized[1]);
+        std::swap(best_p[0], best_p[1]);
+        for (uint8_t& index : best_indices) {
+            index = static_cast<uint8_t>(15 - index);
+        }
+    }
+
+    std::memset(block, 0, 16);
+    BitWriter bits{ block };
+    bits.write(1u << 6, 7);
+    for (int c = 0; c < 4; c++) {
+        bits.write(best_quantized[0][c], 7);
+        bits.write(best_quantized[1][c], 7);
+    }
+    bits.write(best_p[0], 1);
+    bits.write(best_p[1], 1);
+    bits.write(best_indices[0], 3);
+    for (int i = 1; i < 16; i++) {
+        bits.write(best_indices[i], 4);
+    }
+}
+
+void decodeBC1Block(uint8_t const block[8], uint8_t texels[64])
+{
+    uint16_t color0 = static_cast<uint16_t>(block[0] | (block[1] << 8));
+    uint16_t color1 = static_cast<uint16_t>(block[2] | (block[3] << 8));
+    int palette[4][4];
+    bc1Palette(color0, color1, palette);
+
+    for (int i = 0; i < 16; i++) {
+        int index = (block[4 + i / 4] >> ((i % 4) * 2)) & 3;
+        for (int c = 0; c < 4; c++) {
+            texels[i * 4 + c] = static_cast<uint8_t>(palette[index][c]);
+        }
+    }
+}
+
+void decodeBC7Block(uint8_t const block[16], uint8_t texels[64])
+{
+    BitReader bits{ block };
+    if (bits.read(7) != (1u << 6)) {
+        // not mode 6, decode as the error colour
+        for (int i = 0; i < 16; i++) {
+            texels[i * 4 + 0] = 255;
+            texels[i * 4 + 1] = 0;
+            texels[i * 4 + 2] = 255;
+            texels[i * 4 + 3] = 255;
+        }
+        return;
+    }
+
+    int quantized[2][4];
+    for (int c = 0; c < 4; c++) {
+        quantized[0][c] = static_cast<int>(bits.read(7));
+        quantized[1][c] = static_cast<int>(bits.read(7));
+    }
+    int p0 = static_cast<int>(bits.read(1));
+    int p1 = static_cast<int>(bits.read(1));
+
+    int endpoint0[4], endpoint1[4];
+    for (int c = 0; c < 4; c++) {
+        endpoint0[c] = (quantized[0][c] << 1) | p0;
+        endpoint1[c] = (quantized[1][c] << 1) | p1;
+    }
+    int palette[16][4];
+    bc7Palette(endpoint0, endpoint1, palette);
+
+    for (int i = 0; i < 16; i++) {
+        uint32_t index = bits.read(i == 0 ? 3 : 4);
+        for (int c = 0; c < 4; c++) {
+            texels[i * 4 + c] = static_cast<uint8_t>(palette[index][c]);
+        }
+    }
+}
+
+std::vector<uint8_t> compressMipChain(BlockFormat format, uint8_t const* chain, std::vector<MipLevel> const& levels,
+    std::vector<MipLevel>& compressed_levels, ThreadPool* pool)
+{
+    compressed_levels.clear();
+    size_t offset = 0;
+    for (MipLevel const& level : levels) {
+        size_t size = compressedLevelSize(format, level.width, level.height);
+        compressed_levels.push_back({ level.width, level.height, offset, size });
+        offset += size;
+    }
+
+    std::vector<uint8_t> compressed(offset);
+    size_t block_size = blockBytes(format);
+
+    for (size_t i = 0; i < levels.size(); i++) {
+        MipLevel const& level = levels[i];
+        uint8_t const* pixels = chain + level.offset;
+        uint8_t* blocks = compressed.data() + compressed_levels[i].offset;
+        uint32_t blocks_x = (level.width + 3) / 4;
+        uint32_t blocks_y = (level.height + 3) / 4;
+
+        // blocks past the right or bottom edge repeat the last column or row
+        auto encodeRows = [&](size_t begin, size_t end) {
+            uint8_t texels[64];
+            for (size_t by = begin; by < end; by++) {
+                for (uint32_t bx = 0; bx < blocks_x; bx++) {
+                    for (uint32_t y = 0; y < 4; y++) {
+                        size_t sy = std::min<size_t>(by * 4 + y, level.height - 1);
+                        for (uint32_t x = 0; x < 4; x++) {
+                            size_t sx = std::min<size_t>(bx * 4 + x, level.width - 1);
+                            std::memcpy(texels + (y * 4 + x) * 4, pixels + (sy * level.width + sx) * 4, 4);
+                        }
+                    }
+
+                    uint8_t* block = blocks + (by * blocks_x + bx) * block_size;
+                    if (format == BlockFormat::BC1) {
+                        encodeBC1Block(texels, block);
+                    }
+                    else {
+                        encodeBC7Block(texels, block);
+                    }
+                }
+            }
+        };
+
+        if (pool != nullptr && blocks_y > 1) {
+            pool->parallelFor(blocks_y, std::max<size_t>(blocks_y / (pool->size() * 4), 1), encodeRows);
+        }
+        else {
+            encodeRows(0, blocks_y);
+        }
+    }
+
+    return compressed;
+}
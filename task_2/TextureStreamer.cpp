@@ -0,0 +1,252 @@
+#include "task_1/TextureStreamer.h"
+#include "task_1/TextureCompression.h"
+#include "task_1/HelperFunctions.h"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+void TextureStreamer::init(UploadManager& upload_manager, std::vector<VkFormat> const& sampled_formats, size_t threads)
+{
+    uploads = &upload_manager;
+    formats = sampled_formats;
+    if (threads == 0) {
+        threads = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+    }
+    workers = std::make_unique<ThreadPool>(threads);
+
+    bytes_streamed = 0;
+    frames_streaming = 0;
+}
+
+void TextureStreamer::destroy()
+{
+    // joins the workers, a conversion that failed has nothing left to report to
+    workers.reset();
+    textures.clear();
+}
+
+VkFormat TextureStreamer::chooseFormat(bool alpha) const
+{
+    for (VkFormat format : formats) {
+        if (!alpha || format != VK_FORMAT_BC1_RGB_SRGB_BLOCK) {
+            return format;
+        }
+    }
+    return VK_FORMAT_R8G8B8A8_SRGB;
+}
+
+uint32_t TextureStreamer::request(std::string const& path, Info& info)
+{
+    auto texture = std::make_unique<Texture>();
+    texture->path = path;
+    texture->requested = Clock::now();
+    // hash the source so an edited image never loads a stale cache
+    texture->sourceHash = hashFile(path, texture->sourceSize);
+
+    TextureCache& cache = texture->cache;
+    if (cache.open(TextureCache::pathFor(path), texture->sourceHash, texture->sourceSize) &&
+        std::find(formats.begin(), formats.end(), cache.format()) != formats.end()) {
+        // the levels stream straight from the mapping, there is nothing to convert
+        TextureCache::Header const& header = cache.header();
+        texture->info = { cache.format(), header.pixelWidth, header.pixelHeight, header.levelCount };
+        texture->levels = cache.levels();
+        texture->data = cache.data();
+        texture->cached = true;
+
+        std::promise<void> done;
+        done.set_value();
+        texture->conversion = done.get_future();
+    }
+    else {
+        // a cache in a format the device cannot sample is rebuilt
+        cache.close();
+
+        int width, height, channels;
+        if (!stbi_info(path.c_str(), &width, &height, &channels)) {
+            throw std::runtime_error("failed to load texture image!");
+        }
+
+        std::vector<MipLevel> layout;
+        mipChainLayout(static_cast<uint32_t>(width), static_cast<uint32_t>(height), layout);
+        bool alpha = channels == 2 || channels == 4;
+        texture->info = { chooseFormat(alpha), static_cast<uint32_t>(width), static_cast<uint32_t>(height), static_cast<uint32_t>(layout.size()) };
+
+        Texture* target = texture.get();
+        texture->conversion = workers->submit([this, target]() { convert(*target); });
+    }
+
+    texture->resident = texture->info.levelCount;
+    info = texture->info;
+    textures.push_back(std::move(texture));
+    return static_cast<uint32_t>(textures.size() - 1);
+}
+
+void TextureStreamer::attach(uint32_t texture, VkImage image)
+{
+    textures[texture]->image = image;
+}
+
+// runs on a worker. the other workers are converting textures of their own, so the blocks are
+// compressed on this thread alone rather than nesting a parallelFor in the same pool
+void TextureStreamer::convert(Texture& texture)
+{
+    int width, height, channels;
+    stbi_uc* pixels = stbi_load(texture.path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+
+    if (!pixels) {
+        throw std::runtime_error("failed to load texture image!");
+    }
+
+    std::vector<MipLevel> levels;
+    std::vector<uint8_t> chain(mipChainLayout(static_cast<uint32_t>(width), static_cast<uint32_t>(height), levels));
+    memcpy(chain.data(), pixels, levels[0].size);
+    stbi_image_free(pixels);
+
+    if (levels[0].width != texture.info.width || levels[0].height != texture.info.height) {
+        throw std::runtime_error("texture changed size while loading: " + texture.path + "!");
+    }
+
+    generateMipChain(chain.data(), levels);
+
+    if (texture.info.format == VK_FORMAT_R8G8B8A8_SRGB) {
+        texture.converted = std::move(chain);
+        texture.levels = levels;
+    }
+    else {
+        BlockFormat block_format = texture.info.format == VK_FORMAT_BC1_RGB_SRGB_BLOCK ? BlockFormat::BC1 : BlockFormat::BC7;
+        texture.converted = compressMipChain(block_format, chain.data(), levels, texture.levels);
+    }
+    texture.data = texture.converted.data();
+
+    // a read only asset directory only costs the conversion again next launch
+    std::filesystem::path cache_path = TextureCache::pathFor(texture.path);
+    if (!TextureCache::write(cache_path, texture.sourceHash, texture.sourceSize, texture.info.format, texture.levels, texture.data)) {
+        std::cerr << "could not write texture cache " << cache_path.generic_string() << std::endl;
+    }
+}
+
+VkDeviceSize TextureStreamer::update()
+{
+    VkDeviceSize staged = 0;
+    bool full = false;
+
+    for (size_t i = 0; i < textures.size() && !full; i++) {
+        Texture& texture = *textures[i];
+        if (texture.image == VK_NULL_HANDLE || texture.resident == 0) {
+            continue;
+        }
+
+        if (!texture.ready) {
+            if (texture.conversion.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                continue;
+            }
+            // rethrows whatever the conversion threw
+            texture.conversion.get();
+            texture.ready = true;
+
+            // tallied for summary, a line per texture would flood the log with hundreds of them
+            double ready_ms = std::chrono::duration<double, std::milli>(Clock::now() - texture.requested).count();
+            textures_ready++;
+            textures_cached += texture.cached ? 1 : 0;
+            ready_ms_total += ready_ms;
+            ready_ms_max = std::max(ready_ms_max, ready_ms);
+        }
+
+        // smallest first, so a view from the resident level down is always complete. the levels
+        // that fit this frame go up as one copy
+        uint32_t first = texture.resident;
+        while (first > 0) {
+            size_t size = texture.levels[first - 1].size;
+            if (staged > 0 && staged + size > budget) {
+                full = true;
+                break;
+            }
+            staged += size;
+            first--;
+        }
+
+        if (first < texture.resident) {
+            stageLevels(texture, first, texture.resident - first);
+            texture.resident = first;
+        }
+
+        if (texture.resident == 0) {
+            texture.cache.close();
+            texture.converted = std::vector<uint8_t>();
+            texture.data = nullptr;
+        }
+    }
+
+    if (staged > 0) {
+        uploads->flush();
+        bytes_streamed += staged;
+        frames_streaming++;
+    }
+
+    return staged;
+}
+
+void TextureStreamer::stageLevels(Texture& texture, uint32_t first, uint32_t count)
+{
+    VkImageSubresourceRange range{};
+    range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    range.baseMipLevel = first;
+    range.levelCount = count;
+    range.baseArrayLayer = 0;
+    range.layerCount = 1;
+
+    // packed back to back. level sizes are whole blocks or texels, so each stays aligned for the copy
+    std::vector<VkBufferImageCopy> regions(count);
+    VkDeviceSize size = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        MipLevel const& level = texture.levels[first + i];
+        VkBufferImageCopy& region = regions[i];
+        region.bufferOffset = size;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = first + i;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = { 0, 0, 0 };
+        region.imageExtent = { level.width, level.height, 1 };
+        size += level.size;
+    }
+
+    uint8_t* staged = static_cast<uint8_t*>(uploads->stageImage(texture.image, range, regions.data(), count, size,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+    for (uint32_t i = 0; i < count; i++) {
+        MipLevel const& level = texture.levels[first + i];
+        memcpy(staged + regions[i].bufferOffset, texture.data + level.offset, level.size);
+    }
+}
+
+bool TextureStreamer::complete() const
+{
+    for (auto const& texture : textures) {
+        if (texture->resident > 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string TextureStreamer::summary() const
+{
+    size_t streaming = 0;
+    for (auto const& texture : textures) {
+        streaming += texture->resident > 0 ? 1 : 0;
+    }
+
+    char line[256];
+    snprintf(line, sizeof(line), "textures: %zu of %zu streaming, %.1f MB in %llu frames, budget %.1f MB a frame, "
+        "%zu ready (%zu from the cache) after %.1f ms on average, %.1f ms at most",
+        streaming, textures.size(), bytes_streamed / (1024.0 * 1024.0), static_cast<unsigned long long>(frames_streaming),
+        budget / (1024.0 * 1024.0), textures_ready, textures_cached, textures_ready > 0 ? ready_ms_total / textures_ready : 0.0,
+        ready_ms_max);
+    return line;
+}
@@ -0,0 +1,47 @@
+#include "task_1/ThreadPool.h"
+
+ThreadPool::ThreadPool(size_t thread_count)
+{
+    // hardware_concurrency is allowed to report 0 when it doesn't know
+    thread_count = std::max<size_t>(thread_count, 1);
+
+    workers.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; i++) {
+        workers.emplace_back([this]() { workerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+
+    // workers drain the queue before exiting, so no future is left dangling
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::workerLoop()
+{
+    for (;;) {
+        std::function<void()> task;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+            if (tasks.empty()) {
+                return;
+            }
+
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+
+        task();
+    }
+}
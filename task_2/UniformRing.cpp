@@ -0,0 +1,35 @@
+#include "task_1/UniformRing.h"
+
+#include <stdexcept>
+
+void UniformRing::init(VkBuffer buffer, void* mapped_data, VkDeviceSize size_per_frame, uint32_t frames, VkDeviceSize offset_alignment)
+{
+    ring_buffer = buffer;
+    mapped = static_cast<char*>(mapped_data);
+    frame_size = size_per_frame;
+    frame_count = frames;
+    alignment = offset_alignment > 0 ? offset_alignment : 1;
+
+    frame_begin = 0;
+    cursor = 0;
+}
+
+void UniformRing::beginFrame(uint32_t frame)
+{
+    frame_begin = frame_size * (frame % frame_count);
+    cursor = frame_begin;
+}
+
+uint32_t UniformRing::allocate(VkDeviceSize size, void** data)
+{
+    // minUniformBufferOffsetAlignment is a power of two
+    VkDeviceSize offset = (cursor + alignment - 1) & ~(alignment - 1);
+    if (offset + size > frame_begin + frame_size) {
+        throw std::runtime_error("uniform ring ran out of space for this frame!");
+    }
+
+    cursor = offset + size;
+    *data = mapped + offset;
+
+    return static_cast<uint32_t>(offset);
+}
@@ -0,0 +1,444 @@
+#include "task_1/UploadManager.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+void UploadManager::init(VkPhysicalDevice physical_device, VkDevice device, DeviceMemoryAllocator& allocator,
+    uint32_t graphics_family, VkQueue graphics_queue, uint32_t transfer_family, VkQueue transfer_queue, VkDeviceSize ring_size)
+{
+    this->device = device;
+    this->allocator = &allocator;
+    this->graphics_family = graphics_family;
+    this->graphics_queue = graphics_queue;
+    this->transfer_family = transfer_family;
+    this->transfer_queue = transfer_queue;
+    this->ring_size = ring_size;
+
+    // 16 covers the texel block size of every format uploaded, compressed ones included
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    alignment = std::max<VkDeviceSize>(16, properties.limits.optimalBufferCopyOffsetAlignment);
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    // a command buffer per batch, freed when it finishes
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    poolInfo.queueFamilyIndex = transfer_family;
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &transfer_pool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create upload command pool!");
+    }
+
+    if (dedicatedTransfer()) {
+        poolInfo.queueFamilyIndex = graphics_family;
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &graphics_pool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upload command pool!");
+        }
+    }
+
+    ring = createStagingBuffer(ring_size);
+    ring_head = ring_tail = ring_used = 0;
+
+    bytes_uploaded = copy_count = batch_count = stall_count = 0;
+}
+
+void UploadManager::destroy()
+{
+    if (device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    flush();
+    while (!in_flight.empty()) {
+        retireOldest();
+    }
+
+    destroyStagingBuffer(ring);
+    vkDestroyCommandPool(device, transfer_pool, nullptr);
+    if (graphics_pool != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(device, graphics_pool, nullptr);
+    }
+    transfer_pool = graphics_pool = VK_NULL_HANDLE;
+    device = VK_NULL_HANDLE;
+}
+
+UploadManager::StagingBuffer UploadManager::createStagingBuffer(VkDeviceSize size)
+{
+    StagingBuffer staging;
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(device, &bufferInfo, nullptr, &staging.buffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create staging buffer!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, staging.buffer, &memRequirements);
+
+    // host visible memory comes back already mapped
+    staging.memory = allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, ResourceKind::Linear);
+    vkBindBufferMemory(device, staging.buffer, staging.memory.memory, staging.memory.offset);
+
+    return staging;
+}
+
+void UploadManager::destroyStagingBuffer(StagingBuffer& staging)
+{
+    vkDestroyBuffer(device, staging.buffer, nullptr);
+    allocator->free(staging.memory);
+    staging.buffer = VK_NULL_HANDLE;
+}
+
+UploadManager::Batch& UploadManager::recording()
+{
+    if (has_current) {
+        return current;
+    }
+
+    current = Batch{};
+    current.id = next_batch++;
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = transfer_pool;
+    allocInfo.commandBufferCount = 1;
+
+    if (vkAllocateCommandBuffers(device, &allocInfo, &current.transferCommands) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate upload command buffer!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(current.transferCommands, &beginInfo);
+
+    has_current = true;
+    return current;
+}
+
+bool UploadManager::reserveRing(VkDeviceSize size, VkDeviceSize& offset)
+{
+    auto align = [&](VkDeviceSize value) { return (value + alignment - 1) / alignment * alignment; };
+
+    VkDeviceSize start;
+    // bytes taken from the free space, padding and a skipped tail included
+    VkDeviceSize consumed;
+
+    if (ring_used == 0) {
+        ring_head = ring_tail = 0;
+        start = 0;
+        consumed = size;
+    }
+    else if (ring_head > ring_tail) {
+        // free space after the head, then before the tail
+        start = align(ring_head);
+        if (start + size <= ring_size) {
+            consumed = start + size - ring_head;
+        }
+        else if (size <= ring_tail) {
+            start = 0;
+            consumed = ring_size - ring_head + size;
+        }
+        else {
+            return false;
+        }
+    }
+    else {
+        // wrapped, free space between the head and the tail. full if they meet
+        start = align(ring_head);
+        if (start + size > ring_tail) {
+            return false;
+        }
+        consumed = start + size - ring_head;
+    }
+
+    ring_head = start + size;
+    ring_used += consumed;
+
+    Batch& batch = recording();
+    batch.ringBytes += consumed;
+    batch.ringEnd = ring_head;
+
+    offset = start;
+    return true;
+}
+
+void* UploadManager::reserve(VkDeviceSize size, VkBuffer& buffer, VkDeviceSize& offset)
+{
+    if (size > ring_size) {
+        StagingBuffer staging = createStagingBuffer(size);
+        recording().oversized.push_back(staging);
+
+        buffer = staging.buffer;
+        offset = 0;
+        return staging.memory.mapped;
+    }
+
+    while (!reserveRing(size, offset)) {
+        // the ring is full of batches the GPU has not finished, the one being staged included
+        if (has_current && current.ringBytes > 0) {
+            flush();
+        }
+        if (in_flight.empty()) {
+            throw std::runtime_error("upload staging ring is full with nothing in flight!");
+        }
+        stall_count++;
+        retireOldest();
+    }
+
+    buffer = ring.buffer;
+    return static_cast<char*>(ring.memory.mapped) + offset;
+}
+
+void* UploadManager::stageBuffer(VkBuffer dst, VkDeviceSize size, VkDeviceSize dst_offset)
+{
+    VkBuffer src;
+    VkDeviceSize src_offset;
+    void* data = reserve(size, src, src_offset);
+
+    Batch& batch = recording();
+
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = src_offset;
+    copyRegion.dstOffset = dst_offset;
+    copyRegion.size = size;
+    vkCmdCopyBuffer(batch.transferCommands, src, dst, 1, &copyRegion);
+
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.buffer = dst;
+    barrier.offset = dst_offset;
+    barrier.size = size;
+    batch.bufferBarriers.push_back(barrier);
+
+    bytes_uploaded += size;
+    copy_count++;
+    return data;
+}
+
+void* UploadManager::stageImage(VkImage image, VkImageSubresourceRange const& range, VkBufferImageCopy const* regions, uint32_t region_count,
+    VkDeviceSize size, VkImageLayout final_layout)
+{
+    VkBuffer src;
+    VkDeviceSize src_offset;
+    void* data = reserve(size, src, src_offset);
+
+    Batch& batch = recording();
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = range;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(batch.transferCommands, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        0, nullptr, 0, nullptr, 1, &barrier);
+
+    // whole subresources only, so any transfer queue granularity is met
+    std::vector<VkBufferImageCopy> copies(regions, regions + region_count);
+    for (VkBufferImageCopy& copy : copies) {
+        copy.bufferOffset += src_offset;
+    }
+    vkCmdCopyBufferToImage(batch.transferCommands, src, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, region_count, copies.data());
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = final_layout;
+    batch.imageBarriers.push_back(barrier);
+
+    bytes_uploaded += size;
+    copy_count++;
+    return data;
+}
+
+// the barriers making a batch's copies visible to the graphics queue. with a dedicated transfer
+// queue the release half runs on the transfer queue, the acquire half on the graphics queue after
+// the semaphore, and both carry the same layout change. otherwise one barrier does it all
+void UploadManager::recordBarriers(VkCommandBuffer commands, Batch& batch, bool release)
+{
+    if (batch.bufferBarriers.empty() && batch.imageBarriers.empty()) {
+        return;
+    }
+
+    bool transfer = dedicatedTransfer();
+    uint32_t src_family = transfer ? transfer_family : VK_QUEUE_FAMILY_IGNORED;
+    uint32_t dst_family = transfer ? graphics_family : VK_QUEUE_FAMILY_IGNORED;
+    // the acquire's source access is covered by the semaphore, the release has no destination access
+    VkAccessFlags src_access = transfer && !release ? 0 : VK_ACCESS_TRANSFER_WRITE_BIT;
+    VkAccessFlags dst_access = transfer && release ? 0 : VK_ACCESS_MEMORY_READ_BIT;
+
+    for (VkBufferMemoryBarrier& barrier : batch.bufferBarriers) {
+        barrier.srcQueueFamilyIndex = src_family;
+        barrier.dstQueueFamilyIndex = dst_family;
+        barrier.srcAccessMask = src_access;
+        barrier.dstAccessMask = dst_access;
+    }
+    for (VkImageMemoryBarrier& barrier : batch.imageBarriers) {
+        barrier.srcQueueFamilyIndex = src_family;
+        barrier.dstQueueFamilyIndex = dst_family;
+        barrier.srcAccessMask = src_access;
+        barrier.dstAccessMask = dst_access;
+    }
+
+    VkPipelineStageFlags src_stage = transfer && !release ? VK_PIPELINE_STAGE_ALL_COMMANDS_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT;
+    VkPipelineStageFlags dst_stage = transfer && release ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+    vkCmdPipelineBarrier(commands, src_stage, dst_stage, 0, 0, nullptr,
+        static_cast<uint32_t>(batch.bufferBarriers.size()), batch.bufferBarriers.data(),
+        static_cast<uint32_t>(batch.imageBarriers.size()), batch.imageBarriers.data());
+}
+
+uint64_t UploadManager::flush()
+{
+    if (!has_current) {
+        return last_submitted;
+    }
+
+    Batch& batch = current;
+    recordBarriers(batch.transferCommands, batch, true);
+    if (vkEndCommandBuffer(batch.transferCommands) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record upload command buffer!");
+    }
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vkCreateFence(device, &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create upload fence!");
+    }
+
+    VkSubmitInfo transferSubmit{};
+    transferSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    transferSubmit.commandBufferCount = 1;
+    transferSubmit.pCommandBuffers = &batch.transferCommands;
+
+    if (!dedicatedTransfer()) {
+        if (vkQueueSubmit(transfer_queue, 1, &transferSubmit, batch.fence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit upload batch!");
+        }
+    }
+    else {
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &batch.transferDone) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upload semaphore!");
+        }
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = graphics_pool;
+        allocInfo.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(device, &allocInfo, &batch.acquireCommands) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate upload command buffer!");
+        }
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(batch.acquireCommands, &beginInfo);
+        recordBarriers(batch.acquireCommands, batch, false);
+        if (vkEndCommandBuffer(batch.acquireCommands) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record upload command buffer!");
+        }
+
+        transferSubmit.signalSemaphoreCount = 1;
+        transferSubmit.pSignalSemaphores = &batch.transferDone;
+
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        VkSubmitInfo acquireSubmit{};
+        acquireSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        acquireSubmit.waitSemaphoreCount = 1;
+        acquireSubmit.pWaitSemaphores = &batch.transferDone;
+        acquireSubmit.pWaitDstStageMask = &waitStage;
+        acquireSubmit.commandBufferCount = 1;
+        acquireSubmit.pCommandBuffers = &batch.acquireCommands;
+
+        if (vkQueueSubmit(transfer_queue, 1, &transferSubmit, VK_NULL_HANDLE) != VK_SUCCESS ||
+            vkQueueSubmit(graphics_queue, 1, &acquireSubmit, batch.fence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit upload batch!");
+        }
+    }
+
+    last_submitted = batch.id;
+    batch_count++;
+    in_flight.push_back(std::move(current));
+    has_current = false;
+    current = Batch{};
+
+    return last_submitted;
+}
+
+void UploadManager::retireOldest()
+{
+    Batch& batch = in_flight.front();
+    vkWaitForFences(device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+
+    ring_used -= batch.ringBytes;
+    if (batch.ringBytes > 0) {
+        ring_tail = batch.ringEnd;
+    }
+
+    for (StagingBuffer& staging : batch.oversized) {
+        destroyStagingBuffer(staging);
+    }
+
+    vkFreeCommandBuffers(device, transfer_pool, 1, &batch.transferCommands);
+    if (batch.acquireCommands != VK_NULL_HANDLE) {
+        vkFreeCommandBuffers(device, graphics_pool, 1, &batch.acquireCommands);
+        vkDestroySemaphore(device, batch.transferDone, nullptr);
+    }
+    vkDestroyFence(device, batch.fence, nullptr);
+
+    last_finished = batch.id;
+    in_flight.pop_front();
+}
+
+void UploadManager::retire()
+{
+    while (!in_flight.empty() && vkGetFenceStatus(device, in_flight.front().fence) == VK_SUCCESS) {
+        retireOldest();
+    }
+}
+
+bool UploadManager::finished(uint64_t batch)
+{
+    retire();
+    return batch <= last_finished;
+}
+
+void UploadManager::wait(uint64_t batch)
+{
+    if (has_current && batch >= current.id) {
+        flush();
+    }
+    while (!in_flight.empty() && in_flight.front().id <= batch) {
+        retireOldest();
+    }
+}
+
+std::string UploadManager::summary() const
+{
+    char queue[64];
+    if (dedicatedTransfer()) {
+        snprintf(queue, sizeof(queue), "transfer queue family %u", transfer_family);
+    }
+    else {
+        snprintf(queue, sizeof(queue), "graphics queue");
+    }
+
+    char line[256];
+    snprintf(line, sizeof(line), "uploads: %.2f MB in %llu copies, %llu batches on the %s, %llu waits on a full staging ring",
+        bytes_uploaded / (1024.0 * 1024.0), static_cast<unsigned long long>(copy_count), static_cast<unsigned long long>(batch_count),
+        queue, static_cast<unsigned long long>(stall_count));
+    return line;
+}
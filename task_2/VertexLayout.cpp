@@ -0,0 +1,198 @@
+#include "task_1/VertexLayout.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    uint16_t unorm16(float value)
+    {
+        return static_cast<uint16_t>(std::lround(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f));
+    }
+
+    int16_t snorm16(float value)
+    {
+        return static_cast<int16_t>(std::lround(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f));
+    }
+
+    float signNotZero(float value)
+    {
+        return value >= 0.0f ? 1.0f : -1.0f;
+    }
+
+    // the same folding as octEncode and octDecode in shaders/gbuffer.glsl
+    glm::vec2 octEncode(glm::vec3 n)
+    {
+        n /= std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        if (n.z >= 0.0f) {
+            return glm::vec2(n.x, n.y);
+        }
+        return glm::vec2((1.0f - std::abs(n.y)) * signNotZero(n.x), (1.0f - std::abs(n.x)) * signNotZero(n.y));
+    }
+
+    glm::vec3 octDecode(glm::vec2 e)
+    {
+        glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+        if (n.z < 0.0f) {
+            n = glm::vec3((1.0f - std::abs(e.y)) * signNotZero(e.x), (1.0f - std::abs(e.x)) * signNotZero(e.y), n.z);
+        }
+        return glm::normalize(n);
+    }
+
+    // range [offset, offset + scale] onto [0, 1], a flat range all onto 0
+    float normalise(float value, float offset, float scale)
+    {
+        return scale > 0.0f ? (value - offset) / scale : 0.0f;
+    }
+}
+
+char const* vertexLayoutName(VertexLayout layout)
+{
+    switch (layout) {
+    case VertexLayout::Quantized:
+        return "quantized";
+    case VertexLayout::Interleaved:
+    default:
+        return "interleaved";
+    }
+}
+
+bool parseVertexLayout(std::string const& name, VertexLayout& layout)
+{
+    for (VertexLayout candidate : VERTEX_LAYOUTS) {
+        if (name == vertexLayoutName(candidate)) {
+            layout = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint32_t vertexStreamStride(VertexLayout layout, VertexStream stream)
+{
+    if (layout == VertexLayout::Quantized) {
+        return stream == VERTEX_STREAM_POSITION ? sizeof(PackedPosition) : sizeof(PackedAttributes);
+    }
+    return stream == VERTEX_STREAM_POSITION ? sizeof(Vertex) : 0;
+}
+
+std::vector<VkVertexInputBindingDescription> getBindingDescriptions(VertexLayout layout, bool position_only)
+{
+    std::vector<VkVertexInputBindingDescription> bindings;
+    for (VertexStream stream : { VERTEX_STREAM_POSITION, VERTEX_STREAM_ATTRIBUTES }) {
+        uint32_t stride = vertexStreamStride(layout, stream);
+        if (stride == 0 || (position_only && stream != VERTEX_STREAM_POSITION)) {
+            continue;
+        }
+
+        VkVertexInputBindingDescription binding{};
+        binding.binding = stream;
+        binding.stride = stride;
+        binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        bindings.push_back(binding);
+    }
+
+    return bindings;
+}
+
+// locations 0, 2 and 3 as the shaders declare them, location 1 was the colour
+std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions(VertexLayout layout, bool position_only)
+{
+    std::vector<VkVertexInputAttributeDescription> attributes;
+    if (layout == VertexLayout::Quantized) {
+        attributes.push_back({ 0, VERTEX_STREAM_POSITION, VK_FORMAT_R16G16B16A16_UNORM, 0 });
+        if (!position_only) {
+            attributes.push_back({ 2, VERTEX_STREAM_ATTRIBUTES, VK_FORMAT_R16G16_UNORM, offsetof(PackedAttributes, texCoord) });
+            attributes.push_back({ 3, VERTEX_STREAM_ATTRIBUTES, VK_FORMAT_R16G16_SNORM, offsetof(PackedAttributes, normal) });
+        }
+        return attributes;
+    }
+
+    attributes.push_back({ 0, VERTEX_STREAM_POSITION, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos) });
+    if (!position_only) {
+        attributes.push_back({ 2, VERTEX_STREAM_POSITION, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, texCoord) });
+        attributes.push_back({ 3, VERTEX_STREAM_POSITION, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, norm) });
+    }
+    return attributes;
+}
+
+MeshQuantization quantizeMesh(VertexLayout layout, Vertex const* vertices, size_t count)
+{
+    MeshQuantization quantization{};
+    quantization.positionScale = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+    quantization.texCoordTransform = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+    if (layout == VertexLayout::Interleaved || count == 0) {
+        return quantization;
+    }
+
+    glm::vec3 position_min = vertices[0].pos;
+    glm::vec3 position_max = position_min;
+    glm::vec2 tex_coord_min = vertices[0].texCoord;
+    glm::vec2 tex_coord_max = tex_coord_min;
+    for (size_t i = 1; i < count; i++) {
+        position_min = glm::min(position_min, vertices[i].pos);
+        position_max = glm::max(position_max, vertices[i].pos);
+        tex_coord_min = glm::min(tex_coord_min, vertices[i].texCoord);
+        tex_coord_max = glm::max(tex_coord_max, vertices[i].texCoord);
+    }
+
+    quantization.positionScale = glm::vec4(position_max - position_min, 0.0f);
+    quantization.positionOffset = glm::vec4(position_min, 0.0f);
+    quantization.texCoordTransform = glm::vec4(tex_coord_max - tex_coord_min, tex_coord_min);
+    return quantization;
+}
+
+void packVertices(VertexLayout layout, MeshQuantization const& quantization, Vertex const* vertices, size_t count,
+    void* positions, void* attributes)
+{
+    if (layout == VertexLayout::Interleaved) {
+        std::memcpy(positions, vertices, sizeof(Vertex) * count);
+        return;
+    }
+
+    PackedPosition* packed_positions = static_cast<PackedPosition*>(positions);
+    PackedAttributes* packed_attributes = static_cast<PackedAttributes*>(attributes);
+    glm::vec4 const& scale = quantization.positionScale;
+    glm::vec4 const& offset = quantization.positionOffset;
+    glm::vec4 const& tex_coord = quantization.texCoordTransform;
+
+    for (size_t i = 0; i < count; i++) {
+        Vertex const& vertex = vertices[i];
+        packed_positions[i] = {
+            unorm16(normalise(vertex.pos.x, offset.x, scale.x)),
+            unorm16(normalise(vertex.pos.y, offset.y, scale.y)),
+            unorm16(normalise(vertex.pos.z, offset.z, scale.z)),
+            0
+        };
+
+        glm::vec2 normal = octEncode(vertex.norm);
+        packed_attributes[i] = {
+            { snorm16(normal.x), snorm16(normal.y) },
+            { unorm16(normalise(vertex.texCoord.x, tex_coord.z, tex_coord.x)), unorm16(normalise(vertex.texCoord.y, tex_coord.w, tex_coord.y)) }
+        };
+    }
+}
+
+Vertex unpackVertex(VertexLayout layout, MeshQuantization const& quantization, void const* positions, void const* attributes, size_t index)
+{
+    if (layout == VertexLayout::Interleaved) {
+        return static_cast<Vertex const*>(positions)[index];
+    }
+
+    PackedPosition const& position = static_cast<PackedPosition const*>(positions)[index];
+    PackedAttributes const& packed = static_cast<PackedAttributes const*>(attributes)[index];
+
+    // what the unorm and snorm vertex formats hand the shader
+    auto unorm = [](uint16_t value) { return value / 65535.0f; };
+    auto snorm = [](int16_t value) { return std::max(value / 32767.0f, -1.0f); };
+
+    Vertex vertex{};
+    vertex.pos = glm::vec3(quantization.positionOffset) +
+        glm::vec3(unorm(position.x), unorm(position.y), unorm(position.z)) * glm::vec3(quantization.positionScale);
+    vertex.color = glm::vec3(1.0f);
+    vertex.texCoord = glm::vec2(unorm(packed.texCoord[0]), unorm(packed.texCoord[1])) * glm::vec2(quantization.texCoordTransform) +
+        glm::vec2(quantization.texCoordTransform.z, quantization.texCoordTransform.w);
+    vertex.norm = octDecode(glm::vec2(snorm(packed.normal[0]), snorm(packed.normal[1])));
+    return vertex;
+}
@@ -9,7 +9,6 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-#define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/gtx/euler_angles.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/transform.hpp>
@@ -22,9 +21,12 @@
 #include <algorithm>
 #include <vector>
 #include <chrono>
+#include <cstddef>
 #include <cstring>
 #include <cstdlib>
 #include <cstdint>
+#include <cstdio>
+#include <limits>
 #include <optional>
 #include <set>
 #include <unordered_map>
@@ -116,8 +118,16 @@ void VulkanObject::createCommandBuffers(VkCommandBuffer* commandBuffer, uint32_t
     vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, commandBuffer);
 }
 
+void VulkanObject::initHeadless(uint32_t width, uint32_t height) {
+    headless = true;
+    swapChainExtent = { width, height };
+
+    initVulkan(nullptr);
+}
+
 void VulkanObject::initVulkan(GLFWwindow* window) {
     this->window = window;
+    startTime = std::chrono::high_resolution_clock::now();
 
     imgui_clear_value = { 0.6, 0.4, 0.0, 1.0 };
 
@@ -128,44 +138,58 @@ void VulkanObject::initVulkan(GLFWwindow* window) {
     createInstance();
     // setup our debugger to control output
     setupDebugMessenger();
-    // create our surface
-    createSurface();
+    // create our surface. headless rendering has nothing to present to
+    if (!headless) {
+        createSurface();
+    }
     // pick a physical device to use
     pickPhysicalDevice();
     // create a logical device to use based off physical device
     createLogicalDevice();
-    // create a swap chain
-    createSwapChain();
+    allocator.init(physicalDevice, device);
+    profiler.init(physicalDevice, device, findQueueFamilies(physicalDevice).graphicsFamily.value(), MAX_FRAMES_IN_FLIGHT);
+    pipelineCache.init(physicalDevice, device, PIPELINE_CACHE_PATH);
+    QueueFamilyIndices queueFamilies = findQueueFamilies(physicalDevice);
+    uploads.init(physicalDevice, device, allocator, queueFamilies.graphicsFamily.value(), graphicsQueue,
+        queueFamilies.transferFamily.value_or(queueFamilies.graphicsFamily.value()), transferQueue);
+    // the block compressed formats the device can sample, RGBA8 always can be
+    std::vector<VkFormat> textureFormats;
+    for (VkFormat candidate : { VK_FORMAT_BC1_RGB_SRGB_BLOCK, VK_FORMAT_BC7_SRGB_BLOCK }) {
+        if (findSupportedFormat({ candidate, VK_FORMAT_R8G8B8A8_SRGB }, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) == candidate) {
+            textureFormats.push_back(candidate);
+        }
+    }
+    textureFormats.push_back(VK_FORMAT_R8G8B8A8_SRGB);
+    textureStreamer.init(uploads, textureFormats);
+    textureStreamer.setBudget(textureBudget);
+    // create a swap chain, or images standing in for one
+    if (headless) {
+        createOffscreenTargets();
+    }
+    else {
+        createSwapChain();
+    }
     // create our image views
     createImageViews();
-    // create render pass object using previous information
+    // render passes only depend on formats, so they live through resizes
     createRenderPass();
     createDescriptorSetLayout();
-    // create graphics pipeline
+    // create graphics pipeline, timed so cold and warm cache starts can be compared
+    auto pipelineStart = std::chrono::high_resolution_clock::now();
     createGraphicsPipeline();
+    createComputePipelines();
+    auto pipelineEnd = std::chrono::high_resolution_clock::now();
+    pipelineCache.recordCreateTime(std::chrono::duration<float, std::milli>(pipelineEnd - pipelineStart).count());
     // create our command pool
     createCommandPool();
-    createDepthResources();
+    // everything sized to the window, recreated on resize
+    createGeometryAttachments();
     // function to create framebuffers and populate swapChainFramebuffers vector
     createFramebuffers();
 
-    imgui_frame_buffers.resize(swapChainImages.size());
-	
-    {
-        VkImageView attachment[1];
-        VkFramebufferCreateInfo info = {};
-        info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        info.renderPass = imgui_render_pass;
-        info.attachmentCount = 1;
-        info.pAttachments = attachment;
-        info.width = swapChainExtent.width;
-        info.height = swapChainExtent.height;
-        info.layers = 1;
-        for (uint32_t i = 0; i < swapChainImages.size(); i++)
-        {
-            attachment[0] = swapChainImageViews[i];
-            vkCreateFramebuffer(device, &info, VK_NULL_HANDLE, &imgui_frame_buffers[i]);
-        }
+    // no UI without a window
+    if (!headless) {
+        createImguiFramebuffers();
     }
 
     createTextureImage();
@@ -174,44 +198,69 @@ void VulkanObject::initVulkan(GLFWwindow* window) {
     loadModel();
     createVertexBuffer();
     createIndexBuffer();
+    createInstanceBuffer();
+    createCullingBuffers();
+    createLightBuffers();
+    // sized by its own setting, lives through resizes. needs the scene to know about dynamic casters
+    createShadowMap();
     createUniformBuffers();
     createDescriptorPool();
     createDescriptorSets();
+    // every asset is staged by now. the graphics queue picks the copies up before the first
+    // frame without the CPU waiting, the staging space comes back as the batches finish
+    uploads.flush();
 
-    VkDescriptorPoolSize imgui_pool_sizes[] =
-    {
-        { VK_DESCRIPTOR_TYPE_SAMPLER, 1000 },
-        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000 },
-        { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1000 },
-        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1000 },
-        { VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1000 },
-        { VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1000 },
-        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1000 },
-        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1000 },
-        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1000 },
-        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1000 },
-        { VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1000 }
-    };
-    VkDescriptorPoolCreateInfo imgui_pool_info = {};
-    imgui_pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    imgui_pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-    imgui_pool_info.maxSets = 1000 * IM_ARRAYSIZE(imgui_pool_sizes);
-    imgui_pool_info.poolSizeCount = (uint32_t)IM_ARRAYSIZE(imgui_pool_sizes);
-    imgui_pool_info.pPoolSizes = imgui_pool_sizes;
-    vkCreateDescriptorPool(device, &imgui_pool_info, VK_NULL_HANDLE, &imgui_descriptor_pool);
-
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    ImGuiIO& io = ImGui::GetIO(); (void)io;
-
-    ImGui_ImplGlfw_InitForVulkan(window, true);
+    if (!headless) {
+        VkDescriptorPoolSize imgui_pool_sizes[] =
+        {
+            { VK_DESCRIPTOR_TYPE_SAMPLER, 1000 },
+            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000 },
+            { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1000 },
+            { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1000 },
+            { VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1000 },
+            { VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1000 },
+            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1000 },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1000 },
+            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1000 },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1000 },
+            { VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1000 }
+        };
+        VkDescriptorPoolCreateInfo imgui_pool_info = {};
+        imgui_pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        imgui_pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+        imgui_pool_info.maxSets = 1000 * IM_ARRAYSIZE(imgui_pool_sizes);
+        imgui_pool_info.poolSizeCount = (uint32_t)IM_ARRAYSIZE(imgui_pool_sizes);
+        imgui_pool_info.pPoolSizes = imgui_pool_sizes;
+        vkCreateDescriptorPool(device, &imgui_pool_info, VK_NULL_HANDLE, &imgui_descriptor_pool);
+
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        ImGuiIO& io = ImGui::GetIO(); (void)io;
+
+        ImGui_ImplGlfw_InitForVulkan(window, true);
+        initImguiRenderer();
+
+        createCommandPool(&imgui_command_pool, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+        imgui_command_buffers.resize(swapChainImageViews.size());
+        createCommandBuffers(imgui_command_buffers.data(), static_cast<uint32_t>(imgui_command_buffers.size()), imgui_command_pool);
+    }
+
+    // create command buffers
+    createCommandBuffers();
+    // command pools for the workers recording CPU draws
+    createRecordContexts();
+    // create and set up semaphores and fences
+    createSyncObjects();
+}
+
+void VulkanObject::initImguiRenderer() {
     ImGui_ImplVulkan_InitInfo init_info = {};
     init_info.Instance = instance;
     init_info.PhysicalDevice = physicalDevice;
     init_info.Device = device;
     init_info.QueueFamily = findQueueFamilies(physicalDevice).graphicsFamily.value();
     init_info.Queue = graphicsQueue;
-    init_info.PipelineCache = VK_NULL_HANDLE;
+    init_info.PipelineCache = pipelineCache.handle();
     init_info.DescriptorPool = imgui_descriptor_pool;
     init_info.Allocator = VK_NULL_HANDLE;
     init_info.MinImageCount = swapChainImages.size();
@@ -222,15 +271,6 @@ void VulkanObject::initVulkan(GLFWwindow* window) {
     VkCommandBuffer command_buffer = beginSingleTimeCommands();
     ImGui_ImplVulkan_CreateFontsTexture(command_buffer);
     endSingleTimeCommands(command_buffer);
-
-    createCommandPool(&imgui_command_pool, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
-    imgui_command_buffers.resize(swapChainImageViews.size());
-    createCommandBuffers(imgui_command_buffers.data(), static_cast<uint32_t>(imgui_command_buffers.size()), imgui_command_pool);
-
-    // create command buffers
-    createCommandBuffers();
-    // create and set up semaphores and fences
-    createSyncObjects();
 }
 
 VkFormat VulkanObject::findDepthFormat() {
@@ -261,16 +301,6 @@ VkFormat VulkanObject::findSupportedFormat(const std::vector<VkFormat>& candidat
     throw std::runtime_error("failed to find supported format!");
 }
 
-void VulkanObject::createDepthResources() {
-    VkFormat depthFormat = findDepthFormat();
-    createImage(swapChainExtent.width, swapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
-    depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
-
-    transitionImageLayout(depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
-
-
-}
-
 void VulkanObject::createTextureSampler() {
     VkSamplerCreateInfo samplerInfo{};
     samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -290,24 +320,25 @@ void VulkanObject::createTextureSampler() {
     samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
     samplerInfo.mipLodBias = 0.0f;
     samplerInfo.minLod = 0.0f;
-    samplerInfo.maxLod = 0.0f;
+    samplerInfo.maxLod = static_cast<float>(textureMipLevels);
 
     if (vkCreateSampler(device, &samplerInfo, nullptr, &textureSampler) != VK_SUCCESS) {
         throw std::runtime_error("failed to create texture sampler!");
     }
 }
 
-VkImageView VulkanObject::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags) {
+VkImageView VulkanObject::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags,
+    VkImageViewType viewType, uint32_t baseLayer, uint32_t layerCount, uint32_t levelCount, uint32_t baseLevel) {
     VkImageViewCreateInfo viewInfo{};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     viewInfo.image = image;
-    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.viewType = viewType;
     viewInfo.format = format;
     viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    viewInfo.subresourceRange.baseMipLevel = 0;
-    viewInfo.subresourceRange.levelCount = 1;
-    viewInfo.subresourceRange.baseArrayLayer = 0;
-    viewInfo.subresourceRange.layerCount = 1;
+    viewInfo.subresourceRange.baseMipLevel = baseLevel;
+    viewInfo.subresourceRange.levelCount = levelCount;
+    viewInfo.subresourceRange.baseArrayLayer = baseLayer;
+    viewInfo.subresourceRange.layerCount = layerCount;
     viewInfo.subresourceRange.aspectMask = aspectFlags;
 
     VkImageView imageView;
@@ -321,52 +352,136 @@ VkImageView VulkanObject::createImageView(VkImage image, VkFormat format, VkImag
 void VulkanObject::loadModel()
 {
     dragon_model.loadModel("../assets/dragon_cow_and_plane/dragon_cow_and_plane.obj");
+
+    scene.clear();
+    uint32_t dragon_mesh = scene.addMesh(dragon_model);
+
+    if (stressInstances == 0) {
+        scene.addInstance(dragon_mesh, glm::mat4(1.0f), 0, dynamicInstances > 0 ? INSTANCE_DYNAMIC : 0u);
+    }
+    else {
+        // stay well inside the 4 unit far plane of the camera and the light
+        scene.addInstanceGrid(dragon_mesh, stressInstances, 0.75f, dynamicInstances);
+    }
+
+    scene.build(batchSize > 0 ? batchSize : ~0u);
+    scene.bounds(sceneBoundsMin, sceneBoundsMax);
 }
 
 void VulkanObject::createTextureImageView() {
-    textureImageView = createImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
+    placeholderImageView = createImageView(placeholderImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
+    textureLevelViews.assign(textureMipLevels, VK_NULL_HANDLE);
 }
 
 void VulkanObject::createTextureImage() {
-    int texWidth, texHeight, texChannels;
-    stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-    VkDeviceSize imageSize = texWidth * texHeight * 4;
+    // only the size and format are known yet, the levels stream in once converted, see streamTextures
+    TextureStreamer::Info info{};
+    streamedTexture = textureStreamer.request(TEXTURE_PATH, info);
+    textureFormat = info.format;
+    textureMipLevels = info.levelCount;
 
-    if (!pixels) {
-        throw std::runtime_error("failed to load texture image!");
+    createImage(info.width, info.height, info.format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory, 1, textureMipLevels);
+    textureStreamer.attach(streamedTexture, textureImage);
+
+    // a single texel at half the light stands in until the smallest levels arrive
+    createImage(1, 1, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, placeholderImage, placeholderImageMemory);
+
+    VkImageSubresourceRange range{};
+    range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    range.baseMipLevel = 0;
+    range.levelCount = 1;
+    range.baseArrayLayer = 0;
+    range.layerCount = 1;
+
+    VkBufferImageCopy region{};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = { 1, 1, 1 };
+
+    uint8_t const grey[4] = { 188, 188, 188, 255 };
+    memcpy(uploads.stageImage(placeholderImage, range, &region, 1, sizeof(grey), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL), grey, sizeof(grey));
+}
+
+// a view of the levels resident so far, the placeholder while there are none. made on first
+// use and kept until cleanup, there are only as many as there are levels
+VkImageView VulkanObject::residentTextureView() {
+    uint32_t resident = textureStreamer.residentLevel(streamedTexture);
+    if (resident == textureMipLevels) {
+        return placeholderImageView;
+    }
+
+    if (textureLevelViews[resident] == VK_NULL_HANDLE) {
+        textureLevelViews[resident] = createImageView(textureImage, textureFormat, VK_IMAGE_ASPECT_COLOR_BIT,
+            VK_IMAGE_VIEW_TYPE_2D, 0, 1, textureMipLevels - resident, resident);
     }
+    return textureLevelViews[resident];
+}
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+// stage what the budget allows and point this frame's set at the levels resident so far.
+// the frame's fence has been waited on, so nothing still reads its set
+void VulkanObject::streamTextures() {
+    textureStreamer.update();
 
-    void* data;
-    vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-    memcpy(data, pixels, static_cast<size_t>(imageSize));
-    vkUnmapMemory(device, stagingBufferMemory);
+    VkImageView view = residentTextureView();
+    if (boundTextureViews[currentFrame] != view) {
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo.imageView = view;
+        imageInfo.sampler = textureSampler;
 
-    stbi_image_free(pixels);
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = descriptorSets[currentFrame];
+        write.dstBinding = 1;
+        write.dstArrayElement = 0;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.descriptorCount = 1;
+        write.pImageInfo = &imageInfo;
+        vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+        boundTextureViews[currentFrame] = view;
+    }
 
-    createImage(texWidth, texHeight, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
+    if (fullQualityMs < 0.0f && textureStreamer.complete()) {
+        fullQualityMs = millisecondsSinceStart();
+        std::cout << "texture at full quality " << fullQualityMs << " ms after start" << std::endl;
+    }
+}
 
-    transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    copyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
+void VulkanObject::frameSubmitted() {
+    if (firstFrameMs < 0.0f) {
+        firstFrameMs = millisecondsSinceStart();
+        std::cout << "first frame submitted " << firstFrameMs << " ms after start" << std::endl;
+    }
+}
 
-    transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+float VulkanObject::millisecondsSinceStart() const {
+    return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+std::string VulkanObject::textureSummary() {
+    char line[96];
+    snprintf(line, sizeof(line), "first frame %.1f ms, full quality ", firstFrameMs);
+    std::string summary = line;
+    if (fullQualityMs < 0.0f) {
+        summary += "pending";
+    }
+    else {
+        snprintf(line, sizeof(line), "%.1f ms", fullQualityMs);
+        summary += line;
+    }
+    return summary + "\n" + textureStreamer.summary();
 }
 
-void VulkanObject::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
+void VulkanObject::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, Allocation& imageMemory, uint32_t arrayLayers, uint32_t mipLevels) {
     VkImageCreateInfo imageInfo{};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
     imageInfo.extent.width = width;
     imageInfo.extent.height = height;
     imageInfo.extent.depth = 1;
-    imageInfo.mipLevels = 1;
-    imageInfo.arrayLayers = 1;
+    imageInfo.mipLevels = mipLevels;
+    imageInfo.arrayLayers = arrayLayers;
     imageInfo.format = format;
     imageInfo.tiling = tiling;
     imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -381,98 +496,140 @@ void VulkanObject::createImage(uint32_t width, uint32_t height, VkFormat format,
     VkMemoryRequirements memRequirements;
     vkGetImageMemoryRequirements(device, image, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+    // attachments are recreated with the swap chain, give them their own memory
+    bool attachment = (usage & (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)) != 0;
+    ResourceKind kind = tiling == VK_IMAGE_TILING_OPTIMAL ? ResourceKind::Optimal : ResourceKind::Linear;
 
-    if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate image memory!");
+    // lazily allocated memory only exists on tiled GPUs, elsewhere transient attachments get regular memory
+    if ((properties & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) && !allocator.hasMemoryType(memRequirements.memoryTypeBits, properties)) {
+        properties &= ~VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
     }
 
-    vkBindImageMemory(device, image, imageMemory, 0);
+    imageMemory = allocator.allocate(memRequirements, properties, kind, attachment);
+
+    vkBindImageMemory(device, image, imageMemory.memory, imageMemory.offset);
 }
 
+// pools for the single set of each kind. the sets never change per frame, uniforms
+// come from the ring through dynamic offsets. the geometry set is the exception, with a
+// copy per frame so the streamed texture can be rebound while other frames are in flight
 void VulkanObject::createDescriptorPool() {
-    std::array<VkDescriptorPoolSize, 2> poolSizes{};
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
+    uint32_t frames = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    std::array<VkDescriptorPoolSize, 3> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSizes[0].descriptorCount = frames;
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
+    poolSizes[1].descriptorCount = frames;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[2].descriptorCount = 3 * frames;
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
     poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = static_cast<uint32_t>(swapChainImages.size());
+    poolInfo.maxSets = frames;
 
     if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
         throw std::runtime_error("failed to create descriptor pool!");
     }
 
-    std::array<VkDescriptorPoolSize, 6> lightingPoolSizes{};
-    lightingPoolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    lightingPoolSizes[0].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
+    std::array<VkDescriptorPoolSize, 8> lightingPoolSizes{};
+    lightingPoolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    lightingPoolSizes[0].descriptorCount = 1;
     lightingPoolSizes[1].type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-    lightingPoolSizes[1].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
+    lightingPoolSizes[1].descriptorCount = 1;
     lightingPoolSizes[2].type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-    lightingPoolSizes[2].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
+    lightingPoolSizes[2].descriptorCount = 1;
     lightingPoolSizes[3].type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-    lightingPoolSizes[3].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
+    lightingPoolSizes[3].descriptorCount = 1;
     lightingPoolSizes[4].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    lightingPoolSizes[4].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
+    lightingPoolSizes[4].descriptorCount = 1;
     lightingPoolSizes[5].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    lightingPoolSizes[5].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
+    lightingPoolSizes[5].descriptorCount = 1;
+    lightingPoolSizes[6].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    lightingPoolSizes[6].descriptorCount = 1;
+    lightingPoolSizes[7].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    lightingPoolSizes[7].descriptorCount = 1;
 
     VkDescriptorPoolCreateInfo lightingPoolInfo{};
     lightingPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     lightingPoolInfo.poolSizeCount = static_cast<uint32_t>(lightingPoolSizes.size());
     lightingPoolInfo.pPoolSizes = lightingPoolSizes.data();
-    lightingPoolInfo.maxSets = static_cast<uint32_t>(swapChainImages.size());
+    lightingPoolInfo.maxSets = 1;
 
     if (vkCreateDescriptorPool(device, &lightingPoolInfo, nullptr, &lightingDescriptorPool) != VK_SUCCESS) {
         throw std::runtime_error("failed to create descriptor pool!");
     }
 
-    std::array<VkDescriptorPoolSize, 1> shadowPoolSizes{};
-    shadowPoolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    shadowPoolSizes[0].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
+    std::array<VkDescriptorPoolSize, 3> shadowPoolSizes{};
+    shadowPoolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    shadowPoolSizes[0].descriptorCount = 1;
+    shadowPoolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    shadowPoolSizes[1].descriptorCount = 2;
+    shadowPoolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    shadowPoolSizes[2].descriptorCount = 1;
 
     VkDescriptorPoolCreateInfo shadowPoolInfo{};
     shadowPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     shadowPoolInfo.poolSizeCount = static_cast<uint32_t>(shadowPoolSizes.size());
     shadowPoolInfo.pPoolSizes = shadowPoolSizes.data();
-    shadowPoolInfo.maxSets = static_cast<uint32_t>(swapChainImages.size());
+    shadowPoolInfo.maxSets = 1;
 
     if (vkCreateDescriptorPool(device, &shadowPoolInfo, nullptr, &shadowDescriptorPool) != VK_SUCCESS) {
         throw std::runtime_error("failed to create descriptor pool!");
     }
-}
 
-void VulkanObject::createUniformBuffers() {
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+    std::array<VkDescriptorPoolSize, 2> cullPoolSizes{};
+    cullPoolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    cullPoolSizes[0].descriptorCount = 1;
+    cullPoolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    cullPoolSizes[1].descriptorCount = 5;
 
-    uniformBuffers.resize(swapChainImages.size());
-    uniformBuffersMemory.resize(swapChainImages.size());
+    VkDescriptorPoolCreateInfo cullPoolInfo{};
+    cullPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    cullPoolInfo.poolSizeCount = static_cast<uint32_t>(cullPoolSizes.size());
+    cullPoolInfo.pPoolSizes = cullPoolSizes.data();
+    cullPoolInfo.maxSets = 1;
 
-    for (size_t i = 0; i < swapChainImages.size(); i++) {
-        createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i], uniformBuffersMemory[i]);
+    if (vkCreateDescriptorPool(device, &cullPoolInfo, nullptr, &cullDescriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor pool!");
+    }
+
+    std::array<VkDescriptorPoolSize, 3> clusterPoolSizes{};
+    clusterPoolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    clusterPoolSizes[0].descriptorCount = 1;
+    clusterPoolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    clusterPoolSizes[1].descriptorCount = 1;
+    clusterPoolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    clusterPoolSizes[2].descriptorCount = 1;
+
+    VkDescriptorPoolCreateInfo clusterPoolInfo{};
+    clusterPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    clusterPoolInfo.poolSizeCount = static_cast<uint32_t>(clusterPoolSizes.size());
+    clusterPoolInfo.pPoolSizes = clusterPoolSizes.data();
+    clusterPoolInfo.maxSets = 1;
+
+    if (vkCreateDescriptorPool(device, &clusterPoolInfo, nullptr, &clusterDescriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor pool!");
     }
+}
+
+void VulkanObject::createUniformBuffers() {
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
 
-    VkDeviceSize shadowBufferSize = sizeof(ShadowUniformBufferObject);
+    VkDeviceSize bufferSize = UNIFORM_RING_FRAME_SIZE * MAX_FRAMES_IN_FLIGHT;
 
-    shadowUniformBuffers.resize(swapChainImages.size());
-    shadowUniformBuffersMemory.resize(swapChainImages.size());
+    // host coherent and mapped for its whole lifetime, so writes need no flush or unmap
+    createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformRingBuffer, uniformRingMemory);
 
-    for (size_t i = 0; i < swapChainImages.size(); i++) {
-        createBuffer(shadowBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, shadowUniformBuffers[i], shadowUniformBuffersMemory[i]);
-    }
+    uniformRing.init(uniformRingBuffer, uniformRingMemory.mapped, UNIFORM_RING_FRAME_SIZE, MAX_FRAMES_IN_FLIGHT, properties.limits.minUniformBufferOffsetAlignment);
 }
 
 void VulkanObject::createDescriptorSetLayout() {
     VkDescriptorSetLayoutBinding uboLayoutBinding{};
     uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     uboLayoutBinding.descriptorCount = 1;
     uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     uboLayoutBinding.pImmutableSamplers = nullptr;
@@ -484,7 +641,29 @@ void VulkanObject::createDescriptorSetLayout() {
     samplerLayoutBinding.pImmutableSamplers = nullptr;
     samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-    std::array<VkDescriptorSetLayoutBinding, 2> bindings = { uboLayoutBinding, samplerLayoutBinding };
+    VkDescriptorSetLayoutBinding instanceLayoutBinding{};
+    instanceLayoutBinding.binding = 2;
+    instanceLayoutBinding.descriptorCount = 1;
+    instanceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    instanceLayoutBinding.pImmutableSamplers = nullptr;
+    instanceLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    VkDescriptorSetLayoutBinding visibleLayoutBinding{};
+    visibleLayoutBinding.binding = 3;
+    visibleLayoutBinding.descriptorCount = 1;
+    visibleLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    visibleLayoutBinding.pImmutableSamplers = nullptr;
+    visibleLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    // dequantisation ranges of the vertex layout, per mesh
+    VkDescriptorSetLayoutBinding meshLayoutBinding{};
+    meshLayoutBinding.binding = 4;
+    meshLayoutBinding.descriptorCount = 1;
+    meshLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    meshLayoutBinding.pImmutableSamplers = nullptr;
+    meshLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    std::array<VkDescriptorSetLayoutBinding, 5> bindings = { uboLayoutBinding, samplerLayoutBinding, instanceLayoutBinding, visibleLayoutBinding, meshLayoutBinding };
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
@@ -496,9 +675,10 @@ void VulkanObject::createDescriptorSetLayout() {
 
     VkDescriptorSetLayoutBinding lightingUboLayoutBinding{};
     lightingUboLayoutBinding.binding = 0;
-    lightingUboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    lightingUboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     lightingUboLayoutBinding.descriptorCount = 1;
-    lightingUboLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    // the vertex shader works out the view rays at the corners of the screen
+    lightingUboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
     lightingUboLayoutBinding.pImmutableSamplers = nullptr;
 	
     VkDescriptorSetLayoutBinding colorInputLayoutBinding0{};
@@ -533,13 +713,29 @@ void VulkanObject::createDescriptorSetLayout() {
     PCFshadowSamplerLayoutBinding.pImmutableSamplers = nullptr;
     PCFshadowSamplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-    std::array<VkDescriptorSetLayoutBinding, 6> lightingBindings = {
+    VkDescriptorSetLayoutBinding lightsLayoutBinding{};
+    lightsLayoutBinding.binding = 7;
+    lightsLayoutBinding.descriptorCount = 1;
+    lightsLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    lightsLayoutBinding.pImmutableSamplers = nullptr;
+    lightsLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutBinding clustersLayoutBinding{};
+    clustersLayoutBinding.binding = 8;
+    clustersLayoutBinding.descriptorCount = 1;
+    clustersLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    clustersLayoutBinding.pImmutableSamplers = nullptr;
+    clustersLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    std::array<VkDescriptorSetLayoutBinding, 8> lightingBindings = {
     	lightingUboLayoutBinding,
     	colorInputLayoutBinding0,
     	colorInputLayoutBinding1,
     	depthInputLayoutBinding1,
     	shadowSamplerLayoutBinding,
-        PCFshadowSamplerLayoutBinding
+        PCFshadowSamplerLayoutBinding,
+        lightsLayoutBinding,
+        clustersLayoutBinding
     };
     VkDescriptorSetLayoutCreateInfo lightingLayoutInfo{};
     lightingLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -552,12 +748,34 @@ void VulkanObject::createDescriptorSetLayout() {
 
     VkDescriptorSetLayoutBinding shadowUboLayoutBinding{};
     shadowUboLayoutBinding.binding = 0;
-    shadowUboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    shadowUboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     shadowUboLayoutBinding.descriptorCount = 1;
     shadowUboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     shadowUboLayoutBinding.pImmutableSamplers = nullptr;
 
-    std::array<VkDescriptorSetLayoutBinding, 1> shadowBindings = { shadowUboLayoutBinding };
+    VkDescriptorSetLayoutBinding shadowInstanceLayoutBinding{};
+    shadowInstanceLayoutBinding.binding = 1;
+    shadowInstanceLayoutBinding.descriptorCount = 1;
+    shadowInstanceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    shadowInstanceLayoutBinding.pImmutableSamplers = nullptr;
+    shadowInstanceLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    // static and dynamic casters have their own visible lists, picked with a dynamic offset
+    VkDescriptorSetLayoutBinding shadowVisibleLayoutBinding{};
+    shadowVisibleLayoutBinding.binding = 2;
+    shadowVisibleLayoutBinding.descriptorCount = 1;
+    shadowVisibleLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    shadowVisibleLayoutBinding.pImmutableSamplers = nullptr;
+    shadowVisibleLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    VkDescriptorSetLayoutBinding shadowMeshLayoutBinding{};
+    shadowMeshLayoutBinding.binding = 3;
+    shadowMeshLayoutBinding.descriptorCount = 1;
+    shadowMeshLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    shadowMeshLayoutBinding.pImmutableSamplers = nullptr;
+    shadowMeshLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    std::array<VkDescriptorSetLayoutBinding, 4> shadowBindings = { shadowUboLayoutBinding, shadowInstanceLayoutBinding, shadowVisibleLayoutBinding, shadowMeshLayoutBinding };
     VkDescriptorSetLayoutCreateInfo shadowLayoutInfo{};
     shadowLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     shadowLayoutInfo.bindingCount = static_cast<uint32_t>(shadowBindings.size());
@@ -566,30 +784,57 @@ void VulkanObject::createDescriptorSetLayout() {
     if (vkCreateDescriptorSetLayout(device, &shadowLayoutInfo, nullptr, &shadowSetLayout) != VK_SUCCESS) {
         throw std::runtime_error("failed to create descriptor set layout!");
     }
+
+    // culling uniforms, then instances, batches, visible lists, draws and counts (see shaders/cull.glsl)
+    std::array<VkDescriptorSetLayoutBinding, 6> cullBindings{};
+    for (uint32_t i = 0; i < cullBindings.size(); i++) {
+        cullBindings[i].binding = i;
+        cullBindings[i].descriptorCount = 1;
+        cullBindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        cullBindings[i].pImmutableSamplers = nullptr;
+        cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo cullLayoutInfo{};
+    cullLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    cullLayoutInfo.bindingCount = static_cast<uint32_t>(cullBindings.size());
+    cullLayoutInfo.pBindings = cullBindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &cullLayoutInfo, nullptr, &cullSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
+
+    // cluster uniforms, this frame's lights and the cluster lists (see shaders/cluster_assign.comp)
+    std::array<VkDescriptorSetLayoutBinding, 3> clusterBindings{};
+    VkDescriptorType clusterTypes[] = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER };
+    for (uint32_t i = 0; i < clusterBindings.size(); i++) {
+        clusterBindings[i].binding = i;
+        clusterBindings[i].descriptorCount = 1;
+        clusterBindings[i].descriptorType = clusterTypes[i];
+        clusterBindings[i].pImmutableSamplers = nullptr;
+        clusterBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo clusterLayoutInfo{};
+    clusterLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    clusterLayoutInfo.bindingCount = static_cast<uint32_t>(clusterBindings.size());
+    clusterLayoutInfo.pBindings = clusterBindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &clusterLayoutInfo, nullptr, &clusterSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
     
 }
 
 void VulkanObject::createIndexBuffer() {
-    VkDeviceSize bufferSize = sizeof(dragon_model.getIndices()[0]) * dragon_model.getIndices().size();
-
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-    void* data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, dragon_model.getIndices().data(), (size_t)bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
+    VkDeviceSize bufferSize = sizeof(uint32_t) * scene.indexCount();
 
     createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
 
-    copyBuffer(stagingBuffer, indexBuffer, bufferSize);
-
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    scene.writeIndices(static_cast<uint32_t*>(uploads.stageBuffer(indexBuffer, bufferSize)));
 }
 
-void VulkanObject::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+void VulkanObject::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& bufferMemory) {
     VkBufferCreateInfo bufferInfo{};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bufferInfo.size = size;
@@ -603,137 +848,110 @@ void VulkanObject::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkM
     VkMemoryRequirements memRequirements;
     vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-    if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate buffer memory!");
-    }
+    bufferMemory = allocator.allocate(memRequirements, properties, ResourceKind::Linear);
 
-    vkBindBufferMemory(device, buffer, bufferMemory, 0);
+    vkBindBufferMemory(device, buffer, bufferMemory.memory, bufferMemory.offset);
 }
 
+// one buffer per stream of the vertex layout, packed straight out of the parsed meshes or the
+// mapped mesh caches, and the dequantisation ranges of every mesh next to them
 void VulkanObject::createVertexBuffer() {
-    VkDeviceSize bufferSize = sizeof(dragon_model.getVertices()[0]) * dragon_model.getVertices().size();
-
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-    void* data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, dragon_model.getVertices().data(), (size_t)bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
-
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
-
-    copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
-}
-
-void VulkanObject::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
-    VkImageMemoryBarrier barrier{};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.oldLayout = oldLayout;
-    barrier.newLayout = newLayout;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = image;
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
-    barrier.srcAccessMask = 0;
-    barrier.dstAccessMask = 0;
-
-    if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    std::vector<MeshQuantization> quantization = scene.quantizeMeshes(vertexLayout);
 
-        if (hasStencilComponent(format)) {
-            barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-        }
-    }
-    else {
-        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    VkDeviceSize positionSize = VkDeviceSize(vertexStreamStride(vertexLayout, VERTEX_STREAM_POSITION)) * scene.vertexCount();
+    VkDeviceSize attributeSize = VkDeviceSize(vertexStreamStride(vertexLayout, VERTEX_STREAM_ATTRIBUTES)) * scene.vertexCount();
+
+    createBuffer(positionSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+    void* attributes = nullptr;
+    if (attributeSize > 0) {
+        createBuffer(attributeSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, attributeBuffer, attributeBufferMemory);
+        attributes = uploads.stageBuffer(attributeBuffer, attributeSize);
     }
 
-    VkPipelineStageFlags sourceStage;
-    VkPipelineStageFlags destinationStage;
+    scene.writeVertices(vertexLayout, quantization, uploads.stageBuffer(vertexBuffer, positionSize), attributes);
+
+    VkDeviceSize meshSize = sizeof(MeshQuantization) * quantization.size();
+    createBuffer(meshSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, meshBuffer, meshBufferMemory);
+    memcpy(uploads.stageBuffer(meshBuffer, meshSize), quantization.data(), (size_t)meshSize);
+}
+
+// instances never move, so their transforms are uploaded once to device local memory
+void VulkanObject::createInstanceBuffer() {
+    VkDeviceSize bufferSize = sizeof(InstanceData) * scene.instances().size();
 
-    if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, instanceBuffer, instanceBufferMemory);
 
-        sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    memcpy(uploads.stageBuffer(instanceBuffer, bufferSize), scene.instances().data(), (size_t)bufferSize);
+}
+
+// batch bounding spheres are uploaded once. the visible lists start out as the identity. the
+// direct draw path culls on the CPU and writes them to host visible memory, a slice per frame
+// in flight, the GPU driven path has its single set rewritten by the culling pass
+void VulkanObject::createCullingBuffers() {
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    uint32_t instanceCount = static_cast<uint32_t>(scene.instances().size());
+    uint32_t alignment = std::max(1u, static_cast<uint32_t>(properties.limits.minStorageBufferOffsetAlignment / sizeof(uint32_t)));
+    visibleStride = (instanceCount + alignment - 1) / alignment * alignment;
+
+    cullBatches = buildCullBatches(scene);
+
+    std::vector<uint32_t> visible(static_cast<size_t>(visibleStride) * CULL_VIEW_COUNT, 0);
+    for (uint32_t view = 0; view < CULL_VIEW_COUNT; view++) {
+        for (uint32_t i = 0; i < instanceCount; i++) {
+            visible[view * visibleStride + i] = i;
+        }
     }
-    else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
-        sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-        destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    VkDeviceSize batchSize = sizeof(CullBatch) * cullBatches.size();
+    VkDeviceSize visibleSize = sizeof(uint32_t) * visible.size();
+
+    createBuffer(batchSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, cullBatchBuffer, cullBatchMemory);
+    memcpy(uploads.stageBuffer(cullBatchBuffer, batchSize), cullBatches.data(), (size_t)batchSize);
+
+    // every batch draws all of its instances until the first frame has been culled
+    visibleCounts.assign(cullBatches.size() * CULL_VIEW_COUNT, 0);
+    for (uint32_t view = 0; view < CULL_VIEW_COUNT; view++) {
+        for (InstanceData const& instance : scene.instances()) {
+            visibleCounts[view * cullBatches.size() + instance.batch] += instanceInView(instance, static_cast<CullView>(view)) ? 1 : 0;
+        }
     }
-    else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
-        sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    if (gpuDriven) {
+        visibleFrameStride = 0;
+        createBuffer(visibleSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, visibleBuffer, visibleMemory);
+        memcpy(uploads.stageBuffer(visibleBuffer, visibleSize), visible.data(), (size_t)visibleSize);
     }
     else {
-        throw std::invalid_argument("unsupported layout transition!");
+        visibleFrameStride = visibleStride * CULL_VIEW_COUNT;
+        createBuffer(visibleSize * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, visibleBuffer, visibleMemory);
+        for (size_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++) {
+            memcpy(static_cast<char*>(visibleMemory.mapped) + visibleSize * frame, visible.data(), (size_t)visibleSize);
+        }
     }
 
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-    vkCmdPipelineBarrier(
-        commandBuffer,
-        sourceStage, destinationStage,
-        0,
-        0, nullptr,
-        0, nullptr,
-        1, &barrier
-    );
-
-    endSingleTimeCommands(commandBuffer);
+    // written by the culling passes every frame
+    createBuffer(sizeof(VkDrawIndexedIndirectCommand) * cullBatches.size() * CULL_VIEW_COUNT,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawBuffer, drawMemory);
+    createBuffer(sizeof(uint32_t) * (CULL_VIEW_COUNT + cullBatches.size() * CULL_VIEW_COUNT),
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, countBuffer, countMemory);
 }
 
-void VulkanObject::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-
-    VkBufferImageCopy region{};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
-
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
-
-    region.imageOffset = { 0, 0, 0 };
-    region.imageExtent = {
-        width,
-        height,
-        1
-    };
+// lights live in host visible memory, a slice per frame in flight, as they move every frame.
+// the cluster lists are only ever touched by the GPU
+void VulkanObject::createLightBuffers() {
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
 
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    VkDeviceSize alignment = std::max<VkDeviceSize>(1, properties.limits.minStorageBufferOffsetAlignment);
+    lightStride = (sizeof(GpuLight) * MAX_LIGHTS + alignment - 1) / alignment * alignment;
 
-    vkCmdCopyBufferToImage(
-        commandBuffer,
-        buffer,
-        image,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        1,
-        &region
-    );
+    createBuffer(lightStride * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, lightBuffer, lightMemory);
+    createBuffer(sizeof(uint32_t) * (CLUSTER_COUNT + CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, clusterBuffer, clusterMemory);
 
-    endSingleTimeCommands(commandBuffer);
+    // generate them all up front so the UI can change the count without reallocating
+    lightSet.generate(MAX_LIGHTS, sceneBoundsMin, sceneBoundsMax);
 }
 
 VkCommandBuffer VulkanObject::beginSingleTimeCommands() {
@@ -769,115 +987,139 @@ void VulkanObject::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
     vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
 }
 
-void VulkanObject::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-    VkBufferCopy copyRegion{};
-    copyRegion.size = size;
-    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-    endSingleTimeCommands(commandBuffer);
-}
-
-uint32_t VulkanObject::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-            return i;
-        }
-    }
-
-    throw std::runtime_error("failed to find suitable memory type!");
-}
-
 // clean up swap chain for a clean recreate
+// destroy everything sized to the swap chain. pipelines, render passes and
+// descriptor sets survive a resize
 void VulkanObject::cleanupSwapChain() {
-    vkDestroyImageView(device, depthImageView, nullptr);
-    vkDestroyImage(device, depthImage, nullptr);
-    vkFreeMemory(device, depthImageMemory, nullptr);
-
     // destroy all framebuffers in swap chain
     for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
-        vkDestroyFramebuffer(device, imgui_frame_buffers[i], nullptr);
         vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
     }
 
-    vkFreeCommandBuffers(device, imgui_command_pool, static_cast<uint32_t>(imgui_command_buffers.size()), imgui_command_buffers.data());
-    vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+    for (size_t i = 0; i < imgui_frame_buffers.size(); i++) {
+        vkDestroyFramebuffer(device, imgui_frame_buffers[i], nullptr);
+    }
 
-    //destroy pipeline
-    vkDestroyPipeline(device, graphicsPipeline, nullptr);
-    // destroy pipeline layout
-    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-    // destroy render pass resources
-    vkDestroyRenderPass(device, imgui_render_pass, nullptr);
-    vkDestroyRenderPass(device, renderPass, nullptr);
+    if (!imgui_command_buffers.empty()) {
+        vkFreeCommandBuffers(device, imgui_command_pool, static_cast<uint32_t>(imgui_command_buffers.size()), imgui_command_buffers.data());
+    }
+
+    destroyGeometryAttachments();
 
     // Destroy each image view we own
     for (size_t i = 0; i < swapChainImageViews.size(); i++) {
         vkDestroyImageView(device, swapChainImageViews[i], nullptr);
     }
 
-    // destroy our swapchain
-    vkDestroySwapchainKHR(device, swapChain, nullptr);
-
-    for (size_t i = 0; i < uniformBuffers.size(); i++) {
-        vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-        vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
+    // destroy our swapchain, or the images we rendered to instead
+    if (headless) {
+        for (size_t i = 0; i < swapChainImages.size(); i++) {
+            vkDestroyImage(device, swapChainImages[i], nullptr);
+            allocator.free(offscreenImagesMemory[i]);
+        }
+    }
+    else {
+        vkDestroySwapchainKHR(device, swapChain, nullptr);
     }
-
-    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
 }
 
 void VulkanObject::cleanup() {
-    ImGui_ImplVulkan_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
+    if (!headless) {
+        ImGui_ImplVulkan_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
+    }
 
     // cleanup swap chain
     cleanupSwapChain();
-
-    vkDestroyImageView(device, offScreenPass.position.view, nullptr);
-    vkDestroyImage(device, offScreenPass.position.image, nullptr);
-    vkFreeMemory(device, offScreenPass.position.mem, nullptr);
-
-    vkDestroyImageView(device, offScreenPass.albedo.view, nullptr);
-    vkDestroyImage(device, offScreenPass.albedo.image, nullptr);
-    vkFreeMemory(device, offScreenPass.albedo.mem, nullptr);
-
-    vkDestroyImageView(device, offScreenPass.normal.view, nullptr);
-    vkDestroyImage(device, offScreenPass.normal.image, nullptr);
-    vkFreeMemory(device, offScreenPass.normal.mem, nullptr);
-
-    vkDestroyImageView(device, offScreenPass.depth.view, nullptr);
-    vkDestroyImage(device, offScreenPass.depth.image, nullptr);
-    vkFreeMemory(device, offScreenPass.depth.mem, nullptr);
-
-    vkDestroyFramebuffer(device, geometryFrameBuffer, nullptr);
-
-    vkDestroyDescriptorSetLayout(device, lightingSetLayout, nullptr);
-    vkDestroyRenderPass(device, geometryPass, nullptr);
+    destroyShadowMap();
+    // the workers may still be converting, and nothing they convert can be staged any more
+    textureStreamer.destroy();
+    // waits for anything still copying before the destinations go
+    uploads.destroy();
+
+    geometryPipelines.destroy();
+    lightingPipelines.destroy();
+    vkDestroyShaderModule(device, geometryVertModule, nullptr);
+    vkDestroyShaderModule(device, geometryFragModule, nullptr);
+    vkDestroyShaderModule(device, lightingVertModule, nullptr);
+    vkDestroyShaderModule(device, lightingFragModule, nullptr);
+    vkDestroyPipeline(device, shadowPipeline, nullptr);
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
     vkDestroyPipelineLayout(device, lightingLayout, nullptr);
-    vkDestroyPipeline(device, lightingPipeline, nullptr);
+    vkDestroyPipelineLayout(device, shadowLayout, nullptr);
+    vkDestroyPipeline(device, cullPipeline, nullptr);
+    vkDestroyPipeline(device, cullCompactPipeline, nullptr);
+    vkDestroyPipelineLayout(device, cullLayout, nullptr);
+    vkDestroyPipeline(device, clusterPipeline, nullptr);
+    vkDestroyPipelineLayout(device, clusterLayout, nullptr);
+
+    vkDestroyRenderPass(device, shadowPass.renderPass, nullptr);
+    vkDestroyRenderPass(device, shadowPass.cacheRenderPass, nullptr);
+    vkDestroyRenderPass(device, shadowPass.compositeRenderPass, nullptr);
+    vkDestroyRenderPass(device, geometryPass, nullptr);
+    vkDestroyRenderPass(device, imgui_render_pass, nullptr);
 
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
     vkDestroyDescriptorPool(device, lightingDescriptorPool, nullptr);
+    vkDestroyDescriptorPool(device, shadowDescriptorPool, nullptr);
+    vkDestroyDescriptorPool(device, cullDescriptorPool, nullptr);
+    vkDestroyDescriptorPool(device, clusterDescriptorPool, nullptr);
+
+    vkDestroyDescriptorSetLayout(device, lightingSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, shadowSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, cullSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, clusterSetLayout, nullptr);
 
+    vkDestroySampler(device, shadowPass.sampler, nullptr);
+    vkDestroySampler(device, shadowPass.pcfsampler, nullptr);
 
     vkDestroySampler(device, textureSampler, nullptr);
-    vkDestroyImageView(device, textureImageView, nullptr);
+    for (VkImageView view : textureLevelViews) {
+        if (view != VK_NULL_HANDLE) {
+            vkDestroyImageView(device, view, nullptr);
+        }
+    }
+    vkDestroyImageView(device, placeholderImageView, nullptr);
 
     vkDestroyImage(device, textureImage, nullptr);
-    vkFreeMemory(device, textureImageMemory, nullptr);
+    allocator.free(textureImageMemory);
+    vkDestroyImage(device, placeholderImage, nullptr);
+    allocator.free(placeholderImageMemory);
 
     vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
     vkDestroyBuffer(device, indexBuffer, nullptr);
-    vkFreeMemory(device, indexBufferMemory, nullptr);
+    allocator.free(indexBufferMemory);
 
     vkDestroyBuffer(device, vertexBuffer, nullptr);
-    vkFreeMemory(device, vertexBufferMemory, nullptr);
+    allocator.free(vertexBufferMemory);
+
+    if (attributeBuffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, attributeBuffer, nullptr);
+        allocator.free(attributeBufferMemory);
+    }
+
+    vkDestroyBuffer(device, meshBuffer, nullptr);
+    allocator.free(meshBufferMemory);
+
+    vkDestroyBuffer(device, instanceBuffer, nullptr);
+    allocator.free(instanceBufferMemory);
+
+    VkBuffer cullingBuffers[] = { cullBatchBuffer, visibleBuffer, drawBuffer, countBuffer };
+    Allocation* cullingMemory[] = { &cullBatchMemory, &visibleMemory, &drawMemory, &countMemory };
+    for (size_t i = 0; i < 4; i++) {
+        vkDestroyBuffer(device, cullingBuffers[i], nullptr);
+        allocator.free(*cullingMemory[i]);
+    }
+
+    vkDestroyBuffer(device, lightBuffer, nullptr);
+    allocator.free(lightMemory);
+    vkDestroyBuffer(device, clusterBuffer, nullptr);
+    allocator.free(clusterMemory);
+
+    vkDestroyBuffer(device, uniformRingBuffer, nullptr);
+    allocator.free(uniformRingMemory);
 
     // destroy all semaphores and fences
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
@@ -887,11 +1129,23 @@ void VulkanObject::cleanup() {
     }
 
     // destory command pool memory
+    destroyRecordContexts();
     vkDestroyCommandPool(device, commandPool, nullptr);
     vkDestroyCommandPool(device, imgui_command_pool, nullptr);
 
     vkDestroyDescriptorPool(device, imgui_descriptor_pool, VK_NULL_HANDLE);
 
+    profiler.destroy();
+
+    // keep whatever the driver compiled this run for the next one
+    if (!pipelineCache.save()) {
+        std::cerr << "failed to write " << PIPELINE_CACHE_PATH << std::endl;
+    }
+    pipelineCache.destroy();
+
+    // release every memory block before the device goes
+    allocator.destroy();
+
     // destory logical device
     vkDestroyDevice(device, nullptr);
 
@@ -902,17 +1156,21 @@ void VulkanObject::cleanup() {
     }
 
     // destory our surface BEFORE our instance
-    vkDestroySurfaceKHR(instance, surface, nullptr);
+    if (!headless) {
+        vkDestroySurfaceKHR(instance, surface, nullptr);
+    }
 
     // destory our instance of vulkan using the default deallocator
     vkDestroyInstance(instance, nullptr);
 
     // These were created first, so we delete them last!
-    // frees the memory allocated for our memory and invalidates the pointer
-    glfwDestroyWindow(window);
+    if (!headless) {
+        // frees the memory allocated for our memory and invalidates the pointer
+        glfwDestroyWindow(window);
 
-    // frees all resources GLFW had taken up
-    glfwTerminate();
+        // frees all resources GLFW had taken up
+        glfwTerminate();
+    }
 }
 
 void VulkanObject::createInstance() {
@@ -1068,6 +1326,9 @@ void VulkanObject::createLogicalDevice() {
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
     // set of our desired queue family's values
     std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+    if (indices.transferFamily.has_value()) {
+        uniqueQueueFamilies.insert(indices.transferFamily.value());
+    }
 
     // set queue priority
     float queuePriority = 1.0f;
@@ -1091,6 +1352,25 @@ void VulkanObject::createLogicalDevice() {
     VkPhysicalDeviceFeatures deviceFeatures{};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+    // the GPU driven path draws every batch from one indirect buffer, each with its own firstInstance
+    VkPhysicalDeviceFeatures supportedFeatures{};
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
+    // the texture is stored block compressed wherever the device can sample it
+    deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+    bool graphicsCompute = (queueFamilies[indices.graphicsFamily.value()].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+
+    gpuDriven = !cpuDraws && graphicsCompute && supportedFeatures.multiDrawIndirect && supportedFeatures.drawIndirectFirstInstance;
+    drawIndirectCount = gpuDriven && hasDeviceExtension(physicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+
+    deviceFeatures.multiDrawIndirect = gpuDriven ? VK_TRUE : VK_FALSE;
+    deviceFeatures.drawIndirectFirstInstance = gpuDriven ? VK_TRUE : VK_FALSE;
+
     // struct to hold device info
     VkDeviceCreateInfo createInfo{};
     // set device type
@@ -1104,10 +1384,19 @@ void VulkanObject::createLogicalDevice() {
     // enabled features is set to our struct containing that information
     createInfo.pEnabledFeatures = &deviceFeatures;
 
+    // extensions to enable. headless needs no swap chain
+    std::vector<const char*> enabledExtensions;
+    if (!headless) {
+        enabledExtensions = deviceExtensions;
+    }
+    if (drawIndirectCount) {
+        enabledExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    }
+
     // number of extensions to enable
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
     // array of extensions to enable
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
     // if we are using validation layers
     if (enableValidationLayers) {
@@ -1127,6 +1416,11 @@ void VulkanObject::createLogicalDevice() {
         throw std::runtime_error("failed to create logical device!");
     }
 
+    if (drawIndirectCount) {
+        cmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR"));
+        drawIndirectCount = cmdDrawIndexedIndirectCount != nullptr;
+    }
+
     VkPhysicalDeviceProperties output_props{};
 	
     vkGetPhysicalDeviceProperties(physicalDevice, &output_props);
@@ -1137,6 +1431,11 @@ void VulkanObject::createLogicalDevice() {
     vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
     // and get the presentation queue handle and assign it to presentQueue
     vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+    // uploads share the graphics queue without a transfer family
+    transferQueue = graphicsQueue;
+    if (indices.transferFamily.has_value()) {
+        vkGetDeviceQueue(device, indices.transferFamily.value(), 0, &transferQueue);
+    }
 }
 
 // create a swap chain
@@ -1228,6 +1527,19 @@ void VulkanObject::createSwapChain() {
     swapChainExtent = extent;
 }
 
+// create images to render into in place of a swap chain
+void VulkanObject::createOffscreenTargets() {
+    swapChainImageFormat = VK_FORMAT_R8G8B8A8_SRGB;
+
+    // one per frame in flight, so consecutive frames don't write the same target
+    swapChainImages.resize(MAX_FRAMES_IN_FLIGHT);
+    offscreenImagesMemory.resize(MAX_FRAMES_IN_FLIGHT);
+
+    for (size_t i = 0; i < swapChainImages.size(); i++) {
+        createImage(swapChainExtent.width, swapChainExtent.height, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swapChainImages[i], offscreenImagesMemory[i]);
+    }
+}
+
 // create our image views
 void VulkanObject::createImageViews() {
     // create enough space in our container for the number of images in our swap chain
@@ -1288,29 +1600,23 @@ void VulkanObject::createImguiPass()
 
 void VulkanObject::createGeometryPass()
 {
-	
+    GBufferFormats gbuffer_formats = gbufferFormats(gbufferLayout);
+    offScreenPass.albedo.format = gbuffer_formats.albedo;
+    offScreenPass.normal.format = gbuffer_formats.normal;
+    offScreenPass.depth.format = findDepthFormat();
+
+    // nothing reads the G-buffer after the lighting subpass, transient attachments never leave tile memory
+    VkAttachmentStoreOp gbufferStoreOp = transientAttachments ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+
     std::array<VkAttachmentDescription, 4> attachmentDescriptions{};
-    std::array<VkImageView, 4> imageViews{};
 
     std::array<VkAttachmentReference, 2> colorAttachmentRefs{};
 	
 	// color 1
-    createImage(swapChainExtent.width,
-        swapChainExtent.height,
-        VK_FORMAT_R32G32B32A32_SFLOAT,
-        VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        offScreenPass.albedo.image,
-        offScreenPass.albedo.mem);
-
-    imageViews[0] = createImageView(offScreenPass.albedo.image, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT);
-    offScreenPass.albedo.view = imageViews[0];
-
-    attachmentDescriptions[0].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+    attachmentDescriptions[0].format = offScreenPass.albedo.format;
     attachmentDescriptions[0].samples = VK_SAMPLE_COUNT_1_BIT;
     attachmentDescriptions[0].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachmentDescriptions[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachmentDescriptions[0].storeOp = gbufferStoreOp;
     attachmentDescriptions[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     attachmentDescriptions[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     attachmentDescriptions[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -1320,22 +1626,10 @@ void VulkanObject::createGeometryPass()
     colorAttachmentRefs[0].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
     // color 2
-    createImage(swapChainExtent.width,
-        swapChainExtent.height,
-        VK_FORMAT_A2R10G10B10_UNORM_PACK32,
-        VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        offScreenPass.normal.image,
-        offScreenPass.normal.mem);
-
-    imageViews[1] = createImageView(offScreenPass.normal.image, VK_FORMAT_A2R10G10B10_UNORM_PACK32, VK_IMAGE_ASPECT_COLOR_BIT);
-    offScreenPass.normal.view = imageViews[1];
-
-    attachmentDescriptions[1].format = VK_FORMAT_A2R10G10B10_UNORM_PACK32;
+    attachmentDescriptions[1].format = offScreenPass.normal.format;
     attachmentDescriptions[1].samples = VK_SAMPLE_COUNT_1_BIT;
     attachmentDescriptions[1].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachmentDescriptions[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachmentDescriptions[1].storeOp = gbufferStoreOp;
     attachmentDescriptions[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     attachmentDescriptions[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     attachmentDescriptions[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -1355,22 +1649,10 @@ void VulkanObject::createGeometryPass()
     attachmentDescriptions[2].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 	// depth
-    createImage(swapChainExtent.width,
-        swapChainExtent.height,
-        findDepthFormat(),
-        VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        offScreenPass.depth.image,
-        offScreenPass.depth.mem);
-
-    imageViews[imageViews.size() - 1] = createImageView(offScreenPass.depth.image, findDepthFormat(), VK_IMAGE_ASPECT_DEPTH_BIT);
-    offScreenPass.depth.view = imageViews[imageViews.size() - 1];
-	
-    attachmentDescriptions[attachmentDescriptions.size() - 1].format = findDepthFormat();
+    attachmentDescriptions[attachmentDescriptions.size() - 1].format = offScreenPass.depth.format;
     attachmentDescriptions[attachmentDescriptions.size() - 1].samples = VK_SAMPLE_COUNT_1_BIT;
     attachmentDescriptions[attachmentDescriptions.size() - 1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachmentDescriptions[attachmentDescriptions.size() - 1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachmentDescriptions[attachmentDescriptions.size() - 1].storeOp = gbufferStoreOp;
     attachmentDescriptions[attachmentDescriptions.size() - 1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     attachmentDescriptions[attachmentDescriptions.size() - 1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     attachmentDescriptions[attachmentDescriptions.size() - 1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -1457,31 +1739,21 @@ void VulkanObject::createGeometryPass()
 
 void VulkanObject::createShadowPass()
 {
-    std::array<VkAttachmentDescription, 1> attachmentDescriptions{};
-	
-    createImage(swapChainExtent.width,
-        swapChainExtent.height,
-        findDepthFormat(),
-        VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        shadowPass.depth.image,
-        shadowPass.depth.mem);
+    shadowPass.depth.format = findDepthFormat();
 
-    shadowPass.depth.view = createImageView(shadowPass.depth.image, findDepthFormat(), VK_IMAGE_ASPECT_DEPTH_BIT);
-	
     VkSamplerCreateInfo samplerInfo{};
     samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
     samplerInfo.magFilter = VK_FILTER_LINEAR;
     samplerInfo.minFilter = VK_FILTER_LINEAR;
-    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
     samplerInfo.anisotropyEnable = VK_TRUE;
     VkPhysicalDeviceProperties properties{};
     vkGetPhysicalDeviceProperties(physicalDevice, &properties);
     samplerInfo.maxAnisotropy = properties.limits.maxSamplerAnisotropy;
-    samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+    // past the edge of a cascade reads as the far plane, so it is never in shadow
+    samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
     samplerInfo.unnormalizedCoordinates = VK_FALSE;
     samplerInfo.compareEnable = VK_FALSE;
     samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
@@ -1498,14 +1770,14 @@ void VulkanObject::createShadowPass()
     pcfSamplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
     pcfSamplerInfo.magFilter = VK_FILTER_LINEAR;
     pcfSamplerInfo.minFilter = VK_FILTER_LINEAR;
-    pcfSamplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    pcfSamplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    pcfSamplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    pcfSamplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+    pcfSamplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+    pcfSamplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
     pcfSamplerInfo.anisotropyEnable = VK_TRUE;
     VkPhysicalDeviceProperties pcfproperties{};
     vkGetPhysicalDeviceProperties(physicalDevice, &pcfproperties);
     pcfSamplerInfo.maxAnisotropy = properties.limits.maxSamplerAnisotropy;
-    pcfSamplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+    pcfSamplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
     pcfSamplerInfo.unnormalizedCoordinates = VK_FALSE;
     pcfSamplerInfo.compareEnable = VK_TRUE;
     pcfSamplerInfo.compareOp = VK_COMPARE_OP_LESS;
@@ -1518,14 +1790,26 @@ void VulkanObject::createShadowPass()
         throw std::runtime_error("failed to create texture sampler!");
     }
 
-    attachmentDescriptions[attachmentDescriptions.size() - 1].format = findDepthFormat();
+    shadowPass.renderPass = createShadowRenderPass(VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+    // static casters are cached to be copied from, dynamic ones drawn over the copy
+    shadowPass.cacheRenderPass = createShadowRenderPass(VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    shadowPass.compositeRenderPass = createShadowRenderPass(VK_ATTACHMENT_LOAD_OP_LOAD, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+}
+
+// the three shadow render passes only differ in load op and layouts, so they are compatible
+// and share the shadow pipeline and framebuffers
+VkRenderPass VulkanObject::createShadowRenderPass(VkAttachmentLoadOp loadOp, VkImageLayout initialLayout, VkImageLayout finalLayout)
+{
+    std::array<VkAttachmentDescription, 1> attachmentDescriptions{};
+
+    attachmentDescriptions[attachmentDescriptions.size() - 1].format = shadowPass.depth.format;
     attachmentDescriptions[attachmentDescriptions.size() - 1].samples = VK_SAMPLE_COUNT_1_BIT;
-    attachmentDescriptions[attachmentDescriptions.size() - 1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachmentDescriptions[attachmentDescriptions.size() - 1].loadOp = loadOp;
     attachmentDescriptions[attachmentDescriptions.size() - 1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     attachmentDescriptions[attachmentDescriptions.size() - 1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     attachmentDescriptions[attachmentDescriptions.size() - 1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachmentDescriptions[attachmentDescriptions.size() - 1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachmentDescriptions[attachmentDescriptions.size() - 1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    attachmentDescriptions[attachmentDescriptions.size() - 1].initialLayout = initialLayout;
+    attachmentDescriptions[attachmentDescriptions.size() - 1].finalLayout = finalLayout;
 	
     VkAttachmentReference depthAttachmentRef{};
     depthAttachmentRef.attachment = attachmentDescriptions.size() - 1;
@@ -1572,9 +1856,12 @@ void VulkanObject::createShadowPass()
     shadowPassInfo.dependencyCount = dependencies.size();
     shadowPassInfo.pDependencies = dependencies.data();
 	
-    if (vkCreateRenderPass(device, &shadowPassInfo, nullptr, &shadowPass.renderPass) != VK_SUCCESS) {
+    VkRenderPass renderPass;
+    if (vkCreateRenderPass(device, &shadowPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
         throw std::runtime_error("failed to create render pass!");
     }
+
+    return renderPass;
 }
 
 // create our render pass object
@@ -1585,381 +1872,738 @@ void VulkanObject::createRenderPass()
     createImguiPass();
 }
 
-// recreate swap chain incase it is invalidated
-void VulkanObject::recreateSwapChain() {
-    // if minimised
-    int width = 0, height = 0;
-    while (width == 0 || height == 0) {
-        // minimise
-        glfwGetFramebufferSize(window, &width, &height);
-        // pause
-        glfwWaitEvents();
+// create the G-buffer images at the current extent
+void VulkanObject::createGeometryAttachments()
+{
+    VkImageUsageFlags transientUsage = transientAttachments ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0;
+    // createImage drops the lazily allocated bit when the device has no such memory
+    VkMemoryPropertyFlags memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | (transientAttachments ? VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : 0);
+
+    FrameBufferAttachment* colorAttachments[] = { &offScreenPass.albedo, &offScreenPass.normal };
+    for (FrameBufferAttachment* attachment : colorAttachments) {
+        createImage(swapChainExtent.width, swapChainExtent.height, attachment->format, VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | transientUsage, memoryProperties,
+            attachment->image, attachment->mem);
+        attachment->view = createImageView(attachment->image, attachment->format, VK_IMAGE_ASPECT_COLOR_BIT);
     }
 
-    ImGui_ImplVulkan_SetMinImageCount(swapChainImages.size());
+    createImage(swapChainExtent.width, swapChainExtent.height, offScreenPass.depth.format, VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | transientUsage, memoryProperties,
+        offScreenPass.depth.image, offScreenPass.depth.mem);
+    offScreenPass.depth.view = createImageView(offScreenPass.depth.image, offScreenPass.depth.format, VK_IMAGE_ASPECT_DEPTH_BIT);
 
-    // wait for device to finish
-    vkDeviceWaitIdle(device);
+    gbufferLazilyAllocated = (allocator.propertyFlags(offScreenPass.albedo.mem) & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
 
-    // clear swap chain
-    cleanupSwapChain();
+    offScreenPass.width = static_cast<int32_t>(swapChainExtent.width);
+    offScreenPass.height = static_cast<int32_t>(swapChainExtent.height);
+}
+
+// one line description of the G-buffer attachments and the memory behind them
+std::string VulkanObject::gbufferSummary()
+{
+    FrameBufferAttachment* attachments[] = { &offScreenPass.albedo, &offScreenPass.normal, &offScreenPass.depth };
+
+    VkDeviceSize allocated = 0;
+    VkDeviceSize committed = 0;
+    for (FrameBufferAttachment* attachment : attachments) {
+        allocated += attachment->mem.size;
+
+        // attachments always get a dedicated VkDeviceMemory, so the commitment is theirs alone
+        if (gbufferLazilyAllocated) {
+            VkDeviceSize bytes = 0;
+            vkGetDeviceMemoryCommitment(device, attachment->mem.memory, &bytes);
+            committed += bytes;
+        }
+    }
+
+    char line[192];
+    if (!transientAttachments) {
+        snprintf(line, sizeof(line), "G-buffer %s, %u bytes/px, %.2f MB", gbufferLayoutName(gbufferLayout),
+            gbufferBytesPerPixel(gbufferLayout, offScreenPass.depth.format), allocated / (1024.0 * 1024.0));
+    }
+    else if (gbufferLazilyAllocated) {
+        snprintf(line, sizeof(line), "G-buffer %s, %u bytes/px, transient, %.2f MB lazily allocated, %.2f MB committed", gbufferLayoutName(gbufferLayout),
+            gbufferBytesPerPixel(gbufferLayout, offScreenPass.depth.format), allocated / (1024.0 * 1024.0), committed / (1024.0 * 1024.0));
+    }
+    else {
+        snprintf(line, sizeof(line), "G-buffer %s, %u bytes/px, transient, %.2f MB (no lazily allocated memory)", gbufferLayoutName(gbufferLayout),
+            gbufferBytesPerPixel(gbufferLayout, offScreenPass.depth.format), allocated / (1024.0 * 1024.0));
+    }
+    return line;
+}
+
+void VulkanObject::destroyGeometryAttachments()
+{
+    FrameBufferAttachment* attachments[] = { &offScreenPass.albedo, &offScreenPass.normal, &offScreenPass.depth };
+    for (FrameBufferAttachment* attachment : attachments) {
+        vkDestroyImageView(device, attachment->view, nullptr);
+        vkDestroyImage(device, attachment->image, nullptr);
+        allocator.free(attachment->mem);
+    }
+}
+
+// the shadow map has its own resolution and outlives resizes. with dynamic casters every
+// cascade gets a second layer caching its static casters
+void VulkanObject::createShadowMap()
+{
+    shadowPass.width = static_cast<int32_t>(shadowResolution);
+    shadowPass.height = static_cast<int32_t>(shadowResolution);
+
+    shadowCompositing = scene.dynamicCount() > 0;
+    shadowPass.layers = cascadeSettings.count * (shadowCompositing ? 2 : 1);
+
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    if (shadowCompositing) {
+        usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+
+    createImage(shadowPass.width, shadowPass.height, shadowPass.depth.format, VK_IMAGE_TILING_OPTIMAL,
+        usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, shadowPass.depth.image, shadowPass.depth.mem, shadowPass.layers);
+    // the lighting pass only ever sees the cascades, not the caches
+    shadowPass.depth.view = createImageView(shadowPass.depth.image, shadowPass.depth.format, VK_IMAGE_ASPECT_DEPTH_BIT,
+        VK_IMAGE_VIEW_TYPE_2D_ARRAY, 0, cascadeSettings.count);
+
+    for (uint32_t i = 0; i < shadowPass.layers; i++) {
+        shadowPass.layerViews[i] = createImageView(shadowPass.depth.image, shadowPass.depth.format, VK_IMAGE_ASPECT_DEPTH_BIT,
+            VK_IMAGE_VIEW_TYPE_2D, i, 1);
+
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = shadowPass.renderPass;
+        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.pAttachments = &shadowPass.layerViews[i];
+        framebufferInfo.width = shadowPass.width;
+        framebufferInfo.height = shadowPass.height;
+        framebufferInfo.layers = 1;
+
+        if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &shadowPass.frameBuffers[i]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create framebuffer!");
+        }
+    }
+
+    // the new layers hold nothing yet
+    invalidateShadowCache();
+}
+
+void VulkanObject::destroyShadowMap()
+{
+    for (uint32_t i = 0; i < shadowPass.layers; i++) {
+        vkDestroyFramebuffer(device, shadowPass.frameBuffers[i], nullptr);
+        vkDestroyImageView(device, shadowPass.layerViews[i], nullptr);
+    }
+    vkDestroyImageView(device, shadowPass.depth.view, nullptr);
+    vkDestroyImage(device, shadowPass.depth.image, nullptr);
+    allocator.free(shadowPass.depth.mem);
+}
+
+void VulkanObject::createImguiFramebuffers()
+{
+    imgui_frame_buffers.resize(swapChainImages.size());
+
+    VkImageView attachment[1];
+    VkFramebufferCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    info.renderPass = imgui_render_pass;
+    info.attachmentCount = 1;
+    info.pAttachments = attachment;
+    info.width = swapChainExtent.width;
+    info.height = swapChainExtent.height;
+    info.layers = 1;
+    for (uint32_t i = 0; i < swapChainImages.size(); i++)
+    {
+        attachment[0] = swapChainImageViews[i];
+        vkCreateFramebuffer(device, &info, VK_NULL_HANDLE, &imgui_frame_buffers[i]);
+    }
+}
+
+// recreate swap chain incase it is invalidated. only what depends on the extent is
+// rebuilt, viewport and scissor are dynamic state so pipelines are left alone
+void VulkanObject::recreateSwapChain() {
+    // if minimised
+    int width = 0, height = 0;
+    while (width == 0 || height == 0) {
+        // minimise
+        glfwGetFramebufferSize(window, &width, &height);
+        // pause
+        glfwWaitEvents();
+    }
+
+    // wait for device to finish
+    vkDeviceWaitIdle(device);
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // clear swap chain
+    cleanupSwapChain();
+
+    // the render passes were built for this format
+    VkFormat previousFormat = swapChainImageFormat;
 
     // create swap chain
     createSwapChain();
+    // e.g. the window moved to a monitor with another surface format
+    if (swapChainImageFormat != previousFormat) {
+        recreateFormatDependent();
+    }
     // create image views off of swap chain
     createImageViews();
-    // create render pass
-    createRenderPass();
-    // create graphics pipeline
-    createGraphicsPipeline();
-    createDepthResources();
+    createGeometryAttachments();
     // create framebuffers
     createFramebuffers();
+    createImguiFramebuffers();
 
-    imgui_frame_buffers.resize(swapChainImages.size());
+    imgui_command_buffers.resize(swapChainImageViews.size());
+    createCommandBuffers(imgui_command_buffers.data(), static_cast<uint32_t>(imgui_command_buffers.size()), imgui_command_pool);
 
-    {
-        VkImageView attachment[1];
-        VkFramebufferCreateInfo info = {};
-        info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        info.renderPass = imgui_render_pass;
-        info.attachmentCount = 1;
-        info.pAttachments = attachment;
-        info.width = swapChainExtent.width;
-        info.height = swapChainExtent.height;
-        info.layers = 1;
-        for (uint32_t i = 0; i < swapChainImages.size(); i++)
-        {
-            attachment[0] = swapChainImageViews[i];
-            vkCreateFramebuffer(device, &info, VK_NULL_HANDLE, &imgui_frame_buffers[i]);
-        }
-    }
+    ImGui_ImplVulkan_SetMinImageCount(swapChainImages.size());
 
-    createUniformBuffers();
-    createDescriptorPool();
+    // point the lighting pass at the new attachments
+    updateAttachmentDescriptors();
 
-    ImGui_ImplVulkan_SetMinImageCount(swapChainImages.size());
+    // the image count may have changed
+    imagesInFlight.assign(swapChainImages.size(), VK_NULL_HANDLE);
 
-    VkCommandBuffer command_buffer = beginSingleTimeCommands();
-    ImGui_ImplVulkan_CreateFontsTexture(command_buffer);
-    endSingleTimeCommands(command_buffer);
+    auto end = std::chrono::high_resolution_clock::now();
+    lastResizeMs = std::chrono::duration<float, std::milli>(end - start).count();
+}
 
-    createCommandPool(&imgui_command_pool, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
-    imgui_command_buffers.resize(swapChainImageViews.size());
-    createCommandBuffers(imgui_command_buffers.data(), static_cast<uint32_t>(imgui_command_buffers.size()), imgui_command_pool);
+// the device is idle and the framebuffers are gone, so nothing still refers to the old passes
+void VulkanObject::recreateFormatDependent() {
+    geometryPipelines.destroy();
+    lightingPipelines.destroy();
+    ImGui_ImplVulkan_Shutdown();
+    vkDestroyRenderPass(device, geometryPass, nullptr);
+    vkDestroyRenderPass(device, imgui_render_pass, nullptr);
 
-    createDescriptorSets();
-    // create command buffers
-    createCommandBuffers();
+    createGeometryPass();
+    createImguiPass();
+    initPermutations();
+    initImguiRenderer();
 }
 
 void VulkanObject::createDescriptorSets() {
-    std::vector<VkDescriptorSetLayout> layouts(swapChainImages.size(), descriptorSetLayout);
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    std::vector<VkDescriptorSetLayout> frameLayouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayout);
+    descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
     allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(swapChainImages.size());
-    allocInfo.pSetLayouts = layouts.data();
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(frameLayouts.size());
+    allocInfo.pSetLayouts = frameLayouts.data();
 
-    descriptorSets.resize(swapChainImages.size());
     if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
         throw std::runtime_error("failed to allocate descriptor sets!");
     }
 
-    std::vector<VkDescriptorSetLayout> lightingLayouts(swapChainImages.size(), lightingSetLayout);
     VkDescriptorSetAllocateInfo lightingAllocInfo{};
     lightingAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     lightingAllocInfo.descriptorPool = lightingDescriptorPool;
-    lightingAllocInfo.descriptorSetCount = static_cast<uint32_t>(swapChainImages.size());
-    lightingAllocInfo.pSetLayouts = lightingLayouts.data();
+    lightingAllocInfo.descriptorSetCount = 1;
+    lightingAllocInfo.pSetLayouts = &lightingSetLayout;
 
-    lightingDescriptorSets.resize(swapChainImages.size());
-    if (vkAllocateDescriptorSets(device, &lightingAllocInfo, lightingDescriptorSets.data()) != VK_SUCCESS) {
+    if (vkAllocateDescriptorSets(device, &lightingAllocInfo, &lightingDescriptorSet) != VK_SUCCESS) {
         throw std::runtime_error("failed to allocate descriptor sets!");
     }
 
-    std::vector<VkDescriptorSetLayout> shadowLayouts(swapChainImages.size(), shadowSetLayout);
     VkDescriptorSetAllocateInfo shadowAllocInfo{};
     shadowAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     shadowAllocInfo.descriptorPool = shadowDescriptorPool;
-    shadowAllocInfo.descriptorSetCount = static_cast<uint32_t>(swapChainImages.size());
-    shadowAllocInfo.pSetLayouts = shadowLayouts.data();
+    shadowAllocInfo.descriptorSetCount = 1;
+    shadowAllocInfo.pSetLayouts = &shadowSetLayout;
 
-    shadowDescriptorSets.resize(swapChainImages.size());
-    if (vkAllocateDescriptorSets(device, &shadowAllocInfo, shadowDescriptorSets.data()) != VK_SUCCESS) {
+    if (vkAllocateDescriptorSets(device, &shadowAllocInfo, &shadowDescriptorSet) != VK_SUCCESS) {
         throw std::runtime_error("failed to allocate descriptor sets!");
     }
 
-    for (size_t i = 0; i < swapChainImages.size(); i++) {
-        VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = uniformBuffers[i];
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(UniformBufferObject);
-
-        VkDescriptorBufferInfo shadowBufferInfo{};
-        shadowBufferInfo.buffer = shadowUniformBuffers[i];
-        shadowBufferInfo.offset = 0;
-        shadowBufferInfo.range = sizeof(ShadowUniformBufferObject);
-
-        VkDescriptorImageInfo shadowImageInfo{};
-        shadowImageInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
-        shadowImageInfo.imageView = shadowPass.depth.view;
-        shadowImageInfo.sampler = shadowPass.sampler;
-
-        VkDescriptorImageInfo PCFShadowImageInfo{};
-        PCFShadowImageInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
-        PCFShadowImageInfo.imageView = shadowPass.depth.view;
-        PCFShadowImageInfo.sampler = shadowPass.pcfsampler;
+    // the actual offset into the ring is supplied when binding
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = uniformRing.buffer();
+    bufferInfo.offset = 0;
+    bufferInfo.range = sizeof(UniformBufferObject);
+
+    VkDescriptorBufferInfo shadowBufferInfo{};
+    shadowBufferInfo.buffer = uniformRing.buffer();
+    shadowBufferInfo.offset = 0;
+    shadowBufferInfo.range = sizeof(ShadowUniformBufferObject);
+
+    VkDescriptorBufferInfo instanceBufferInfo{};
+    instanceBufferInfo.buffer = instanceBuffer;
+    instanceBufferInfo.offset = 0;
+    instanceBufferInfo.range = VK_WHOLE_SIZE;
+
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfo.imageView = residentTextureView();
+    imageInfo.sampler = textureSampler;
+    boundTextureViews.assign(MAX_FRAMES_IN_FLIGHT, imageInfo.imageView);
+
+    // camera and light each cull into their own slice of the visible list
+    VkDescriptorBufferInfo cameraVisibleInfo{};
+    cameraVisibleInfo.buffer = visibleBuffer;
+    cameraVisibleInfo.offset = 0;
+    cameraVisibleInfo.range = sizeof(uint32_t) * visibleStride;
+
+    // the light views' slices are picked with a dynamic offset when binding
+    VkDescriptorBufferInfo lightVisibleInfo{};
+    lightVisibleInfo.buffer = visibleBuffer;
+    lightVisibleInfo.offset = 0;
+    lightVisibleInfo.range = sizeof(uint32_t) * visibleStride;
+
+    // the frame's slice is picked with a dynamic offset when binding
+    VkDescriptorBufferInfo lightsInfo{};
+    lightsInfo.buffer = lightBuffer;
+    lightsInfo.offset = 0;
+    lightsInfo.range = sizeof(GpuLight) * MAX_LIGHTS;
+
+    VkDescriptorBufferInfo clustersInfo{};
+    clustersInfo.buffer = clusterBuffer;
+    clustersInfo.offset = 0;
+    clustersInfo.range = VK_WHOLE_SIZE;
+
+    VkDescriptorBufferInfo meshInfo{};
+    meshInfo.buffer = meshBuffer;
+    meshInfo.offset = 0;
+    meshInfo.range = VK_WHOLE_SIZE;
+
+    std::array<VkWriteDescriptorSet, 12> descriptorWrites{};
+
+    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[0].dstSet = descriptorSets[0];
+    descriptorWrites[0].dstBinding = 0;
+    descriptorWrites[0].dstArrayElement = 0;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    descriptorWrites[0].descriptorCount = 1;
+    descriptorWrites[0].pBufferInfo = &bufferInfo;
+
+    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[1].dstSet = descriptorSets[0];
+    descriptorWrites[1].dstBinding = 1;
+    descriptorWrites[1].dstArrayElement = 0;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrites[1].descriptorCount = 1;
+    descriptorWrites[1].pImageInfo = &imageInfo;
+
+    descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[2].dstSet = lightingDescriptorSet;
+    descriptorWrites[2].dstBinding = 0;
+    descriptorWrites[2].dstArrayElement = 0;
+    descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    descriptorWrites[2].descriptorCount = 1;
+    descriptorWrites[2].pBufferInfo = &bufferInfo;
+
+    descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[3].dstSet = shadowDescriptorSet;
+    descriptorWrites[3].dstBinding = 0;
+    descriptorWrites[3].dstArrayElement = 0;
+    descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    descriptorWrites[3].descriptorCount = 1;
+    descriptorWrites[3].pBufferInfo = &shadowBufferInfo;
+
+    descriptorWrites[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[4].dstSet = descriptorSets[0];
+    descriptorWrites[4].dstBinding = 2;
+    descriptorWrites[4].dstArrayElement = 0;
+    descriptorWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrites[4].descriptorCount = 1;
+    descriptorWrites[4].pBufferInfo = &instanceBufferInfo;
+
+    descriptorWrites[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[5].dstSet = shadowDescriptorSet;
+    descriptorWrites[5].dstBinding = 1;
+    descriptorWrites[5].dstArrayElement = 0;
+    descriptorWrites[5].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrites[5].descriptorCount = 1;
+    descriptorWrites[5].pBufferInfo = &instanceBufferInfo;
+
+    descriptorWrites[6].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[6].dstSet = descriptorSets[0];
+    descriptorWrites[6].dstBinding = 3;
+    descriptorWrites[6].dstArrayElement = 0;
+    descriptorWrites[6].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrites[6].descriptorCount = 1;
+    descriptorWrites[6].pBufferInfo = &cameraVisibleInfo;
+
+    descriptorWrites[7].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[7].dstSet = shadowDescriptorSet;
+    descriptorWrites[7].dstBinding = 2;
+    descriptorWrites[7].dstArrayElement = 0;
+    descriptorWrites[7].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    descriptorWrites[7].descriptorCount = 1;
+    descriptorWrites[7].pBufferInfo = &lightVisibleInfo;
+
+    descriptorWrites[8].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[8].dstSet = lightingDescriptorSet;
+    descriptorWrites[8].dstBinding = 7;
+    descriptorWrites[8].dstArrayElement = 0;
+    descriptorWrites[8].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    descriptorWrites[8].descriptorCount = 1;
+    descriptorWrites[8].pBufferInfo = &lightsInfo;
+
+    descriptorWrites[9].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[9].dstSet = lightingDescriptorSet;
+    descriptorWrites[9].dstBinding = 8;
+    descriptorWrites[9].dstArrayElement = 0;
+    descriptorWrites[9].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrites[9].descriptorCount = 1;
+    descriptorWrites[9].pBufferInfo = &clustersInfo;
+
+    descriptorWrites[10].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[10].dstSet = descriptorSets[0];
+    descriptorWrites[10].dstBinding = 4;
+    descriptorWrites[10].dstArrayElement = 0;
+    descriptorWrites[10].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrites[10].descriptorCount = 1;
+    descriptorWrites[10].pBufferInfo = &meshInfo;
+
+    descriptorWrites[11].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[11].dstSet = shadowDescriptorSet;
+    descriptorWrites[11].dstBinding = 3;
+    descriptorWrites[11].dstArrayElement = 0;
+    descriptorWrites[11].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrites[11].descriptorCount = 1;
+    descriptorWrites[11].pBufferInfo = &meshInfo;
+
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+    // the other frames' copies of the geometry set, each on its own camera visible list
+    for (size_t frame = 1; frame < descriptorSets.size(); frame++) {
+        VkDescriptorBufferInfo frameVisibleInfo = cameraVisibleInfo;
+        frameVisibleInfo.offset = sizeof(uint32_t) * visibleFrameStride * frame;
+
+        std::array<VkWriteDescriptorSet, 5> frameWrites = { descriptorWrites[0], descriptorWrites[1], descriptorWrites[4], descriptorWrites[6], descriptorWrites[10] };
+        for (VkWriteDescriptorSet& write : frameWrites) {
+            write.dstSet = descriptorSets[frame];
+        }
+        frameWrites[3].pBufferInfo = &frameVisibleInfo;
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(frameWrites.size()), frameWrites.data(), 0, nullptr);
+    }
 
-        VkDescriptorImageInfo imageInfo{};
-        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageInfo.imageView = textureImageView;
-        imageInfo.sampler = textureSampler;
+    VkDescriptorSetAllocateInfo cullAllocInfo{};
+    cullAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    cullAllocInfo.descriptorPool = cullDescriptorPool;
+    cullAllocInfo.descriptorSetCount = 1;
+    cullAllocInfo.pSetLayouts = &cullSetLayout;
 
-        VkDescriptorImageInfo colorDescriptorInfo{};
-        colorDescriptorInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        colorDescriptorInfo.imageView = offScreenPass.albedo.view;
-        colorDescriptorInfo.sampler = VK_NULL_HANDLE;
-
-        VkDescriptorImageInfo normalDescriptorInfo{};
-        normalDescriptorInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        normalDescriptorInfo.imageView = offScreenPass.normal.view;
-        normalDescriptorInfo.sampler = VK_NULL_HANDLE;
-
-        VkDescriptorImageInfo depthDescriptorInfo{};
-        depthDescriptorInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        depthDescriptorInfo.imageView = offScreenPass.depth.view;
-        depthDescriptorInfo.sampler = VK_NULL_HANDLE;
-
-        std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-
-        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[0].dstSet = descriptorSets[i];
-        descriptorWrites[0].dstBinding = 0;
-        descriptorWrites[0].dstArrayElement = 0;
-        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites[0].descriptorCount = 1;
-        descriptorWrites[0].pBufferInfo = &bufferInfo;
-
-        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[1].dstSet = descriptorSets[i];
-        descriptorWrites[1].dstBinding = 1;
-        descriptorWrites[1].dstArrayElement = 0;
-        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        descriptorWrites[1].descriptorCount = 1;
-        descriptorWrites[1].pImageInfo = &imageInfo;
-
-        vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
-
-        std::array<VkWriteDescriptorSet, 6> lightingDescriptorWrites{};
-
-        lightingDescriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        lightingDescriptorWrites[0].dstSet = lightingDescriptorSets[i];
-        lightingDescriptorWrites[0].dstBinding = 0;
-        lightingDescriptorWrites[0].dstArrayElement = 0;
-        lightingDescriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        lightingDescriptorWrites[0].descriptorCount = 1;
-        lightingDescriptorWrites[0].pBufferInfo = &bufferInfo;
-
-        lightingDescriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        lightingDescriptorWrites[1].dstSet = lightingDescriptorSets[i];
-        lightingDescriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-        lightingDescriptorWrites[1].descriptorCount = 1;
-        lightingDescriptorWrites[1].dstBinding = 1;
-        lightingDescriptorWrites[1].pImageInfo = &colorDescriptorInfo;
-
-        lightingDescriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        lightingDescriptorWrites[2].dstSet = lightingDescriptorSets[i];
-        lightingDescriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-        lightingDescriptorWrites[2].descriptorCount = 1;
-        lightingDescriptorWrites[2].dstBinding = 2;
-        lightingDescriptorWrites[2].pImageInfo = &normalDescriptorInfo;
-
-        lightingDescriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        lightingDescriptorWrites[3].dstSet = lightingDescriptorSets[i];
-        lightingDescriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-        lightingDescriptorWrites[3].descriptorCount = 1;
-        lightingDescriptorWrites[3].dstBinding = 4;
-        lightingDescriptorWrites[3].pImageInfo = &depthDescriptorInfo;
-
-        lightingDescriptorWrites[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        lightingDescriptorWrites[4].dstSet = lightingDescriptorSets[i];
-        lightingDescriptorWrites[4].dstBinding = 5;
-        lightingDescriptorWrites[4].dstArrayElement = 0;
-        lightingDescriptorWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        lightingDescriptorWrites[4].descriptorCount = 1;
-        lightingDescriptorWrites[4].pImageInfo = &shadowImageInfo;
-
-        lightingDescriptorWrites[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        lightingDescriptorWrites[5].dstSet = lightingDescriptorSets[i];
-        lightingDescriptorWrites[5].dstBinding = 6;
-        lightingDescriptorWrites[5].dstArrayElement = 0;
-        lightingDescriptorWrites[5].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        lightingDescriptorWrites[5].descriptorCount = 1;
-        lightingDescriptorWrites[5].pImageInfo = &PCFShadowImageInfo;
-
-        vkUpdateDescriptorSets(device, static_cast<uint32_t>(lightingDescriptorWrites.size()), lightingDescriptorWrites.data(), 0, nullptr);
-
-        std::array<VkWriteDescriptorSet, 1> shadowDescriptorWrites{};
-
-        shadowDescriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        shadowDescriptorWrites[0].dstSet = shadowDescriptorSets[i];
-        shadowDescriptorWrites[0].dstBinding = 0;
-        shadowDescriptorWrites[0].dstArrayElement = 0;
-        shadowDescriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        shadowDescriptorWrites[0].descriptorCount = 1;
-        shadowDescriptorWrites[0].pBufferInfo = &shadowBufferInfo;
-
-        vkUpdateDescriptorSets(device, static_cast<uint32_t>(shadowDescriptorWrites.size()), shadowDescriptorWrites.data(), 0, nullptr);
+    if (vkAllocateDescriptorSets(device, &cullAllocInfo, &cullDescriptorSet) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate descriptor sets!");
+    }
+
+    // binding order matches shaders/cull.glsl
+    std::array<VkDescriptorBufferInfo, 6> cullBufferInfos{};
+    cullBufferInfos[0] = { uniformRing.buffer(), 0, sizeof(CullUniformBufferObject) };
+    cullBufferInfos[1] = { instanceBuffer, 0, VK_WHOLE_SIZE };
+    cullBufferInfos[2] = { cullBatchBuffer, 0, VK_WHOLE_SIZE };
+    cullBufferInfos[3] = { visibleBuffer, 0, VK_WHOLE_SIZE };
+    cullBufferInfos[4] = { drawBuffer, 0, VK_WHOLE_SIZE };
+    cullBufferInfos[5] = { countBuffer, 0, VK_WHOLE_SIZE };
+
+    std::array<VkWriteDescriptorSet, 6> cullWrites{};
+    for (uint32_t i = 0; i < cullWrites.size(); i++) {
+        cullWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        cullWrites[i].dstSet = cullDescriptorSet;
+        cullWrites[i].dstBinding = i;
+        cullWrites[i].dstArrayElement = 0;
+        cullWrites[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        cullWrites[i].descriptorCount = 1;
+        cullWrites[i].pBufferInfo = &cullBufferInfos[i];
     }
+
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(cullWrites.size()), cullWrites.data(), 0, nullptr);
+
+    VkDescriptorSetAllocateInfo clusterAllocInfo{};
+    clusterAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    clusterAllocInfo.descriptorPool = clusterDescriptorPool;
+    clusterAllocInfo.descriptorSetCount = 1;
+    clusterAllocInfo.pSetLayouts = &clusterSetLayout;
+
+    if (vkAllocateDescriptorSets(device, &clusterAllocInfo, &clusterDescriptorSet) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate descriptor sets!");
+    }
+
+    std::array<VkDescriptorBufferInfo, 3> clusterBufferInfos{};
+    clusterBufferInfos[0] = { uniformRing.buffer(), 0, sizeof(ClusterUniformBufferObject) };
+    clusterBufferInfos[1] = lightsInfo;
+    clusterBufferInfos[2] = clustersInfo;
+
+    std::array<VkWriteDescriptorSet, 3> clusterWrites{};
+    VkDescriptorType clusterTypes[] = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER };
+    for (uint32_t i = 0; i < clusterWrites.size(); i++) {
+        clusterWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        clusterWrites[i].dstSet = clusterDescriptorSet;
+        clusterWrites[i].dstBinding = i;
+        clusterWrites[i].dstArrayElement = 0;
+        clusterWrites[i].descriptorType = clusterTypes[i];
+        clusterWrites[i].descriptorCount = 1;
+        clusterWrites[i].pBufferInfo = &clusterBufferInfos[i];
+    }
+
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(clusterWrites.size()), clusterWrites.data(), 0, nullptr);
+
+    updateAttachmentDescriptors();
 }
 
-// create the graphics pipeline.
-void VulkanObject::createGraphicsPipeline() {
-    // read in our compiled SPIR-V shaders
-    auto vertShaderCode = readFile("../shaders/vulkan3/geometry_pass_vert.spv");
-    auto fragShaderCode = readFile("../shaders/vulkan3/geometry_pass_frag.spv");
+// (re)point the lighting set at the G-buffer and shadow map. only valid while
+// no command buffer using the set is pending
+void VulkanObject::updateAttachmentDescriptors() {
+    VkDescriptorImageInfo shadowImageInfo{};
+    shadowImageInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    shadowImageInfo.imageView = shadowPass.depth.view;
+    shadowImageInfo.sampler = shadowPass.sampler;
+
+    VkDescriptorImageInfo PCFShadowImageInfo{};
+    PCFShadowImageInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    PCFShadowImageInfo.imageView = shadowPass.depth.view;
+    PCFShadowImageInfo.sampler = shadowPass.pcfsampler;
+
+    VkDescriptorImageInfo colorDescriptorInfo{};
+    colorDescriptorInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    colorDescriptorInfo.imageView = offScreenPass.albedo.view;
+    colorDescriptorInfo.sampler = VK_NULL_HANDLE;
+
+    VkDescriptorImageInfo normalDescriptorInfo{};
+    normalDescriptorInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    normalDescriptorInfo.imageView = offScreenPass.normal.view;
+    normalDescriptorInfo.sampler = VK_NULL_HANDLE;
+
+    VkDescriptorImageInfo depthDescriptorInfo{};
+    depthDescriptorInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    depthDescriptorInfo.imageView = offScreenPass.depth.view;
+    depthDescriptorInfo.sampler = VK_NULL_HANDLE;
+
+    std::array<VkWriteDescriptorSet, 5> lightingDescriptorWrites{};
+
+    lightingDescriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    lightingDescriptorWrites[0].dstSet = lightingDescriptorSet;
+    lightingDescriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    lightingDescriptorWrites[0].descriptorCount = 1;
+    lightingDescriptorWrites[0].dstBinding = 1;
+    lightingDescriptorWrites[0].pImageInfo = &colorDescriptorInfo;
+
+    lightingDescriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    lightingDescriptorWrites[1].dstSet = lightingDescriptorSet;
+    lightingDescriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    lightingDescriptorWrites[1].descriptorCount = 1;
+    lightingDescriptorWrites[1].dstBinding = 2;
+    lightingDescriptorWrites[1].pImageInfo = &normalDescriptorInfo;
+
+    lightingDescriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    lightingDescriptorWrites[2].dstSet = lightingDescriptorSet;
+    lightingDescriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    lightingDescriptorWrites[2].descriptorCount = 1;
+    lightingDescriptorWrites[2].dstBinding = 4;
+    lightingDescriptorWrites[2].pImageInfo = &depthDescriptorInfo;
+
+    lightingDescriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    lightingDescriptorWrites[3].dstSet = lightingDescriptorSet;
+    lightingDescriptorWrites[3].dstBinding = 5;
+    lightingDescriptorWrites[3].dstArrayElement = 0;
+    lightingDescriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    lightingDescriptorWrites[3].descriptorCount = 1;
+    lightingDescriptorWrites[3].pImageInfo = &shadowImageInfo;
+
+    lightingDescriptorWrites[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    lightingDescriptorWrites[4].dstSet = lightingDescriptorSet;
+    lightingDescriptorWrites[4].dstBinding = 6;
+    lightingDescriptorWrites[4].dstArrayElement = 0;
+    lightingDescriptorWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    lightingDescriptorWrites[4].descriptorCount = 1;
+    lightingDescriptorWrites[4].pImageInfo = &PCFShadowImageInfo;
+
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(lightingDescriptorWrites.size()), lightingDescriptorWrites.data(), 0, nullptr);
+}
 
-    // create shader module per shader
-    VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-    VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
-
-    // create a shader stage info struct for the vertex shader
-    VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-    // assign it's type
-    vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    // assign vertex shader to it's stage
-    vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    // add the shader code
-    vertShaderStageInfo.module = vertShaderModule;
-    // add standard name
-    vertShaderStageInfo.pName = "main";
-
-    // create a shader stage info struct for the fragment shader
-    VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-    // assign it's type
-    fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    // assign fragment shader to it's stage
-    fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    // add the shader code
-    fragShaderStageInfo.module = fragShaderModule;
-    // add standard name
-    fragShaderStageInfo.pName = "main";
-
-    // an array which contains both shaders for convenience 
-    VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
-
-    // a struct to store information about vertex data we will be passing to the vertex shader
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-    // set type of struct
-    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    // for now, this data is hard coded
-
-    auto bindingDescription = Vertex::getBindingDescription();
-    auto attributeDescriptions = Vertex::getAttributeDescriptions();
-
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-
-    // create struct to describe how geometry should be drawn. Points, lines, strips, etc.
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-    // assign struct type
-    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    // assign drawing type
-    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    // we dont intend on splitting geometry up with special operations
-    inputAssembly.primitiveRestartEnable = VK_FALSE;
+namespace {
+    // fixed function state of the scene pipelines, set up for the geometry pass apart from the vertex
+    // input, which setVertexInput adds. the lighting and shadow passes adjust it before building.
+    // pipelineInfo points into the struct, so it is not copyable
+    struct GraphicsPipelineState
+    {
+        std::vector<VkVertexInputBindingDescription> bindingDescriptions;
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        VkPipelineViewportStateCreateInfo viewportState{};
+        std::array<VkDynamicState, 2> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+        VkPipelineDynamicStateCreateInfo dynamicState{};
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        std::array<VkPipelineColorBlendAttachmentState, 2> colorBlendAttachments{};
+        VkPipelineColorBlendStateCreateInfo colorBlending{};
+        VkPipelineDepthStencilStateCreateInfo depthStencil{};
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+
+        GraphicsPipelineState();
+        GraphicsPipelineState(GraphicsPipelineState const&) = delete;
+        GraphicsPipelineState& operator=(GraphicsPipelineState const&) = delete;
+
+        // vertex streams of a layout, only the positions for the depth only passes. without a
+        // call the pipeline has no vertex input
+        void setVertexInput(VertexLayout layout, bool position_only);
+    };
 
-    // struct to describe region to be rendered to
-    VkViewport viewport{};
-    // position in window
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    // width and height in window
-    viewport.width = (float)swapChainExtent.width;
-    viewport.height = (float)swapChainExtent.height;
-    // range of depth values to use
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
+    GraphicsPipelineState::GraphicsPipelineState()
+    {
+        // a struct to store information about vertex data we will be passing to the vertex shader
+        // set type of struct
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInputInfo.vertexBindingDescriptionCount = 0;
+        vertexInputInfo.vertexAttributeDescriptionCount = 0;
 
-    // struct to describe scissor rectangle (for cropping the output without transforming)
-    VkRect2D scissor{};
-    // position in window
-    scissor.offset = { 0, 0 };
-    // width and ehight
-    scissor.extent = swapChainExtent;
+        // create struct to describe how geometry should be drawn. Points, lines, strips, etc.
+        // assign struct type
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        // assign drawing type
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        // we dont intend on splitting geometry up with special operations
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-    // create viewport state struct as a combination of viewport and scissor
-    VkPipelineViewportStateCreateInfo viewportState{};
-    // assign type
-    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    // assign viewport count
-    viewportState.viewportCount = 1;
-    // set the viewport to be our previously created viewport
-    viewportState.pViewports = &viewport;
-    // assign scissor count
-    viewportState.scissorCount = 1;
-    // set the scissor rectangle to be our previously created scissor rectangle
-    viewportState.pScissors = &scissor;
-
-    // create struct describing the rasteriser (i will spell it english-style!)
-    VkPipelineRasterizationStateCreateInfo rasterizer{};
-    // assign type
-    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    // fragments beyond the near and far plane are not clamped as opposed to deleted
-    rasterizer.depthClampEnable = VK_FALSE;
-    // we want output data from the rasteriser, so we set this false
-    rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    // we are filling polygons we draw (so generating fragments within boundaries
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-    // set the width of our boundary lines
-    rasterizer.lineWidth = 1.0f;
-    // we will be culling the back faces
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-    // we consider vertex order to be clockwise and front facing
-    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-    // no shadow mapping, no need for depth biasing
-    rasterizer.depthBiasEnable = VK_FALSE;
-
-    // used for anti-aliasing. struct to store info on multisampling
-    VkPipelineMultisampleStateCreateInfo multisampling{};
-    // assign struct type
-    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    // we disable it
-    multisampling.sampleShadingEnable = VK_FALSE;
-    // one 1 sample count
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-    // colour blend state per attached frame buffer
-    std::array<VkPipelineColorBlendAttachmentState, 2> colorBlendAttachments{};
-    // blend RGBA
-    colorBlendAttachments[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    // disable
-    colorBlendAttachments[0].blendEnable = VK_FALSE;
-    // blend RGBA
-    colorBlendAttachments[1].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    // disable
-    colorBlendAttachments[1].blendEnable = VK_FALSE;
-
-    // used for all framebuffers. allows setting of blend constants that can be used as blend factors.
-    VkPipelineColorBlendStateCreateInfo colorBlending{};
-    // assign type
-    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    // disable logicOp
-    colorBlending.logicOpEnable = VK_FALSE;
-    // bitwise operation specified here
-    colorBlending.logicOp = VK_LOGIC_OP_COPY;
-    // number of attachments
-    colorBlending.attachmentCount = colorBlendAttachments.size();
-    // set as previously defined attachment
-    colorBlending.pAttachments = colorBlendAttachments.data();
-    // blend constants
-    colorBlending.blendConstants[0] = 0.0f;
-    colorBlending.blendConstants[1] = 0.0f;
-    colorBlending.blendConstants[2] = 0.0f;
-    colorBlending.blendConstants[3] = 0.0f;
+        // one viewport and scissor, both set when recording so a resize keeps the pipelines
+        // assign type
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        // assign viewport count
+        viewportState.viewportCount = 1;
+        // assign scissor count
+        viewportState.scissorCount = 1;
+
+        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+        dynamicState.pDynamicStates = dynamicStates.data();
+
+        // create struct describing the rasteriser (i will spell it english-style!)
+        // assign type
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        // fragments beyond the near and far plane are not clamped as opposed to deleted
+        rasterizer.depthClampEnable = VK_FALSE;
+        // we want output data from the rasteriser, so we set this false
+        rasterizer.rasterizerDiscardEnable = VK_FALSE;
+        // we are filling polygons we draw (so generating fragments within boundaries
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        // set the width of our boundary lines
+        rasterizer.lineWidth = 1.0f;
+        // we will be culling the back faces
+        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+        // we consider vertex order to be clockwise and front facing
+        rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        // no shadow mapping, no need for depth biasing
+        rasterizer.depthBiasEnable = VK_FALSE;
+
+        // used for anti-aliasing. struct to store info on multisampling
+        // assign struct type
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        // we disable it
+        multisampling.sampleShadingEnable = VK_FALSE;
+        // one 1 sample count
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+        // colour blend state per attached frame buffer
+        for (VkPipelineColorBlendAttachmentState& attachment : colorBlendAttachments) {
+            // blend RGBA
+            attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+            // disable
+            attachment.blendEnable = VK_FALSE;
+        }
+
+        // used for all framebuffers. allows setting of blend constants that can be used as blend factors.
+        // assign type
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        // disable logicOp
+        colorBlending.logicOpEnable = VK_FALSE;
+        // bitwise operation specified here
+        colorBlending.logicOp = VK_LOGIC_OP_COPY;
+        // number of attachments
+        colorBlending.attachmentCount = static_cast<uint32_t>(colorBlendAttachments.size());
+        // set as previously defined attachment
+        colorBlending.pAttachments = colorBlendAttachments.data();
+        // blend constants
+        colorBlending.blendConstants[0] = 0.0f;
+        colorBlending.blendConstants[1] = 0.0f;
+        colorBlending.blendConstants[2] = 0.0f;
+        colorBlending.blendConstants[3] = 0.0f;
+
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = VK_TRUE;
+        depthStencil.depthWriteEnable = VK_TRUE;
+        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+        depthStencil.depthBoundsTestEnable = VK_FALSE;
+        depthStencil.minDepthBounds = 0.0f;
+        depthStencil.maxDepthBounds = 1.0f;
+        depthStencil.stencilTestEnable = VK_FALSE;
+        depthStencil.front = {};
+        depthStencil.back = {};
+
+        // assign type
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        // set number of pipeline stages (vertex and fragment in this case)
+        pipelineInfo.stageCount = 2;
+        // assign vertex input info
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        // assign input assembly info
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        // assign viewport data info
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pDynamicState = &dynamicState;
+        // assign rasteriser info
+        pipelineInfo.pRasterizationState = &rasterizer;
+        // assign multisampling info
+        pipelineInfo.pMultisampleState = &multisampling;
+        // assign colour blend info
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDepthStencilState = &depthStencil;
+        // number of subpasses
+        pipelineInfo.subpass = 0;
+        // we wont fail, so NULL
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    }
+
+    void GraphicsPipelineState::setVertexInput(VertexLayout layout, bool position_only)
+    {
+        bindingDescriptions = getBindingDescriptions(layout, position_only);
+        attributeDescriptions = getAttributeDescriptions(layout, position_only);
+        vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+        vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
+        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+    }
+
+    VkPipelineShaderStageCreateInfo shaderStage(VkShaderStageFlagBits stage, VkShaderModule module, VkSpecializationInfo const* specialization)
+    {
+        VkPipelineShaderStageCreateInfo info{};
+        info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        info.stage = stage;
+        info.module = module;
+        // add standard name
+        info.pName = "main";
+        info.pSpecializationInfo = specialization;
+        return info;
+    }
+
+    // specialisation constants of shaders/geometry_pass.vert and geometry_pass.frag
+    struct GeometrySpecialization
+    {
+        int32_t gbufferLayout;
+        VkBool32 textureStage;
+        int32_t vertexLayout;
+    };
+
+    // specialisation constants of shaders/lighting_pass.frag
+    struct LightingSpecialization
+    {
+        int32_t gbufferLayout;
+        int32_t displayMode;
+        VkBool32 modelStage;
+        VkBool32 lightingStage;
+        VkBool32 pcf;
+        VkBool32 inverseReconstruction;
+    };
+}
+
+// create the graphics pipeline.
+void VulkanObject::createGraphicsPipeline() {
+    // read in our compiled SPIR-V shaders. the geometry and lighting modules stay alive for
+    // permutations built later on
+    geometryVertModule = createShaderModule(readFile("../shaders/vulkan3/geometry_pass_vert.spv"));
+    geometryFragModule = createShaderModule(readFile("../shaders/vulkan3/geometry_pass_frag.spv"));
+    lightingVertModule = createShaderModule(readFile("../shaders/vulkan3/lighting_pass_vert.spv"));
+    lightingFragModule = createShaderModule(readFile("../shaders/vulkan3/lighting_pass_frag.spv"));
 
     // zero initialise pipeline layout struct
     VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
@@ -1977,205 +2621,243 @@ void VulkanObject::createGraphicsPipeline() {
         throw std::runtime_error("failed to create pipeline layout!");
     }
 
-    // create pipeline info struct
-    VkGraphicsPipelineCreateInfo pipelineInfo{};
-    // assign type
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    // set number of pipeline stages (vertex and fragment in this case)
-    pipelineInfo.stageCount = 2;
-    // assign list of stages
-    pipelineInfo.pStages = shaderStages;
-    // assign vertex input info
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    // assign input assembly info
-    pipelineInfo.pInputAssemblyState = &inputAssembly;
-    // assign viewport data info
-    pipelineInfo.pViewportState = &viewportState;
-    // assign rasteriser info
-    pipelineInfo.pRasterizationState = &rasterizer;
-    // assign multisampling info
-    pipelineInfo.pMultisampleState = &multisampling;
-    // assign colour blend info
-    pipelineInfo.pColorBlendState = &colorBlending;
-    // assign layout (for passing uniforms)
-    pipelineInfo.layout = pipelineLayout;
-    // assign renderpass
-    pipelineInfo.renderPass = geometryPass;
-    // number of subpasses
-    pipelineInfo.subpass = 0;
-    // we wont fail, so NULL
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-
-    VkPipelineDepthStencilStateCreateInfo depthStencil{};
-    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    depthStencil.depthTestEnable = VK_TRUE;
-    depthStencil.depthWriteEnable = VK_TRUE;
-    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-    depthStencil.depthBoundsTestEnable = VK_FALSE;
-    depthStencil.minDepthBounds = 0.0f;
-    depthStencil.maxDepthBounds = 1.0f;
-    depthStencil.stencilTestEnable = VK_FALSE;
-    depthStencil.front = {};
-    depthStencil.back = {};
-
-    pipelineInfo.pDepthStencilState = &depthStencil;
-
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create graphics pipeline!");
+    pipelineLayoutInfo.pSetLayouts = &lightingSetLayout;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &lightingLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline layout!");
     }
 
-	///////////////////////////////////////////////////// geometry
+    initPermutations();
 
-    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 0;
-    vertexInputInfo.vertexAttributeDescriptionCount = 0;
-    vertexInputInfo.pVertexBindingDescriptions = nullptr;
-    vertexInputInfo.pVertexAttributeDescriptions = nullptr;
+    ///////////////////////////////////////////////////////// shadow
 
-    // we will be culling the back faces
-    rasterizer.cullMode = VK_CULL_MODE_FRONT_BIT;
-    // we consider vertex order to be clockwise and front facing
-    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    GraphicsPipelineState state;
+    state.setVertexInput(vertexLayout, true);
 
-    pipelineLayoutInfo.pSetLayouts = &lightingSetLayout;
+    // we will be culling the back faces
+    state.rasterizer.cullMode = VK_CULL_MODE_NONE;
+    // orthographic cascades have linear depth, slope scaled bias keeps surfaces at grazing angles from self shadowing
+    state.rasterizer.depthBiasEnable = VK_TRUE;
+    state.rasterizer.depthBiasConstantFactor = 1.25f;
+    state.rasterizer.depthBiasSlopeFactor = 1.75f;
 
     // number of attachments
-    colorBlending.attachmentCount = 1;
-    // set as previously defined attachment
-    colorBlending.pAttachments = &colorBlendAttachments[0];
+    state.colorBlending.attachmentCount = 0;
+
+    pipelineLayoutInfo.pSetLayouts = &shadowSetLayout;
 
     // create pipeline layout and if failed
-    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &lightingLayout) != VK_SUCCESS) {
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &shadowLayout) != VK_SUCCESS) {
         // throw error
         throw std::runtime_error("failed to create pipeline layout!");
     }
 
-    // destroy shader modules (they are elsewhere now)
-    vkDestroyShaderModule(device, fragShaderModule, nullptr);
-    vkDestroyShaderModule(device, vertShaderModule, nullptr);
-
-    vertShaderCode = std::vector<char>{};
-    fragShaderCode = std::vector<char>{};
-	
-    vertShaderCode = readFile("../shaders/vulkan3/lighting_pass_vert.spv");
-    fragShaderCode = readFile("../shaders/vulkan3/lighting_pass_frag.spv");
-
     // create shader module per shader
-    auto lightingVertShaderModule = createShaderModule(vertShaderCode);
-    auto lightingFragShaderModule = createShaderModule(fragShaderCode);
+    auto shadowVertShaderModule = createShaderModule(readFile("../shaders/vulkan3/shadow_pass_vert.spv"));
+    auto shadowFragShaderModule = createShaderModule(readFile("../shaders/vulkan3/shadow_pass_frag.spv"));
 
-    // add the shader code
-    vertShaderStageInfo.module = lightingVertShaderModule;
-    // add the shader code
-    fragShaderStageInfo.module = lightingFragShaderModule;
-
-    shaderStages[0] = vertShaderStageInfo;
-	shaderStages[1] = fragShaderStageInfo;
+    // the shadow pass does not touch the G-buffer or the vertex attributes, nothing to specialise
+    VkPipelineShaderStageCreateInfo shaderStages[] = {
+        shaderStage(VK_SHADER_STAGE_VERTEX_BIT, shadowVertShaderModule, nullptr),
+        shaderStage(VK_SHADER_STAGE_FRAGMENT_BIT, shadowFragShaderModule, nullptr)
+    };
 
-    pipelineInfo.pStages = shaderStages;
+    state.pipelineInfo.pStages = shaderStages;
     // assign layout (for passing uniforms)
-    pipelineInfo.layout = lightingLayout;
+    state.pipelineInfo.layout = shadowLayout;
     // assign renderpass
-    pipelineInfo.renderPass = geometryPass;
-    // number of subpasses
-    pipelineInfo.subpass = 1;
-    // we wont fail, so NULL
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-
-    depthStencil.depthTestEnable = VK_FALSE;
-    depthStencil.depthWriteEnable = VK_FALSE;
-    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-    depthStencil.depthBoundsTestEnable = VK_FALSE;
-    depthStencil.minDepthBounds = 0.0f;
-    depthStencil.maxDepthBounds = 1.0f;
-    depthStencil.stencilTestEnable = VK_FALSE;
-    depthStencil.front = {};
-    depthStencil.back = {};
-
-    pipelineInfo.pDepthStencilState = &depthStencil;
-
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &lightingPipeline) != VK_SUCCESS) {
+    state.pipelineInfo.renderPass = shadowPass.renderPass;
+
+    if (vkCreateGraphicsPipelines(device, pipelineCache.handle(), 1, &state.pipelineInfo, nullptr, &shadowPipeline) != VK_SUCCESS) {
         throw std::runtime_error("failed to create graphics pipeline!");
     }
 
-    vkDestroyShaderModule(device, lightingVertShaderModule, nullptr);
-    vkDestroyShaderModule(device, lightingFragShaderModule, nullptr);
-
-    ///////////////////////////////////////////////////////// shadow
+    vkDestroyShaderModule(device, shadowVertShaderModule, nullptr);
+    vkDestroyShaderModule(device, shadowFragShaderModule, nullptr);
+}
 
-	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    bindingDescription = Vertex::getBindingDescription();
-    attributeDescriptions = Vertex::getAttributeDescriptions();
+// the permutation the first frame draws with is built up front, the rest on the pool when first used
+void VulkanObject::initPermutations() {
+    geometryPipelines.init(device, permutationBuilders, [this](uint32_t permutation) { return createGeometryPipeline(permutation); });
+    lightingPipelines.init(device, permutationBuilders, [this](uint32_t permutation) { return createLightingPipeline(permutation); });
+    geometryPipelines.get(geometryPermutation());
+    lightingPipelines.get(lightingPermutation());
+}
 
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+// texture sampling on or off
+uint32_t VulkanObject::geometryPermutation() const {
+    return texture_stage_on ? GEOMETRY_TEXTURE_STAGE : 0u;
+}
 
-    // we will be culling the back faces
-    rasterizer.cullMode = VK_CULL_MODE_NONE;
-    // we consider vertex order to be clockwise and front facing
-    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+// the display mode in the low bits, then a bit per toggle
+uint32_t VulkanObject::lightingPermutation() const {
+    uint32_t permutation = static_cast<uint32_t>(display_mode) & LIGHTING_DISPLAY_MODE_MASK;
+    permutation |= model_stage_on ? LIGHTING_MODEL_STAGE : 0u;
+    permutation |= lighting_stage_on ? LIGHTING_LIGHTING_STAGE : 0u;
+    permutation |= pcf ? LIGHTING_PCF : 0u;
+    permutation |= inverseReconstruction ? LIGHTING_INVERSE_RECONSTRUCTION : 0u;
+    return permutation;
+}
 
-    pipelineLayoutInfo.pSetLayouts = &shadowSetLayout;
+// called on a worker of permutationBuilders, only reads state that is fixed after init
+VkPipeline VulkanObject::createGeometryPipeline(uint32_t permutation) {
+    GraphicsPipelineState state;
+    state.setVertexInput(vertexLayout, false);
+
+    // the G-buffer layout is a specialisation constant of both the geometry and lighting fragment shaders
+    GeometrySpecialization constants{};
+    constants.gbufferLayout = static_cast<int32_t>(gbufferLayout);
+    constants.textureStage = (permutation & GEOMETRY_TEXTURE_STAGE) ? VK_TRUE : VK_FALSE;
+    constants.vertexLayout = static_cast<int32_t>(vertexLayout);
+
+    std::array<VkSpecializationMapEntry, 3> entries = { {
+        { SPEC_GBUFFER_LAYOUT, offsetof(GeometrySpecialization, gbufferLayout), sizeof(int32_t) },
+        { SPEC_TEXTURE_STAGE, offsetof(GeometrySpecialization, textureStage), sizeof(VkBool32) },
+        { SPEC_VERTEX_LAYOUT, offsetof(GeometrySpecialization, vertexLayout), sizeof(int32_t) },
+    } };
+
+    VkSpecializationInfo specialization{};
+    specialization.mapEntryCount = static_cast<uint32_t>(entries.size());
+    specialization.pMapEntries = entries.data();
+    specialization.dataSize = sizeof(constants);
+    specialization.pData = &constants;
+
+    VkPipelineShaderStageCreateInfo shaderStages[] = {
+        shaderStage(VK_SHADER_STAGE_VERTEX_BIT, geometryVertModule, &specialization),
+        shaderStage(VK_SHADER_STAGE_FRAGMENT_BIT, geometryFragModule, &specialization)
+    };
 
-    // number of attachments
-    colorBlending.attachmentCount = 0;
-    // set as previously defined attachment
-    colorBlending.pAttachments = &colorBlendAttachments[0];
+    // assign list of stages
+    state.pipelineInfo.pStages = shaderStages;
+    // assign layout (for passing uniforms)
+    state.pipelineInfo.layout = pipelineLayout;
+    // assign renderpass
+    state.pipelineInfo.renderPass = geometryPass;
 
-    // create pipeline layout and if failed
-    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &shadowLayout) != VK_SUCCESS) {
-        // throw error
-        throw std::runtime_error("failed to create pipeline layout!");
+    VkPipeline pipeline;
+    if (vkCreateGraphicsPipelines(device, pipelineCache.handle(), 1, &state.pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create graphics pipeline!");
     }
-	
-    vertShaderCode = std::vector<char>{};
-    fragShaderCode = std::vector<char>{};
+    return pipeline;
+}
 
-    vertShaderCode = readFile("../shaders/vulkan3/shadow_pass_vert.spv");
-    fragShaderCode = readFile("../shaders/vulkan3/shadow_pass_frag.spv");
+// called on a worker of permutationBuilders, only reads state that is fixed after init
+VkPipeline VulkanObject::createLightingPipeline(uint32_t permutation) {
+    GraphicsPipelineState state;
 
-    // create shader module per shader
-    auto shadowVertShaderModule = createShaderModule(vertShaderCode);
-    auto shadowFragShaderModule = createShaderModule(fragShaderCode);
+    // a fullscreen triangle made up in the vertex shader, so no vertex input
 
-    // add the shader code
-    vertShaderStageInfo.module = shadowVertShaderModule;
-    // add the shader code
-    fragShaderStageInfo.module = shadowFragShaderModule;
+    // we will be culling the front faces
+    state.rasterizer.cullMode = VK_CULL_MODE_FRONT_BIT;
 
-    shaderStages[0] = vertShaderStageInfo;
-    shaderStages[1] = fragShaderStageInfo;
+    // number of attachments
+    state.colorBlending.attachmentCount = 1;
+
+    state.depthStencil.depthTestEnable = VK_FALSE;
+    state.depthStencil.depthWriteEnable = VK_FALSE;
+
+    LightingSpecialization constants{};
+    constants.gbufferLayout = static_cast<int32_t>(gbufferLayout);
+    constants.displayMode = static_cast<int32_t>(permutation & LIGHTING_DISPLAY_MODE_MASK);
+    constants.modelStage = (permutation & LIGHTING_MODEL_STAGE) ? VK_TRUE : VK_FALSE;
+    constants.lightingStage = (permutation & LIGHTING_LIGHTING_STAGE) ? VK_TRUE : VK_FALSE;
+    constants.pcf = (permutation & LIGHTING_PCF) ? VK_TRUE : VK_FALSE;
+    constants.inverseReconstruction = (permutation & LIGHTING_INVERSE_RECONSTRUCTION) ? VK_TRUE : VK_FALSE;
+
+    std::array<VkSpecializationMapEntry, 6> entries = { {
+        { SPEC_GBUFFER_LAYOUT, offsetof(LightingSpecialization, gbufferLayout), sizeof(int32_t) },
+        { SPEC_DISPLAY_MODE, offsetof(LightingSpecialization, displayMode), sizeof(int32_t) },
+        { SPEC_MODEL_STAGE, offsetof(LightingSpecialization, modelStage), sizeof(VkBool32) },
+        { SPEC_LIGHTING_STAGE, offsetof(LightingSpecialization, lightingStage), sizeof(VkBool32) },
+        { SPEC_PCF, offsetof(LightingSpecialization, pcf), sizeof(VkBool32) },
+        { SPEC_INVERSE_RECONSTRUCTION, offsetof(LightingSpecialization, inverseReconstruction), sizeof(VkBool32) },
+    } };
+
+    VkSpecializationInfo specialization{};
+    specialization.mapEntryCount = static_cast<uint32_t>(entries.size());
+    specialization.pMapEntries = entries.data();
+    specialization.dataSize = sizeof(constants);
+    specialization.pData = &constants;
+
+    VkPipelineShaderStageCreateInfo shaderStages[] = {
+        shaderStage(VK_SHADER_STAGE_VERTEX_BIT, lightingVertModule, nullptr),
+        shaderStage(VK_SHADER_STAGE_FRAGMENT_BIT, lightingFragModule, &specialization)
+    };
 
-    pipelineInfo.pStages = shaderStages;
+    state.pipelineInfo.pStages = shaderStages;
     // assign layout (for passing uniforms)
-    pipelineInfo.layout = shadowLayout;
+    state.pipelineInfo.layout = lightingLayout;
     // assign renderpass
-    pipelineInfo.renderPass = shadowPass.renderPass;
+    state.pipelineInfo.renderPass = geometryPass;
     // number of subpasses
-    pipelineInfo.subpass = 0;
-    // we wont fail, so NULL
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-
-    depthStencil.depthTestEnable = VK_TRUE;
-    depthStencil.depthWriteEnable = VK_TRUE;
-    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-    depthStencil.depthBoundsTestEnable = VK_FALSE;
-    depthStencil.minDepthBounds = 0.0f;
-    depthStencil.maxDepthBounds = 1.0f;
-    depthStencil.stencilTestEnable = VK_FALSE;
-    depthStencil.front = {};
-    depthStencil.back = {};
-
-    pipelineInfo.pDepthStencilState = &depthStencil;
-
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &shadowPipeline) != VK_SUCCESS) {
+    state.pipelineInfo.subpass = 1;
+
+    VkPipeline pipeline;
+    if (vkCreateGraphicsPipelines(device, pipelineCache.handle(), 1, &state.pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
         throw std::runtime_error("failed to create graphics pipeline!");
     }
+    return pipeline;
+}
 
-    vkDestroyShaderModule(device, shadowVertShaderModule, nullptr);
-    vkDestroyShaderModule(device, shadowFragShaderModule, nullptr);
+// culling runs as two compute passes sharing one layout, see shaders/cull.comp and cull_compact.comp.
+// light clustering is a third, see shaders/cluster_assign.comp
+void VulkanObject::createComputePipelines() {
+    VkPipelineLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &cullSetLayout;
+
+    if (vkCreatePipelineLayout(device, &layoutInfo, nullptr, &cullLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+
+    char const* shaderPaths[] = { "../shaders/vulkan3/cull_comp.spv", "../shaders/vulkan3/cull_compact_comp.spv" };
+    VkPipeline* pipelines[] = { &cullPipeline, &cullCompactPipeline };
+
+    for (size_t i = 0; i < 2; i++) {
+        auto shaderCode = readFile(shaderPaths[i]);
+        VkShaderModule shaderModule = createShaderModule(shaderCode);
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = cullLayout;
+
+        if (vkCreateComputePipelines(device, pipelineCache.handle(), 1, &pipelineInfo, nullptr, pipelines[i]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create compute pipeline!");
+        }
+
+        vkDestroyShaderModule(device, shaderModule, nullptr);
+    }
+
+    VkPipelineLayoutCreateInfo clusterLayoutInfo{};
+    clusterLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    clusterLayoutInfo.setLayoutCount = 1;
+    clusterLayoutInfo.pSetLayouts = &clusterSetLayout;
+
+    if (vkCreatePipelineLayout(device, &clusterLayoutInfo, nullptr, &clusterLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+
+    auto clusterShaderCode = readFile("../shaders/vulkan3/cluster_assign_comp.spv");
+    VkShaderModule clusterShaderModule = createShaderModule(clusterShaderCode);
+
+    VkComputePipelineCreateInfo clusterPipelineInfo{};
+    clusterPipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    clusterPipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    clusterPipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    clusterPipelineInfo.stage.module = clusterShaderModule;
+    clusterPipelineInfo.stage.pName = "main";
+    clusterPipelineInfo.layout = clusterLayout;
+
+    if (vkCreateComputePipelines(device, pipelineCache.handle(), 1, &clusterPipelineInfo, nullptr, &clusterPipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute pipeline!");
+    }
+
+    vkDestroyShaderModule(device, clusterShaderModule, nullptr);
 }
 
 // function to create all of our framebuffers
@@ -2216,34 +2898,6 @@ void VulkanObject::createFramebuffers() {
             throw std::runtime_error("failed to create framebuffer!");
         }
     }
-
-    std::array<VkImageView, 1> attachments = {
-		shadowPass.depth.view
-    };
-
-    // struct to store frame buffer info
-    VkFramebufferCreateInfo framebufferInfo{};
-    // type of struct
-    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-    // specify our render pass data
-    framebufferInfo.renderPass = shadowPass.renderPass;
-    // our attament count
-    framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-    // our attachment
-    framebufferInfo.pAttachments = attachments.data();
-    // width of our frame buffer
-    framebufferInfo.width = swapChainExtent.width;
-    // height of our frame buffer
-    framebufferInfo.height = swapChainExtent.height;
-    // number of layers
-    framebufferInfo.layers = 1;
-
-    // create the pipeline!! 
-    // if it fails
-    if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &shadowPass.frameBuffer) != VK_SUCCESS) {
-        // throw error
-        throw std::runtime_error("failed to create framebuffer!");
-    }
 }
 
 // create our command pool
@@ -2257,6 +2911,8 @@ void VulkanObject::createCommandPool() {
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     // index for our graphics queue to run graphics commands
     poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+    // command buffers are re-recorded every frame
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
     // create command pool
     // if fails
@@ -2269,7 +2925,7 @@ void VulkanObject::createCommandPool() {
 // create command buffers
 void VulkanObject::createCommandBuffers() {
     // resize vector to store all command buffers
-    commandBuffers.resize(swapChainFramebuffers.size());
+    commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
 
     // struct to specify how to generate command buffers and fill command pool
     VkCommandBufferAllocateInfo allocInfo{};
@@ -2288,113 +2944,561 @@ void VulkanObject::createCommandBuffers() {
         // throw error
         throw std::runtime_error("failed to allocate command buffers!");
     }
+}
 
-    // for each command buffer generated
-    for (size_t i = 0; i < commandBuffers.size(); i++) {
-        // specify some info about the usage of this command buffer
-        VkCommandBufferBeginInfo beginInfo{};
-        // assign struct type
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+void VulkanObject::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, UniformOffsets const& offsets) {
+    auto recordStart = std::chrono::high_resolution_clock::now();
 
-        // create initial command buffer
-        // if fails
-        if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS) {
-            // throw error
-            throw std::runtime_error("failed to begin recording command buffer!");
+    // specify some info about the usage of this command buffer
+    VkCommandBufferBeginInfo beginInfo{};
+    // assign struct type
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    // recorded again next time this frame comes round
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    // create initial command buffer
+    // if fails
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        // throw error
+        throw std::runtime_error("failed to begin recording command buffer!");
+    }
+
+    // this frame's fence has been waited on, so its secondaries are no longer in use
+    if (secondaryDraws()) {
+        for (uint32_t worker = 0; worker < recordThreads; worker++) {
+            RecordContext& context = recordContexts[currentFrame * recordThreads + worker];
+            vkResetCommandPool(device, context.pool, 0);
+            context.used = 0;
         }
+    }
 
-        // struct to specify render pass info
-        VkRenderPassBeginInfo shadowRenderPassInfo{};
-        // assign type
-        shadowRenderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        // assign our previously created render pass
-        shadowRenderPassInfo.renderPass = shadowPass.renderPass;
-        // assign the current framebuffer
-        //shadowRenderPassInfo.framebuffer = swapChainFramebuffers[i
-        shadowRenderPassInfo.framebuffer = shadowPass.frameBuffer;
-        // screen space offset
-        shadowRenderPassInfo.renderArea.offset = { 0, 0 };
-        // width and height of render
-        shadowRenderPassInfo.renderArea.extent = swapChainExtent;
+    profiler.beginFrame(commandBuffer, static_cast<uint32_t>(currentFrame));
 
-        std::array<VkClearValue, 1> shadowClearValues{};
-        shadowClearValues[0].depthStencil = { 1.0f, 0 };
+    if (gpuDriven) {
+        recordCulling(commandBuffer, offsets.cull);
+    }
 
-        // number of clear colour
-        shadowRenderPassInfo.clearValueCount = static_cast<uint32_t>(shadowClearValues.size());
-        // clear colour value
-        shadowRenderPassInfo.pClearValues = shadowClearValues.data();
+    if (lightCount > 0) {
+        recordLightClusters(commandBuffer, offsets);
+    }
 
-        vkCmdBeginRenderPass(commandBuffers[i], &shadowRenderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    recordShadows(commandBuffer, offsets);
 
-        vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, shadowPipeline);
+    // both streams of the vertex layout, the attribute stream only when it has one
+    VkBuffer vertexBuffers[] = { vertexBuffer, attributeBuffer };
+    VkDeviceSize vertexOffsets[] = { 0, 0 };
+    uint32_t vertexBufferCount = attributeBuffer != VK_NULL_HANDLE ? 2 : 1;
 
-        VkBuffer vertexBuffers[] = { vertexBuffer };
-        VkDeviceSize offsets[] = { 0 };
-        vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers, offsets);
-        vkCmdBindIndexBuffer(commandBuffers[i], indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    // struct to specify render pass info
+    VkRenderPassBeginInfo renderPassInfo{};
+    // assign type
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    // assign our previously created render pass
+    renderPassInfo.renderPass = geometryPass;
+    // assign the current framebuffer
+    renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+    // screen space offset
+    renderPassInfo.renderArea.offset = { 0, 0 };
+    // width and height of render
+    renderPassInfo.renderArea.extent = swapChainExtent;
+
+    std::array<VkClearValue, 4> clearValues{};
+    clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+    clearValues[1].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+    clearValues[2].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+    clearValues[3].depthStencil = { 1.0f, 0 };
+
+    // number of clear colour
+    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+    // clear colour value
+    renderPassInfo.pClearValues = clearValues.data();
+
+    // timestamps cannot go into a subpass recorded as secondaries, so the geometry scope
+    // wraps the begin of the render pass and ends once the lighting subpass has started
+    uint32_t geometryScope = profiler.beginScope(commandBuffer, "geometry");
+    // functions starting in vkCmd record commands. This ebgins the process
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, drawContents());
+
+    // bind the graphics pipeline we set up, the previous permutation's while this one builds
+    VkPipeline geometryPipeline = geometryPipelines.select(geometryPermutation());
+    auto bindGeometry = [&](VkCommandBuffer cmd) {
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, geometryPipeline);
+        setViewportAndScissor(cmd, swapChainExtent);
+
+        vkCmdBindVertexBuffers(cmd, 0, vertexBufferCount, vertexBuffers, vertexOffsets);
+        vkCmdBindIndexBuffer(cmd, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 1, &offsets.ubo);
+    };
 
-        vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, shadowLayout, 0, 1, &shadowDescriptorSets[i], 0, nullptr);
+    recordDraws(commandBuffer, geometryPass, 0, renderPassInfo.framebuffer, bindGeometry, CULL_VIEW_CAMERA);
 
-        vkCmdDrawIndexed(commandBuffers[i], static_cast<uint32_t>(dragon_model.getIndices().size()), 1, 0, 0, 0);
+    vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+    profiler.endScope(commandBuffer, geometryScope);
+    uint32_t lightingScope = profiler.beginScope(commandBuffer, "lighting");
 
-        vkCmdEndRenderPass(commandBuffers[i]);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, lightingPipelines.select(lightingPermutation()));
 
-        // struct to specify render pass info
-        VkRenderPassBeginInfo renderPassInfo{};
-        // assign type
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        // assign our previously created render pass
-        renderPassInfo.renderPass = geometryPass;
-        // assign the current framebuffer
-        renderPassInfo.framebuffer = swapChainFramebuffers[i];
-        // screen space offset
-        renderPassInfo.renderArea.offset = { 0, 0 };
-        // width and height of render
-        renderPassInfo.renderArea.extent = swapChainExtent;
+    // dynamic offsets in binding order, the uniforms then this frame's lights
+    uint32_t lightingOffsets[] = { offsets.ubo, offsets.lights };
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, lightingLayout, 0, 1, &lightingDescriptorSet, 2, lightingOffsets);
 
-        std::array<VkClearValue, 4> clearValues{};
-        clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-        clearValues[1].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-        clearValues[2].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-        clearValues[3].depthStencil = { 1.0f, 0 };
+    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
 
-        // number of clear colour
-        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-        // clear colour value
-        renderPassInfo.pClearValues = clearValues.data();
+    profiler.endScope(commandBuffer, lightingScope);
+    // finish the render pass
+    vkCmdEndRenderPass(commandBuffer);
 
-        // functions starting in vkCmd record commands. This ebgins the process
-        vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    // finish recording commands
+    // if fails
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        // throw error
+        throw std::runtime_error("failed to record command buffer!");
+    }
 
-        // bind the graphics pipeline we set up
-        vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    auto recordEnd = std::chrono::high_resolution_clock::now();
+    lastRecordMs = std::chrono::duration<float, std::milli>(recordEnd - recordStart).count();
+    totalRecordMs += lastRecordMs;
+    recordedFrames++;
+}
 
-        vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers, offsets);
-        vkCmdBindIndexBuffer(commandBuffers[i], indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+// instance and draw counts plus the CPU cost of recording them
+std::string VulkanObject::sceneSummary() {
+    // redrawn cascades draw the static batches, with dynamic casters every cascade draws the
+    // dynamic batches, geometry draws every batch the camera sees and lighting is one fullscreen triangle.
+    // GPU driven, each pass is a single indirect call
+    uint32_t redrawn = 0;
+    for (uint32_t i = 0; i < cascadeSettings.count; i++) {
+        redrawn += (shadowRedrawMask >> i) & 1u;
+    }
+    uint32_t compositePasses = shadowCompositing ? cascadeSettings.count : 0;
+
+    // without GPU culling the batches with no visible instance are skipped
+    size_t draws = gpuDriven ? redrawn + compositePasses + 2
+        : redrawn * drawnBatches(CULL_VIEW_LIGHT) + compositePasses * drawnBatches(CULL_VIEW_LIGHT_DYNAMIC) + drawnBatches(CULL_VIEW_CAMERA) + 1;
+    char const* path = !gpuDriven ? "CPU draws" : drawIndirectCount ? "GPU culled, indirect count" : "GPU culled, indirect";
+
+    // bytes fetched per vertex, both streams in the geometry pass and the positions alone in the shadow pass
+    uint32_t positionStride = vertexStreamStride(vertexLayout, VERTEX_STREAM_POSITION);
+    uint32_t geometryStride = positionStride + vertexStreamStride(vertexLayout, VERTEX_STREAM_ATTRIBUTES);
+
+    char line[320];
+    snprintf(line, sizeof(line), "%zu instances (%zu dynamic) of %zu meshes, %s vertices %u/%u bytes geometry/shadow, %u lights, %u/%u shadow cascades redrawn, %s, %zu draw calls/frame, record %.3f ms (avg %.3f ms) on %u threads",
+        scene.instances().size(), scene.dynamicCount(), scene.meshes().size(), vertexLayoutName(vertexLayout), geometryStride, positionStride,
+        lightCount, redrawn, cascadeSettings.count, path, draws, lastRecordMs, recordedFrames > 0 ? totalRecordMs / recordedFrames : 0.0,
+        secondaryDraws() ? recordThreads : 1u);
+    return line;
+}
 
-        vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[i], 0, nullptr);
+// one instanced draw per mesh. firstInstance offsets gl_InstanceIndex into the visible list,
+// which the culling pass or cullDirectDraws has compacted
+void VulkanObject::drawScene(VkCommandBuffer commandBuffer, CullView view) {
+    if (gpuDriven) {
+        uint32_t batchCount = static_cast<uint32_t>(cullBatches.size());
+        VkDeviceSize drawOffset = sizeof(VkDrawIndexedIndirectCommand) * batchCount * view;
 
-        vkCmdDrawIndexed(commandBuffers[i], static_cast<uint32_t>(dragon_model.getIndices().size()), 1, 0, 0, 0);
+        if (drawIndirectCount) {
+            cmdDrawIndexedIndirectCount(commandBuffer, drawBuffer, drawOffset, countBuffer, sizeof(uint32_t) * view, batchCount, sizeof(VkDrawIndexedIndirectCommand));
+        }
+        else {
+            // culled batches are left in place with instanceCount 0
+            vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, drawOffset, batchCount, sizeof(VkDrawIndexedIndirectCommand));
+        }
+        return;
+    }
 
-        vkCmdNextSubpass(commandBuffers[i], VK_SUBPASS_CONTENTS_INLINE);
+    size_t first, last;
+    batchRange(view, first, last);
+    drawBatches(commandBuffer, view, first, last);
+}
 
-        vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, lightingPipeline);
+void VulkanObject::batchRange(CullView view, size_t& first, size_t& last) const {
+    std::vector<Scene::DrawBatch> const& batches = scene.batches();
+    // each light view only draws its own kind of caster
+    auto firstDynamic = std::find_if(batches.begin(), batches.end(), [](Scene::DrawBatch const& batch) { return batch.dynamic; });
+    size_t staticCount = static_cast<size_t>(std::distance(batches.begin(), firstDynamic));
 
-        vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, lightingLayout, 0, 1, &lightingDescriptorSets[i], 0, nullptr);
+    first = view == CULL_VIEW_LIGHT_DYNAMIC ? staticCount : 0;
+    last = view == CULL_VIEW_LIGHT ? staticCount : batches.size();
+}
 
-        vkCmdDraw(commandBuffers[i], 3, 1, 0, 0);
+void VulkanObject::drawBatches(VkCommandBuffer commandBuffer, CullView view, size_t first, size_t last) {
+    uint32_t const* counts = visibleCounts.data() + scene.batches().size() * view;
+    for (size_t i = first; i < last; i++) {
+        if (counts[i] == 0) {
+            continue;
+        }
 
-        // finish the render pass
-        vkCmdEndRenderPass(commandBuffers[i]);
+        Scene::DrawBatch const& batch = scene.batches()[i];
+        Scene::Mesh const& mesh = scene.meshes()[batch.mesh];
+        vkCmdDrawIndexed(commandBuffer, mesh.indexCount, counts[i], mesh.firstIndex, mesh.vertexOffset, batch.firstInstance);
+    }
+}
 
-        // finish recording commands
-        // if fails
-        if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
-            // throw error
-            throw std::runtime_error("failed to record command buffer!");
+size_t VulkanObject::drawnBatches(CullView view) const {
+    size_t first, last;
+    batchRange(view, first, last);
+
+    uint32_t const* counts = visibleCounts.data() + scene.batches().size() * view;
+    return static_cast<size_t>(std::count_if(counts + first, counts + last, [](uint32_t count) { return count > 0; }));
+}
+
+// the CPU side of cull.comp for the direct draw path. the survivors of each view are grouped
+// by batch into this frame's visible lists and their counts become the instance counts
+void VulkanObject::cullDirectDraws(glm::mat4 const& model, Frustum const& camera, Frustum const& light) {
+    std::vector<InstanceData> const& instances = scene.instances();
+    size_t batchCount = scene.batches().size();
+
+    // the scene transform only changes with the UI, the spheres are rebuilt when it does
+    if (!instanceSpheresValid || model != instanceSpheresModel) {
+        std::vector<glm::vec4> spheres(instances.size());
+        for (size_t i = 0; i < instances.size(); i++) {
+            spheres[i] = transformSphere(model * instances[i].model, cullBatches[instances[i].batch].sphere);
+        }
+        instanceSpheres.assign(spheres.data(), spheres.size());
+        instanceSpheresModel = model;
+        instanceSpheresValid = true;
+    }
+
+    cullSurvivors.resize(instanceSpheres.paddedSize());
+    cullVisible.resize(static_cast<size_t>(visibleStride) * CULL_VIEW_COUNT);
+
+    size_t survivors = 0;
+    for (uint32_t view = 0; view < CULL_VIEW_COUNT; view++) {
+        // both light views are culled against the same planes
+        if (view != CULL_VIEW_LIGHT_DYNAMIC) {
+            if (frustumCulling) {
+                survivors = cullSpheres(instanceSpheres, view == CULL_VIEW_CAMERA ? camera : light, cullSurvivors.data());
+            }
+            else {
+                survivors = instances.size();
+                for (size_t i = 0; i < survivors; i++) {
+                    cullSurvivors[i] = static_cast<uint32_t>(i);
+                }
+            }
+        }
+
+        uint32_t* counts = visibleCounts.data() + batchCount * view;
+        uint32_t* visible = cullVisible.data() + static_cast<size_t>(visibleStride) * view;
+        std::fill(counts, counts + batchCount, 0u);
+
+        for (size_t i = 0; i < survivors; i++) {
+            uint32_t index = cullSurvivors[i];
+            InstanceData const& instance = instances[index];
+            if (!instanceInView(instance, static_cast<CullView>(view))) {
+                continue;
+            }
+            visible[cullBatches[instance.batch].firstInstance + counts[instance.batch]++] = index;
+        }
+    }
+
+    memcpy(static_cast<uint32_t*>(visibleMemory.mapped) + static_cast<size_t>(visibleFrameStride) * currentFrame, cullVisible.data(),
+        sizeof(uint32_t) * cullVisible.size());
+}
+
+// each worker records an even share of the batches into its own secondary, continuing the
+// subpass the primary is in. the primary then executes them in order, so the draws land
+// exactly as they would have inline
+void VulkanObject::recordDraws(VkCommandBuffer commandBuffer, VkRenderPass renderPass, uint32_t subpass, VkFramebuffer framebuffer,
+    std::function<void(VkCommandBuffer)> const& bind, CullView view) {
+    if (!secondaryDraws()) {
+        bind(commandBuffer);
+        drawScene(commandBuffer, view);
+        return;
+    }
+
+    size_t first, last;
+    batchRange(view, first, last);
+    size_t count = last - first;
+
+    // buffers are allocated here, pools are not safe to allocate from on the workers
+    // while another thread records from them
+    std::vector<VkCommandBuffer> secondaries(recordThreads);
+    for (uint32_t worker = 0; worker < recordThreads; worker++) {
+        RecordContext& context = recordContexts[currentFrame * recordThreads + worker];
+        if (context.used == context.buffers.size()) {
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = context.pool;
+            // only ever executed from a primary
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            allocInfo.commandBufferCount = 1;
+
+            VkCommandBuffer buffer;
+            if (vkAllocateCommandBuffers(device, &allocInfo, &buffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate secondary command buffer!");
+            }
+            context.buffers.push_back(buffer);
         }
+        secondaries[worker] = context.buffers[context.used++];
+    }
+
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = renderPass;
+    inheritanceInfo.subpass = subpass;
+    inheritanceInfo.framebuffer = framebuffer;
+
+    std::vector<std::future<void>> recorded;
+    recorded.reserve(recordThreads);
+    for (uint32_t worker = 0; worker < recordThreads; worker++) {
+        size_t begin = first + count * worker / recordThreads;
+        size_t end = first + count * (worker + 1) / recordThreads;
+        VkCommandBuffer secondary = secondaries[worker];
+
+        recorded.push_back(recordWorkers->submit([&, begin, end, secondary]() {
+            VkCommandBufferBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+            if (vkBeginCommandBuffer(secondary, &beginInfo) != VK_SUCCESS) {
+                throw std::runtime_error("failed to begin recording secondary command buffer!");
+            }
+
+            // nothing is inherited from the primary but the render pass
+            bind(secondary);
+            drawBatches(secondary, view, begin, end);
+
+            if (vkEndCommandBuffer(secondary) != VK_SUCCESS) {
+                throw std::runtime_error("failed to record secondary command buffer!");
+            }
+        }));
+    }
+
+    // every task finishes before any error is rethrown, they all reference this frame
+    for (std::future<void>& future : recorded) {
+        future.wait();
+    }
+    for (std::future<void>& future : recorded) {
+        future.get();
+    }
+
+    vkCmdExecuteCommands(commandBuffer, recordThreads, secondaries.data());
+}
+
+void VulkanObject::createRecordContexts() {
+    // the GPU driven path has a single indirect draw per pass, nothing to split
+    if (recordThreads <= 1 || gpuDriven) {
+        return;
+    }
+
+    recordWorkers = std::make_unique<ThreadPool>(recordThreads);
+    recordContexts.resize(static_cast<size_t>(MAX_FRAMES_IN_FLIGHT) * recordThreads);
+    for (RecordContext& context : recordContexts) {
+        // reset as a whole once per frame, secondaries only live for the frame
+        createCommandPool(&context.pool, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+    }
+}
+
+void VulkanObject::destroyRecordContexts() {
+    // destroying a pool frees its command buffers
+    for (RecordContext& context : recordContexts) {
+        vkDestroyCommandPool(device, context.pool, nullptr);
     }
+    recordContexts.clear();
+    recordWorkers.reset();
+}
+
+// static casters are drawn only into cascades whose cache is out of date. with dynamic casters
+// the static ones go to a cache layer, copied into the cascade every frame before the dynamic
+// ones are drawn over it. a render pass per cascade so each is timed on its own
+void VulkanObject::recordShadows(VkCommandBuffer commandBuffer, UniformOffsets const& offsets) {
+    static char const* const cascadeScopes[MAX_CASCADES] = { "shadow cascade 0", "shadow cascade 1", "shadow cascade 2", "shadow cascade 3" };
+
+    // struct to specify render pass info
+    VkRenderPassBeginInfo shadowRenderPassInfo{};
+    // assign type
+    shadowRenderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    // screen space offset
+    shadowRenderPassInfo.renderArea.offset = { 0, 0 };
+    // width and height of render
+    shadowRenderPassInfo.renderArea.extent = { static_cast<uint32_t>(shadowPass.width), static_cast<uint32_t>(shadowPass.height) };
+
+    std::array<VkClearValue, 1> shadowClearValues{};
+    shadowClearValues[0].depthStencil = { 1.0f, 0 };
+
+    // number of clear colour
+    shadowRenderPassInfo.clearValueCount = static_cast<uint32_t>(shadowClearValues.size());
+    // clear colour value
+    shadowRenderPassInfo.pClearValues = shadowClearValues.data();
+
+    // the position stream alone
+    VkBuffer vertexBuffers[] = { vertexBuffer };
+    VkDeviceSize vertexOffsets[] = { 0 };
+
+    auto drawCasters = [&](VkRenderPass renderPass, uint32_t layer, uint32_t cascade, CullView view) {
+        shadowRenderPassInfo.renderPass = renderPass;
+        shadowRenderPassInfo.framebuffer = shadowPass.frameBuffers[layer];
+        vkCmdBeginRenderPass(commandBuffer, &shadowRenderPassInfo, drawContents());
+
+        // the cascade's matrix, then the view's slice of this frame's visible lists
+        uint32_t dynamicOffsets[] = { offsets.shadow[cascade], static_cast<uint32_t>(sizeof(uint32_t) * (visibleFrameStride * currentFrame + visibleStride * view)) };
+        auto bindShadow = [&](VkCommandBuffer cmd) {
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowPipeline);
+            setViewportAndScissor(cmd, shadowRenderPassInfo.renderArea.extent);
+
+            vkCmdBindVertexBuffers(cmd, 0, 1, vertexBuffers, vertexOffsets);
+            vkCmdBindIndexBuffer(cmd, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowLayout, 0, 1, &shadowDescriptorSet, 2, dynamicOffsets);
+        };
+
+        recordDraws(commandBuffer, renderPass, 0, shadowRenderPassInfo.framebuffer, bindShadow, view);
+
+        vkCmdEndRenderPass(commandBuffer);
+    };
+
+    uint32_t shadowScope = profiler.beginScope(commandBuffer, "shadow");
+    for (uint32_t cascade = 0; cascade < cascadeSettings.count; cascade++) {
+        bool redraw = (shadowRedrawMask & (1u << cascade)) != 0;
+        // the layer still holds what an earlier frame drew
+        if (!redraw && !shadowCompositing) {
+            continue;
+        }
+
+        uint32_t cascadeScope = profiler.beginScope(commandBuffer, cascadeScopes[cascade]);
+        if (!shadowCompositing) {
+            drawCasters(shadowPass.renderPass, cascade, cascade, CULL_VIEW_LIGHT);
+        }
+        else {
+            if (redraw) {
+                drawCasters(shadowPass.cacheRenderPass, cascadeSettings.count + cascade, cascade, CULL_VIEW_LIGHT);
+            }
+            copyShadowCache(commandBuffer, cascade);
+            drawCasters(shadowPass.compositeRenderPass, cascade, cascade, CULL_VIEW_LIGHT_DYNAMIC);
+        }
+        profiler.endScope(commandBuffer, cascadeScope);
+    }
+    profiler.endScope(commandBuffer, shadowScope);
+}
+
+void VulkanObject::copyShadowCache(VkCommandBuffer commandBuffer, uint32_t cascade) {
+    uint32_t cacheLayer = cascadeSettings.count + cascade;
+
+    std::array<VkImageMemoryBarrier, 2> barriers{};
+    for (VkImageMemoryBarrier& barrier : barriers) {
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = shadowPass.depth.image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.layerCount = 1;
+    }
+
+    // the cache may have just been drawn, it stays in TRANSFER_SRC between frames
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barriers[0].subresourceRange.baseArrayLayer = cacheLayer;
+
+    // the cascade's old contents go, but an earlier frame's lighting pass may still be reading them
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barriers[1].subresourceRange.baseArrayLayer = cascade;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    VkImageCopy region{};
+    region.srcSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, cacheLayer, 1 };
+    region.dstSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, cascade, 1 };
+    region.extent = { static_cast<uint32_t>(shadowPass.width), static_cast<uint32_t>(shadowPass.height), 1 };
+    vkCmdCopyImage(commandBuffer, shadowPass.depth.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        shadowPass.depth.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    // ready for the composite pass to draw over
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barriers[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 0, 0, nullptr, 0, nullptr, 1, &barriers[1]);
+}
+
+// reset the counts, cull every instance against the camera and light frusta, then
+// write one indirect command per batch and view
+void VulkanObject::recordCulling(VkCommandBuffer commandBuffer, uint32_t cullOffset) {
+    uint32_t cullScope = profiler.beginScope(commandBuffer, "cull");
+
+    // the previous frame's draws may still be reading the buffers we are about to write
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    vkCmdFillBuffer(commandBuffer, countBuffer, 0, VK_WHOLE_SIZE, 0);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullLayout, 0, 1, &cullDescriptorSet, 1, &cullOffset);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+    vkCmdDispatch(commandBuffer, (static_cast<uint32_t>(scene.instances().size()) + 63) / 64, 1, 1);
+
+    // per batch counts must be complete before they become draws
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullCompactPipeline);
+    vkCmdDispatch(commandBuffer, (static_cast<uint32_t>(cullBatches.size()) + 63) / 64, 1, 1);
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    profiler.endScope(commandBuffer, cullScope);
+}
+
+void VulkanObject::recordLightClusters(VkCommandBuffer commandBuffer, UniformOffsets const& offsets) {
+    uint32_t clusterScope = profiler.beginScope(commandBuffer, "clusters");
+
+    // the previous frame's lighting pass may still be reading the lists. a write after
+    // read only needs the execution dependency
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+    uint32_t clusterOffsets[] = { offsets.cluster, offsets.lights };
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, clusterLayout, 0, 1, &clusterDescriptorSet, 2, clusterOffsets);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, clusterPipeline);
+    vkCmdDispatch(commandBuffer, CLUSTER_COUNT / 64, 1, 1);
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    profiler.endScope(commandBuffer, clusterScope);
+}
+
+// viewport and scissor are dynamic in every pipeline, they cover the whole target
+void VulkanObject::setViewportAndScissor(VkCommandBuffer commandBuffer, VkExtent2D extent) {
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(extent.width);
+    viewport.height = static_cast<float>(extent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+
+    VkRect2D scissor{};
+    scissor.offset = { 0, 0 };
+    scissor.extent = extent;
+
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 }
 
 void VulkanObject::createSyncObjects() {
@@ -2427,8 +3531,87 @@ void VulkanObject::createSyncObjects() {
     }
 }
 
+// render a frame into the offscreen targets. no acquire, present or UI
+void VulkanObject::drawFrameHeadless() {
+    vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    streamTextures();
+
+    uint32_t imageIndex = static_cast<uint32_t>(currentFrame);
+
+    uniformRing.beginFrame(static_cast<uint32_t>(currentFrame));
+    UniformOffsets offsets = updateUniformBuffer();
+
+    recordCommandBuffer(commandBuffers[currentFrame], imageIndex, offsets);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+
+    vkResetFences(device, 1, &inFlightFences[currentFrame]);
+
+    if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit draw command buffer!");
+    }
+    frameSubmitted();
+
+    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+}
+
+void VulkanObject::printGpuTimings(std::ostream& out) {
+    // pick up the frames still in flight when rendering stopped
+    vkDeviceWaitIdle(device);
+    profiler.flush();
+
+    out << pipelineCache.summary() << std::endl;
+    out << uploads.summary() << std::endl;
+    out << textureSummary() << std::endl;
+    out << gbufferSummary() << std::endl;
+    out << sceneSummary() << std::endl;
+
+    if (!profiler.enabled()) {
+        out << "GPU timings unavailable, no timestamp support" << std::endl;
+        return;
+    }
+
+    out << "pass        last ms    min ms    avg ms    p99 ms" << std::endl;
+    for (size_t scope = 0; scope < profiler.scopeCount(); scope++) {
+        GpuProfiler::ScopeStats stats = profiler.scopeStats(scope);
+
+        char line[128];
+        snprintf(line, sizeof(line), "%-10s %8.3f  %8.3f  %8.3f  %8.3f", profiler.scopeName(scope).c_str(), stats.lastMs, stats.minMs, stats.avgMs, stats.p99Ms);
+        out << line << std::endl;
+    }
+}
+
+bool VulkanObject::writeGpuTimings(std::filesystem::path const& path) {
+    vkDeviceWaitIdle(device);
+    profiler.flush();
+
+    return profiler.writeCsv(path);
+}
+
+float VulkanObject::gpuScopeAverage(char const* name) {
+    vkDeviceWaitIdle(device);
+    profiler.flush();
+
+    for (size_t scope = 0; scope < profiler.scopeCount(); scope++) {
+        if (profiler.scopeName(scope) == name) {
+            return profiler.scopeStats(scope).avgMs;
+        }
+    }
+    return std::numeric_limits<float>::quiet_NaN();
+}
+
 // get image from swap chain, execute command buffer, put image back in chain
 void VulkanObject::drawFrame() {
+    uploads.retire();
+
+    if (headless) {
+        drawFrameHeadless();
+        return;
+    }
+
     // wait for all (VK_TRUE) fences before continueing.
     vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
 
@@ -2456,7 +3639,12 @@ void VulkanObject::drawFrame() {
     // mark image as now being used by this frame
     imagesInFlight[imageIndex] = inFlightFences[currentFrame];
 
-    updateUniformBuffer(imageIndex);
+    // this frame's fence has been waited on, so its part of the ring is free again
+    uniformRing.beginFrame(static_cast<uint32_t>(currentFrame));
+    UniformOffsets offsets = updateUniformBuffer();
+    streamTextures();
+
+    recordCommandBuffer(commandBuffers[currentFrame], imageIndex, offsets);
 
     ImGui_ImplVulkan_NewFrame();
     ImGui_ImplGlfw_NewFrame();
@@ -2497,10 +3685,86 @@ void VulkanObject::drawFrame() {
     ImGui::RadioButton("albedo", &display_mode, 3);
     ImGui::RadioButton("shadow", &display_mode, 4);
     ImGui::RadioButton("position", &display_mode, 5);
+    ImGui::RadioButton("material", &display_mode, 7);
+    ImGui::RadioButton("lights per cluster", &display_mode, 8);
+    ImGui::RadioButton("shadow cascades", &display_mode, 9);
     ImGui::RadioButton("composed", &display_mode, 6); ImGui::SameLine();
     ImGui::Checkbox("PCF", &pcf);
+    ImGui::Checkbox("per pixel inverse reconstruction", &inverseReconstruction);
+    ImGui::SliderFloat("cascade split", &cascadeSettings.lambda, 0.0f, 1.0f);
+    ImGui::Checkbox("cache static shadows", &shadowCaching);
+
+    uint32_t minLights = 0;
+    uint32_t maxLights = MAX_LIGHTS;
+    ImGui::SliderScalar("lights", ImGuiDataType_U32, &lightCount, &minLights, &maxLights);
    
     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+
+    if (ImGui::CollapsingHeader("GPU profiler", ImGuiTreeNodeFlags_DefaultOpen)) {
+        ImGui::TextUnformatted(pipelineCache.summary().c_str());
+        ImGui::Text("pipeline permutations: %zu geometry, %zu lighting, %zu building", geometryPipelines.readyCount(), lightingPipelines.readyCount(),
+            geometryPipelines.pendingCount() + lightingPipelines.pendingCount());
+        ImGui::TextUnformatted(uploads.summary().c_str());
+        ImGui::TextUnformatted(textureSummary().c_str());
+        ImGui::Text("last resize %.2f ms", lastResizeMs);
+        ImGui::TextUnformatted(sceneSummary().c_str());
+        // culled by the compute pass or by cullDirectDraws
+        ImGui::Checkbox("frustum culling", &frustumCulling);
+
+        if (!profiler.enabled()) {
+            ImGui::Text("timestamps not supported on the graphics queue");
+        }
+        else if (ImGui::BeginTable("gpu_scopes", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+            ImGui::TableSetupColumn("pass");
+            ImGui::TableSetupColumn("last ms");
+            ImGui::TableSetupColumn("min ms");
+            ImGui::TableSetupColumn("avg ms");
+            ImGui::TableSetupColumn("p99 ms");
+            ImGui::TableHeadersRow();
+
+            for (size_t scope = 0; scope < profiler.scopeCount(); scope++) {
+                GpuProfiler::ScopeStats stats = profiler.scopeStats(scope);
+
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn(); ImGui::TextUnformatted(profiler.scopeName(scope).c_str());
+                ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.lastMs);
+                ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.minMs);
+                ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.avgMs);
+                ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.p99Ms);
+            }
+            ImGui::EndTable();
+
+            for (size_t scope = 0; scope < profiler.scopeCount(); scope++) {
+                std::vector<float> history = profiler.scopeHistory(scope);
+                ImGui::PlotLines(profiler.scopeName(scope).c_str(), history.data(), static_cast<int>(history.size()), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 40));
+            }
+
+            static std::string csv_status;
+            if (ImGui::Button("dump CSV")) {
+                csv_status = profiler.writeCsv("gpu_profile.csv") ? "wrote gpu_profile.csv" : "failed to write gpu_profile.csv";
+            }
+            ImGui::SameLine();
+            ImGui::TextUnformatted(csv_status.c_str());
+        }
+    }
+
+    if (ImGui::CollapsingHeader("device memory")) {
+        ImGui::Text("%u / %u VkDeviceMemory objects", allocator.deviceMemoryCount(), allocator.maxDeviceMemoryCount());
+
+        for (const auto& heap : allocator.heapStats()) {
+            if (heap.allocatedBytes == 0) {
+                continue;
+            }
+
+            ImGui::Text("heap %u (%s, %.0f MB)", heap.heapIndex, heap.deviceLocal ? "device local" : "host", heap.heapSize / (1024.0 * 1024.0));
+            ImGui::Text("    %u blocks, %u dedicated, %u allocations", heap.blockCount, heap.dedicatedCount, heap.allocationCount);
+            ImGui::Text("    %.2f / %.2f MB used, %.2f MB requested", heap.usedBytes / (1024.0 * 1024.0), heap.allocatedBytes / (1024.0 * 1024.0), heap.requestedBytes / (1024.0 * 1024.0));
+            ImGui::Text("    fragmentation %.2f", heap.fragmentation);
+        }
+
+        ImGui::Text("%s", gbufferSummary().c_str());
+        ImGui::Text("uniform ring %.1f / %.0f KB this frame", uniformRing.frameUsed() / 1024.0, uniformRing.frameSize() / 1024.0);
+    }
     ImGui::End();
 
     ImGui::Render();
@@ -2526,12 +3790,16 @@ void VulkanObject::drawFrame() {
         vkCmdBeginRenderPass(imgui_command_buffers[imageIndex], &info, VK_SUBPASS_CONTENTS_INLINE);
     }
 
+    // submitted after the main command buffer, so the queries were already reset this frame
+    uint32_t imguiScope = profiler.beginScope(imgui_command_buffers[imageIndex], "imgui");
+
     ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), imgui_command_buffers[imageIndex]);
 
     vkCmdEndRenderPass(imgui_command_buffers[imageIndex]);
+    profiler.endScope(imgui_command_buffers[imageIndex], imguiScope);
     vkEndCommandBuffer(imgui_command_buffers[imageIndex]);
 
-    std::array<VkCommandBuffer, 2> submitCommandBuffers = { commandBuffers[imageIndex], imgui_command_buffers[imageIndex] };
+    std::array<VkCommandBuffer, 2> submitCommandBuffers = { commandBuffers[currentFrame], imgui_command_buffers[imageIndex] };
     // struct to hold info about queue submissions
     VkSubmitInfo submitInfo{};
     // assign type
@@ -2569,6 +3837,7 @@ void VulkanObject::drawFrame() {
         // throw error
         throw std::runtime_error("failed to submit draw command buffer!");
     }
+    frameSubmitted();
 
     // presentation configuration struct
     VkPresentInfoKHR presentInfo{};
@@ -2609,7 +3878,7 @@ void VulkanObject::drawFrame() {
     currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
-void VulkanObject::updateUniformBuffer(uint32_t currentImage) {
+VulkanObject::UniformOffsets VulkanObject::updateUniformBuffer() {
     static auto startTime = std::chrono::high_resolution_clock::now();
 
     auto currentTime = std::chrono::high_resolution_clock::now();
@@ -2631,6 +3900,10 @@ void VulkanObject::updateUniformBuffer(uint32_t currentImage) {
     ubo.proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / (float)swapChainExtent.height, 0.001f, 4.0f);
     ubo.proj[1][1] *= -1;
 
+    // the lighting pass rebuilds positions from linear depth along interpolated view rays
+    ubo.inv_view = glm::inverse(ubo.view);
+    ubo.view_ray_params = glm::vec4(1.0f / ubo.proj[0][0], 1.0f / ubo.proj[1][1], ubo.proj[2][2], ubo.proj[3][2]);
+
     ubo.light = glm::rotate(x_light_rotation, glm::vec3(1.0, 0.0, 0.0));
     ubo.light *= glm::rotate(y_light_rotation, glm::vec3(0.0, 1.0, 0.0));
     ubo.light *= glm::rotate(z_light_rotation, glm::vec3(0.0, 0.0, 1.0));
@@ -2646,34 +3919,100 @@ void VulkanObject::updateUniformBuffer(uint32_t currentImage) {
 
     ubo.shadow_bias = shadow_bias;
 
-    ubo.model_stage_on = model_stage_on;
-    ubo.texture_stage_on = texture_stage_on;
-    ubo.lighting_stage_on = lighting_stage_on;
+    // the stage toggles, display mode and PCF are specialization constants, see lightingPermutation
 
-    ubo.display_mode = display_mode;
+    ubo.win_dim = glm::vec2(swapChainExtent.width, swapChainExtent.height);
 
-    ubo.pcf_on = pcf;
+    ubo.cluster_near = CLUSTER_NEAR;
+    ubo.cluster_far = CLUSTER_FAR;
+    ubo.light_count = lightCount;
+
+    // the directional light shines from where the light used to sit, towards the origin
+    glm::vec3 light_dir = glm::normalize(glm::vec3(ubo.light * glm::vec4(1.0f, 0.0f, 0.0f, 0.0f)));
+
+    // world space bounds of the scene, so the cascades reach every caster
+    glm::vec3 bounds_min(std::numeric_limits<float>::max());
+    glm::vec3 bounds_max(-std::numeric_limits<float>::max());
+    for (int corner = 0; corner < 8; corner++) {
+        glm::vec4 local((corner & 1) ? sceneBoundsMax.x : sceneBoundsMin.x, (corner & 2) ? sceneBoundsMax.y : sceneBoundsMin.y,
+            (corner & 4) ? sceneBoundsMax.z : sceneBoundsMin.z, 1.0f);
+        glm::vec3 world = glm::vec3(ubo.model * local);
+        bounds_min = glm::min(bounds_min, world);
+        bounds_max = glm::max(bounds_max, world);
+    }
 
-    ubo.win_dim = glm::vec2(swapChainExtent.width, swapChainExtent.height);
+    uint32_t resolution = static_cast<uint32_t>(shadowPass.width);
+    Cascade cascades[MAX_CASCADES];
+    fitCascades(ubo.view, ubo.proj, SHADOW_NEAR, SHADOW_FAR, light_dir, cascadeSettings, resolution, bounds_min, bounds_max, cascades);
 
-    glm::mat4 light_view = glm::lookAt(glm::vec3(ubo.light * glm::vec4(-2.5f, 0.0f, 0.0f, 1.0f)), glm::vec3(0.0), glm::vec3(0.0, 1.0, 0.0));
-    glm::mat4 light_proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / (float)swapChainExtent.height, 0.001f, 4.0f);
-    light_proj[1][1] *= -1;
+    ubo.cascade_count = cascadeSettings.count;
+    for (uint32_t i = 0; i < cascadeSettings.count; i++) {
+        ubo.cascade_splits[i] = cascades[i].splitFar;
+        ubo.cascadeVP[i] = cascades[i].viewProj;
+    }
 
-    ubo.lightVP = light_proj * light_view;
+    // one projection around the whole view frustum, the light view is culled against it for every cascade
+    ubo.lightVP = fitCascade(ubo.view, ubo.proj, 0.0f, SHADOW_FAR, light_dir, resolution, bounds_min, bounds_max);
 
-    void* data;
-    vkMapMemory(device, uniformBuffersMemory[currentImage], 0, sizeof(ubo), 0, &data);
-    memcpy(data, &ubo, sizeof(ubo));
-    vkUnmapMemory(device, uniformBuffersMemory[currentImage]);
+    UniformOffsets offsets{};
+    offsets.ubo = uniformRing.push(ubo);
 
-    ShadowUniformBufferObject subo{};
-	
-    subo.depthMVP = ubo.lightVP * ubo.model;
+    shadowRedrawMask = 0;
+    for (uint32_t i = 0; i < cascadeSettings.count; i++) {
+        ShadowUniformBufferObject subo{};
+        subo.depthMVP = cascades[i].viewProj * ubo.model;
+
+        offsets.shadow[i] = uniformRing.push(subo);
+
+        // nothing static moved in this cascade since its casters were last drawn
+        if (shadowCaching && shadowCacheValid[i] && subo.depthMVP == cachedDepthMVP[i]) {
+            continue;
+        }
+
+        shadowRedrawMask |= 1u << i;
+        cachedDepthMVP[i] = subo.depthMVP;
+        shadowCacheValid[i] = true;
+    }
+
+    // the lights move every frame, each frame in flight writes its own slice
+    offsets.lights = static_cast<uint32_t>(lightStride * currentFrame);
+    if (lightCount > 0) {
+        lightSet.update(time);
+        memcpy(static_cast<char*>(lightMemory.mapped) + offsets.lights, lightSet.lights().data(), sizeof(GpuLight) * lightCount);
+
+        ClusterUniformBufferObject lubo{};
+        lubo.view = ubo.view;
+        lubo.inv_proj = glm::inverse(ubo.proj);
+        lubo.z_near = CLUSTER_NEAR;
+        lubo.z_far = CLUSTER_FAR;
+        lubo.light_count = lightCount;
+
+        offsets.cluster = uniformRing.push(lubo);
+    }
+
+    Frustum camera = extractFrustum(ubo.proj * ubo.view);
+    Frustum light = extractFrustum(ubo.lightVP);
+    if (!gpuDriven) {
+        cullDirectDraws(ubo.model, camera, light);
+    }
+    else {
+        CullUniformBufferObject cubo{};
+        cubo.model = ubo.model;
+
+        for (int i = 0; i < 6; i++) {
+            cubo.planes[i] = camera.planes[i];
+            cubo.planes[6 + i] = light.planes[i];
+        }
 
-    vkMapMemory(device, shadowUniformBuffersMemory[currentImage], 0, sizeof(subo), 0, &data);
-    memcpy(data, &subo, sizeof(subo));
-    vkUnmapMemory(device, shadowUniformBuffersMemory[currentImage]);
+        cubo.instance_count = static_cast<uint32_t>(scene.instances().size());
+        cubo.batch_count = static_cast<uint32_t>(cullBatches.size());
+        cubo.visible_stride = visibleStride;
+        cubo.flags = (frustumCulling ? CULL_FLAG_ENABLED : 0u) | (drawIndirectCount ? CULL_FLAG_COMPACT : 0u);
+
+        offsets.cull = uniformRing.push(cubo);
+    }
+
+    return offsets;
 }
 
 // create a VkShaderModule to encapsulate our shaders
@@ -2804,12 +4143,12 @@ bool VulkanObject::isDeviceSuitable(VkPhysicalDevice device) {
     QueueFamilyIndices indices = findQueueFamilies(device);
 
     // check that we can support all extensions
-    bool extensionsSupported = checkDeviceExtensionSupport(device);
+    bool extensionsSupported = headless || checkDeviceExtensionSupport(device);
 
-    // bool to check if our swap chain is usable
-    bool swapChainAdequate = false;
+    // bool to check if our swap chain is usable. headless never creates one
+    bool swapChainAdequate = headless;
     // if we can support all extensions
-    if (extensionsSupported) {
+    if (extensionsSupported && !headless) {
         // check that we have at least one image format and presentation mode to use
         SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
         swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
@@ -2848,6 +4187,22 @@ bool VulkanObject::checkDeviceExtensionSupport(VkPhysicalDevice device) {
     return requiredExtensions.empty();
 }
 
+bool VulkanObject::hasDeviceExtension(VkPhysicalDevice device, char const* name) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+    for (const auto& extension : availableExtensions) {
+        if (std::strcmp(extension.extensionName, name) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 // search for queue family support
 QueueFamilyIndices VulkanObject::findQueueFamilies(VkPhysicalDevice device) {
     // struct to hold queue family data
@@ -2874,8 +4229,13 @@ QueueFamilyIndices VulkanObject::findQueueFamilies(VkPhysicalDevice device) {
 
         // check whether we support drawing to surface
         VkBool32 presentSupport = false;
-        // actually perform check
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+        // actually perform check. without a surface the graphics queue stands in
+        if (headless) {
+            presentSupport = indices.graphicsFamily.has_value() && indices.graphicsFamily.value() == i;
+        }
+        else {
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+        }
 
         // if we can
         if (presentSupport) {
@@ -2891,21 +4251,36 @@ QueueFamilyIndices VulkanObject::findQueueFamilies(VkPhysicalDevice device) {
         i++;
     }
 
+    // graphics and compute families can copy too, but only a family without either runs
+    // beside the graphics queue instead of sharing it
+    for (uint32_t family = 0; family < queueFamilyCount; family++) {
+        VkQueueFlags flags = queueFamilies[family].queueFlags;
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            indices.transferFamily = family;
+            break;
+        }
+    }
+
     return indices;
 }
 
 // return required list of extensions
 std::vector<const char*> VulkanObject::getRequiredExtensions() {
-    // count of GLFW extensions
-    uint32_t glfwExtensionCount = 0;
-    // C style array of GLFW extensions
-    const char** glfwExtensions;
+    // create vector of extensions
+    std::vector<const char*> extensions;
 
-    // GLFW provides this function that returns the extensions required for the interface between vulkan and itself
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    // surface extensions are only needed when there is a window
+    if (!headless) {
+        // count of GLFW extensions
+        uint32_t glfwExtensionCount = 0;
+        // C style array of GLFW extensions
+        const char** glfwExtensions;
 
-    // create vector of extensions
-    std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        // GLFW provides this function that returns the extensions required for the interface between vulkan and itself
+        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
     // is we have enabled validation layers (debug)
     if (enableValidationLayers) {
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <string>
+
+// CPU micro benchmarks, run with "task_2 --bench <name>" instead of opening a window.
+// returns the process exit code
+int runBenchmark(std::string const& name);
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+// power of two buddy suballocator over an abstract range [0, size).
+//
+// this is pure bookkeeping: it hands out offsets and never touches memory, so it
+// can be exercised on the CPU without a device. every block of order k starts at
+// a multiple of 2^k, which satisfies any power of two alignment up to the block size
+class BuddyAllocator
+{
+public:
+    static constexpr uint64_t NO_SPACE = ~0ull;
+
+    // size and min_block_size must be powers of two
+    explicit BuddyAllocator(uint64_t size, uint64_t min_block_size = 256);
+
+    // returns the offset of a range of at least size bytes aligned to alignment,
+    // or NO_SPACE if no free block is big enough
+    uint64_t allocate(uint64_t size, uint64_t alignment);
+    void free(uint64_t offset);
+
+    uint64_t size() const { return uint64_t(1) << max_order; }
+    // bytes handed out, rounded up to block sizes
+    uint64_t usedBytes() const { return used_bytes; }
+    // bytes actually asked for, the difference to usedBytes is internal fragmentation
+    uint64_t requestedBytes() const { return requested_bytes; }
+    uint64_t largestFreeBlock() const;
+    size_t allocationCount() const { return allocations.size(); }
+    bool empty() const { return allocations.empty(); }
+
+    // 0 when all free space is one block, approaching 1 as it splinters
+    float fragmentation() const;
+
+private:
+    struct Allocated {
+        uint32_t order;
+        uint64_t requested;
+    };
+
+    uint32_t min_order;
+    uint32_t max_order;
+
+    // free block offsets per order, starting at min_order. ordered so allocation
+    // prefers low offsets and keeps the top of the range free for large blocks
+    std::vector<std::set<uint64_t>> free_lists;
+    std::unordered_map<uint64_t, Allocated> allocations;
+
+    uint64_t used_bytes = 0;
+    uint64_t requested_bytes = 0;
+
+    std::set<uint64_t>& freeList(uint32_t order) { return free_lists[order - min_order]; }
+    std::set<uint64_t> const& freeList(uint32_t order) const { return free_lists[order - min_order]; }
+};
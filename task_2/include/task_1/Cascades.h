@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+// most cascades the directional light can have, must match shaders/lighting_pass.frag
+static constexpr uint32_t MAX_CASCADES = 4;
+
+// how the camera's depth range is shared out between the cascades
+struct CascadeSettings
+{
+    uint32_t count = 4;
+    // 0 splits the depth range evenly, 1 logarithmically, in between blends the two
+    float lambda = 0.75f;
+};
+
+// one layer of a directional light's shadow map
+struct Cascade
+{
+    // world to light clip space ([0, 1] depth), covering one slice of the camera frustum
+    glm::mat4 viewProj;
+    // view space depth where the slice ends
+    float splitFar;
+};
+
+// view space depths where each of count cascades ends, the last one is z_far
+void cascadeSplits(uint32_t count, float lambda, float z_near, float z_far, float* splits);
+
+// orthographic light clip space around the camera frustum between slice_near and slice_far.
+// the slice is bounded by a sphere so the projection keeps its size as the camera turns,
+// and its centre is snapped to whole shadow map texels so edges do not shimmer as the
+// camera moves. depth reaches out to the scene bounds so casters outside the slice still cast
+glm::mat4 fitCascade(glm::mat4 const& view, glm::mat4 const& proj, float slice_near, float slice_far,
+    glm::vec3 const& light_dir, uint32_t resolution, glm::vec3 const& scene_min, glm::vec3 const& scene_max);
+
+// fit settings.count cascades to the camera. the first one starts at the camera itself so
+// nothing in front of z_near goes unshadowed
+void fitCascades(glm::mat4 const& view, glm::mat4 const& proj, float z_near, float z_far, glm::vec3 const& light_dir,
+    CascadeSettings const& settings, uint32_t resolution, glm::vec3 const& scene_min, glm::vec3 const& scene_max,
+    Cascade* cascades);
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "task_1/Scene.h"
+
+// views culled by the GPU culling pass. each gets its own visible list and draw commands.
+// the light's casters are split in two so the static ones can be cached in the shadow map,
+// both light views are culled against the same planes
+enum CullView : uint32_t {
+    CULL_VIEW_CAMERA = 0,
+    CULL_VIEW_LIGHT = 1,
+    CULL_VIEW_LIGHT_DYNAMIC = 2,
+    CULL_VIEW_COUNT = 3,
+};
+
+// whether a view draws an instance at all, before any frustum test
+bool instanceInView(InstanceData const& instance, CullView view);
+
+// CullUniformBufferObject::flags, must match shaders/cull.glsl
+static constexpr uint32_t CULL_FLAG_ENABLED = 1u;
+static constexpr uint32_t CULL_FLAG_COMPACT = 2u;
+
+// per draw batch data read by the culling shaders, one entry per Scene::DrawBatch
+struct CullBatch
+{
+    // object space bounding sphere of the batch's mesh, xyz centre and w radius
+    glm::vec4 sphere;
+    glm::uint32 indexCount;
+    glm::uint32 firstIndex;
+    glm::int32 vertexOffset;
+    glm::uint32 firstInstance;
+};
+
+// the six planes of a view volume, xyz pointing inwards and normalised
+struct Frustum
+{
+    glm::vec4 planes[6];
+};
+
+// planes of proj * view for a [0, 1] depth range (GLM_FORCE_DEPTH_ZERO_TO_ONE)
+Frustum extractFrustum(glm::mat4 const& view_proj);
+
+// bounding sphere of a mesh's AABB
+glm::vec4 boundingSphere(glm::vec3 const& bounds_min, glm::vec3 const& bounds_max);
+
+// sphere under a transform. the radius grows by the largest axis scale
+glm::vec4 transformSphere(glm::mat4 const& transform, glm::vec4 const& sphere);
+
+bool sphereInFrustum(Frustum const& frustum, glm::vec4 const& sphere);
+
+std::vector<CullBatch> buildCullBatches(Scene const& scene);
+
+// output of culling one view, laid out the way the GPU pass writes it
+struct CullResult
+{
+    // visible instance indices. batch b owns [firstInstance, firstInstance + count) of which
+    // the first instanceCount of its draw are used
+    std::vector<uint32_t> visible;
+    // one command per batch, or only the non empty ones packed at the front when compacting
+    std::vector<VkDrawIndexedIndirectCommand> draws;
+    uint32_t drawCount = 0;
+};
+
+// CPU reference of shaders/cull.comp and cull_compact.comp for one view, so culling results
+// can be checked without a GPU. the GPU appends with atomics, so its visible lists and
+// compacted draws hold the same entries in an unspecified order
+CullResult cullReference(Scene const& scene, std::vector<CullBatch> const& batches, glm::mat4 const& model,
+    Frustum const& frustum, uint32_t flags, CullView view = CULL_VIEW_CAMERA);
+
+// world space bounding spheres stored as separate x, y, z and radius arrays so the SIMD
+// kernels below load 4 or 8 objects per register. the arrays are padded to a multiple of
+// CULL_SIMD_WIDTH with spheres that are always culled, so there is no scalar tail
+class SphereSoA
+{
+public:
+    static constexpr size_t CULL_SIMD_WIDTH = 8;
+
+    void assign(glm::vec4 const* spheres, size_t count);
+    void set(size_t index, glm::vec4 const& sphere);
+
+    size_t size() const { return count; }
+    // size of the arrays, the visible list passed to cullSpheres must hold this many entries
+    size_t paddedSize() const { return xs.size(); }
+
+    float const* x() const { return xs.data(); }
+    float const* y() const { return ys.data(); }
+    float const* z() const { return zs.data(); }
+    float const* radius() const { return radii.data(); }
+
+private:
+    std::vector<float> xs, ys, zs, radii;
+    size_t count = 0;
+};
+
+// write the indices of the spheres inside the frustum to visible, in ascending order, and
+// return how many there are. uses the widest kernel this file was compiled with
+size_t cullSpheres(SphereSoA const& spheres, Frustum const& frustum, uint32_t* visible);
+
+// the same test one sphere at a time over an array of vec4s, kept as the baseline
+size_t cullSpheresScalar(glm::vec4 const* spheres, size_t count, Frustum const& frustum, uint32_t* visible);
+
+// "avx2", "sse2", "neon" or "scalar"
+char const* cullSpheresKernel();
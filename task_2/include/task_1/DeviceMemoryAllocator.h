@@ -0,0 +1,109 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+
+#include <memory>
+#include <vector>
+
+#include "task_1/BuddyAllocator.h"
+
+// buffers and linear images, or optimally tiled images. the two are kept in separate
+// blocks so neighbours never violate bufferImageGranularity
+enum class ResourceKind {
+    Linear,
+    Optimal,
+};
+
+// a range of device memory handed out by DeviceMemoryAllocator. bind the resource
+// at (memory, offset); mapped is non-null for host visible memory
+struct Allocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void* mapped = nullptr;
+
+    uint32_t pool = 0;
+    // index of the block within its pool, or -1 for a dedicated VkDeviceMemory
+    int32_t block = -1;
+};
+
+// suballocates resources out of large VkDeviceMemory blocks, one pool of blocks per
+// memory type and resource kind, instead of one vkAllocateMemory per resource.
+// resources bigger than half a block get a dedicated allocation of their own.
+// host visible blocks are mapped once on creation and stay mapped
+class DeviceMemoryAllocator
+{
+public:
+    static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+    struct HeapStats {
+        uint32_t heapIndex;
+        VkDeviceSize heapSize;
+        bool deviceLocal;
+        uint32_t blockCount;
+        uint32_t dedicatedCount;
+        uint32_t allocationCount;
+        // bytes reserved from the driver, in blocks and dedicated allocations
+        VkDeviceSize allocatedBytes;
+        // bytes handed out, and how many of those were actually requested
+        VkDeviceSize usedBytes;
+        VkDeviceSize requestedBytes;
+        // worst free space fragmentation over the heap's blocks
+        float fragmentation;
+    };
+
+    DeviceMemoryAllocator() = default;
+    ~DeviceMemoryAllocator();
+
+    DeviceMemoryAllocator(DeviceMemoryAllocator const&) = delete;
+    DeviceMemoryAllocator& operator=(DeviceMemoryAllocator const&) = delete;
+
+    void init(VkPhysicalDevice physical_device, VkDevice device);
+    // free every block. all resources bound to them must already be destroyed
+    void destroy();
+
+    uint32_t findMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties) const;
+    // same search as findMemoryType, for optional properties such as lazily allocated
+    bool hasMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties) const;
+    // property flags of the memory type an allocation was made from
+    VkMemoryPropertyFlags propertyFlags(Allocation const& allocation) const;
+
+    Allocation allocate(VkMemoryRequirements const& requirements, VkMemoryPropertyFlags properties, ResourceKind kind, bool dedicated = false);
+    void free(Allocation& allocation);
+
+    std::vector<HeapStats> heapStats() const;
+    // live VkDeviceMemory objects, to compare against maxMemoryAllocationCount
+    uint32_t deviceMemoryCount() const { return device_memory_count; }
+    uint32_t maxDeviceMemoryCount() const { return max_device_memory_count; }
+
+private:
+    struct Block {
+        VkDeviceMemory memory;
+        void* mapped;
+        BuddyAllocator range;
+    };
+
+    struct Pool {
+        uint32_t memoryType;
+        VkDeviceSize blockSize;
+        // null entries are released blocks, kept so block indices stay stable
+        std::vector<std::unique_ptr<Block>> blocks;
+        uint32_t dedicatedCount = 0;
+        VkDeviceSize dedicatedBytes = 0;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memory_properties{};
+    VkDeviceSize buffer_image_granularity = 1;
+
+    // two pools per memory type, indexed by poolIndex
+    std::vector<Pool> pools;
+
+    uint32_t device_memory_count = 0;
+    uint32_t max_device_memory_count = 0;
+
+    uint32_t poolIndex(uint32_t memory_type, ResourceKind kind) const;
+
+    VkDeviceMemory allocateDeviceMemory(uint32_t memory_type, VkDeviceSize size, void** mapped);
+    void freeDeviceMemory(VkDeviceMemory memory, void* mapped);
+};
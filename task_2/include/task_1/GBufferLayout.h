@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include <vulkan/vulkan.hpp>
+
+// how the geometry pass packs its outputs for the lighting pass. the value is
+// passed to both fragment shaders as the GBUFFER_LAYOUT specialisation constant
+// (see shaders/gbuffer.glsl), so the numbering must match
+enum class GBufferLayout : int32_t {
+    // RGBA32F albedo + specular, biased xyz normal in RGB10A2. the original
+    // layout, kept as the baseline for image diffs
+    Reference = 0,
+    // RGBA8 sRGB albedo + specular, octahedral normal in RG16F
+    Compact = 1,
+    // RGBA8 sRGB albedo + specular, octahedral normal and a 10 bit material id in RGB10A2
+    CompactMaterial = 2,
+};
+
+static constexpr GBufferLayout GBUFFER_LAYOUTS[] = { GBufferLayout::Reference, GBufferLayout::Compact, GBufferLayout::CompactMaterial };
+
+struct GBufferFormats {
+    VkFormat albedo;
+    VkFormat normal;
+};
+
+GBufferFormats gbufferFormats(GBufferLayout layout);
+
+char const* gbufferLayoutName(GBufferLayout layout);
+
+// accepts the names returned by gbufferLayoutName. returns false for anything else
+bool parseGBufferLayout(std::string const& name, GBufferLayout& layout);
+
+// bytes per pixel of the formats the G-buffer and depth attachments use
+uint32_t gbufferFormatSize(VkFormat format);
+
+// bytes per pixel of the colour attachments of a layout plus depth
+uint32_t gbufferBytesPerPixel(GBufferLayout layout, VkFormat depth_format);
+
+// attachment memory and estimated per frame traffic of every layout at a resolution.
+// traffic assumes each attachment is written once by the geometry subpass and read
+// once by the lighting subpass, i.e. no overdraw and no on chip tile memory
+void printGBufferReport(std::ostream& out, uint32_t width, uint32_t height, VkFormat depth_format);
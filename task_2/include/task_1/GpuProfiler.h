@@ -0,0 +1,92 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+
+#include <array>
+#include <deque>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// pass level GPU timings from timestamp queries.
+//
+// each frame in flight owns a query pool with a begin/end pair per named scope.
+// results are read back without waiting when the frame slot comes round again
+// (its fence has been waited on by then, so they are normally available) and
+// kept in a rolling log for the stats, graphs and CSV dumps
+class GpuProfiler
+{
+public:
+    static constexpr uint32_t MAX_SCOPES = 16;
+    static constexpr uint32_t NO_SCOPE = ~0u;
+    // frames the min/avg/p99 and graphs are computed over
+    static constexpr size_t HISTORY_LENGTH = 256;
+    // frames kept for CSV dumps
+    static constexpr size_t LOG_LENGTH = 65536;
+
+    struct ScopeStats {
+        float lastMs;
+        float minMs;
+        float avgMs;
+        float p99Ms;
+    };
+
+    // one resolved frame. scopes not written that frame are NaN
+    struct FrameSample {
+        uint64_t frame;
+        std::array<float, MAX_SCOPES> ms;
+    };
+
+    void init(VkPhysicalDevice physical_device, VkDevice device, uint32_t queue_family, uint32_t frame_count);
+    void destroy();
+
+    // false if the queue family has no timestamp support, every call is then a no-op
+    bool enabled() const { return timestamp_mask != 0; }
+
+    // collect what is available from this frame slot's previous use and reset its
+    // queries. must be recorded before any scope of the frame, outside a render pass
+    void beginFrame(VkCommandBuffer command_buffer, uint32_t frame);
+
+    // collect every frame slot still holding results. only call once the device
+    // is idle, e.g. before reporting at shutdown
+    void flush();
+
+    // timestamps around a piece of GPU work. may be recorded inside a render pass
+    uint32_t beginScope(VkCommandBuffer command_buffer, char const* name);
+    void endScope(VkCommandBuffer command_buffer, uint32_t scope);
+
+    size_t scopeCount() const { return scope_names.size(); }
+    std::string const& scopeName(size_t scope) const { return scope_names[scope]; }
+
+    // stats over the last HISTORY_LENGTH frames that contained the scope
+    ScopeStats scopeStats(size_t scope) const;
+    // last HISTORY_LENGTH values of a scope, oldest first
+    std::vector<float> scopeHistory(size_t scope) const;
+
+    std::deque<FrameSample> const& samples() const { return log; }
+
+    // every logged frame as one row, one column per scope
+    bool writeCsv(std::filesystem::path const& path) const;
+
+private:
+    struct FrameQueries {
+        VkQueryPool pool = VK_NULL_HANDLE;
+        // scopes with a begin timestamp written since the last reset
+        uint32_t writtenScopes = 0;
+        uint64_t frame = 0;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    // nanoseconds per tick
+    float timestamp_period = 1.0f;
+    uint64_t timestamp_mask = 0;
+
+    std::vector<FrameQueries> frames;
+    uint32_t current_frame = 0;
+    uint64_t frame_counter = 0;
+
+    std::vector<std::string> scope_names;
+    std::deque<FrameSample> log;
+
+    void collect(FrameQueries& queries);
+};
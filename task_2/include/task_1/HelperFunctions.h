@@ -28,4 +28,32 @@ static std::vector<char> readFile(const std::string& filename) {
 
     //return data
     return buffer;
-}
\ No newline at end of file
+}
+
+// 64 bit FNV-1a hash of a file's contents, streamed in chunks so large assets are
+// never held in memory at once. file_size receives the number of bytes hashed
+static uint64_t hashFile(const std::string& filename, uint64_t& file_size) {
+    std::ifstream file(filename, std::ios::binary);
+
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open file: " + filename + "!");
+    }
+
+    uint64_t hash = 14695981039346656037ull;
+    file_size = 0;
+
+    std::vector<char> chunk(1 << 16);
+    while (file) {
+        file.read(chunk.data(), chunk.size());
+        std::streamsize count = file.gcount();
+
+        for (std::streamsize i = 0; i < count; i++) {
+            hash ^= static_cast<unsigned char>(chunk[i]);
+            hash *= 1099511628211ull;
+        }
+
+        file_size += static_cast<uint64_t>(count);
+    }
+
+    return hash;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// froxel grid the camera frustum is split into for clustered lighting, must match
+// shaders/clusters.glsl. x and y tile the screen, z slices view depth exponentially
+static constexpr uint32_t CLUSTER_X = 16;
+static constexpr uint32_t CLUSTER_Y = 9;
+static constexpr uint32_t CLUSTER_Z = 24;
+static constexpr uint32_t CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+// lights past this in one cluster are dropped
+static constexpr uint32_t MAX_LIGHTS_PER_CLUSTER = 128;
+static constexpr uint32_t MAX_LIGHTS = 1024;
+
+// one point or spot light as the shaders read it. point lights have a cone that covers
+// every direction (cosOuter -2, cosInner -1)
+struct GpuLight
+{
+    // world space position, w is the radius the light reaches
+    glm::vec4 positionRadius;
+    // linear colour scaled by intensity, w is the cosine of the inner cone angle
+    glm::vec4 colorCosInner;
+    // direction the spot points in, w is the cosine of the outer cone angle
+    glm::vec4 directionCosOuter;
+};
+
+// a field of animated lights scattered through a box
+class LightSet
+{
+public:
+    // count lights, every fourth a spot light pointing down
+    void generate(uint32_t count, glm::vec3 const& bounds_min, glm::vec3 const& bounds_max, uint32_t seed = 1);
+    // orbit every light around the centre of the box at its own speed
+    void update(float seconds);
+
+    std::vector<GpuLight> const& lights() const { return current; }
+
+private:
+    std::vector<GpuLight> base;
+    std::vector<GpuLight> current;
+    std::vector<float> speeds;
+    glm::vec3 centre = glm::vec3(0.0f);
+};
+
+// light lists per cluster, laid out like the GPU buffer: a count per cluster, then
+// MAX_LIGHTS_PER_CLUSTER light indices per cluster
+struct ClusterLists
+{
+    std::vector<uint32_t> counts;
+    std::vector<uint32_t> indices;
+};
+
+// view space depth where slice z starts, z_near for slice 0 and z_far for CLUSTER_Z
+float clusterSliceDepth(uint32_t z, float z_near, float z_far);
+
+// view space AABB of one cluster, as shaders/cluster_assign.comp computes it
+void clusterBounds(uint32_t x, uint32_t y, uint32_t z, glm::mat4 const& inv_proj, float z_near, float z_far,
+    glm::vec3& bounds_min, glm::vec3& bounds_max);
+
+// CPU reference of shaders/cluster_assign.comp. lights are listed in ascending index order
+ClusterLists buildClusters(GpuLight const* lights, uint32_t light_count, glm::mat4 const& view, glm::mat4 const& proj,
+    float z_near, float z_far);
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+
+#include "task_1/Vertex.h"
+
+// read-only memory mapping of a whole file. The mapping stays valid for the
+// lifetime of the object, so pointers into it can be handed straight to vkMapMemory/memcpy
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    // map the file at path. returns false (and leaves the object empty) on failure
+    bool open(std::filesystem::path const& path);
+    void close();
+
+    void const* data() const { return mapped_data; }
+    size_t size() const { return mapped_size; }
+
+private:
+    void const* mapped_data = nullptr;
+    size_t mapped_size = 0;
+
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#endif
+};
+
+// binary mesh cache written next to a source OBJ on first load.
+//
+// layout (all offsets 16 byte aligned, little endian, native float):
+//   Header
+//   Material[materialCount]
+//   Vertex[vertexCount]
+//   uint32_t[indexCount]
+//
+// the cache is keyed by a hash of the source file contents, so editing the OBJ
+// invalidates it, and by the format version and sizeof(Vertex), so changing the
+// vertex layout does too. vertices and indices are stored after optimizeMesh.
+class MeshCache
+{
+public:
+    static constexpr char MAGIC[8] = { 'T', '2', 'M', 'E', 'S', 'H', '\0', '\0' };
+    // 2: vertex cache, overdraw and vertex fetch order
+    static constexpr uint32_t VERSION = 2;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerSize;
+        uint64_t sourceHash;
+        uint64_t sourceSize;
+        uint32_t vertexStride;
+        uint32_t materialCount;
+        uint64_t vertexCount;
+        uint64_t indexCount;
+        uint64_t materialOffset;
+        uint64_t vertexOffset;
+        uint64_t indexOffset;
+        float boundsMin[3];
+        float boundsMax[3];
+    };
+
+    // one entry per shape, mirrors the material fields of Model
+    struct Material {
+        float Ns;
+        float Ni;
+        float d;
+        float Tr;
+        float Tf[3];
+        float illum;
+        float Ka[3];
+        float Kd[3];
+        float Ks[3];
+        float Ke[3];
+    };
+
+    // where the cache for a given source file lives
+    static std::filesystem::path pathFor(std::filesystem::path const& source_path);
+
+    // serialise a parsed mesh. returns false if the file could not be written
+    static bool write(std::filesystem::path const& cache_path,
+        uint64_t source_hash,
+        uint64_t source_size,
+        Vertex const* vertices, size_t vertex_count,
+        uint32_t const* indices, size_t index_count,
+        Material const* materials, size_t material_count,
+        glm::vec3 const& bounds_min, glm::vec3 const& bounds_max);
+
+    // map a cache file and validate it against the source hash. returns false if
+    // the file is missing, truncated, from another version or stale
+    bool open(std::filesystem::path const& cache_path, uint64_t source_hash, uint64_t source_size);
+
+    Header const& header() const { return *reinterpret_cast<Header const*>(file.data()); }
+
+    Material const* materials() const { return at<Material>(header().materialOffset); }
+    Vertex const* vertices() const { return at<Vertex>(header().vertexOffset); }
+    uint32_t const* indices() const { return at<uint32_t>(header().indexOffset); }
+
+private:
+    MappedFile file;
+
+    template<typename T>
+    T const* at(uint64_t offset) const
+    {
+        return reinterpret_cast<T const*>(static_cast<char const*>(file.data()) + offset);
+    }
+};
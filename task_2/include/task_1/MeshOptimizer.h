@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "task_1/Vertex.h"
+
+// index and vertex reordering run on a mesh after load, before it goes into the mesh cache.
+//
+// optimizeVertexCache reorders triangles for the post-transform cache (Forsyth's linear speed
+// algorithm), optimizeOverdraw then splits that order into clusters and sorts them so outward
+// facing ones draw first (Sander et al., Tipsify), giving up at most threshold times the ACMR,
+// and optimizeVertexFetch renumbers vertices in the order they are first used so the vertex
+// fetch walks the buffer linearly. every pass keeps the triangles and their winding
+
+// FIFO post-transform cache the stats are simulated with
+static constexpr uint32_t VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStats {
+    size_t misses;
+    // average cache misses per triangle, 0.5 at best on a regular grid and 3 at worst
+    float acmr;
+    // average transforms per referenced vertex, 1 at best
+    float atvr;
+};
+
+// run a triangle list through a FIFO cache of cache_size vertices
+VertexCacheStats analyzeVertexCache(uint32_t const* indices, size_t index_count, size_t vertex_count,
+    uint32_t cache_size = VERTEX_CACHE_SIZE);
+
+void optimizeVertexCache(uint32_t* indices, size_t index_count, size_t vertex_count);
+void optimizeOverdraw(uint32_t* indices, size_t index_count, Vertex const* vertices, size_t vertex_count, float threshold = 1.05f);
+// vertices nothing refers to are dropped
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+// all three passes in order
+void optimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// one level of a mip chain, all levels packed back to back in one buffer
+struct MipLevel
+{
+    uint32_t width;
+    uint32_t height;
+    // bytes from the start of the chain
+    size_t offset;
+    size_t size;
+};
+
+// every level of an RGBA8 chain from width x height down to 1x1. returns the bytes the chain takes
+size_t mipChainLayout(uint32_t width, uint32_t height, std::vector<MipLevel>& levels);
+
+// fill every level after the first of an sRGB RGBA8 chain laid out by mipChainLayout.
+// a texel is the 2x2 box average of the level above. colour is averaged as 16 bit linear
+// values, which are carried down the chain and only rounded to 8 bit sRGB for storage,
+// alpha is averaged as stored. odd sizes drop the last row or column
+void generateMipChain(uint8_t* chain, std::vector<MipLevel> const& levels);
+
+// the same one texel at a time, the reference the SIMD kernels must match exactly
+void generateMipChainScalar(uint8_t* chain, std::vector<MipLevel> const& levels);
+
+// "avx2", "sse2", "neon" or "scalar"
+char const* mipChainKernel();
@@ -1,7 +1,10 @@
 #pragma once
 #include <filesystem>
+#include <memory>
 #include <glm/glm.hpp>
 
+#include "task_1/MeshCache.h"
+#include "task_1/ThreadPool.h"
 #include "task_1/Vertex.h"
 
 class Model
@@ -9,6 +12,12 @@ class Model
 	std::vector<Vertex> vertices;
 	std::vector<uint32_t> indices;
 
+	// when loaded from a mesh cache the vertex and index data live in the mapping
+	// instead of the vectors above
+	std::shared_ptr<MeshCache> cache;
+
+	void applyMaterial(MeshCache::Material const& material);
+
 public:
 
     float Ns;
@@ -24,16 +33,33 @@ public:
     float specular = 0.1;
     float diffuse = 0.5;
     float ambient = 0.2;
-	
-	void loadModel(std::filesystem::path const & model_path);
 
-	std::vector<Vertex> const& getVertices() const
+    // object space bounding box of all vertices
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+
+	// parse an OBJ, or map its mesh cache if one is up to date. vertex deduplication
+	// runs on pool, or on a temporary pool if none is given
+	void loadModel(std::filesystem::path const & model_path, ThreadPool* pool = nullptr);
+
+	// vertex data, either from the parsed OBJ or straight out of the mapped cache
+	Vertex const* getVertexData() const
+	{
+        return cache ? cache->vertices() : vertices.data();
+	}
+
+	size_t getVertexCount() const
+	{
+        return cache ? static_cast<size_t>(cache->header().vertexCount) : vertices.size();
+	}
+
+	uint32_t const* getIndexData() const
 	{
-        return vertices;
+        return cache ? cache->indices() : indices.data();
 	}
 
-	std::vector<uint32_t> const& getIndices() const
+	size_t getIndexCount() const
 	{
-        return indices;
+        return cache ? static_cast<size_t>(cache->header().indexCount) : indices.size();
 	}
 };
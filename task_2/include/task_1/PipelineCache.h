@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include <vulkan/vulkan.hpp>
+
+// VkPipelineCache persisted to disk between runs.
+//
+// layout:
+//   Header
+//   uint8_t[dataSize]   (the blob from vkGetPipelineCacheData)
+//
+// the blob is only handed back to the driver if the header matches the current
+// device (vendor, device, driver version and pipelineCacheUUID) and the data
+// hash checks out, as drivers are not required to survive a corrupt cache.
+// the header also remembers how long pipeline creation took on the run that
+// built the cache, so a warm start can be compared against it.
+class PipelineCache
+{
+public:
+    static constexpr char MAGIC[8] = { 'T', '2', 'P', 'S', 'O', '\0', '\0', '\0' };
+    static constexpr uint32_t VERSION = 1;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerSize;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint32_t driverVersion;
+        uint8_t uuid[VK_UUID_SIZE];
+        uint64_t dataSize;
+        uint64_t dataHash;
+        // pipeline creation time of the cold run that first wrote this file
+        float coldCreateMs;
+    };
+
+    // create the cache, seeded from path if the file there is valid for this device
+    void init(VkPhysicalDevice physical_device, VkDevice device, std::filesystem::path const& path);
+    // write the cache back to disk. returns false if it could not be written
+    bool save();
+    void destroy();
+
+    VkPipelineCache handle() const { return cache; }
+
+    // whether the cache was seeded from disk
+    bool warm() const { return loaded; }
+
+    // time pipeline creation at startup so cold and warm runs can be compared
+    void recordCreateTime(float ms);
+    float createMs() const { return create_ms; }
+    // creation time of the run that built the cache, NaN if unknown
+    float coldCreateMs() const { return cold_create_ms; }
+    // one line description of the above for the profiler output
+    std::string summary() const;
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    VkPipelineCache cache = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties properties{};
+    std::filesystem::path path;
+
+    bool loaded = false;
+    float create_ms = 0.0f;
+    float cold_create_ms = 0.0f;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+
+#include <vulkan/vulkan.hpp>
+
+#include "task_1/ThreadPool.h"
+
+// pipelines of one pass specialised per permutation key, e.g. the debug view and stage toggles
+// baked in as specialization constants.
+//
+// a key is built once, on the first frame that asks for it, by a worker of the pool, and kept
+// until destroy(). while it builds the pass keeps drawing with the previous key's pipeline, so
+// switching a debug view never stalls a frame. VkPipelineCache is internally synchronised, so
+// the workers share the renderer's cache
+class PipelinePermutations
+{
+public:
+    // builds the pipeline of a key, called on a worker thread. throws on failure
+    using Builder = std::function<VkPipeline(uint32_t key)>;
+
+    void init(VkDevice device, ThreadPool& pool, Builder builder);
+    // wait for builds still running and destroy every pipeline
+    void destroy();
+
+    // the pipeline of key. if it is not ready yet its build is queued on the pool, unless it
+    // already is, and the calling thread waits for a worker to finish it. the key becomes the
+    // current one, use it for the permutations every run needs
+    VkPipeline get(uint32_t key);
+    // the pipeline of key if it is ready, otherwise queue its build (once) and return the
+    // current pipeline. rethrows a failed build
+    VkPipeline select(uint32_t key);
+
+    size_t readyCount() const;
+    size_t pendingCount() const;
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    ThreadPool* pool = nullptr;
+    Builder builder;
+
+    mutable std::mutex mutex;
+    std::unordered_map<uint32_t, VkPipeline> ready;
+    std::unordered_map<uint32_t, std::shared_future<void>> pending;
+    VkPipeline current = VK_NULL_HANDLE;
+
+    // queue the build of key, mutex must be held
+    std::shared_future<void> queue(uint32_t key);
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "task_1/Model.h"
+#include "task_1/Vertex.h"
+#include "task_1/VertexLayout.h"
+
+// InstanceData::flags, must match shaders/instance.glsl
+// the instance moves, so it is drawn into the shadow map every frame instead of being cached
+static constexpr uint32_t INSTANCE_DYNAMIC = 1u;
+
+// per instance data read by the vertex shaders through gl_InstanceIndex.
+// matches the std430 Instance struct in shaders/instance.glsl
+struct InstanceData
+{
+    glm::mat4 model;
+    glm::uint32 materialId;
+    // index into Scene::batches(), filled in by build()
+    glm::uint32 batch;
+    glm::uint32 flags;
+    // index into Scene::meshes(), and into the dequantisation ranges of the vertex layout
+    glm::uint32 mesh;
+};
+
+// many meshes drawn many times. all meshes share one vertex and one index buffer,
+// and instances are grouped by mesh so each mesh is a single instanced draw per pass
+class Scene
+{
+public:
+    // a range of the shared vertex and index buffers
+    struct Mesh {
+        Model const* model;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        int32_t vertexOffset;
+        uint32_t vertexCount;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+    };
+
+    // one vkCmdDrawIndexed, instances [firstInstance, firstInstance + instanceCount) of a mesh.
+    // static and dynamic instances never share a batch
+    struct DrawBatch {
+        uint32_t mesh;
+        uint32_t firstInstance;
+        uint32_t instanceCount;
+        bool dynamic;
+    };
+
+    // register a mesh. the model is not copied and must outlive the scene, so a mapped
+    // mesh cache is read once, straight into the staging buffer
+    uint32_t addMesh(Model const& model);
+
+    void addInstance(uint32_t mesh, glm::mat4 const& transform, uint32_t material = 0, uint32_t flags = 0);
+    // count instances of a mesh on a cubic grid filling [-extent, extent], each scaled to its cell.
+    // the last dynamic_count of them are INSTANCE_DYNAMIC
+    void addInstanceGrid(uint32_t mesh, uint32_t count, float extent, uint32_t dynamic_count = 0);
+
+    // sort instances by mesh, static ones first, and build the draw batches. call once all instances are added.
+    // a batch holds at most max_batch_instances instances, lower it to turn the scene into more draws
+    void build(uint32_t max_batch_instances = ~0u);
+
+    void clear();
+
+    // world space AABB around every instance, from the transformed corners of its mesh's bounds.
+    // valid after build()
+    void bounds(glm::vec3& bounds_min, glm::vec3& bounds_max) const;
+
+    // dequantisation of every mesh in a vertex layout, indexed by InstanceData::mesh
+    std::vector<MeshQuantization> quantizeMeshes(VertexLayout layout) const;
+
+    // pack every mesh into the streams of a layout, vertexCount() elements each, and copy
+    // the indices into a buffer of indexCount() elements
+    void writeVertices(VertexLayout layout, std::vector<MeshQuantization> const& quantization, void* positions, void* attributes) const;
+    void writeIndices(uint32_t* destination) const;
+
+    std::vector<Mesh> const& meshes() const { return mesh_list; }
+    std::vector<InstanceData> const& instances() const { return instance_list; }
+    std::vector<DrawBatch> const& batches() const { return batch_list; }
+
+    size_t vertexCount() const { return vertex_count; }
+    size_t indexCount() const { return index_count; }
+    // INSTANCE_DYNAMIC instances, valid after build()
+    size_t dynamicCount() const { return dynamic_count; }
+
+private:
+    std::vector<Mesh> mesh_list;
+    std::vector<InstanceData> instance_list;
+    // mesh of each entry in instance_list, only needed until build()
+    std::vector<uint32_t> instance_mesh;
+    std::vector<DrawBatch> batch_list;
+
+    size_t vertex_count = 0;
+    size_t index_count = 0;
+    size_t dynamic_count = 0;
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "task_1/MeshCache.h"
+#include "task_1/MipChain.h"
+
+// converted texture written next to a source image on first load, in the KTX2 layout:
+//   Header, starting with the KTX2 identifier
+//   LevelIndex[levelCount]
+//   key/value data holding one "T2cache" entry with the CacheKey
+//   levels from the smallest to the largest, each 16 byte aligned
+//
+// there is no data format descriptor, the vkFormat field alone says what the blocks are,
+// so other KTX2 tools may refuse the file. like the mesh cache it is keyed by a hash of the
+// source file and the format version, so editing the image or the encoders invalidates it
+class TextureCache
+{
+public:
+    static constexpr uint8_t IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+    static constexpr uint32_t VERSION = 1;
+    static constexpr char KEY[8] = "T2cache";
+
+    struct Header {
+        uint8_t identifier[12];
+        uint32_t vkFormat;
+        uint32_t typeSize;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t layerCount;
+        uint32_t faceCount;
+        uint32_t levelCount;
+        uint32_t supercompressionScheme;
+        uint32_t dfdByteOffset;
+        uint32_t dfdByteLength;
+        uint32_t kvdByteOffset;
+        uint32_t kvdByteLength;
+        uint64_t sgdByteOffset;
+        uint64_t sgdByteLength;
+    };
+
+    struct LevelIndex {
+        uint64_t byteOffset;
+        uint64_t byteLength;
+        uint64_t uncompressedByteLength;
+    };
+
+    // value of the key/value entry
+    struct CacheKey {
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t sourceHash;
+        uint64_t sourceSize;
+    };
+
+    // where the cache for a given source image lives
+    static std::filesystem::path pathFor(std::filesystem::path const& source_path);
+
+    // bytes a width x height level of format takes, 0 for formats the cache does not hold
+    static size_t levelSize(VkFormat format, uint32_t width, uint32_t height);
+
+    // serialise a mip chain, levels as laid out by mipChainLayout or compressMipChain over data.
+    // returns false if the file could not be written
+    static bool write(std::filesystem::path const& cache_path,
+        uint64_t source_hash,
+        uint64_t source_size,
+        VkFormat format,
+        std::vector<MipLevel> const& levels,
+        uint8_t const* data);
+
+    // map a cache file and validate it against the source hash. returns false if the file
+    // is missing, truncated, from another version or stale
+    bool open(std::filesystem::path const& cache_path, uint64_t source_hash, uint64_t source_size);
+    void close() { file.close(); }
+
+    Header const& header() const { return *reinterpret_cast<Header const*>(file.data()); }
+    VkFormat format() const { return static_cast<VkFormat>(header().vkFormat); }
+
+    // every level, offsets from data()
+    std::vector<MipLevel> levels() const;
+    uint8_t const* data() const { return static_cast<uint8_t const*>(file.data()); }
+
+private:
+    MappedFile file;
+
+    LevelIndex const* levelIndex() const { return reinterpret_cast<LevelIndex const*>(data() + sizeof(Header)); }
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "task_1/MipChain.h"
+
+class ThreadPool;
+
+// the block compressed formats the texture cache can hold. both are 4x4 blocks, BC1 is RGB
+// at 8 bytes a block and BC7 is RGBA at 16
+enum class BlockFormat
+{
+    BC1,
+    BC7
+};
+
+size_t blockBytes(BlockFormat format);
+// bytes a width x height level takes, partial blocks at the right and bottom edges included
+size_t compressedLevelSize(BlockFormat format, uint32_t width, uint32_t height);
+
+// encode 4x4 RGBA8 texels, row by row. BC1 ignores alpha and always uses the four colour
+// mode, BC7 only uses mode 6, one RGBA line with 16 steps. both fit the endpoints to the
+// principal axis of the block and then refine them by least squares on the chosen indices
+void encodeBC1Block(uint8_t const texels[64], uint8_t block[8]);
+void encodeBC7Block(uint8_t const texels[64], uint8_t block[16]);
+
+// decode back to RGBA8 to measure the encoders. decodeBC7Block only understands mode 6
+void decodeBC1Block(uint8_t const block[8], uint8_t texels[64]);
+void decodeBC7Block(uint8_t const block[16], uint8_t texels[64]);
+
+// compress every level of an RGBA8 chain laid out by mipChainLayout. the compressed levels
+// are packed back to back the same way and described in compressed_levels.
+// rows of blocks are spread over pool when one is given
+std::vector<uint8_t> compressMipChain(BlockFormat format, uint8_t const* chain, std::vector<MipLevel> const& levels,
+    std::vector<MipLevel>& compressed_levels, ThreadPool* pool = nullptr);
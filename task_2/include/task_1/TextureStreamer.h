@@ -0,0 +1,107 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "task_1/MipChain.h"
+#include "task_1/TextureCache.h"
+#include "task_1/ThreadPool.h"
+#include "task_1/UploadManager.h"
+
+// converts textures on a pool of workers and streams their mips in through the upload manager,
+// smallest first and no more than a budget of bytes a frame.
+//
+// request only reads the cache header, or the image header while there is no cache, so the
+// caller can create and bind the image before anything is decoded. update stages the levels of
+// finished conversions and flushes them, residentLevel then says how far down the chain a view
+// may reach. levels only go up whole, so one larger than the budget gets a frame to itself
+class TextureStreamer
+{
+public:
+    static constexpr VkDeviceSize DEFAULT_BUDGET = 8ull * 1024 * 1024;
+
+    // what a texture will be once converted
+    struct Info {
+        VkFormat format;
+        uint32_t width;
+        uint32_t height;
+        uint32_t levelCount;
+    };
+
+    TextureStreamer() = default;
+    TextureStreamer(TextureStreamer const&) = delete;
+    TextureStreamer& operator=(TextureStreamer const&) = delete;
+
+    // formats lists which of BC1, BC7 and RGBA8 the device can sample, best first. images with
+    // an alpha channel skip BC1. no threads means one fewer than the hardware has
+    void init(UploadManager& uploads, std::vector<VkFormat> const& formats, size_t threads = 0);
+    // wait for the conversions still running and drop every texture
+    void destroy();
+
+    // start converting the image at path, unless the cache already holds it. returns the texture
+    uint32_t request(std::string const& path, Info& info);
+    // the image to copy the levels into, with every level of info's format and size
+    void attach(uint32_t texture, VkImage image);
+
+    // stage levels of finished conversions up to the budget and flush them. returns the bytes staged
+    VkDeviceSize update();
+
+    // the finest level staged so far, levelCount while there is none
+    uint32_t residentLevel(uint32_t texture) const { return textures[texture]->resident; }
+    // whether every level of every texture is staged
+    bool complete() const;
+
+    void setBudget(VkDeviceSize bytes) { budget = bytes; }
+    // one line description for the UI
+    std::string summary() const;
+
+private:
+    using Clock = std::chrono::high_resolution_clock;
+
+    struct Texture {
+        std::string path;
+        Info info{};
+        VkImage image = VK_NULL_HANDLE;
+        uint64_t sourceHash = 0;
+        uint64_t sourceSize = 0;
+        Clock::time_point requested;
+
+        // the levels, mapped from the cache or converted on a worker. the worker only writes
+        // them before the future is ready and update only reads them after
+        TextureCache cache;
+        std::vector<uint8_t> converted;
+        std::vector<MipLevel> levels;
+        uint8_t const* data = nullptr;
+        std::future<void> conversion;
+
+        bool ready = false;
+        bool cached = false;
+        uint32_t resident = 0;
+    };
+
+    void convert(Texture& texture);
+    void stageLevels(Texture& texture, uint32_t first, uint32_t count);
+    VkFormat chooseFormat(bool alpha) const;
+
+    UploadManager* uploads = nullptr;
+    std::vector<VkFormat> formats;
+    VkDeviceSize budget = DEFAULT_BUDGET;
+
+    // declared before the workers so the workers are joined before any texture they write goes away
+    std::vector<std::unique_ptr<Texture>> textures;
+    std::unique_ptr<ThreadPool> workers;
+
+    uint64_t bytes_streamed = 0;
+    uint64_t frames_streaming = 0;
+    // time from request to converted or mapped, over the textures that got there
+    size_t textures_ready = 0;
+    size_t textures_cached = 0;
+    double ready_ms_total = 0.0;
+    double ready_ms_max = 0.0;
+};
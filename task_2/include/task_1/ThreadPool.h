@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed size pool of worker threads fed from a single FIFO queue.
+// tasks must not block on other tasks of the same pool (parallelFor included),
+// otherwise a small pool can deadlock waiting on itself
+class ThreadPool
+{
+public:
+    explicit ThreadPool(size_t thread_count = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(ThreadPool const&) = delete;
+    ThreadPool& operator=(ThreadPool const&) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    // queue a task. the future rethrows anything the task threw
+    template<typename F>
+    std::future<void> submit(F&& task)
+    {
+        auto packaged = std::make_shared<std::packaged_task<void()>>(std::forward<F>(task));
+        std::future<void> result = packaged->get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.emplace_back([packaged]() { (*packaged)(); });
+        }
+        condition.notify_one();
+
+        return result;
+    }
+
+    // call body(begin, end) over [0, count) in chunks of chunk_size and wait for all of them
+    template<typename F>
+    void parallelFor(size_t count, size_t chunk_size, F&& body)
+    {
+        chunk_size = std::max<size_t>(chunk_size, 1);
+
+        std::vector<std::future<void>> pending;
+        pending.reserve((count + chunk_size - 1) / chunk_size);
+
+        for (size_t begin = 0; begin < count; begin += chunk_size) {
+            size_t end = std::min(begin + chunk_size, count);
+            pending.push_back(submit([&body, begin, end]() { body(begin, end); }));
+        }
+
+        for (auto& future : pending) {
+            future.get();
+        }
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+
+    void workerLoop();
+};
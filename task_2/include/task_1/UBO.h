@@ -1,10 +1,11 @@
 #pragma once
 
 #define GLM_FORCE_RADIANS
-#define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "Cascades.h"
+
 struct UniformBufferObject {
     glm::mat4 model;
     glm::mat4 view;
@@ -17,18 +18,46 @@ struct UniformBufferObject {
 	glm::vec4 Ke;
 	glm::vec2 win_dim;
 	glm::float32 Ns;
-	glm::float32 model_stage_on;
-	glm::float32 texture_stage_on;
-	glm::float32 lighting_stage_on;
-	glm::float32 pcf_on;
 	glm::float32 specular;
 	glm::float32 diffuse;
 	glm::float32 ambient;
 	glm::float32 shadow_bias;
-	glm::int32 display_mode;
+	// depth range split into cluster slices, and the number of clustered lights
+	glm::float32 cluster_near;
+	glm::float32 cluster_far;
+	glm::uint32 light_count;
+	// shadow cascades, with the view space depth where each one ends. std140 starts a vec4 on 16 bytes
+	glm::uint32 cascade_count;
+	alignas(16) glm::vec4 cascade_splits;
+	glm::mat4 cascadeVP[MAX_CASCADES];
+	// position reconstruction in the lighting pass, see shaders/lighting.glsl
+	glm::mat4 inv_view;
+	glm::vec4 view_ray_params;
 };
 
 struct ShadowUniformBufferObject
 {
 	glm::mat4 depthMVP;
-};
\ No newline at end of file
+};
+
+// input of the GPU culling passes, see shaders/cull.glsl
+struct CullUniformBufferObject
+{
+	glm::mat4 model;
+	// six frustum planes per view, camera then light
+	glm::vec4 planes[12];
+	glm::uint32 instance_count;
+	glm::uint32 batch_count;
+	glm::uint32 visible_stride;
+	glm::uint32 flags;
+};
+
+// input of the cluster assignment pass, see shaders/cluster_assign.comp
+struct ClusterUniformBufferObject
+{
+	glm::mat4 view;
+	glm::mat4 inv_proj;
+	glm::float32 z_near;
+	glm::float32 z_far;
+	glm::uint32 light_count;
+};
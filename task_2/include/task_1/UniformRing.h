@@ -0,0 +1,48 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+
+#include <cstring>
+
+// linear allocator over one persistently mapped, host coherent uniform buffer.
+//
+// the buffer is split into one region per frame in flight. each frame bump
+// allocates its uniforms out of its own region and binds them with dynamic
+// offsets, so nothing is mapped, unmapped or rewritten while the GPU reads it.
+// the caller must have waited on the frame's fence before beginFrame
+class UniformRing
+{
+public:
+    // buffer must be frame_size * frame_count bytes and mapped at mapped
+    void init(VkBuffer buffer, void* mapped, VkDeviceSize frame_size, uint32_t frame_count, VkDeviceSize alignment);
+
+    void beginFrame(uint32_t frame);
+
+    // reserve size bytes in the current frame's region. returns the dynamic offset
+    // to bind and where to write the data
+    uint32_t allocate(VkDeviceSize size, void** data);
+
+    template<typename T>
+    uint32_t push(T const& value)
+    {
+        void* data;
+        uint32_t offset = allocate(sizeof(T), &data);
+        std::memcpy(data, &value, sizeof(T));
+        return offset;
+    }
+
+    VkBuffer buffer() const { return ring_buffer; }
+    VkDeviceSize frameSize() const { return frame_size; }
+    // bytes used by the current frame so far, including alignment padding
+    VkDeviceSize frameUsed() const { return cursor - frame_begin; }
+
+private:
+    VkBuffer ring_buffer = VK_NULL_HANDLE;
+    char* mapped = nullptr;
+    VkDeviceSize frame_size = 0;
+    uint32_t frame_count = 0;
+    VkDeviceSize alignment = 1;
+
+    VkDeviceSize frame_begin = 0;
+    VkDeviceSize cursor = 0;
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "task_1/DeviceMemoryAllocator.h"
+
+// batches asset uploads through one persistently mapped staging ring.
+//
+// stageBuffer and stageImage reserve space in the ring and record the copy, flush submits
+// everything staged since the last flush as one batch. with a transfer only queue family
+// the copies run there and each resource's ownership is released to the graphics family,
+// which acquires it in a small submit waiting on the transfer one. either way the resources
+// are ready for any later graphics submit without the CPU waiting.
+// a fence per batch says when its part of the ring can be written again. uploads bigger than
+// the whole ring get a staging buffer of their own, freed with their batch
+class UploadManager
+{
+public:
+    static constexpr VkDeviceSize DEFAULT_RING_SIZE = 32ull * 1024 * 1024;
+
+    UploadManager() = default;
+    UploadManager(UploadManager const&) = delete;
+    UploadManager& operator=(UploadManager const&) = delete;
+
+    // transfer_family may be graphics_family, with transfer_queue then the graphics queue
+    void init(VkPhysicalDevice physical_device, VkDevice device, DeviceMemoryAllocator& allocator,
+        uint32_t graphics_family, VkQueue graphics_queue, uint32_t transfer_family, VkQueue transfer_queue,
+        VkDeviceSize ring_size = DEFAULT_RING_SIZE);
+    // wait for every batch in flight and free everything
+    void destroy();
+
+    // copy size bytes to dst_offset in dst. returns where to write them, valid until the next flush
+    void* stageBuffer(VkBuffer dst, VkDeviceSize size, VkDeviceSize dst_offset = 0);
+    // copy regions into image, their bufferOffsets relative to the returned pointer. every
+    // subresource in range goes from undefined to final_layout
+    void* stageImage(VkImage image, VkImageSubresourceRange const& range, VkBufferImageCopy const* regions, uint32_t region_count,
+        VkDeviceSize size, VkImageLayout final_layout);
+
+    // submit everything staged so far. returns the batch, or the last one if nothing was staged
+    uint64_t flush();
+    // free the staging space of every finished batch, without waiting
+    void retire();
+    // whether batch and all batches before it have finished
+    bool finished(uint64_t batch);
+    // block until batch has finished
+    void wait(uint64_t batch);
+
+    bool dedicatedTransfer() const { return transfer_family != graphics_family; }
+    // one line description of the uploads so far for the UI
+    std::string summary() const;
+
+private:
+    struct StagingBuffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation memory;
+    };
+
+    // a submitted batch, or the one being recorded
+    struct Batch {
+        uint64_t id = 0;
+        VkCommandBuffer transferCommands = VK_NULL_HANDLE;
+        // acquires ownership on the graphics queue, dedicated transfer only
+        VkCommandBuffer acquireCommands = VK_NULL_HANDLE;
+        VkSemaphore transferDone = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        // ring bytes the batch holds, padding included, and where they end
+        VkDeviceSize ringBytes = 0;
+        VkDeviceSize ringEnd = 0;
+        std::vector<StagingBuffer> oversized;
+        // barriers after the copies. with a dedicated transfer queue these are recorded twice,
+        // as the release on the transfer queue and the acquire on the graphics queue
+        std::vector<VkBufferMemoryBarrier> bufferBarriers;
+        std::vector<VkImageMemoryBarrier> imageBarriers;
+    };
+
+    StagingBuffer createStagingBuffer(VkDeviceSize size);
+    void destroyStagingBuffer(StagingBuffer& staging);
+
+    // the batch being recorded, begun on first use
+    Batch& recording();
+    // space for size bytes, from the ring or an oversized buffer. flushes and waits when the ring is full
+    void* reserve(VkDeviceSize size, VkBuffer& buffer, VkDeviceSize& offset);
+    bool reserveRing(VkDeviceSize size, VkDeviceSize& offset);
+    void retireOldest();
+    void recordBarriers(VkCommandBuffer commands, Batch& batch, bool release);
+
+    VkDevice device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* allocator = nullptr;
+
+    uint32_t graphics_family = 0;
+    uint32_t transfer_family = 0;
+    VkQueue graphics_queue = VK_NULL_HANDLE;
+    VkQueue transfer_queue = VK_NULL_HANDLE;
+    VkCommandPool transfer_pool = VK_NULL_HANDLE;
+    VkCommandPool graphics_pool = VK_NULL_HANDLE;
+
+    StagingBuffer ring;
+    VkDeviceSize ring_size = 0;
+    VkDeviceSize alignment = 16;
+    // next byte to write, first byte still in use, and bytes in use between them
+    VkDeviceSize ring_head = 0;
+    VkDeviceSize ring_tail = 0;
+    VkDeviceSize ring_used = 0;
+
+    Batch current;
+    bool has_current = false;
+    std::deque<Batch> in_flight;
+    uint64_t next_batch = 1;
+    uint64_t last_submitted = 0;
+    uint64_t last_finished = 0;
+
+    uint64_t bytes_uploaded = 0;
+    uint64_t copy_count = 0;
+    uint64_t batch_count = 0;
+    // times the ring was full and the CPU had to wait for a batch
+    uint64_t stall_count = 0;
+};
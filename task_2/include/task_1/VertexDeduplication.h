@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "task_1/ThreadPool.h"
+#include "task_1/Vertex.h"
+
+// vertex deduplication for index streams.
+//
+// both paths take the number of corners (one per entry of the index stream) and a
+// fetch(corner) callable that builds the Vertex for that corner. they produce the
+// same output: unique vertices in order of first use and one index per corner.
+// the parallel path dedupes fixed size chunks of the stream independently and then
+// merges them in chunk order, which reproduces the serial first-use order exactly.
+
+static_assert(sizeof(Vertex) == 11 * sizeof(float), "vertex hashing assumes Vertex is 11 tightly packed floats");
+
+// 64 bit hash of a vertex that agrees with Vertex::operator==, so +0 and -0 hash the same
+inline uint64_t hashVertex(Vertex const& vertex)
+{
+    float components[11];
+    std::memcpy(components, &vertex, sizeof(components));
+
+    uint64_t hash = 0x9E3779B97F4A7C15ull;
+    for (float component : components) {
+        // fold -0 onto +0 as they compare equal
+        float value = component == 0.0f ? 0.0f : component;
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+
+        hash = (hash ^ bits) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 32;
+    }
+
+    // splitmix64 finaliser so every bit of the result depends on every input bit
+    hash ^= hash >> 30;
+    hash *= 0xBF58476D1CE4E5B9ull;
+    hash ^= hash >> 27;
+    hash *= 0x94D049BB133111EBull;
+    hash ^= hash >> 31;
+
+    return hash;
+}
+
+// open addressing (linear probing) table mapping vertices to their index in an
+// external vertex array. only the hash and the index are stored per slot
+class VertexHashTable
+{
+public:
+    static constexpr uint32_t EMPTY = 0xFFFFFFFFu;
+
+    void reset(size_t expected_count)
+    {
+        size_t capacity = 16;
+        while (capacity < expected_count * 2) {
+            capacity <<= 1;
+        }
+
+        slots.assign(capacity, Slot{ 0, EMPTY });
+        count = 0;
+    }
+
+    // look up vertex. if no equal vertex is stored, record candidate as its index.
+    // storage must hold every index inserted so far (candidate itself excluded)
+    uint32_t findOrInsert(uint64_t hash, Vertex const& vertex, uint32_t candidate, Vertex const* storage)
+    {
+        if ((count + 1) * 2 > slots.size()) {
+            grow();
+        }
+
+        size_t mask = slots.size() - 1;
+        for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+            Slot& entry = slots[slot];
+
+            if (entry.index == EMPTY) {
+                entry.hash = hash;
+                entry.index = candidate;
+                count++;
+                return candidate;
+            }
+
+            if (entry.hash == hash && storage[entry.index] == vertex) {
+                return entry.index;
+            }
+        }
+    }
+
+private:
+    struct Slot {
+        uint64_t hash;
+        uint32_t index;
+    };
+
+    std::vector<Slot> slots;
+    size_t count = 0;
+
+    void grow()
+    {
+        std::vector<Slot> old_slots = std::move(slots);
+        slots.assign(old_slots.size() * 2, Slot{ 0, EMPTY });
+
+        size_t mask = slots.size() - 1;
+        for (const auto& entry : old_slots) {
+            if (entry.index == EMPTY) {
+                continue;
+            }
+
+            size_t slot = entry.hash & mask;
+            while (slots[slot].index != EMPTY) {
+                slot = (slot + 1) & mask;
+            }
+            slots[slot] = entry;
+        }
+    }
+};
+
+// reference implementation, one std::unordered_map over the whole stream
+template<typename Fetch>
+void deduplicateVerticesSerial(size_t corner_count, Fetch const& fetch, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+    std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+
+    vertices.clear();
+    indices.clear();
+    indices.reserve(corner_count);
+
+    for (size_t corner = 0; corner < corner_count; corner++) {
+        Vertex vertex = fetch(corner);
+
+        auto inserted = uniqueVertices.try_emplace(vertex, static_cast<uint32_t>(vertices.size()));
+        if (inserted.second) {
+            vertices.push_back(vertex);
+        }
+
+        indices.push_back(inserted.first->second);
+    }
+}
+
+template<typename Fetch>
+void deduplicateVerticesParallel(size_t corner_count, Fetch const& fetch, ThreadPool& pool, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+    struct Chunk {
+        std::vector<Vertex> vertices;
+        std::vector<uint64_t> hashes;
+        std::vector<uint32_t> indices;
+        std::vector<uint32_t> remap;
+    };
+
+    // a few chunks per thread for load balancing, but big enough that vertices
+    // shared across chunk borders stay a small fraction of the merge work
+    size_t chunk_size = std::max<size_t>(corner_count / (pool.size() * 4), 1 << 16);
+    size_t chunk_count = (corner_count + chunk_size - 1) / chunk_size;
+
+    std::vector<Chunk> chunks(chunk_count);
+
+    pool.parallelFor(chunk_count, 1, [&](size_t begin, size_t end) {
+        VertexHashTable table;
+
+        for (size_t c = begin; c < end; c++) {
+            Chunk& chunk = chunks[c];
+            size_t first = c * chunk_size;
+            size_t last = std::min(first + chunk_size, corner_count);
+
+            // index streams typically reference each vertex ~6 times
+            table.reset((last - first) / 4);
+            chunk.indices.reserve(last - first);
+
+            for (size_t corner = first; corner < last; corner++) {
+                Vertex vertex = fetch(corner);
+                uint64_t hash = hashVertex(vertex);
+
+                uint32_t candidate = static_cast<uint32_t>(chunk.vertices.size());
+                uint32_t index = table.findOrInsert(hash, vertex, candidate, chunk.vertices.data());
+                if (index == candidate) {
+                    chunk.vertices.push_back(vertex);
+                    chunk.hashes.push_back(hash);
+                }
+
+                chunk.indices.push_back(index);
+            }
+        }
+    });
+
+    // merge in chunk order. a vertex's first use in the whole stream is its first
+    // use in the first chunk containing it, so this gives the serial ordering
+    VertexHashTable table;
+    table.reset(chunks.empty() ? 0 : chunks[0].vertices.size() * chunk_count);
+
+    vertices.clear();
+    for (auto& chunk : chunks) {
+        chunk.remap.resize(chunk.vertices.size());
+
+        for (size_t i = 0; i < chunk.vertices.size(); i++) {
+            uint32_t candidate = static_cast<uint32_t>(vertices.size());
+            uint32_t index = table.findOrInsert(chunk.hashes[i], chunk.vertices[i], candidate, vertices.data());
+            if (index == candidate) {
+                vertices.push_back(chunk.vertices[i]);
+            }
+
+            chunk.remap[i] = index;
+        }
+
+        chunk.vertices = std::vector<Vertex>{};
+        chunk.hashes = std::vector<uint64_t>{};
+    }
+
+    // rewriting local indices to global ones is independent per chunk
+    indices.resize(corner_count);
+    pool.parallelFor(chunk_count, 1, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; c++) {
+            Chunk const& chunk = chunks[c];
+            uint32_t* output = indices.data() + c * chunk_size;
+
+            for (size_t i = 0; i < chunk.indices.size(); i++) {
+                output[i] = chunk.remap[chunk.indices[i]];
+            }
+        }
+    });
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "task_1/Vertex.h"
+
+// how mesh vertices are laid out in the vertex buffers. Vertex stays the loaded form, meshes
+// are packed into a layout on upload. the value is passed to shaders/geometry_pass.vert as
+// the VERTEX_LAYOUT specialisation constant, so the numbering must match
+enum class VertexLayout : int32_t {
+    // Vertex as it is, 44 bytes in one stream. the original layout, kept as the baseline for image diffs
+    Interleaved = 0,
+    // 16 bit unorm positions in a stream of their own, all the depth only passes fetch, and an
+    // octahedral snorm16 normal and unorm16 uv in a second. 8 + 8 bytes, dequantised with per
+    // mesh ranges. the colour is always white and no shader reads it, so it is dropped
+    Quantized = 1,
+};
+
+static constexpr VertexLayout VERTEX_LAYOUTS[] = { VertexLayout::Interleaved, VertexLayout::Quantized };
+
+char const* vertexLayoutName(VertexLayout layout);
+
+// accepts the names returned by vertexLayoutName. returns false for anything else
+bool parseVertexLayout(std::string const& name, VertexLayout& layout);
+
+// vertex buffer bindings. the shadow pass binds the position stream alone
+enum VertexStream : uint32_t {
+    VERTEX_STREAM_POSITION = 0,
+    VERTEX_STREAM_ATTRIBUTES = 1,
+};
+
+// bytes per vertex of a stream, 0 when the layout has no such stream
+uint32_t vertexStreamStride(VertexLayout layout, VertexStream stream);
+
+// vertex input of the geometry pass, or of the depth only passes with position_only
+std::vector<VkVertexInputBindingDescription> getBindingDescriptions(VertexLayout layout, bool position_only);
+std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions(VertexLayout layout, bool position_only);
+
+// per mesh dequantisation, found by the vertex shaders through InstanceData::mesh.
+// matches the std430 MeshData struct in shaders/instance.glsl
+struct MeshQuantization
+{
+    // position = offset + unorm * scale, xyz
+    glm::vec4 positionScale;
+    glm::vec4 positionOffset;
+    // uv = unorm * xy + zw
+    glm::vec4 texCoordTransform;
+};
+
+struct PackedPosition
+{
+    uint16_t x, y, z, w;
+};
+
+struct PackedAttributes
+{
+    int16_t normal[2];
+    uint16_t texCoord[2];
+};
+
+// ranges of a mesh's positions and uvs, the identity for the interleaved layout
+MeshQuantization quantizeMesh(VertexLayout layout, Vertex const* vertices, size_t count);
+
+// pack count vertices to the start of each stream. attributes is unused by the interleaved layout
+void packVertices(VertexLayout layout, MeshQuantization const& quantization, Vertex const* vertices, size_t count,
+    void* positions, void* attributes);
+
+// the vertex the shaders see, to measure the quantisation error. the colour is left white
+Vertex unpackVertex(VertexLayout layout, MeshQuantization const& quantization, void const* positions, void const* attributes, size_t index);
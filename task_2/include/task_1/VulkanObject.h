@@ -4,18 +4,34 @@
 #include "VulkanStructs.h"
 #include "UBO.h"
 #include "Vertex.h"
+#include "DeviceMemoryAllocator.h"
+#include "UniformRing.h"
+#include "GpuProfiler.h"
+#include "PipelineCache.h"
+#include "GBufferLayout.h"
+#include "VertexLayout.h"
+#include "Scene.h"
+#include "Culling.h"
+#include "Lights.h"
+#include "Cascades.h"
+#include "PipelinePermutations.h"
+#include "ThreadPool.h"
+#include "UploadManager.h"
+#include "TextureStreamer.h"
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
 #define GLM_FORCE_RADIANS
-#define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/hash.hpp>
 
+#include <algorithm>
+#include <filesystem>
 #include <iostream>
+#include <iterator>
 #include <optional>
 
 #include "task_1/Model.h"
@@ -23,9 +39,56 @@
 class VulkanObject {
 public:
     void initVulkan(GLFWwindow* window);
+    // render offscreen at a fixed size, without a window, surface or swap chain
+    void initHeadless(uint32_t width, uint32_t height);
+    // must be called before init, the layout is baked into the render pass and pipelines
+    void setGBufferLayout(GBufferLayout layout) { gbufferLayout = layout; }
+    GBufferLayout getGBufferLayout() const { return gbufferLayout; }
+    // layout of the vertex buffers, baked into the pipelines. must be called before init
+    void setVertexLayout(VertexLayout layout) { vertexLayout = layout; }
+    // G-buffer attachments that only live in tile memory on tiled GPUs. must be called before init
+    void setTransientAttachments(bool enabled) { transientAttachments = enabled; }
+    // replace the single model with count instances of it on a grid. must be called before init
+    void setStressInstances(uint32_t count) { stressInstances = count; }
+    // record a direct draw per mesh instead of GPU culled indirect draws. must be called before init
+    void setCpuDraws(bool enabled) { cpuDraws = enabled; }
+    // cull instances against the view frustums before drawing. can also be changed in the UI
+    void setFrustumCulling(bool enabled) { frustumCulling = enabled; }
+    // at most count instances per draw, 0 for no limit. must be called before init
+    void setBatchSize(uint32_t count) { batchSize = count; }
+    // split the CPU draws of every pass across count workers recording secondary command buffers,
+    // 1 records them on the render thread. must be called before init
+    void setRecordThreads(uint32_t count) { recordThreads = std::max(count, 1u); }
+    // number of clustered point and spot lights, at most MAX_LIGHTS. can also be changed in the UI
+    void setLightCount(uint32_t count) { lightCount = std::min(count, MAX_LIGHTS); }
+    // number of shadow cascades of the directional light, 1 to MAX_CASCADES. must be called before init
+    void setCascadeCount(uint32_t count) { cascadeSettings.count = std::min(std::max(count, 1u), MAX_CASCADES); }
+    // width and height of every cascade's layer, independent of the window. must be called before init
+    void setShadowResolution(uint32_t size) { shadowResolution = std::max(size, 1u); }
+    // mark the last count instances as moving shadow casters, redrawn every frame on top of the
+    // cached static ones. must be called before init
+    void setDynamicInstances(uint32_t count) { dynamicInstances = count; }
+    // keep the static casters of each cascade and only redraw them once its light matrix changes,
+    // false redraws every cascade every frame. can also be changed in the UI
+    void setShadowCaching(bool enabled) { shadowCaching = enabled; }
+    // bytes of texture levels staged per frame while textures stream in. must be called before init
+    void setTextureBudget(VkDeviceSize bytes) { textureBudget = bytes; }
+    // reconstruct lighting pass positions with per pixel matrix inverses, the old way, for comparison.
+    // can also be changed in the UI
+    void setInverseReconstruction(bool enabled) { inverseReconstruction = enabled; }
+    // start on the fully lit scene instead of the normals view, so every stage of the lighting pass runs
+    void setComposedView() { display_mode = 6; model_stage_on = texture_stage_on = lighting_stage_on = true; }
     void drawFrame();
     void cleanup();
 
+    // per pass GPU stats over the most recent frames
+    void printGpuTimings(std::ostream& out);
+    bool writeGpuTimings(std::filesystem::path const& path);
+    // CPU time spent recording a frame's command buffers, averaged over every frame so far
+    float averageRecordMs() const { return recordedFrames > 0 ? static_cast<float>(totalRecordMs / recordedFrames) : 0.0f; }
+    // average ms of a named GPU scope over the most recent frames, NaN if it never ran
+    float gpuScopeAverage(char const* name);
+
     VkDevice device;
 
     static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
@@ -46,19 +109,54 @@ private:
     // create instance of debug messenger
     VkDebugUtilsMessengerEXT debugMessenger;
     // create a "surface" to interface with any window system
-    VkSurfaceKHR surface;
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
 
     // physical device to use
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
     // logical device to use
 
+    // all buffers and images are suballocated from here
+    DeviceMemoryAllocator allocator;
+
+    // per pass GPU timings
+    GpuProfiler profiler;
+
+    // pipelines compiled on previous runs, loaded from and saved to the working directory
+    static constexpr char const* PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+    PipelineCache pipelineCache;
+
+    // every asset copy goes through here, on the transfer queue when there is one
+    UploadManager uploads;
+
+    // textures convert on workers and their levels stream in over the first frames
+    TextureStreamer textureStreamer;
+    VkDeviceSize textureBudget = TextureStreamer::DEFAULT_BUDGET;
+    uint32_t streamedTexture = 0;
+    // since initVulkan started, -1 until reached
+    std::chrono::high_resolution_clock::time_point startTime;
+    float firstFrameMs = -1.0f;
+    float fullQualityMs = -1.0f;
+    void streamTextures();
+    void frameSubmitted();
+    float millisecondsSinceStart() const;
+    std::string textureSummary();
+
+    GBufferLayout gbufferLayout = GBufferLayout::Reference;
+    // G-buffer images are only read as input attachments inside the geometry pass, so they
+    // can be transient with DONT_CARE stores. lazily allocated memory backs them where available
+    bool transientAttachments = false;
+    bool gbufferLazilyAllocated = false;
+    std::string gbufferSummary();
+
     // handle to graphics queue
     VkQueue graphicsQueue;
     // handle to graphics queue
     VkQueue presentQueue;
+    // the graphics queue when the device has no transfer only family
+    VkQueue transferQueue;
 
     // our swap chain object
-    VkSwapchainKHR swapChain;
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE;
     // vector of our swap chain images 
     std::vector<VkImage> swapChainImages;
     // the format of our swap chain
@@ -66,9 +164,13 @@ private:
     // the extent (dimensions) of our swap chain images
     VkExtent2D swapChainExtent;
 
+    // headless runs render into plain images in place of the swap chain images
+    bool headless = false;
+    std::vector<Allocation> offscreenImagesMemory;
+
     struct FrameBufferAttachment {
         VkImage image;
-        VkDeviceMemory mem;
+        Allocation mem;
         VkImageView view;
         VkFormat format;
     };
@@ -80,13 +182,23 @@ private:
         VkRenderPass renderPass;
     } offScreenPass;
 
+    // one layer per cascade. depth.view sees every layer for the lighting pass, each
+    // cascade renders through a framebuffer on its own layer view. with dynamic casters
+    // a second set of layers after the cascades caches their static casters
     struct DepthFrameBuffer {
         int32_t width, height;
-        VkFramebuffer frameBuffer;
+        uint32_t layers;
+        VkFramebuffer frameBuffers[MAX_CASCADES * 2];
+        VkImageView layerViews[MAX_CASCADES * 2];
         FrameBufferAttachment depth;
         VkSampler sampler;
         VkSampler pcfsampler;
+        // clears and leaves the layer for sampling
         VkRenderPass renderPass;
+        // clears and leaves the layer to be copied from
+        VkRenderPass cacheRenderPass;
+        // draws over a copied cache and leaves the layer for sampling
+        VkRenderPass compositeRenderPass;
     } shadowPass;
 	
     // vector of image views (to access our images)
@@ -96,29 +208,61 @@ private:
 
     std::vector<VkFramebuffer> imgui_frame_buffers;
 
-    VkFramebuffer geometryFrameBuffer;
-
     VkDescriptorSetLayout lightingSetLayout;
     VkDescriptorSetLayout shadowSetLayout;
 	
     // render pass object
-    VkRenderPass renderPass;
     VkRenderPass geometryPass;
     VkRenderPass imgui_render_pass;
     VkDescriptorSetLayout descriptorSetLayout;
     VkPipelineLayout pipelineLayout;
     VkPipelineLayout lightingLayout;
     VkPipelineLayout shadowLayout;
-    VkPipeline graphicsPipeline;
-    VkPipeline lightingPipeline;
     VkPipeline shadowPipeline;
 
+    // the debug views and stage toggles are specialization constants instead of uniforms, so the
+    // geometry and lighting pipelines come in permutations, built in the background on first use
+    ThreadPool permutationBuilders{ 2 };
+    PipelinePermutations geometryPipelines;
+    PipelinePermutations lightingPipelines;
+    VkShaderModule geometryVertModule;
+    VkShaderModule geometryFragModule;
+    VkShaderModule lightingVertModule;
+    VkShaderModule lightingFragModule;
+
+    // constant_ids, must match shaders/gbuffer.glsl, geometry_pass.vert, geometry_pass.frag and lighting_pass.frag
+    enum SpecializationConstant : uint32_t {
+        SPEC_GBUFFER_LAYOUT = 0,
+        SPEC_TEXTURE_STAGE = 1,
+        SPEC_DISPLAY_MODE = 2,
+        SPEC_MODEL_STAGE = 3,
+        SPEC_LIGHTING_STAGE = 4,
+        SPEC_PCF = 5,
+        SPEC_INVERSE_RECONSTRUCTION = 6,
+        SPEC_VERTEX_LAYOUT = 7,
+    };
+
+    // permutation keys, see geometryPermutation and lightingPermutation
+    static constexpr uint32_t GEOMETRY_TEXTURE_STAGE = 1u;
+    static constexpr uint32_t LIGHTING_DISPLAY_MODE_MASK = 0xfu;
+    static constexpr uint32_t LIGHTING_MODEL_STAGE = 1u << 4;
+    static constexpr uint32_t LIGHTING_LIGHTING_STAGE = 1u << 5;
+    static constexpr uint32_t LIGHTING_PCF = 1u << 6;
+    static constexpr uint32_t LIGHTING_INVERSE_RECONSTRUCTION = 1u << 7;
+    VkDescriptorSetLayout cullSetLayout;
+    VkPipelineLayout cullLayout;
+    VkPipeline cullPipeline;
+    VkPipeline cullCompactPipeline;
+    VkDescriptorSetLayout clusterSetLayout;
+    VkPipelineLayout clusterLayout;
+    VkPipeline clusterPipeline;
+
     // create a command pool to manage the memory required for our command buffers
     VkCommandPool commandPool;
-    // vector of command buffers. One for each image in swap chain
+    // vector of command buffers. One for each frame in flight, re-recorded every frame
     std::vector<VkCommandBuffer> commandBuffers;
 
-    VkCommandPool imgui_command_pool;
+    VkCommandPool imgui_command_pool = VK_NULL_HANDLE;
     std::vector<VkCommandBuffer> imgui_command_buffers;
 
     // vector of semaphores indicating images have been aquired
@@ -133,35 +277,164 @@ private:
 
     // bool to store if we have resized
     bool framebufferResized = false;
+    // time taken by the last recreateSwapChain
+    float lastResizeMs = 0.0f;
 
     Model dragon_model;
+    // every mesh shares the vertex and index buffers, instance transforms live in a storage buffer
+    Scene scene;
+    uint32_t stressInstances = 0;
+    uint32_t batchSize = 0;
+    // the position stream of the vertex layout, and the attribute stream when it has one
+    VertexLayout vertexLayout = VertexLayout::Interleaved;
     VkBuffer vertexBuffer;
-    VkDeviceMemory vertexBufferMemory;
+    Allocation vertexBufferMemory;
+    VkBuffer attributeBuffer = VK_NULL_HANDLE;
+    Allocation attributeBufferMemory;
+    // MeshQuantization of every mesh, indexed by InstanceData::mesh
+    VkBuffer meshBuffer;
+    Allocation meshBufferMemory;
     VkBuffer indexBuffer;
-    VkDeviceMemory indexBufferMemory;
-
-    std::vector<VkBuffer> uniformBuffers;
-    std::vector<VkDeviceMemory> uniformBuffersMemory;
-
-    std::vector<VkBuffer> shadowUniformBuffers;
-    std::vector<VkDeviceMemory> shadowUniformBuffersMemory;
+    Allocation indexBufferMemory;
+    VkBuffer instanceBuffer;
+    Allocation instanceBufferMemory;
+
+    // GPU driven path. a compute pass culls every instance against the camera and light
+    // frustums and writes the indirect draws of both passes. needs multiDrawIndirect and
+    // drawIndirectFirstInstance, without them the instances are culled on the CPU and every
+    // mesh is a direct draw of its visible ones
+    bool cpuDraws = false;
+    bool gpuDriven = false;
+    // VK_KHR_draw_indirect_count. without it empty batches are drawn with zero instances
+    bool drawIndirectCount = false;
+    PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount = nullptr;
+    bool frustumCulling = true;
+    std::vector<CullBatch> cullBatches;
+    // visible lists of the views start this many elements apart, for minStorageBufferOffsetAlignment
+    uint32_t visibleStride = 0;
+    // elements between the frames' visible lists, 0 when the GPU driven path shares one set
+    uint32_t visibleFrameStride = 0;
+    // direct draw path. surviving instances of every batch, batch count apart for each view
+    std::vector<uint32_t> visibleCounts;
+    // world space instance spheres under instanceSpheresModel
+    SphereSoA instanceSpheres;
+    glm::mat4 instanceSpheresModel;
+    bool instanceSpheresValid = false;
+    // cullDirectDraws scratch, the survivors of one frustum and every view's list before the copy
+    std::vector<uint32_t> cullSurvivors;
+    std::vector<uint32_t> cullVisible;
+    VkBuffer cullBatchBuffer;
+    Allocation cullBatchMemory;
+    VkBuffer visibleBuffer;
+    Allocation visibleMemory;
+    VkBuffer drawBuffer;
+    Allocation drawMemory;
+    VkBuffer countBuffer;
+    Allocation countMemory;
+
+    // clustered lighting. lights are animated on the CPU and written to this frame's slice of
+    // lightBuffer, then a compute pass lists the lights reaching each cluster of the view frustum
+    // for the lighting pass. slices start at CLUSTER_NEAR rather than the camera's near plane,
+    // which would spend most of them in front of the scene
+    static constexpr float CLUSTER_NEAR = 0.1f;
+    static constexpr float CLUSTER_FAR = 4.0f;
+    uint32_t lightCount = 0;
+    LightSet lightSet;
+    // bytes between the light slices of the frames in flight
+    VkDeviceSize lightStride = 0;
+    VkBuffer lightBuffer;
+    Allocation lightMemory;
+    VkBuffer clusterBuffer;
+    Allocation clusterMemory;
+
+    // cascaded shadow maps of the directional light. the depth range is split from SHADOW_NEAR
+    // to SHADOW_FAR and each slice of the view frustum gets its own orthographic layer
+    static constexpr float SHADOW_NEAR = 0.1f;
+    static constexpr float SHADOW_FAR = 4.0f;
+    CascadeSettings cascadeSettings;
+    // model space bounds of the scene, the cascades reach back to them for casters
+    glm::vec3 sceneBoundsMin;
+    glm::vec3 sceneBoundsMax;
+    uint32_t shadowResolution = 2048;
+    bool inverseReconstruction = false;
+    uint32_t dynamicInstances = 0;
+
+    // static casters of a cascade are only redrawn when its light matrix (light rotation, camera
+    // or model transform) differs from the one they were last drawn with
+    bool shadowCaching = true;
+    // the scene has dynamic casters, drawn every frame over a copy of the static cache
+    bool shadowCompositing = false;
+    bool shadowCacheValid[MAX_CASCADES] = {};
+    glm::mat4 cachedDepthMVP[MAX_CASCADES];
+    // cascades whose static casters are redrawn this frame
+    uint32_t shadowRedrawMask = 0;
+    void invalidateShadowCache() { std::fill(std::begin(shadowCacheValid), std::end(shadowCacheValid), false); }
+
+    // CPU draws recorded in parallel. each worker has its own command pool per frame in flight,
+    // so no pool is ever touched by two threads, and records one secondary command buffer per pass
+    struct RecordContext {
+        VkCommandPool pool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> buffers;
+        // buffers handed out since the pool was last reset
+        size_t used = 0;
+    };
+    uint32_t recordThreads = 1;
+    std::unique_ptr<ThreadPool> recordWorkers;
+    // recordThreads contexts per frame in flight
+    std::vector<RecordContext> recordContexts;
+    bool secondaryDraws() const { return recordWorkers != nullptr; }
+
+    // CPU time spent recording the frame command buffer
+    float lastRecordMs = 0.0f;
+    double totalRecordMs = 0.0;
+    uint64_t recordedFrames = 0;
+    std::string sceneSummary();
+
+    // space for uniforms per frame in flight. enough for thousands of per draw blocks
+    static constexpr VkDeviceSize UNIFORM_RING_FRAME_SIZE = 4 * 1024 * 1024;
+
+    // all uniforms are streamed through this ring and bound with dynamic offsets
+    VkBuffer uniformRingBuffer;
+    Allocation uniformRingMemory;
+    UniformRing uniformRing;
+
+    // dynamic offsets of this frame's uniform blocks within the ring
+    struct UniformOffsets {
+        uint32_t ubo;
+        // one per cascade
+        uint32_t shadow[MAX_CASCADES];
+        uint32_t cull;
+        uint32_t cluster;
+        // offset of this frame's lights in lightBuffer
+        uint32_t lights;
+    };
 
     VkDescriptorPool descriptorPool;
     VkDescriptorPool lightingDescriptorPool;
     VkDescriptorPool shadowDescriptorPool;
+    VkDescriptorPool cullDescriptorPool;
+    VkDescriptorPool clusterDescriptorPool;
+    // one of each. nothing in them changes per frame, and attachment
+    // descriptors are only rewritten on resize while the device is idle.
+    // except the geometry set, one per frame, whose texture follows the streamed levels
     std::vector<VkDescriptorSet> descriptorSets;
-    std::vector<VkDescriptorSet> lightingDescriptorSets;
-    std::vector<VkDescriptorSet> shadowDescriptorSets;
-    VkDescriptorPool imgui_descriptor_pool;
+    std::vector<VkImageView> boundTextureViews;
+    VkDescriptorSet lightingDescriptorSet;
+    VkDescriptorSet shadowDescriptorSet;
+    VkDescriptorSet cullDescriptorSet;
+    VkDescriptorSet clusterDescriptorSet;
+    VkDescriptorPool imgui_descriptor_pool = VK_NULL_HANDLE;
 
     VkImage textureImage;
-    VkDeviceMemory textureImageMemory;
-    VkImageView textureImageView;
+    Allocation textureImageMemory;
+    // a view per resident level, made as the levels arrive
+    std::vector<VkImageView> textureLevelViews;
+    VkImage placeholderImage;
+    Allocation placeholderImageMemory;
+    VkImageView placeholderImageView;
     VkSampler textureSampler;
-
-    VkImage depthImage;
-    VkDeviceMemory depthImageMemory;
-    VkImageView depthImageView;
+    uint32_t textureMipLevels = 1;
+    VkFormat textureFormat = VK_FORMAT_R8G8B8A8_SRGB;
 
     std::string MODEL_PATH;
     std::string TEXTURE_PATH;
@@ -188,8 +461,18 @@ private:
     bool pcf = false;
 
     void createImguiPass();
+    // the Dear ImGui renderer, its pipeline is built against imgui_render_pass
+    void initImguiRenderer();
     void createGeometryPass();
     void createShadowPass();
+    VkRenderPass createShadowRenderPass(VkAttachmentLoadOp loadOp, VkImageLayout initialLayout, VkImageLayout finalLayout);
+
+    // size dependent resources, recreated on resize
+    void createGeometryAttachments();
+    void destroyGeometryAttachments();
+    void createShadowMap();
+    void destroyShadowMap();
+    void createImguiFramebuffers();
 	
     VkFormat findDepthFormat();
 
@@ -197,11 +480,10 @@ private:
 
     VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
-    void createDepthResources();
-
     void createTextureSampler();
 
-    VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
+    VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags,
+        VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D, uint32_t baseLayer = 0, uint32_t layerCount = 1, uint32_t levelCount = 1, uint32_t baseLevel = 0);
 
     void loadModel();
 
@@ -209,7 +491,9 @@ private:
 
     void createTextureImage();
 
-    void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
+    VkImageView residentTextureView();
+
+    void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, Allocation& imageMemory, uint32_t arrayLayers = 1, uint32_t mipLevels = 1);
 
     void createDescriptorPool();
 
@@ -219,13 +503,34 @@ private:
 
     void createIndexBuffer();
 
-    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& bufferMemory);
 
     void createVertexBuffer();
 
-    void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
-
-    void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+    void createInstanceBuffer();
+
+    void createCullingBuffers();
+
+    void createLightBuffers();
+
+    // draw every mesh of the scene as seen from view
+    void drawScene(VkCommandBuffer commandBuffer, CullView view);
+    // the batches view draws without GPU culling, static casters come first so it is one range
+    void batchRange(CullView view, size_t& first, size_t& last) const;
+    // draw the batches in [first, last) with the instances view left visible, skipping empty ones
+    void drawBatches(VkCommandBuffer commandBuffer, CullView view, size_t first, size_t last);
+    // batches drawBatches draws for view
+    size_t drawnBatches(CullView view) const;
+    // cull the instances against the camera and light frustums into this frame's visible lists
+    void cullDirectDraws(glm::mat4 const& model, Frustum const& camera, Frustum const& light);
+    // draw the scene inside a render pass subpass. with secondaryDraws() the subpass must have been
+    // begun with secondary contents and the draws are spread over the workers, each calling bind
+    // on its own command buffer first. otherwise bind and draw go straight into commandBuffer
+    void recordDraws(VkCommandBuffer commandBuffer, VkRenderPass renderPass, uint32_t subpass, VkFramebuffer framebuffer,
+        std::function<void(VkCommandBuffer)> const& bind, CullView view);
+    VkSubpassContents drawContents() const { return secondaryDraws() ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE; }
+    void createRecordContexts();
+    void destroyRecordContexts();
 
     VkCommandBuffer beginSingleTimeCommands();
 
@@ -235,10 +540,6 @@ private:
 
     void createCommandBuffers(VkCommandBuffer* commandBuffer, uint32_t commandBufferCount, VkCommandPool& commandPool);
 
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
-
-    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
-
     // clean up swap chain for a clean recreate
     void cleanupSwapChain();
 
@@ -260,6 +561,9 @@ private:
     // create a swap chain
     void createSwapChain();
 
+    // create offscreen colour targets standing in for the swap chain images
+    void createOffscreenTargets();
+
     // create our image views
     void createImageViews();
 
@@ -268,11 +572,38 @@ private:
 
     // recreate swap chain incase it is invalidated
     void recreateSwapChain();
+    // the geometry and imgui render passes write the swap chain images, rebuilt with everything
+    // built against them when a recreated swap chain comes back in another format
+    void recreateFormatDependent();
+    // set up both passes' permutations and build the ones the current settings draw with
+    void initPermutations();
 
     void createDescriptorSets();
 
+    // write the G-buffer and shadow map views into the lighting set
+    void updateAttachmentDescriptors();
+
     // create the graphics pipeline.
     void createGraphicsPipeline();
+    // one permutation of the geometry or lighting pipeline
+    VkPipeline createGeometryPipeline(uint32_t permutation);
+    VkPipeline createLightingPipeline(uint32_t permutation);
+    // the permutations this frame's UI state asks for
+    uint32_t geometryPermutation() const;
+    uint32_t lightingPermutation() const;
+
+    void createComputePipelines();
+
+    // reset the counters and run both culling passes, ahead of the shadow pass
+    void recordCulling(VkCommandBuffer commandBuffer, uint32_t cullOffset);
+
+    // build this frame's per cluster light lists, ahead of the lighting pass
+    void recordLightClusters(VkCommandBuffer commandBuffer, UniformOffsets const& offsets);
+
+    // draw the cascades that need it, see shadowRedrawMask
+    void recordShadows(VkCommandBuffer commandBuffer, UniformOffsets const& offsets);
+    // replace a cascade's layer with its static cache, ready to draw the dynamic casters over
+    void copyShadowCache(VkCommandBuffer commandBuffer, uint32_t cascade);
 
     // function to create all of our framebuffers
     void createFramebuffers();
@@ -283,9 +614,17 @@ private:
     // create command buffers
     void createCommandBuffers();
 
+    // record the shadow, geometry and lighting passes for one frame
+    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, UniformOffsets const& offsets);
+
+    void setViewportAndScissor(VkCommandBuffer commandBuffer, VkExtent2D extent);
+
     void createSyncObjects();
 
-    void updateUniformBuffer(uint32_t currentImage);
+    void drawFrameHeadless();
+
+    // write this frame's uniforms into the ring
+    UniformOffsets updateUniformBuffer();
 
     // create a VkShaderModule to encapsulate our shaders
     VkShaderModule createShaderModule(const std::vector<char>& code);
@@ -308,6 +647,9 @@ private:
     // check that our device has support for the set of extensions we are interested in
     bool checkDeviceExtensionSupport(VkPhysicalDevice device);
 
+    // whether an optional device extension is available
+    bool hasDeviceExtension(VkPhysicalDevice device, char const* name);
+
     // search for queue family support
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
 
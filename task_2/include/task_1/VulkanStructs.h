@@ -10,6 +10,9 @@ struct QueueFamilyIndices {
     // information on presentation queue
     // this is used to check that we can draw to our surface
     std::optional<uint32_t> presentFamily;
+    // a family that only does transfers, usually a copy engine running next to the graphics
+    // queue. uploads fall back to the graphics queue without one
+    std::optional<uint32_t> transferFamily;
 
     // query whether all families have a value
     bool isComplete() {
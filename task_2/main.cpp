@@ -1,3 +1,4 @@
+#include "task_1/Benchmarks.h"
 #include "task_1/VulkanObject.h"
 #include "task_1/GLFWObject.h"
 
@@ -6,13 +7,319 @@
 #include <imgui.h>
 #include <imgui_impl_vulkan.h>
 
-int main() {
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <string>
+
+// "--gbuffer <layout>" picks the G-buffer layout for either mode. returns false for an unknown name
+static bool parseGBufferArg(int argc, char** argv, GBufferLayout& layout) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == "--gbuffer" && !parseGBufferLayout(argv[i + 1], layout)) {
+            std::cerr << "unknown G-buffer layout " << argv[i + 1] << ", expected reference, compact or compact-material" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// "--vertex-layout <layout>" picks the vertex buffer layout for either mode. returns false for an unknown name
+static bool parseVertexLayoutArg(int argc, char** argv, VertexLayout& layout) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == "--vertex-layout" && !parseVertexLayout(argv[i + 1], layout)) {
+            std::cerr << "unknown vertex layout " << argv[i + 1] << ", expected interleaved or quantized" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// whether a flag without a value was given, e.g. "--transient-gbuffer" or "--cpu-draws"
+static bool hasArg(int argc, char** argv, char const* name) {
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// a whole decimal number that fits in 32 bits. returns false for anything else, "abc", "-1" or "12x"
+static bool parseCount(char const* text, uint32_t& count) {
+    if (!std::isdigit(static_cast<unsigned char>(text[0]))) {
+        return false;
+    }
+
+    errno = 0;
+    char* end = nullptr;
+    unsigned long long value = std::strtoull(text, &end, 10);
+    if (errno == ERANGE || *end != '\0' || value > std::numeric_limits<uint32_t>::max()) {
+        return false;
+    }
+
+    count = static_cast<uint32_t>(value);
+    return true;
+}
+
+// value of a count flag, count is left alone when the flag is not given. returns false, with a
+// message, when the value is not a valid count
+static bool parseCountArg(int argc, char** argv, char const* name, uint32_t& count) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == name && !parseCount(argv[i + 1], count)) {
+            std::cerr << name << " expects a count, got " << argv[i + 1] << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// the renderer settings shared by the windowed and headless modes. "--stress N" draws N instances
+// of the model instead of one, "--lights N" adds N clustered lights, "--cascades N" splits the
+// directional light's shadow map into N cascades (1 to 4, default 4), "--shadow-size N" makes each
+// cascade N x N (default 2048), "--dynamic-casters N" redraws the last N instances' shadows every
+// frame, "--batch-size N" caps each draw at N instances, "--record-threads N" records CPU draws on
+// N threads and "--texture-budget N" streams at most N KB of texture levels a frame.
+// returns false for an invalid value, before anything is set
+static bool configure(VulkanObject& vulkan_object, int argc, char** argv) {
+    GBufferLayout gbuffer_layout = GBufferLayout::Reference;
+    VertexLayout vertex_layout = VertexLayout::Interleaved;
+    uint32_t stress = 0;
+    uint32_t lights = 0;
+    uint32_t cascades = 0;
+    uint32_t shadow_size = 0;
+    uint32_t dynamic_casters = 0;
+    uint32_t batch_size = 0;
+    uint32_t record_threads = 0;
+    uint32_t texture_budget = 0;
+
+    if (!parseGBufferArg(argc, argv, gbuffer_layout) || !parseVertexLayoutArg(argc, argv, vertex_layout) ||
+        !parseCountArg(argc, argv, "--stress", stress) || !parseCountArg(argc, argv, "--lights", lights) ||
+        !parseCountArg(argc, argv, "--cascades", cascades) || !parseCountArg(argc, argv, "--shadow-size", shadow_size) ||
+        !parseCountArg(argc, argv, "--dynamic-casters", dynamic_casters) || !parseCountArg(argc, argv, "--batch-size", batch_size) ||
+        !parseCountArg(argc, argv, "--record-threads", record_threads) || !parseCountArg(argc, argv, "--texture-budget", texture_budget)) {
+        return false;
+    }
+
+    vulkan_object.setGBufferLayout(gbuffer_layout);
+    vulkan_object.setVertexLayout(vertex_layout);
+    vulkan_object.setTransientAttachments(hasArg(argc, argv, "--transient-gbuffer"));
+    vulkan_object.setStressInstances(stress);
+    vulkan_object.setCpuDraws(hasArg(argc, argv, "--cpu-draws"));
+    vulkan_object.setLightCount(lights);
+    if (cascades > 0) {
+        vulkan_object.setCascadeCount(cascades);
+    }
+    if (shadow_size > 0) {
+        vulkan_object.setShadowResolution(shadow_size);
+    }
+    vulkan_object.setDynamicInstances(dynamic_casters);
+    vulkan_object.setInverseReconstruction(hasArg(argc, argv, "--inverse-reconstruction"));
+    vulkan_object.setBatchSize(batch_size);
+    vulkan_object.setRecordThreads(record_threads);
+    if (texture_budget > 0) {
+        vulkan_object.setTextureBudget(static_cast<VkDeviceSize>(texture_budget) * 1024);
+    }
+    return true;
+}
+
+// "--headless [--frames N] [--width W] [--height H] [--csv path]" renders offscreen
+// for a fixed number of frames and prints CPU and per pass GPU timings
+static int runHeadless(int argc, char** argv) {
+    uint32_t frames = 1000;
+    uint32_t width = 1920;
+    uint32_t height = 1080;
+    std::string csv_path;
+
+    if (!parseCountArg(argc, argv, "--frames", frames) || !parseCountArg(argc, argv, "--width", width) ||
+        !parseCountArg(argc, argv, "--height", height)) {
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == "--csv") {
+            csv_path = argv[++i];
+        }
+    }
+
+    if (frames == 0 || width == 0 || height == 0) {
+        std::cerr << "--frames, --width and --height must be positive" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::unique_ptr<VulkanObject> vulkan_object = std::make_unique<VulkanObject>();
+    if (!configure(*vulkan_object, argc, argv)) {
+        return EXIT_FAILURE;
+    }
+
+    try {
+        vulkan_object->initHeadless(width, height);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t frame = 0; frame < frames; frame++) {
+            vulkan_object->drawFrame();
+        }
+        vkDeviceWaitIdle(vulkan_object->device);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        double total_ms = std::chrono::duration<double, std::milli>(end - start).count();
+        std::cout << frames << " frames at " << width << "x" << height << " (" << gbufferLayoutName(vulkan_object->getGBufferLayout()) << " G-buffer): "
+            << total_ms / frames << " ms/frame (" << frames * 1000.0 / total_ms << " fps)" << std::endl;
+
+        vulkan_object->printGpuTimings(std::cout);
+
+        if (!csv_path.empty() && !vulkan_object->writeGpuTimings(csv_path)) {
+            std::cerr << "failed to write " << csv_path << std::endl;
+        }
+
+        vulkan_object->cleanup();
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// "--reconstruction-bench [--frames N]" times the lighting pass at 1080p and 4K, reconstructing
+// positions with per pixel matrix inverses and then with the interpolated view rays
+static int runReconstructionBenchmark(int argc, char** argv) {
+    uint32_t frames = 500;
+    GBufferLayout gbuffer_layout = GBufferLayout::Reference;
+    if (!parseCountArg(argc, argv, "--frames", frames) || !parseGBufferArg(argc, argv, gbuffer_layout)) {
+        return EXIT_FAILURE;
+    }
+    frames = std::max(frames, 1u);
+
+    struct Resolution { uint32_t width, height; };
+    static const Resolution resolutions[] = { { 1920, 1080 }, { 3840, 2160 } };
+
+    std::cout << "resolution   inverse ms   view ray ms" << std::endl;
+    for (Resolution const& resolution : resolutions) {
+        float lighting_ms[2];
+        for (int inverse = 1; inverse >= 0; inverse--) {
+            std::unique_ptr<VulkanObject> vulkan_object = std::make_unique<VulkanObject>();
+            vulkan_object->setGBufferLayout(gbuffer_layout);
+            vulkan_object->setInverseReconstruction(inverse != 0);
+            // the normals view the renderer starts on never reconstructs a position
+            vulkan_object->setComposedView();
+
+            try {
+                vulkan_object->initHeadless(resolution.width, resolution.height);
+                for (uint32_t frame = 0; frame < frames; frame++) {
+                    vulkan_object->drawFrame();
+                }
+                lighting_ms[inverse] = vulkan_object->gpuScopeAverage("lighting");
+                vulkan_object->cleanup();
+            }
+            catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+
+        char line[128];
+        snprintf(line, sizeof(line), "%4ux%-4u    %9.3f    %10.3f", resolution.width, resolution.height, lighting_ms[1], lighting_ms[0]);
+        std::cout << line << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// "--record-bench [--frames N] [--stress N]" times command buffer recording on 1, 2, 4 and 8
+// threads. every instance is its own unculled CPU draw and every cascade is redrawn every frame, so with
+// the default 10000 instances each frame records 10000 draws per cascade plus 10000 geometry draws
+static int runRecordBenchmark(int argc, char** argv) {
+    uint32_t frames = 200;
+    uint32_t instances = 10000;
+    if (!parseCountArg(argc, argv, "--frames", frames) || !parseCountArg(argc, argv, "--stress", instances)) {
+        return EXIT_FAILURE;
+    }
+    frames = std::max(frames, 1u);
+    instances = std::max(instances, 1u);
+
+    static const uint32_t thread_counts[] = { 1, 2, 4, 8 };
+
+    std::cout << "threads   record ms   speedup" << std::endl;
+    float single_ms = 0.0f;
+    for (uint32_t threads : thread_counts) {
+        std::unique_ptr<VulkanObject> vulkan_object = std::make_unique<VulkanObject>();
+        vulkan_object->setStressInstances(instances);
+        vulkan_object->setCpuDraws(true);
+        vulkan_object->setBatchSize(1);
+        vulkan_object->setShadowCaching(false);
+        vulkan_object->setFrustumCulling(false);
+        vulkan_object->setRecordThreads(threads);
+
+        float record_ms = 0.0f;
+        try {
+            vulkan_object->initHeadless(1920, 1080);
+            for (uint32_t frame = 0; frame < frames; frame++) {
+                vulkan_object->drawFrame();
+            }
+            vkDeviceWaitIdle(vulkan_object->device);
+            record_ms = vulkan_object->averageRecordMs();
+            vulkan_object->cleanup();
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        if (threads == 1) {
+            single_ms = record_ms;
+        }
+
+        char line[128];
+        snprintf(line, sizeof(line), "%7u   %9.3f   %6.2fx", threads, record_ms, record_ms > 0.0f ? single_ms / record_ms : 0.0f);
+        std::cout << line << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+    // "--bench <name>" runs a CPU benchmark instead of the renderer
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--bench" && i + 1 < argc) {
+            return runBenchmark(argv[i + 1]);
+        }
+
+        if (std::string(argv[i]) == "--headless") {
+            return runHeadless(argc, argv);
+        }
+
+        if (std::string(argv[i]) == "--reconstruction-bench") {
+            return runReconstructionBenchmark(argc, argv);
+        }
+
+        if (std::string(argv[i]) == "--record-bench") {
+            return runRecordBenchmark(argc, argv);
+        }
+
+        // "--gbuffer-report" prints attachment memory and bandwidth of every G-buffer layout
+        if (std::string(argv[i]) == "--gbuffer-report") {
+            printGBufferReport(std::cout, 1920, 1080, VK_FORMAT_D32_SFLOAT);
+            std::cout << std::endl;
+            printGBufferReport(std::cout, 3840, 2160, VK_FORMAT_D32_SFLOAT);
+            return EXIT_SUCCESS;
+        }
+    }
+
+    // settings are checked before a window opens
+    std::unique_ptr<VulkanObject> vulkan_object = std::make_unique<VulkanObject>();
+    if (!configure(*vulkan_object, argc, argv)) {
+        return EXIT_FAILURE;
+    }
+
     // function used to create a window with GLFW
     GLFWObject glfw_object(1920, 1080);
     glfw_object.init();
 
-    std::unique_ptr<VulkanObject> vulkan_object = std::make_unique<VulkanObject>();
-
     // create vulkan instance
     vulkan_object->initVulkan(glfw_object.window);
 
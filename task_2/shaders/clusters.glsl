@@ -0,0 +1,39 @@
+// clustered lighting shared by the cluster assignment pass and the lighting pass,
+// matches Lights.h
+
+#define CLUSTER_X 16u
+#define CLUSTER_Y 9u
+#define CLUSTER_Z 24u
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+#define MAX_LIGHTS_PER_CLUSTER 128u
+
+// point lights have a cone covering every direction, cos_outer -2 and cos_inner -1
+struct Light {
+    vec4 position_radius;
+    vec4 color_cos_inner;
+    vec4 direction_cos_outer;
+};
+
+float clusterSliceDepth(uint z, float z_near, float z_far)
+{
+    return z_near * pow(z_far / z_near, float(z) / float(CLUSTER_Z));
+}
+
+// cluster of a pixel from its [0, 1] screen position and positive view space depth
+uint clusterIndex(vec2 screen_uv, float depth, float z_near, float z_far)
+{
+    uvec2 tile = min(uvec2(screen_uv * vec2(CLUSTER_X, CLUSTER_Y)), uvec2(CLUSTER_X - 1u, CLUSTER_Y - 1u));
+    uint slice = depth <= z_near ? 0u : min(uint(log(depth / z_near) / log(z_far / z_near) * float(CLUSTER_Z)), CLUSTER_Z - 1u);
+    return tile.x + tile.y * CLUSTER_X + slice * CLUSTER_X * CLUSTER_Y;
+}
+
+// smooth falloff to zero at the light's radius, times the spot cone
+float lightAttenuation(Light light, vec3 to_light, float distance)
+{
+    float ratio = distance / light.position_radius.w;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    float falloff = window * window / (1.0 + 25.0 * ratio * ratio);
+
+    float cos_angle = dot(-to_light / distance, light.direction_cos_outer.xyz);
+    return falloff * smoothstep(light.direction_cos_outer.w, light.color_cos_inner.w, cos_angle);
+}
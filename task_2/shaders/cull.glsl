@@ -0,0 +1,67 @@
+// resources shared by the two culling passes, matches Culling.h and
+// CullUniformBufferObject in UBO.h
+
+#include "instance.glsl"
+
+#define CULL_VIEW_CAMERA 0u
+#define CULL_VIEW_LIGHT 1u
+#define CULL_VIEW_LIGHT_DYNAMIC 2u
+#define CULL_VIEW_COUNT 3u
+
+#define CULL_FLAG_ENABLED 1u
+#define CULL_FLAG_COMPACT 2u
+
+struct Batch {
+    vec4 sphere;
+    uint index_count;
+    uint first_index;
+    int vertex_offset;
+    uint first_instance;
+};
+
+// VkDrawIndexedIndirectCommand
+struct DrawCommand {
+    uint index_count;
+    uint instance_count;
+    uint first_index;
+    int vertex_offset;
+    uint first_instance;
+};
+
+layout(std140, binding = 0) uniform CullUniformBufferObject {
+    mat4 model;
+    // six planes for the camera, then six for both light views
+    vec4 planes[12];
+    uint instance_count;
+    uint batch_count;
+    uint visible_stride;
+    uint flags;
+} cull;
+
+layout(std430, binding = 1) readonly buffer Instances {
+    Instance instances[];
+};
+
+layout(std430, binding = 2) readonly buffer Batches {
+    Batch batches[];
+};
+
+// per view, visible instance indices grouped by batch. views are visible_stride apart
+layout(std430, binding = 3) writeonly buffer Visible {
+    uint visible[];
+};
+
+// per view, batch_count commands
+layout(std430, binding = 4) writeonly buffer Draws {
+    DrawCommand draws[];
+};
+
+// draw count of each view, then the visible instance count of every batch of every view
+layout(std430, binding = 5) buffer Counts {
+    uint counts[];
+};
+
+uint batchCountIndex(uint view, uint batch)
+{
+    return CULL_VIEW_COUNT + view * cull.batch_count + batch;
+}
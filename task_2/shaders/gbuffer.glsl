@@ -0,0 +1,67 @@
+// G-buffer encodings shared by the geometry and lighting passes. the layout
+// values must match GBufferLayout in GBufferLayout.h
+
+#define GBUFFER_REFERENCE 0
+#define GBUFFER_COMPACT 1
+#define GBUFFER_COMPACT_MATERIAL 2
+
+layout (constant_id = 0) const int GBUFFER_LAYOUT = GBUFFER_REFERENCE;
+
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// unit vector to the [-1, 1] square, folding the lower hemisphere over the diagonals
+vec2 octEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    return n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signNotZero(n.xy);
+}
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * signNotZero(n.xy);
+    }
+    return normalize(n);
+}
+
+vec4 encodeNormal(vec3 normal, uint material)
+{
+    normal = normalize(normal);
+
+    if (GBUFFER_LAYOUT == GBUFFER_COMPACT) {
+        // RG16F holds the signed values as they are
+        return vec4(octEncode(normal), 0.0, 0.0);
+    }
+    else if (GBUFFER_LAYOUT == GBUFFER_COMPACT_MATERIAL) {
+        // 10 bit unorm channels, material id in the third
+        return vec4(octEncode(normal) * 0.5 + 0.5, float(min(material, 1023u)) / 1023.0, 0.0);
+    }
+
+    return vec4(normal * 0.5 + vec3(0.5), 0.0);
+}
+
+vec3 decodeNormal(vec4 texel)
+{
+    if (GBUFFER_LAYOUT == GBUFFER_COMPACT) {
+        return octDecode(texel.xy);
+    }
+    else if (GBUFFER_LAYOUT == GBUFFER_COMPACT_MATERIAL) {
+        return octDecode(texel.xy * 2.0 - 1.0);
+    }
+
+    return (texel.rgb - vec3(0.5)) / 0.5;
+}
+
+// 0 when the layout has no material channel
+uint decodeMaterial(vec4 texel)
+{
+    if (GBUFFER_LAYOUT == GBUFFER_COMPACT_MATERIAL) {
+        return uint(round(texel.b * 1023.0));
+    }
+
+    return 0u;
+}
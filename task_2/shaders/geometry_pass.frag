@@ -1,11 +1,17 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "gbuffer.glsl"
+
+// sample the texture, see VulkanObject::geometryPermutation
+layout (constant_id = 1) const bool TEXTURE_STAGE = true;
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 fragTexCoord;
-layout(location = 3) in flat float texture_on;
-layout(location = 4) in float specularity;
+layout(location = 3) in float specularity;
+layout(location = 4) in flat uint materialId;
 
 layout(location = 0) out vec4 outColor;
 layout(location = 1) out vec4 outNormal;
@@ -13,7 +19,7 @@ layout(location = 1) out vec4 outNormal;
 layout(binding = 1) uniform sampler2D texSampler;
 
 void main() {
-    if(texture_on > 0)
+    if(TEXTURE_STAGE)
     {
         outColor = vec4(fragColor * texture(texSampler, fragTexCoord).rgb, 1.0);
     }
@@ -22,6 +28,6 @@ void main() {
         outColor = vec4(fragColor, 1.0);
     }
 
-    outNormal.rgb = normalize(inNormal) * 0.5 + vec3(0.5);
+    outNormal = encodeNormal(inNormal, materialId);
     outColor.a = specularity;
 }
\ No newline at end of file
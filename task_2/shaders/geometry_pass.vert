@@ -1,49 +1,65 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
 
-layout(std140, binding = 0) uniform UniformBufferObject {
-    mat4 model;
-    mat4 view;
-    mat4 proj;
-    mat4 light;
-    mat4 lightVP;
-	vec4 Ka;
-	vec4 Kd;
-	vec4 Ks;
-	vec4 Ke;
-    vec2 win_dim;
-    float Ns;
-	float model_stage_on;
-	float texture_stage_on;
-	float lighting_stage_on;
-    float pcf_on;
-    float specular;
-	float diffuse;
-	float ambient;
-    float shadow_bias;
-	int display_mode;
-} ubo;
-
-layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inColor;
+#include "instance.glsl"
+#include "lighting.glsl"
+
+// values of VertexLayout in VertexLayout.h
+#define VERTEX_LAYOUT_INTERLEAVED 0
+#define VERTEX_LAYOUT_QUANTIZED 1
+
+layout (constant_id = 7) const int VERTEX_LAYOUT = VERTEX_LAYOUT_INTERLEAVED;
+
+layout(std430, binding = 2) readonly buffer Instances {
+    Instance instances[];
+};
+
+// instance indices of this view, written by the culling pass or identity without it
+layout(std430, binding = 3) readonly buffer Visible {
+    uint visible[];
+};
+
+layout(std430, binding = 4) readonly buffer Meshes {
+    MeshData meshes[];
+};
+
+// float or unorm positions, float normals or an octahedral snorm pair, see VertexLayout.h
+layout(location = 0) in vec4 inPosition;
 layout(location = 2) in vec2 inTexCoord;
-layout(location = 3) in vec3 inNormal;
+layout(location = 3) in vec4 inNormal;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec3 outNormal;
 layout(location = 2) out vec2 fragTexCoord;
-layout(location = 3) out float texture_on;
-layout(location = 4) out float specularity;
+layout(location = 3) out float specularity;
+layout(location = 4) out flat uint materialId;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    Instance instance = instances[visible[gl_InstanceIndex]];
+    MeshData mesh = meshes[instance.mesh];
+    mat4 model = ubo.model * instance.model;
+
+    vec3 position = mesh.position_offset.xyz + inPosition.xyz * mesh.position_scale.xyz;
+    gl_Position = ubo.proj * ubo.view * model * vec4(position, 1.0);
 
-    outNormal = inNormal;
+    vec3 normal = VERTEX_LAYOUT == VERTEX_LAYOUT_QUANTIZED ? octDecode(inNormal.xy) : inNormal.xyz;
+    // world space, instances are only ever uniformly scaled
+    outNormal = mat3(model) * normal;
 
     specularity = ubo.specular;
 
     fragColor = vec3(ubo.diffuse,ubo.diffuse,ubo.diffuse);
 
-    fragTexCoord = inTexCoord;
-    texture_on = int(ubo.texture_stage_on);
+    fragTexCoord = inTexCoord * mesh.tex_coord_transform.xy + mesh.tex_coord_transform.zw;
+    materialId = instance.material_id;
 }
\ No newline at end of file
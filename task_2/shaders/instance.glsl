@@ -0,0 +1,19 @@
+// per instance data, matches InstanceData in Scene.h
+
+#define INSTANCE_DYNAMIC 1u
+
+struct Instance {
+    mat4 model;
+    uint material_id;
+    uint batch;
+    uint flags;
+    uint mesh;
+};
+
+// per mesh dequantisation of the vertex layout, matches MeshQuantization in VertexLayout.h.
+// position = offset + unorm * scale, uv = unorm * xy + zw
+struct MeshData {
+    vec4 position_scale;
+    vec4 position_offset;
+    vec4 tex_coord_transform;
+};
@@ -0,0 +1,46 @@
+// uniforms shared by the geometry and lighting passes, matches UniformBufferObject in UBO.h
+
+// must match MAX_CASCADES in include/task_1/Cascades.h
+#define MAX_CASCADES 4
+
+layout(std140, binding = 0) uniform UniformBufferObject {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+    mat4 light;
+    mat4 lightVP;
+	vec4 Ka;
+	vec4 Kd;
+	vec4 Ks;
+	vec4 Ke;
+    vec2 win_dim;
+    float Ns;
+    float specular;
+	float diffuse;
+	float ambient;
+    float shadow_bias;
+    float cluster_near;
+    float cluster_far;
+    uint light_count;
+    uint cascade_count;
+    // view space depth where each cascade ends
+    vec4 cascade_splits;
+    mat4 cascade_vp[MAX_CASCADES];
+    // camera to world
+    mat4 inv_view;
+    // 1 / proj[0][0], 1 / proj[1][1], proj[2][2] and proj[3][2], see view_ray and linear_depth
+    vec4 view_ray_params;
+} ubo;
+
+// world space direction through clip space xy, scaled so that it moves one unit along the view axis.
+// linear in xy, so the vertex shader can work it out at the corners and let it be interpolated
+vec3 view_ray(vec2 clip_xy)
+{
+    return mat3(ubo.inv_view) * vec3(clip_xy * ubo.view_ray_params.xy, -1.0);
+}
+
+// view space distance in front of the camera of a [0, 1] depth buffer value
+float linear_depth(float depth)
+{
+    return ubo.view_ray_params.w / (depth + ubo.view_ray_params.z);
+}
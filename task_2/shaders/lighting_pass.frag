@@ -1,127 +1,199 @@
 #version 450
 #extension GL_KHR_vulkan_glsl : enable
+#extension GL_GOOGLE_include_directive : require
 
-layout(std140, binding = 0) uniform UniformBufferObject {
-    mat4 model;
-    mat4 view;
-    mat4 proj;
-    mat4 light;
-    mat4 lightVP;
-	vec4 Ka;
-	vec4 Kd;
-	vec4 Ks;
-	vec4 Ke;
-    vec2 win_dim;
-    float Ns;
-	float model_stage_on;
-	float texture_stage_on;
-	float lighting_stage_on;
-    float pcf_on;
-    float specular;
-	float diffuse;
-	float ambient;
-    float shadow_bias;
-	int display_mode;
-} ubo;
+#include "gbuffer.glsl"
+#include "clusters.glsl"
+#include "lighting.glsl"
+
+// the permutation of this pipeline, see VulkanObject::lightingPermutation. constant 0 is in gbuffer.glsl
+layout (constant_id = 2) const int DISPLAY_MODE = 6;
+layout (constant_id = 3) const bool MODEL_STAGE = true;
+layout (constant_id = 4) const bool LIGHTING_STAGE = true;
+layout (constant_id = 5) const bool PCF = false;
+// reconstruct positions with per pixel matrix inverses instead, to compare the two
+layout (constant_id = 6) const bool INVERSE_RECONSTRUCTION = false;
 
 layout (input_attachment_index = 0, set = 0, binding = 1) uniform subpassInput inColor;
 layout (input_attachment_index = 0, set = 0, binding = 2) uniform subpassInput inNormal;
 layout (input_attachment_index = 0, set = 0, binding = 4) uniform subpassInput inDepth;
-layout (set = 0, binding = 5) uniform sampler2D inShadowDepth;
-layout (set = 0, binding = 6) uniform sampler2DShadow inShadowDepthPCF;
+// one layer per shadow cascade
+layout (set = 0, binding = 5) uniform sampler2DArray inShadowDepth;
+layout (set = 0, binding = 6) uniform sampler2DArrayShadow inShadowDepthPCF;
+
+layout (std430, set = 0, binding = 7) readonly buffer Lights {
+    Light lights[];
+};
+
+// written by cluster_assign.comp
+layout (std430, set = 0, binding = 8) readonly buffer Clusters {
+    uint cluster_counts[CLUSTER_COUNT];
+    uint cluster_lights[];
+};
 
 layout (location = 0) in vec2 inUV;
+layout (location = 1) in vec3 inViewRay;
 
 layout (location = 0) out vec4 outFragcolor;
 
-float LinearizeDepth(float depth, float near_p, float far_p)
+// world space position of this pixel, linear is the view depth of its depth buffer value
+vec3 position_from_depth(float depth, float linear)
 {
-    float z = depth * 2.0 - 1.0; // Back to NDC 
-    return (2.0 * near_p * far_p) / (far_p + near_p - z * (far_p - near_p));
+    if (INVERSE_RECONSTRUCTION) {
+        vec4 clipSpace = vec4(inUV * 2.0 - 1.0, depth, 1.0);
+        vec4 viewSpace = inverse(ubo.proj) * clipSpace;
+        viewSpace.xyz /= viewSpace.w;
+
+        return (inverse(ubo.view) * vec4(viewSpace.xyz, 1.0)).xyz;
+    }
+
+    return ubo.inv_view[3].xyz + inViewRay * linear;
+}
+
+// the first cascade whose slice of the view frustum reaches this depth
+uint select_cascade(float depth)
+{
+    uint cascade = 0u;
+    for (uint i = 0u; i + 1u < ubo.cascade_count; i++) {
+        if (depth > ubo.cascade_splits[i]) {
+            cascade = i + 1u;
+        }
+    }
+    return cascade;
 }
 
-vec4 position_from_depth(float depth)
+// 1 where the directional light reaches frag_pos, 0 in its shadow. depth is its view depth
+float calc_shadow_influence(vec3 frag_pos, float depth)
 {
-    float z = subpassLoad(inDepth).r;
+    uint cascade = select_cascade(depth);
 
-    vec4 clipSpace = vec4(inUV * 2.0 - 1.0, z, 1.0);
-	vec4 viewSpace = inverse(ubo.proj) * clipSpace;
-	viewSpace.xyz /= viewSpace.w;
+    vec4 shadow_clip_space = ubo.cascade_vp[cascade] * vec4(frag_pos, 1.0);
+    vec3 shadow_NDC = shadow_clip_space.xyz / shadow_clip_space.w;
+    shadow_NDC.xy = shadow_NDC.xy * 0.5 + 0.5;
 
-    vec4 position = inverse(ubo.view) * vec4( viewSpace.xyz, 1.0 );
+    // beyond the far end of the cascade nothing casts onto it
+    if (shadow_NDC.z >= 1.0) {
+        return 1.0;
+    }
 
-    return vec4(vec3(position), 1.0);
+    float light_depth = shadow_NDC.z - ubo.shadow_bias;
+
+    if (PCF) {
+        return texture(inShadowDepthPCF, vec4(shadow_NDC.xy, float(cascade), light_depth)).r;
+    }
+
+    float closest_dist = texture(inShadowDepth, vec3(shadow_NDC.xy, float(cascade))).r;
+    return light_depth > closest_dist ? 0.0 : 1.0;
+}
+
+uint pixel_cluster(float depth)
+{
+    return clusterIndex(gl_FragCoord.xy / ubo.win_dim, depth, ubo.cluster_near, ubo.cluster_far);
 }
 
-float calc_shadow_influence(vec4 position)
+// diffuse and specular of the unshadowed lights whose radius reaches this pixel's cluster
+vec3 clustered_lighting(vec3 frag_pos, float depth, vec3 normal_dir, vec3 camera_pos, vec4 albedo)
 {
-    
-    return 1.0;
+    if (ubo.light_count == 0u) {
+        return vec3(0.0);
+    }
+
+    uint cluster = pixel_cluster(depth);
+    uint count = cluster_counts[cluster];
+    vec3 camera_dir = normalize(camera_pos - frag_pos);
+
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < count; i++) {
+        Light light = lights[cluster_lights[cluster * MAX_LIGHTS_PER_CLUSTER + i]];
+
+        vec3 to_light = light.position_radius.xyz - frag_pos;
+        float distance = length(to_light);
+        if (distance >= light.position_radius.w) {
+            continue;
+        }
+
+        vec3 light_dir = to_light / distance;
+        float attenuation = lightAttenuation(light, to_light, distance);
+
+        float diffuse = ubo.diffuse * max(dot(normal_dir, light_dir), 0.0);
+        float specular = 0.0;
+        if (diffuse > 0.0) {
+            vec3 reflection_dir = reflect(-light_dir, normal_dir);
+            specular = clamp(albedo.a * pow(max(dot(reflection_dir, camera_dir), 0.0), ubo.Ns), 0.0, 1.0);
+        }
+
+        result += light.color_cos_inner.rgb * attenuation * (albedo.rgb * diffuse * ubo.Kd.xyz + specular * ubo.Ks.xyz);
+    }
+
+    return result;
 }
 
 void main() 
 {
-	if(ubo.display_mode == 0)
+    float depth = subpassLoad(inDepth).r;
+    float linear = linear_depth(depth);
+
+	if(DISPLAY_MODE == 0)
 	{
-		outFragcolor = vec4(subpassLoad(inNormal).rgb, 1.0);
+		outFragcolor = vec4(decodeNormal(subpassLoad(inNormal)) * 0.5 + vec3(0.5), 1.0);
 	}
-	else if(ubo.display_mode == 1)
+	else if(DISPLAY_MODE == 1)
 	{
-        float z = LinearizeDepth(subpassLoad(inDepth).r, 0.001, 4.0) / 4.0;
+        float z = linear / 4.0;
 		outFragcolor = vec4(z, z, z,  1.0);
 	}
-	else if(ubo.display_mode == 2)
+	else if(DISPLAY_MODE == 2)
 	{
 		outFragcolor = vec4(subpassLoad(inColor).a, subpassLoad(inColor).a, subpassLoad(inColor).a, 1.0);
 	}
-	else if(ubo.display_mode == 3)
+	else if(DISPLAY_MODE == 3)
 	{
 		outFragcolor = vec4(subpassLoad(inColor).rgb, 1.0);
 	}
-    else if(ubo.display_mode == 4)
+    else if(DISPLAY_MODE == 4)
 	{
-        float depth_val = LinearizeDepth(texture(inShadowDepth, inUV).r, 0.001, 4.0) / 4.0;
+        // the cascades are orthographic, their depth is already linear
+        float depth_val = texture(inShadowDepth, vec3(inUV, 0.0)).r;
 		outFragcolor = vec4(depth_val, depth_val, depth_val, 1.0);
 	}
-    else if(ubo.display_mode == 5)
+    else if(DISPLAY_MODE == 5)
+	{
+        outFragcolor = vec4(position_from_depth(depth, linear), 1.0);
+	}
+    else if(DISPLAY_MODE == 8)
+	{
+        // lights per cluster, blue through red as the list fills up
+        float count = ubo.light_count == 0u ? 0.0 : float(cluster_counts[pixel_cluster(linear)]);
+        float heat = clamp(count / 32.0, 0.0, 1.0);
+        outFragcolor = vec4(heat, 1.0 - abs(heat * 2.0 - 1.0), 1.0 - heat, 1.0) * (count > 0.0 ? 1.0 : 0.2);
+	}
+    else if(DISPLAY_MODE == 9)
+	{
+        // red, green, blue then yellow from the nearest cascade out, darkened in shadow
+        vec3 tints[MAX_CASCADES] = vec3[](vec3(1.0, 0.3, 0.3), vec3(0.3, 1.0, 0.3), vec3(0.3, 0.3, 1.0), vec3(1.0, 1.0, 0.3));
+        float shadow = calc_shadow_influence(position_from_depth(depth, linear), linear);
+        outFragcolor = vec4(tints[select_cascade(linear)] * (0.4 + 0.6 * shadow), 1.0);
+	}
+    else if(DISPLAY_MODE == 7)
 	{
-        outFragcolor = position_from_depth(subpassLoad(inDepth).r);
+        // spread neighbouring ids apart so they are distinguishable
+        uint id = decodeMaterial(subpassLoad(inNormal));
+        outFragcolor = id == 0u ? vec4(0.0, 0.0, 0.0, 1.0) : vec4(fract(vec3(id) * vec3(0.618034, 0.381966, 0.7548777)), 1.0);
 	}
 	else
 	{
-        vec4 position = position_from_depth(subpassLoad(inDepth).r);
+        vec3 normal = decodeNormal(subpassLoad(inNormal));
 
-        vec3 normal = (subpassLoad(inNormal).rgb - vec3(0.5)) / 0.5;
-
-		if(ubo.model_stage_on > 0)
+		if(MODEL_STAGE)
         {
-            if(ubo.lighting_stage_on > 0)
+            if(LIGHTING_STAGE)
             {
-                vec4 shadow_clip_space = ubo.lightVP * vec4(position.xyz, 1.0);
-                vec4 shadow_NDC = shadow_clip_space / shadow_clip_space.w;
-                shadow_NDC.xy = shadow_NDC.xy * 0.5 + 0.5;
-
-                float shadow = 1.0;
+                vec3 frag_pos = position_from_depth(depth, linear);
+                float shadow = calc_shadow_influence(frag_pos, linear);
 
-                if(ubo.pcf_on > 0.5)
-                {
-                    shadow = texture(inShadowDepthPCF, shadow_NDC.xyz - vec3(0.0, 0.0, 0.00001)).r;
-                }
-                else
-                {
-                    float closest_dist = texture(inShadowDepth, shadow_NDC.xy).r;
-
-                    if(shadow_NDC.z > closest_dist + 0.00001)
-                    {
-                        outFragcolor = vec4(clamp(ubo.Ke.xyz + subpassLoad(inColor).rgb * (ubo.ambient * ubo.Ka.xyz), vec3(0.0), vec3(1.0)), 1.0);
-                        return;
-                    }
-                }
-
-                vec3 frag_pos = position.xyz;
-                vec3 normal_dir = normalize((mat3(ubo.model) * normal).xyz);
-                vec3 light_pos = (ubo.light * vec4(-2.5, 0.0, 0.0, 1.0)).xyz;
-                vec3 light_dir = normalize(frag_pos - light_pos);
+                vec3 normal_dir = normalize(normal);
+                // directional, from where the light used to sit towards the origin
+                vec3 light_dir = normalize((ubo.light * vec4(1.0, 0.0, 0.0, 0.0)).xyz);
 
                 float ambient = ubo.ambient;
                 float diffuse = ubo.diffuse * max(0.0, dot(normal_dir, -light_dir)) * shadow;
@@ -136,7 +208,10 @@ void main()
                     specular = clamp(subpassLoad(inColor).a * spec_val, 0.0, 1.0) * shadow;
                 }
 
-                outFragcolor = vec4(clamp(ubo.Ke.xyz + subpassLoad(inColor).rgb * (ambient * ubo.Ka.xyz + diffuse * ubo.Kd.xyz + specular * ubo.Ks.xyz), vec3(0.0), vec3(1.0)), 1.0);
+                vec3 color = ubo.Ke.xyz + subpassLoad(inColor).rgb * (ambient * ubo.Ka.xyz + diffuse * ubo.Kd.xyz + specular * ubo.Ks.xyz);
+                color += clustered_lighting(frag_pos, linear, normal_dir, ubo.inv_view[3].xyz, subpassLoad(inColor));
+
+                outFragcolor = vec4(clamp(color, vec3(0.0), vec3(1.0)), 1.0);
              }
              else
              {
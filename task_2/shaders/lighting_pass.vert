@@ -1,10 +1,16 @@
 #version 450
 #extension GL_KHR_vulkan_glsl : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "lighting.glsl"
 
 layout (location = 0) out vec2 outUV;
+layout (location = 1) out vec3 outViewRay;
 
 void main() 
 {
 	outUV = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
 	gl_Position = vec4(outUV * 2.0f - 1.0f, 0.0f, 1.0f);
+	// interpolated, the fragment shader only scales it by its linear depth
+	outViewRay = view_ray(gl_Position.xy);
 }
\ No newline at end of file
@@ -1,15 +1,28 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
 
-layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inColor;
-layout(location = 2) in vec2 inTexCoord;
-layout(location = 3) in vec3 inNormal;
+#include "instance.glsl"
+
+// the position stream alone, float or unorm depending on the vertex layout
+layout(location = 0) in vec4 inPosition;
 
 layout(binding = 0) uniform UBO 
 {
 	mat4 depthMVP;
 } ubo;
 
+layout(std430, binding = 1) readonly buffer Instances {
+    Instance instances[];
+};
+
+layout(std430, binding = 2) readonly buffer Visible {
+    uint visible[];
+};
+
+layout(std430, binding = 3) readonly buffer Meshes {
+    MeshData meshes[];
+};
+
 out gl_PerVertex 
 {
     vec4 gl_Position;   
@@ -18,5 +31,8 @@ out gl_PerVertex
  
 void main()
 {
-	gl_Position =  ubo.depthMVP * vec4(inPosition, 1.0);
+	Instance instance = instances[visible[gl_InstanceIndex]];
+	MeshData mesh = meshes[instance.mesh];
+	vec3 position = mesh.position_offset.xyz + inPosition.xyz * mesh.position_scale.xyz;
+	gl_Position =  ubo.depthMVP * instance.model * vec4(position, 1.0);
 }
\ No newline at end of file